@@ -0,0 +1,387 @@
+#include <fstream>
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <Log.hpp>
+
+#include "AlignmentWriter.hpp"
+
+/**
+ * Write the given words to the given file descriptor at the given word offset,
+ * retrying short writes. Throws on error.
+ */
+static void writeWords(int fd, const uint64_t* words, size_t count,
+    size_t wordOffset) {
+
+    const char* data = (const char*)words;
+    size_t remaining = count * sizeof(uint64_t);
+    off_t offset = wordOffset * sizeof(uint64_t);
+
+    while(remaining > 0) {
+        ssize_t written = pwrite(fd, data, remaining, offset);
+        if(written < 0) {
+            if(errno == EINTR) {
+                // Just try again.
+                continue;
+            }
+            throw std::runtime_error(std::string("Alignment write failed: ") +
+                strerror(errno));
+        }
+        data += written;
+        offset += written;
+        remaining -= written;
+    }
+}
+
+size_t writeBinaryAlignment(stPinchThreadSet* threadSet,
+    const FMDIndex& index, std::string filename, size_t threadCount) {
+
+    Log::info() << "Saving binary alignment to " << filename << std::endl;
+
+    size_t contigCount = index.getNumberOfContigs();
+
+    // First we need to number all the blocks in the order we meet them along
+    // the contigs, and count up the segments on each contig so we know where
+    // each contig's records go. This also grabs all the threads, so the
+    // writers don't need to look them up.
+    std::unordered_map<stPinchBlock*, uint64_t> blockNumbers;
+    std::vector<uint64_t> blockLengths;
+    std::vector<stPinchThread*> threads(contigCount);
+    // Holds the index of the first record for each contig, and then the total.
+    std::vector<uint64_t> recordStarts(contigCount + 1, 0);
+
+    for(size_t contig = 0; contig < contigCount; contig++) {
+        threads[contig] = stPinchThreadSet_getThread(threadSet, contig);
+
+        size_t segments = 0;
+        stPinchSegment* segment = stPinchThread_getFirst(threads[contig]);
+        while(segment != NULL) {
+            stPinchBlock* block = stPinchSegment_getBlock(segment);
+            if(block != NULL && blockNumbers.count(block) == 0) {
+                // This is a new block we haven't given a number yet.
+                blockNumbers[block] = blockLengths.size();
+                blockLengths.push_back(stPinchBlock_getLength(block));
+            }
+            segments++;
+            segment = stPinchSegment_get3Prime(segment);
+        }
+
+        recordStarts[contig + 1] = recordStarts[contig] + segments;
+    }
+
+    // Lay out the file: a 4-word header, the block lengths, the record starts,
+    // and then 3 words per record.
+    size_t blockTableStart = 4;
+    size_t recordTableStart = blockTableStart + blockLengths.size();
+    size_t recordsStart = recordTableStart + recordStarts.size();
+    size_t totalWords = recordsStart + recordStarts[contigCount] * 3;
+
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error("Could not open " + filename + ": " +
+            strerror(errno));
+    }
+
+    // Preallocate the whole file, so every writer has its region.
+    if(ftruncate(fd, totalWords * sizeof(uint64_t)) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not size " + filename + ": " +
+            strerror(errno));
+    }
+
+    // Write the header and tables.
+    uint64_t header[4] = {ALIGNMENT_MAGIC, blockLengths.size(), contigCount,
+        recordStarts[contigCount]};
+    writeWords(fd, header, 4, 0);
+    writeWords(fd, blockLengths.data(), blockLengths.size(), blockTableStart);
+    writeWords(fd, recordStarts.data(), recordStarts.size(),
+        recordTableStart);
+
+    if(threadCount == 0) {
+        // Use one thread per core.
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Now hand out contigs to writers. Nothing writes to the pinch graph or
+    // the block numbers anymore, so they can all read them.
+    std::atomic<size_t> nextContig(0);
+    std::vector<std::exception_ptr> errors(threadCount);
+    std::vector<std::thread> writers;
+    for(size_t i = 0; i < threadCount; i++) {
+        writers.push_back(std::thread([&, i]() {
+            try {
+                // Buffer up each contig's records.
+                std::vector<uint64_t> records;
+
+                size_t contig;
+                while((contig = nextContig++) < contigCount) {
+                    records.clear();
+
+                    stPinchSegment* segment = stPinchThread_getFirst(
+                        threads[contig]);
+                    while(segment != NULL) {
+                        records.push_back(stPinchSegment_getStart(segment));
+                        records.push_back(stPinchSegment_getLength(segment));
+
+                        stPinchBlock* block = stPinchSegment_getBlock(segment);
+                        if(block != NULL) {
+                            // Say what block it's in and which way.
+                            records.push_back(blockNumbers.at(block) << 1 |
+                                stPinchSegment_getBlockOrientation(segment));
+                        } else {
+                            records.push_back(ALIGNMENT_UNALIGNED);
+                        }
+
+                        segment = stPinchSegment_get3Prime(segment);
+                    }
+
+                    // Put them where they go.
+                    writeWords(fd, records.data(), records.size(),
+                        recordsStart + recordStarts[contig] * 3);
+                }
+            } catch(...) {
+                errors[i] = std::current_exception();
+            }
+        }));
+    }
+    for(auto& writer : writers) {
+        writer.join();
+    }
+
+    close(fd);
+
+    for(auto& error : errors) {
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Work out how long the root sequence is.
+    size_t rootBases = 0;
+    for(auto length : blockLengths) {
+        rootBases += length;
+    }
+    return rootBases;
+}
+
+/**
+ * Read the given number of words from the given stream, or throw.
+ */
+static void readWords(std::ifstream& stream, uint64_t* words, size_t count,
+    const std::string& filename) {
+
+    stream.read((char*)words, count * sizeof(uint64_t));
+    if(!stream.good()) {
+        throw std::runtime_error("Truncated binary alignment " + filename);
+    }
+}
+
+size_t convertAlignmentToC2h(std::string binaryFilename,
+    const FMDIndex& index, std::string c2hFilename) {
+
+    Log::info() << "Converting " << binaryFilename << " to " << c2hFilename <<
+        std::endl;
+
+    std::ifstream binary(binaryFilename.c_str(), std::ios::binary);
+    if(!binary.good()) {
+        throw std::runtime_error("Could not open " + binaryFilename);
+    }
+
+    // Read the header.
+    uint64_t header[4];
+    readWords(binary, header, 4, binaryFilename);
+    if(header[0] != ALIGNMENT_MAGIC) {
+        throw std::runtime_error(binaryFilename +
+            " is not a binary alignment file");
+    }
+    if(header[2] != index.getNumberOfContigs()) {
+        throw std::runtime_error(binaryFilename + " has " +
+            std::to_string(header[2]) + " contigs, but the index has " +
+            std::to_string(index.getNumberOfContigs()));
+    }
+
+    // Read the tables.
+    std::vector<uint64_t> blockLengths(header[1]);
+    readWords(binary, blockLengths.data(), blockLengths.size(),
+        binaryFilename);
+    std::vector<uint64_t> recordStarts(header[2] + 1);
+    readWords(binary, recordStarts.data(), recordStarts.size(),
+        binaryFilename);
+
+    // Open up the file to write, with a big buffer.
+    std::vector<char> buffer(1 << 20);
+    std::ofstream c2h;
+    c2h.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    c2h.open(c2hFilename.c_str());
+
+    // First, make a hacked-up consensus reference sequence to be the root of
+    // the tree. It just has all the pinch blocks in order. It is a bottom
+    // sequence since it has bottom segments.
+    c2h << "s\t'rootSeq'\t'rootSeq'\t1\n";
+
+    // Keep track of the total root sequence space already used
+    size_t nextBlockStart = 0;
+    for(size_t block = 0; block < blockLengths.size(); block++) {
+        // For each block, put a bottom segment named after the block number.
+        c2h << "a\t" << block << "\t" << nextBlockStart << "\t" <<
+            blockLengths[block] << "\n";
+        nextBlockStart += blockLengths[block];
+    }
+
+    // Keep a mapping from scaffold name to event name. Event name will be
+    // either the contig scaffold name if all the contigs are from a single
+    // scaffold, or "genome-<number>" if there are multiple scaffolds involved.
+    std::map<std::string, std::string> eventNames;
+
+    // Keep track of the original source sequence
+    std::string sourceSequence;
+
+    // Hold the records for each contig as we go.
+    std::vector<uint64_t> records;
+
+    // Go through contigs in order. The index spec requires them to be grouped
+    // by original source sequence.
+    for(size_t contig = 0; contig < index.getNumberOfContigs(); contig++) {
+        // Grab the sequence name that the contig is on
+        std::string contigName = index.getContigName(contig);
+
+        if(eventNames.count(contigName) == 0) {
+            // We need to figure out the event name for this contig. Start by
+            // naming the event after the contig.
+            eventNames[contigName] = contigName;
+
+            // What contigs are in its genome?
+            auto genomeRange = index.getGenomeContigs(
+                index.getContigGenome(contig));
+
+            for(size_t i = genomeRange.first; i < genomeRange.second; i++) {
+                if(index.getContigName(i) != contigName) {
+                    // They are not all from the same scaffold. Re-name the
+                    // event with a new generic name.
+                    eventNames[contigName] = "genome-" +
+                        std::to_string(index.getContigGenome(contig));
+                    break;
+                }
+            }
+        }
+
+        if(contigName != sourceSequence || contig == 0) {
+            // This is a new scaffold. Start a new top sequence, since it is
+            // only connected up.
+            c2h << "s\t'" << eventNames[contigName] << "'\t'" << contigName <<
+                "'\t0\n";
+
+            // Remember that we are on this sequence
+            sourceSequence = contigName;
+        } else {
+            // This is the same sequence as before, but we need an unaligned
+            // segment to cover the distance from the last contig to the start
+            // of this one. What's 1 base after the end of the last contig?
+            // Leave as 0-based.
+            size_t prevContigEnd = index.getContigStart(contig - 1) +
+                index.getContigLength(contig - 1);
+
+            c2h << "a\t" << prevContigEnd << "\t" <<
+                index.getContigStart(contig) - prevContigEnd << "\n";
+        }
+
+        // Each segment has to account for the offset of the contig on the
+        // sequence.
+        size_t contigStart = index.getContigStart(contig);
+
+        // Read all this contig's records. They come right after the last
+        // contig's.
+        records.resize((recordStarts[contig + 1] - recordStarts[contig]) * 3);
+        readWords(binary, records.data(), records.size(), binaryFilename);
+
+        for(size_t i = 0; i < records.size(); i += 3) {
+            // Convert from 1-based pinch segments to 0-based HAL.
+            size_t segmentStart = contigStart + records[i] - 1;
+
+            if(records[i + 2] != ALIGNMENT_UNALIGNED) {
+                // It actually aligned. Write a top segment mapping to the
+                // block's bottom segment, with the relative orientation.
+                c2h << "a\t" << segmentStart << "\t" << records[i + 1] <<
+                    "\t" << (records[i + 2] >> 1) << "\t" <<
+                    (records[i + 2] & 1) << "\n";
+            } else {
+                // Write a segment for the unaligned sequence.
+                c2h << "a\t" << segmentStart << "\t" << records[i + 1] <<
+                    "\n";
+            }
+        }
+    }
+
+    // Close up the finished file
+    c2h.close();
+
+    return nextBlockStart;
+}
+
+void writeAlignmentFasta(std::vector<std::string> inputFastas,
+    size_t rootBases, std::string filename) {
+
+    // Open the FASTA to write, with a big buffer.
+    std::vector<char> buffer(1 << 20);
+    std::ofstream fasta;
+    fasta.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    fasta.open(filename.c_str(), std::ios::binary);
+
+    Log::info() << "Generating " << rootBases <<
+        " bases of root node sequence." << std::endl;
+
+    // First we put the right number of Ns in a sequence named "rootSeq". The
+    // entire sequence must be on one line, so write it in big chunks.
+    fasta << ">rootSeq\n";
+    std::string ns(1 << 16, 'N');
+    for(size_t written = 0; written < rootBases; written += ns.size()) {
+        fasta.write(ns.data(), std::min(ns.size(), rootBases - written));
+    }
+
+    for(std::vector<std::string>::iterator i = inputFastas.begin();
+        i != inputFastas.end(); ++i) {
+
+        Log::info() << "Copying over " << *i << std::endl;
+
+        // Then we just copy all the other FASTAs in order.
+        std::ifstream inputFasta((*i).c_str());
+
+        // Read it line by line. See <http://stackoverflow.com/a/7868998/402891>
+        std::string line;
+        while(std::getline(inputFasta, line)) {
+            // For each line (without trailing newline)
+
+            if(line.size() == 0) {
+                // Drop blank lines
+                continue;
+            }
+
+            if(line[0] == '>') {
+                // Make sure there are newlines before and after header lines.
+                fasta << "\n" << line << "\n";
+            } else {
+                // Don't put any newlines.
+                fasta.write(line.data(), line.size());
+            }
+        }
+
+        // Close up this input file and move to the next one.
+        inputFasta.close();
+    }
+
+    // Insert a linebreak at the end of the file.
+    fasta << "\n";
+
+    // Now we're done.
+    fasta.close();
+}
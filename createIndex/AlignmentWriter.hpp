@@ -0,0 +1,78 @@
+#ifndef ALIGNMENTWRITER_HPP
+#define ALIGNMENTWRITER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <stPinchGraphs.h>
+
+#include <FMDIndex.hpp>
+
+/**
+ * Functions for saving the alignment defined by a pinched thread set.
+ *
+ * The alignment is saved first in a compact binary format, which lays out the
+ * blocks in a made-up root sequence and lists the segments on each contig. All
+ * values are 64-bit words:
+ *
+ * magic: "SGALIGN1"
+ * block count, contig count, segment count
+ * length of each block, in root sequence order
+ * index of the first segment record for each contig, plus the total
+ * segment records: 1-based start on the contig, length, and the block number
+ * shifted left by 1 and or-ed with the orientation in the block (or all 1s for
+ * an unaligned segment)
+ *
+ * Since the offset of every record is known up front, contigs are written into
+ * their own regions of the file in parallel. The binary file can then be
+ * converted to cactus2hal (.c2h) text.
+ */
+
+/**
+ * Magic number at the start of every binary alignment file.
+ */
+const uint64_t ALIGNMENT_MAGIC = 0x314e47494c414753ULL; // "SGALIGN1"
+
+/**
+ * Block number used for segments that aren't in any block.
+ */
+const uint64_t ALIGNMENT_UNALIGNED = ~(uint64_t)0;
+
+/**
+ * Write the given threadSet on the contigs in the given index out as a binary
+ * alignment file. Blocks are numbered in the order they are first encountered
+ * along the contigs. Segments are written by the given number of threads (or
+ * one per core if 0).
+ *
+ * Returns the total number of bases in the made-up root sequence used to tie
+ * the actual sequences together.
+ */
+size_t writeBinaryAlignment(stPinchThreadSet* threadSet,
+    const FMDIndex& index, std::string filename, size_t threadCount = 0);
+
+/**
+ * Convert a binary alignment file written by writeBinaryAlignment to a
+ * cactus2hal (.c2h) file as described in
+ * <https://github.com/benedictpaten/cactus/blob/development/hal/impl/hal.c>,
+ * using the given index for the contig names and positions. Blocks are named
+ * by their numbers.
+ *
+ * Returns the total number of bases in the made-up root sequence.
+ */
+size_t convertAlignmentToC2h(std::string binaryFilename,
+    const FMDIndex& index, std::string c2hFilename);
+
+/**
+ * Write a FASTA file that goes with the .c2h file from convertAlignmentToC2h,
+ * so that the halAppendCactusSubtree tool can turn both into a HAL file. The
+ * root sequence is rootBases Ns, and the other sequences are copied from the
+ * input FASTAs.
+ *
+ * Strips out newlines so halAppendCactusSubtree will be happy with the
+ * resulting FASTA.
+ */
+void writeAlignmentFasta(std::vector<std::string> inputFastas,
+    size_t rootBases, std::string filename);
+
+#endif
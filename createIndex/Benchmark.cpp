@@ -0,0 +1,362 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+
+#include <boost/filesystem.hpp>
+
+#include "Benchmark.hpp"
+
+/**
+ * Quote the given string for JSON. Our names never need much escaping, but do
+ * it properly anyway.
+ */
+static std::string quote(const std::string& text) {
+    std::string quoted = "\"";
+    for(char c : text) {
+        if(c == '"' || c == '\\') {
+            quoted.push_back('\\');
+            quoted.push_back(c);
+        } else if((unsigned char)c < 0x20) {
+            // Control characters can't appear literally.
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else {
+            quoted.push_back(c);
+        }
+    }
+    quoted.push_back('"');
+    return quoted;
+}
+
+/**
+ * Format the given number for JSON, with enough digits to be useful.
+ */
+static std::string number(double value) {
+    std::ostringstream stream;
+    stream.precision(9);
+    stream << value;
+    return stream.str();
+}
+
+Benchmark::Benchmark(size_t repetitions, uint64_t seed):
+    repetitions(repetitions), parameters(), results(), generator(seed) {
+
+    if(repetitions == 0) {
+        throw std::runtime_error("Benchmarks must run at least once");
+    }
+}
+
+void Benchmark::setParameter(const std::string& name,
+    const std::string& value) {
+
+    parameters.push_back(std::make_pair(name, quote(value)));
+}
+
+void Benchmark::setParameter(const std::string& name, size_t value) {
+    parameters.push_back(std::make_pair(name, std::to_string(value)));
+}
+
+void Benchmark::setParameter(const std::string& name, double value) {
+    parameters.push_back(std::make_pair(name, number(value)));
+}
+
+void Benchmark::timeSearching(const FMDIndex& index,
+    const std::vector<std::string>& reads, size_t genome) {
+
+    time("extend", [&](size_t& operations) {
+        // Search back from the end of each read until the search runs out,
+        // and then start again from the base where it did.
+        size_t checksum = 0;
+        for(auto& read : reads) {
+            FMDPosition search = index.getCoveringPosition();
+            for(size_t i = read.size(); i > 0; i--) {
+                search = index.extend(search, read[i - 1], true);
+                operations++;
+                if(search.isEmpty()) {
+                    search = index.getCharPosition(read[i - 1]);
+                }
+                checksum += search.getLength();
+            }
+        }
+        return checksum;
+    });
+
+    time("extendFast", [&](size_t& operations) {
+        // Do the same thing but in place.
+        size_t checksum = 0;
+        for(auto& read : reads) {
+            FMDPosition search = index.getCoveringPosition();
+            for(size_t i = read.size(); i > 0; i--) {
+                index.extendFast(search, read[i - 1], true);
+                operations++;
+                if(search.isEmpty()) {
+                    search = index.getCharPosition(read[i - 1]);
+                }
+                checksum += search.getLength();
+            }
+        }
+        return checksum;
+    });
+
+    // Pick the BWT positions to locate, skipping the stop characters.
+    size_t firstIndex = index.getNumberOfContigs() * 2;
+    std::vector<int64_t> bwtIndices;
+    for(size_t i = 0; i < QUERY_COUNT; i++) {
+        bwtIndices.push_back(firstIndex +
+            random(index.getBWTLength() - firstIndex));
+    }
+
+    time("locate", [&](size_t& operations) {
+        size_t checksum = 0;
+        for(int64_t bwtIndex : bwtIndices) {
+            TextPosition position = index.locate(bwtIndex);
+            checksum += position.getText() + position.getOffset();
+            operations++;
+        }
+        return checksum;
+    });
+
+    time("map", [&](size_t& operations) {
+        // Count the bases that map.
+        size_t checksum = 0;
+        for(auto& read : reads) {
+            for(auto& mapping : index.map(read, genome)) {
+                checksum += mapping.is_mapped;
+            }
+            operations += read.size();
+        }
+        return checksum;
+    });
+
+    time("mapBoth", [&](size_t& operations) {
+        size_t checksum = 0;
+        for(auto& read : reads) {
+            for(auto& mapping : index.mapBoth(read, genome)) {
+                checksum += mapping.is_mapped;
+            }
+            operations += read.size();
+        }
+        return checksum;
+    });
+}
+
+void Benchmark::timeRangeMapping(const FMDIndex& index,
+    const BitVector& ranges, const BitVector* mask,
+    const std::vector<std::string>& reads,
+    const std::vector<std::string>& changedReads) {
+
+    time("rangeMap", [&](size_t& operations) {
+        // Count the bases that map to a range.
+        size_t checksum = 0;
+        for(auto& read : reads) {
+            for(auto& mapping : index.map(ranges, read, mask)) {
+                checksum += mapping.first != -1;
+            }
+            operations += read.size();
+        }
+        return checksum;
+    });
+
+    time("Cmap", [&](size_t& operations) {
+        size_t checksum = 0;
+        for(auto& read : reads) {
+            for(auto& mapping : index.Cmap(ranges, read, mask)) {
+                checksum += mapping.first != -1;
+            }
+            operations += read.size();
+        }
+        return checksum;
+    });
+
+    time("misMatchMap", [&](size_t& operations) {
+        size_t checksum = 0;
+        for(auto& read : changedReads) {
+            for(auto& mapping : index.misMatchMap(ranges, read, mask, 0, 1)) {
+                checksum += mapping.first != -1;
+            }
+            operations += read.size();
+        }
+        return checksum;
+    });
+
+    time("editMap", [&](size_t& operations) {
+        size_t checksum = 0;
+        for(auto& read : changedReads) {
+            for(auto& mapping : index.editMap(ranges, read, mask, 0, 1)) {
+                checksum += mapping.first != -1;
+            }
+            operations += read.size();
+        }
+        return checksum;
+    });
+}
+
+void Benchmark::timeBitVector(const std::string& name,
+    const BitVector& vector) {
+
+    // Pick the places to ask about.
+    std::vector<size_t> values;
+    std::vector<size_t> indices;
+    for(size_t i = 0; i < QUERY_COUNT; i++) {
+        values.push_back(random(vector.getSize()));
+        if(vector.getNumberOfItems() > 0) {
+            indices.push_back(random(vector.getNumberOfItems()));
+        }
+    }
+
+    time("rank." + name, [&](size_t& operations) {
+        size_t checksum = 0;
+        for(size_t value : values) {
+            checksum += vector.rank(value);
+            operations++;
+        }
+        return checksum;
+    });
+
+    time("select." + name, [&](size_t& operations) {
+        size_t checksum = 0;
+        for(size_t index : indices) {
+            checksum += vector.select(index);
+            operations++;
+        }
+        return checksum;
+    });
+}
+
+std::vector<std::string> Benchmark::writeGenomes(const std::string& directory,
+    size_t bases, size_t haplotypes, double divergence) {
+
+    const char* alphabet = "ACGT";
+
+    // Make up the ancestral genome.
+    std::string root;
+    root.reserve(bases);
+    for(size_t i = 0; i < bases; i++) {
+        root.push_back(alphabet[random(4)]);
+    }
+
+    // Substitutions and indels happen at these rates, as fractions of 2^32.
+    uint64_t substitutionThreshold = divergence * 4294967296.0;
+    uint64_t indelThreshold = substitutionThreshold / 10;
+
+    boost::filesystem::create_directories(directory);
+
+    std::vector<std::string> filenames;
+    for(size_t haplotype = 0; haplotype < haplotypes; haplotype++) {
+        // Copy the root with changes.
+        std::string sequence;
+        sequence.reserve(bases + bases / 100);
+        for(size_t i = 0; i < bases; i++) {
+            uint64_t roll = random((size_t)1 << 32);
+            if(roll < indelThreshold) {
+                // Insert or delete 1 to 5 bases.
+                size_t length = 1 + random(5);
+                if(random(2)) {
+                    for(size_t j = 0; j < length; j++) {
+                        sequence.push_back(alphabet[random(4)]);
+                    }
+                    sequence.push_back(root[i]);
+                } else {
+                    // Skip this base and some after it.
+                    i += length - 1;
+                }
+            } else if(roll < indelThreshold + substitutionThreshold) {
+                // Change to one of the other 3 bases.
+                size_t base = std::string(alphabet).find(root[i]);
+                sequence.push_back(alphabet[(base + 1 + random(3)) % 4]);
+            } else {
+                sequence.push_back(root[i]);
+            }
+        }
+
+        // Save it with 80 bases to a line.
+        std::string name = "haplotype" + std::to_string(haplotype);
+        std::string filename = directory + "/" + name + ".fa";
+        std::ofstream fasta(filename.c_str());
+        fasta << ">" << name << "\n";
+        for(size_t i = 0; i < sequence.size(); i += 80) {
+            fasta << sequence.substr(i, 80) << "\n";
+        }
+        fasta.close();
+        if(!fasta.good()) {
+            throw std::runtime_error("Could not write " + filename);
+        }
+
+        filenames.push_back(filename);
+    }
+
+    return filenames;
+}
+
+std::vector<std::string> Benchmark::sampleReads(const FMDIndex& index,
+    size_t genome, size_t count, size_t changes) {
+
+    const char* alphabet = "ACGT";
+
+    // Only take reads from contigs long enough to hold them.
+    std::vector<size_t> contigs;
+    for(size_t i = index.getGenomeContigs(genome).first;
+        i < index.getGenomeContigs(genome).second; i++) {
+
+        if(index.getContigLength(i) >= READ_LENGTH) {
+            contigs.push_back(i);
+        }
+    }
+    if(contigs.empty()) {
+        throw std::runtime_error("No contigs long enough to sample reads from");
+    }
+
+    std::vector<std::string> reads;
+    for(size_t i = 0; i < count; i++) {
+        size_t contig = contigs[random(contigs.size())];
+        size_t start = random(index.getContigLength(contig) - READ_LENGTH + 1);
+        std::string read = index.extract(contig, start, READ_LENGTH);
+
+        for(size_t j = 0; j < changes; j++) {
+            // Substitute a random base with a different one.
+            size_t position = random(read.size());
+            size_t base = std::string(alphabet).find(read[position]);
+            read[position] = alphabet[(base + 1 + random(3)) % 4];
+        }
+
+        reads.push_back(read);
+    }
+
+    return reads;
+}
+
+void Benchmark::save(const std::string& filename) const {
+    std::ofstream stream(filename.c_str());
+
+    stream << "{\n  \"parameters\": {";
+    for(size_t i = 0; i < parameters.size(); i++) {
+        stream << (i == 0 ? "\n" : ",\n") << "    " <<
+            quote(parameters[i].first) << ": " << parameters[i].second;
+    }
+    stream << "\n  },\n  \"benchmarks\": [";
+    for(size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        stream << (i == 0 ? "\n" : ",\n") << "    {\"name\": " <<
+            quote(result.name) << ", \"operations\": " << result.operations <<
+            ", \"repetitions\": " << result.repetitions << ", \"seconds\": " <<
+            number(result.seconds) << ", \"median_seconds\": " <<
+            number(result.medianSeconds) << ", \"ns_per_operation\": " <<
+            number(result.operations == 0 ? 0 :
+            result.seconds * 1e9 / result.operations) << ", \"checksum\": " <<
+            result.checksum << "}";
+    }
+    stream << "\n  ]\n}\n";
+
+    stream.close();
+    if(!stream.good()) {
+        throw std::runtime_error("Could not save benchmarks to " + filename);
+    }
+}
+
+size_t Benchmark::random(size_t bound) {
+    // Modulo bias is negligible for the bounds we use, and this gives the
+    // same numbers everywhere, unlike the standard distributions.
+    return generator() % bound;
+}
@@ -0,0 +1,199 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+#include <FMDIndex.hpp>
+#include <BitVector.hpp>
+#include <Log.hpp>
+
+/**
+ * Times parts of the index and the merge pipeline, and saves the results as
+ * JSON, so they can be compared from commit to commit.
+ *
+ * Each benchmark is a function that does some number of operations (looking
+ * up a base, extending a search, merging a genome) and returns a checksum of
+ * what it found. The function is run a few times, and the fastest and median
+ * runs are kept. The checksum goes in the results too, so a change that makes
+ * things faster by getting different answers is easy to spot.
+ *
+ * The results file looks like:
+ *
+ * {
+ *   "parameters": {"bases": 1000000, ...},
+ *   "benchmarks": [
+ *     {"name": "extend", "operations": ..., "repetitions": ...,
+ *      "seconds": ..., "median_seconds": ..., "ns_per_operation": ...,
+ *      "checksum": ...},
+ *     ...
+ *   ]
+ * }
+ *
+ * All the random choices come from one seeded generator, so the same
+ * parameters always give the same genomes, reads and queries.
+ */
+class Benchmark {
+
+public:
+    /**
+     * How long are the sampled reads?
+     */
+    static const size_t READ_LENGTH = 200;
+
+    /**
+     * How many random queries do the locate and bit vector benchmarks make?
+     */
+    static const size_t QUERY_COUNT = 100000;
+
+    /**
+     * Make a new Benchmark, running each benchmark the given number of times
+     * (unless told otherwise) and drawing random numbers from the given seed.
+     */
+    Benchmark(size_t repetitions = 3, uint64_t seed = 1);
+
+    /**
+     * Record a parameter of the whole run, like the genome size or the commit
+     * being benchmarked.
+     */
+    void setParameter(const std::string& name, const std::string& value);
+    void setParameter(const std::string& name, size_t value);
+    void setParameter(const std::string& name, double value);
+
+    /**
+     * Time the given function, which takes a size_t& to count its operations
+     * in and returns a checksum of its results. Runs it the given number of
+     * times, or the default number if 0, and records the result under the
+     * given name.
+     */
+    template<typename Function>
+    void time(const std::string& name, Function function,
+        size_t runs = 0);
+
+    /**
+     * Time searching the bottom level of the given index: extending searches
+     * base by base along the given reads with extend and extendFast, locating
+     * random BWT positions, and mapping the reads with map and mapBoth. Reads
+     * are mapped to the given genome.
+     */
+    void timeSearching(const FMDIndex& index,
+        const std::vector<std::string>& reads, size_t genome);
+
+    /**
+     * Time mapping reads to the merged ranges of the given index, with map,
+     * Cmap, and (on the reads with changes) misMatchMap and editMap, allowing
+     * one change. Only positions in the given mask, if any, count.
+     */
+    void timeRangeMapping(const FMDIndex& index, const BitVector& ranges,
+        const BitVector* mask, const std::vector<std::string>& reads,
+        const std::vector<std::string>& changedReads);
+
+    /**
+     * Time rank and select at random places in the given bit vector, under
+     * the given name.
+     */
+    void timeBitVector(const std::string& name, const BitVector& vector);
+
+    /**
+     * Make a random genome of the given number of bases, and the given number
+     * of haplotypes of it, each with the given fraction of bases substituted,
+     * and a tenth as many short insertions and deletions. Saves each haplotype
+     * as a FASTA in the given directory, and returns their filenames.
+     */
+    std::vector<std::string> writeGenomes(const std::string& directory,
+        size_t bases, size_t haplotypes, double divergence);
+
+    /**
+     * Pull the given number of reads out of random places in the given genome
+     * of the given index, each with the given number of random substitutions.
+     */
+    std::vector<std::string> sampleReads(const FMDIndex& index, size_t genome,
+        size_t count, size_t changes);
+
+    /**
+     * Save all the parameters and results so far to the given file as JSON.
+     */
+    void save(const std::string& filename) const;
+
+protected:
+    /**
+     * The timing of one benchmark.
+     */
+    struct Result {
+        // What was timed?
+        std::string name;
+        // How many operations did each run do?
+        size_t operations;
+        // How many runs were there?
+        size_t repetitions;
+        // How long did the fastest and the median runs take?
+        double seconds;
+        double medianSeconds;
+        // What did the function return?
+        size_t checksum;
+    };
+
+    // How many times do we run each benchmark by default?
+    size_t repetitions;
+
+    // Parameter names and their values, already in JSON
+    std::vector<std::pair<std::string, std::string>> parameters;
+
+    // The results so far, in the order they were run
+    std::vector<Result> results;
+
+    // Where all our random numbers come from
+    std::mt19937_64 generator;
+
+    /**
+     * Get a random number from 0 up to but not including the given bound.
+     */
+    size_t random(size_t bound);
+};
+
+template<typename Function>
+void Benchmark::time(const std::string& name, Function function, size_t runs) {
+    if(runs == 0) {
+        // Use the default.
+        runs = repetitions;
+    }
+
+    Result result;
+    result.name = name;
+    result.operations = 0;
+    result.repetitions = runs;
+    result.checksum = 0;
+
+    // How long did each run take?
+    std::vector<double> times;
+
+    for(size_t i = 0; i < runs; i++) {
+        // Count from 0 each time.
+        size_t operations = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        result.checksum = function(operations);
+        auto end = std::chrono::steady_clock::now();
+
+        times.push_back(std::chrono::duration<double>(end - start).count());
+        result.operations = operations;
+    }
+
+    std::sort(times.begin(), times.end());
+    result.seconds = times.front();
+    result.medianSeconds = times[times.size() / 2];
+
+    Log::output() << "Benchmark " << name << ": " << result.operations <<
+        " operations in " << result.seconds << " s (" <<
+        (result.operations == 0 ? 0 :
+        result.seconds * 1e9 / result.operations) << " ns each)" << std::endl;
+
+    results.push_back(result);
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "CanonicalTable.hpp"
+
+CanonicalTable::CanonicalTable(stPinchThreadSet* threadSet): threads() {
+
+    // Go through all the threads.
+    stPinchThreadSetIt threadIterator = stPinchThreadSet_getIt(threadSet);
+    stPinchThread* thread;
+    while((thread = stPinchThreadSetIt_getNext(&threadIterator)) != NULL) {
+        // Threads are named after contig numbers, so we can file them by name.
+        size_t name = stPinchThread_getName(thread);
+        if(name >= threads.size()) {
+            threads.resize(name + 1);
+        }
+
+        // Walk all the segments 3' along the thread.
+        stPinchSegment* segment = stPinchThread_getFirst(thread);
+        while(segment != NULL) {
+            Segment record;
+            record.start = stPinchSegment_getStart(segment);
+            record.orientation = stPinchSegment_getBlockOrientation(segment);
+
+            // Get the first segment in the segment's block, or just this
+            // segment if it isn't in a block.
+            stPinchSegment* firstSegment = segment;
+            stPinchBlock* block = stPinchSegment_getBlock(segment);
+            if(block != NULL) {
+                firstSegment = stPinchBlock_getFirst(block);
+            }
+
+            record.canonicalContig = stPinchSegment_getName(firstSegment);
+            record.canonicalStart = stPinchSegment_getStart(firstSegment);
+            record.canonicalLength = stPinchSegment_getLength(firstSegment);
+            record.canonicalOrientation = stPinchSegment_getBlockOrientation(
+                firstSegment);
+            record.canonicalThreadLength = stPinchThread_getLength(
+                stPinchSegment_getThread(firstSegment));
+
+            threads[name].push_back(record);
+
+            segment = stPinchSegment_get3Prime(segment);
+        }
+    }
+}
+
+std::pair<std::pair<size_t, size_t>, bool> CanonicalTable::canonicalize(
+    size_t contigNumber, size_t offset, bool strand) const {
+
+    if(contigNumber >= threads.size() || threads[contigNumber].empty() ||
+        (int64_t)offset < threads[contigNumber].front().start) {
+
+        throw std::runtime_error("Found position in null segment!");
+    }
+
+    // Find the last segment starting at or before the offset.
+    const std::vector<Segment>& segments = threads[contigNumber];
+    auto found = std::upper_bound(segments.begin(), segments.end(),
+        (int64_t)offset, [](int64_t value, const Segment& segment) {
+            return value < segment.start;
+        });
+    const Segment& segment = *(found - 1);
+
+    // How far into the segment are we? 0-based, from subtracting 1-based
+    // positions.
+    size_t segmentOffset = offset - segment.start;
+
+    // We need to calculate an offset into the canonical segment. If the
+    // segments are pinched together backwards, this will count in opposite
+    // directions on the two segments, so we'll need to flip the within-sement
+    // offset around.
+    size_t canonicalSegmentOffset = segmentOffset;
+    if(segment.orientation != segment.canonicalOrientation) {
+        canonicalSegmentOffset = segment.canonicalLength -
+            canonicalSegmentOffset - 1;
+    }
+
+    // What's the offset into the canonical contig? 1-based because we add a
+    // 0-based offset to a 1-based position.
+    size_t canonicalOffset = segment.canonicalStart + canonicalSegmentOffset;
+
+    if(canonicalOffset <= 0 ||
+        canonicalOffset > (size_t)segment.canonicalThreadLength) {
+
+        // The answer is supposed to be a 1-based offset. Make sure that is
+        // true.
+        throw std::runtime_error("Canonical offset " +
+            std::to_string(canonicalOffset) +
+            " out of range for 1-based position");
+    }
+
+    // Flipping any of the orientations flips the face we map to.
+    return std::make_pair(std::make_pair(segment.canonicalContig,
+        canonicalOffset),
+        (segment.canonicalOrientation != segment.orientation) != strand);
+}
+
+std::pair<std::pair<size_t, size_t>, bool> CanonicalTable::canonicalize(
+    const FMDIndex& index, TextPosition base) const {
+
+    // What contig corresponds to that text?
+    size_t contigNumber = index.getContigNumber(base);
+    // And what strand corresponds to that text? This tells us what
+    // orientation we're actually looking at the base in.
+    bool strand = (bool) index.getStrand(base);
+    // And what base position is that from the front of the contig? This is
+    // 1-based.
+    size_t offset = index.getOffset(base);
+
+    if(offset <= 0 || offset > index.getContigLength(contigNumber)) {
+        // Complain that we got an out of bounds offset from this thing.
+        throw std::runtime_error("Tried to canonicalize text" +
+            std::to_string(base.getText()) + " offset " +
+            std::to_string(base.getOffset()) + " which is out of bounds");
+    }
+
+    return canonicalize(contigNumber, offset, strand);
+}
@@ -0,0 +1,72 @@
+#ifndef CANONICALTABLE_HPP
+#define CANONICALTABLE_HPP
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include <stPinchGraphs.h>
+
+#include <FMDIndex.hpp>
+#include <TextPosition.hpp>
+
+/**
+ * A read-only snapshot of a pinch thread set that can canonicalize positions
+ * the same way canonicalize() does on the thread set itself, but from many
+ * threads at once. The pinch graph library's lookup functions are not safe to
+ * call concurrently, so we copy out, for every segment, everything needed to
+ * find its canonical position, and then answer queries by binary search.
+ *
+ * The snapshot is not updated when the thread set changes.
+ */
+class CanonicalTable {
+
+public:
+    /**
+     * Take a snapshot of all the segments in the given thread set.
+     */
+    CanonicalTable(stPinchThreadSet* threadSet);
+
+    /**
+     * Turn the given (contig number, 1-based offset from start, orientation)
+     * position into the same sort of structure for the canonical base that
+     * represents all the bases it has been pinched with.
+     */
+    std::pair<std::pair<size_t, size_t>, bool> canonicalize(
+        size_t contigNumber, size_t offset, bool strand) const;
+
+    /**
+     * Turn the given (text, 0-based offset offset) pair into a canonical
+     * (contig number, 1-based offset from contig start, orientation), using the
+     * given FMDIndex.
+     */
+    std::pair<std::pair<size_t, size_t>, bool> canonicalize(
+        const FMDIndex& index, TextPosition base) const;
+
+protected:
+    /**
+     * Everything we need to know about a segment to canonicalize positions in
+     * it.
+     */
+    struct Segment {
+        // Where does the segment start on its thread (1-based)?
+        int64_t start;
+        // Which way does it go in its block?
+        bool orientation;
+        // What's the contig of the first segment in its block?
+        size_t canonicalContig;
+        // Where does the first segment in its block start?
+        int64_t canonicalStart;
+        // How long are the segments in the block?
+        int64_t canonicalLength;
+        // Which way does the first segment go in the block?
+        bool canonicalOrientation;
+        // How long is the thread the first segment is on?
+        int64_t canonicalThreadLength;
+    };
+
+    // Holds the segments on each thread, by thread name, in order.
+    std::vector<std::vector<Segment> > threads;
+};
+
+#endif
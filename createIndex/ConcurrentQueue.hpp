@@ -5,6 +5,10 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <algorithm>
+
+#include <MemoryReport.hpp>
+#include <Trace.hpp>
 
 /**
  * A queue which comes with a lock for controlling access from multiple threads.
@@ -28,7 +32,7 @@ public:
      * one).
      */
     ConcurrentQueue(): queue(), mutex(), nonempty(), numWriters(0),
-        totalThroughput(0) {
+        totalThroughput(0), peakSize(0), traceName(), lastTraceTime(0) {
     }
     
     /**
@@ -38,7 +42,8 @@ public:
      * out and not block on data from a queue that nobody will ever write to.
      */
     ConcurrentQueue(size_t numWriters): queue(), mutex(), nonempty(), 
-        numWriters(numWriters), totalThroughput(0) {
+        numWriters(numWriters), totalThroughput(0), peakSize(0), traceName(),
+        lastTraceTime(0) {
     
     }
     
@@ -67,6 +72,9 @@ public:
         // Count that an item has passed through the queue.
         totalThroughput++;
         
+        // Show how long the queue is on the timeline, if anyone is looking.
+        traceDepth();
+        
         // Unlock the caller's lock.
         callerLock.unlock();
         
@@ -85,6 +93,12 @@ public:
         // Put the element at the end of the queue.
         queue.push(value);
         
+        // Remember if it's the longest the queue has been.
+        peakSize = std::max(peakSize, queue.size());
+        
+        // Show how long the queue is on the timeline, if anyone is looking.
+        traceDepth();
+        
         // Release the caller's lock
         callerLock.unlock();
         
@@ -172,6 +186,34 @@ public:
         return totalThroughput;
     }
     
+    /**
+     * Get a breakdown of the bytes used by the items waiting in the queue. Only
+     * counts the items themselves, not anything they point to. Caller must
+     * hold a lock on the queue, but it is not released.
+     */
+    MemoryReport reportMemory(Lock& callerLock) {
+        MemoryReport report;
+        report.add("queued", queue.size() * sizeof(T));
+        return report;
+    }
+    
+    /**
+     * Get the most bytes of items that have ever been waiting in the queue at
+     * once. Caller must hold a lock on the queue, but it is not released.
+     */
+    size_t getPeakBytes(Lock& callerLock) {
+        return peakSize * sizeof(T);
+    }
+    
+    /**
+     * Record how many items are waiting in the queue as a counter with the
+     * given name whenever tracing is on, at most once a millisecond. Caller
+     * must hold a lock on the queue, but it is not released.
+     */
+    void traceAs(const std::string& name, Lock& callerLock) {
+        traceName = name;
+    }
+    
     /**
      * Ask for the default move assignment operator.
      */
@@ -205,6 +247,32 @@ protected:
     // it was created?
     size_t totalThroughput;
     
+    // What's the most items that have been in the queue at once?
+    size_t peakSize;
+    
+    // What do we call our length on the timeline? Empty if we don't trace it.
+    std::string traceName;
+    
+    // When did we last put our length on the timeline, in microseconds?
+    double lastTraceTime;
+    
+    // How many microseconds apart should we put our length on the timeline?
+    static constexpr double TRACE_INTERVAL = 1000;
+    
+    /**
+     * Put the queue length on the timeline if we are tracing it and haven't
+     * done so recently. Caller must hold a lock on the queue.
+     */
+    void traceDepth() {
+        if(traceName != "" && Trace::isEnabled()) {
+            double time = Trace::now();
+            if(time - lastTraceTime >= TRACE_INTERVAL) {
+                Trace::count(traceName, queue.size());
+                lastTraceTime = time;
+            }
+        }
+    }
+    
 private:
     
     /**
@@ -1,6 +1,7 @@
 #include <stdexcept>
 
 #include <Log.hpp>
+#include <Trace.hpp>
 #include <Util.h> // From libsuffixtools, for reverse_complement
 
 #include "MappingMergeScheme.hpp"
@@ -54,6 +55,12 @@ ConcurrentQueue<Merge>& MappingMergeScheme::run() {
     // Make the queue    
     queue = new ConcurrentQueue<Merge>(threadCount);
     
+    {
+        // Put its length on the timeline if we're tracing.
+        auto lock = queue->lock();
+        queue->traceAs("merge queue", lock);
+    }
+    
     // Start up a thread for every contig in this genome.
     
     for(size_t contig = genomeContigs.first; contig < genomeContigs.second; 
@@ -165,6 +172,102 @@ void MappingMergeScheme::generateMerge(size_t queryContig, size_t queryBase,
     
 }
 
+void MappingMergeScheme::findCreditSources(const std::vector<size_t>& contexts,
+    const std::vector<std::pair<std::pair<size_t, size_t>, bool> >& keys,
+    bool leftward, std::vector<int64_t>& sources,
+    std::vector<bool>& consistent) {
+    
+    size_t length = contexts.size();
+    
+    sources.assign(length, -1);
+    consistent.assign(length, true);
+    
+    // Keep linked lists of the covering positions that stop covering at each
+    // position, so we can retire them as we sweep past.
+    std::vector<int64_t> expiringHead(length, -1);
+    std::vector<int64_t> expiringNext(length, -1);
+    
+    // Keep a stack of the covering positions we have passed, nearest on top.
+    // Anything under the top may have stopped covering already, but once the
+    // top stops covering, it never will again, so we can pop it.
+    std::vector<size_t> covering;
+    
+    // Keep all the covering positions that still cover in a doubly linked
+    // list, in the order we passed them, and count how many neighbors in the
+    // list have different keys. Everything agrees exactly when none do.
+    std::vector<int64_t> activePrev(length, -1);
+    std::vector<int64_t> activeNext(length, -1);
+    int64_t activeTail = -1;
+    size_t disagreements = 0;
+    
+    for(size_t step = 0; step < length; step++) {
+        // Sweep towards the side we're looking at.
+        size_t position = leftward ? step : length - 1 - step;
+        
+        for(int64_t j = expiringHead[position]; j != -1; 
+            j = expiringNext[j]) {
+            
+            // Retire anything that no longer reaches this far, by unlinking it
+            // and letting its neighbors meet.
+            int64_t before = activePrev[j];
+            int64_t after = activeNext[j];
+            if(before != -1) {
+                disagreements -= keys[before] != keys[j];
+                activeNext[before] = after;
+            }
+            if(after != -1) {
+                disagreements -= keys[j] != keys[after];
+                activePrev[after] = before;
+            } else {
+                activeTail = before;
+            }
+            if(before != -1 && after != -1) {
+                disagreements += keys[before] != keys[after];
+            }
+        }
+        
+        if(step > 0) {
+            // Consider the position we just passed.
+            size_t j = leftward ? position - 1 : position + 1;
+            
+            if((!leftward || j > 0) && contexts[j] > 1) {
+                // It covers at least this position.
+                if(activeTail != -1) {
+                    disagreements += keys[activeTail] != keys[j];
+                    activeNext[activeTail] = j;
+                }
+                activePrev[j] = activeTail;
+                activeTail = j;
+                covering.push_back(j);
+                
+                // Work out where it stops covering, if that's in the contig.
+                if(leftward && j + contexts[j] < length) {
+                    expiringNext[j] = expiringHead[j + contexts[j]];
+                    expiringHead[j + contexts[j]] = j;
+                } else if(!leftward && contexts[j] <= j) {
+                    expiringNext[j] = expiringHead[j - contexts[j]];
+                    expiringHead[j - contexts[j]] = j;
+                }
+            }
+        }
+        
+        while(!covering.empty() && (leftward ? 
+            covering.back() + contexts[covering.back()] <= position :
+            covering.back() >= position + contexts[covering.back()])) {
+            
+            // Pop anything on top that no longer covers.
+            covering.pop_back();
+        }
+        
+        if(!covering.empty()) {
+            // The nearest covering position provides the credit, as long as
+            // everything covering agrees with it.
+            sources[position] = covering.back();
+            consistent[position] = disagreements == 0;
+        }
+    }
+}
+
 // Generate merges per-contig based on the centered family of
 // context schemes
 
@@ -173,6 +276,8 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
     // What's our thread name?
     std::string threadName = "T" + std::to_string(genome) + "." + 
         std::to_string(queryContig);
+    Trace::nameThread(threadName);
+    TraceSpan span("map contig " + std::to_string(queryContig));
         
     // How many bases have we mapped or not mapped
     size_t mappedBases = 0;
@@ -186,7 +291,7 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
     
     // How many positions are available to map to?
     Log::info() << threadName << " mapping " << contig.size() << 
-        " bases via " << BitVectorIterator(includedPositions).rank(
+        " bases via " << includedPositions.rank(
         includedPositions.getSize()) << " bottom-level positions" << std::endl;
 	
     std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> Mappings;
@@ -236,7 +341,7 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
       
 	if(Mappings[i].first != -1) {
 	    leftSentinel = i;
-	    Log::info() << "Left sentinel is " << i << std::endl;
+	    Log::debug() << "Left sentinel is " << i << std::endl;
 	    break;
 
 	}
@@ -247,7 +352,7 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
 
 	if(Mappings[i].first != -1) {
 	    rightSentinel = i;
-	    Log::info() << "Right sentinel is " << i << std::endl;
+	    Log::debug() << "Right sentinel is " << i << std::endl;
 	    break;
 
 	}
@@ -286,22 +391,32 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
     bool contextMappedR;
     int64_t firstL = -1;
     bool contextMappedL;
-    int64_t centeredOffset;
-            
-    size_t maxContext = 0;
     
     Log::info() << "Checking " << creditCandidates.size() << " unmapped positions \"in the middle\"" << std::endl;
     
-    // What is the maximum context length of any base in the contig? We will not
-    // search beyond this bound for neighbouring bases to provide credit
-    
-    for(size_t i; i < Mappings.size(); i++) {
-	if(Mappings[i].second.second > maxContext) {
-	    maxContext = Mappings[i].second.second;
-	}
+    // Every position with a maximal context covers the bases within it on
+    // either side. Covering positions agree on a candidate if they map to the
+    // same contig and orientation along the same diagonal, so that each one's
+    // mapping, shifted by its distance from the first, lands in the same place.
+    std::vector<size_t> contexts(Mappings.size());
+    std::vector<std::pair<std::pair<size_t, size_t>, bool> > keys(
+        Mappings.size());
+    for(size_t j = 0; j < Mappings.size(); j++) {
+	contexts[j] = Mappings[j].second.second;
+	keys[j] = std::make_pair(std::make_pair(MappingBases[j].first.first,
+	    MappingBases[j].second ? MappingBases[j].first.second + j :
+	    MappingBases[j].first.second - j), MappingBases[j].second);
     }
     
-    Log::debug() << "Max context is " << maxContext << std::endl;
+    // Find the nearest covering position on each side of every position, and
+    // whether all the covering positions on that side agree, in one sweep
+    // each.
+    std::vector<int64_t> sourcesR;
+    std::vector<bool> consistentR;
+    findCreditSources(contexts, keys, true, sourcesR, consistentR);
+    std::vector<int64_t> sourcesL;
+    std::vector<bool> consistentL;
+    findCreditSources(contexts, keys, false, sourcesL, consistentL);
         
     // We search the unmapped positions between the sentinel nodes, scanning
     // left-to-right.
@@ -310,87 +425,20 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
 	std::pair<std::pair<size_t,size_t>,bool> firstBaseR;
 	std::pair<std::pair<size_t,size_t>,bool> firstBaseL;
 	
-	contextMappedR = true;
-	contextMappedL = true;
-
-	// Starting at the unmapped position under consideration, scan leftward
-	// for contexts containing it
-	  
-	for(size_t j = creditCandidates[i] - 1; j + 1 > 1 && creditCandidates[i] - j < maxContext; j--) {
-	    
-	    // Find the first position containing creditCandidates[i] in its maximal
-	    // context
-	  
-	    if(firstR == -1) {
-		if(Mappings[j].second.second > creditCandidates[i] - j) {
-		    firstBaseR = MappingBases[j];
-		    firstR = j;
-		}
-		
-	    // Then continue to search left. If a position has creditCandidates[i]
-	    // in its right context we want to see if subsequent positions map to
-	    // the same place
-	    
-	    // Terminate the search at the first base found which no longer
-	    // has our base in its right context. It is not possible that a position
-	    // farther to the left has our base in its right context and continues
-	    // to map to the same place as before
-	    
-	    // TODO: prove rigorously that this is true
-		
-	    } else {
-		if(Mappings[j].second.second > creditCandidates[i] - j) {
-		    if(!MappingBases[j].second) {
-			centeredOffset = j - firstR;
-		    } else {
-			centeredOffset = firstR - j;
-		    }
-		    
-		    // Check if this other credit-providing position matches our "credit candidate"
-		    // to another position in the reference. If so terminate the search and don't
-		    // merge
-		    
-		    if(MappingBases[j].first.second != firstBaseR.first.second + centeredOffset ||
-			    MappingBases[j].second != firstBaseR.second ||
-			    MappingBases[j].first.first != firstBaseR.first.first) {
-			contextMappedR = false;
-			break;
-		    }
-		}
-	    }
+	// Find the first position to the left containing creditCandidates[i]
+	// in its maximal context, and see if every position that does maps to
+	// the same place.
+	firstR = sourcesR[creditCandidates[i]];
+	contextMappedR = consistentR[creditCandidates[i]];
+	if(firstR != -1) {
+	    firstBaseR = MappingBases[firstR];
 	}
 	
-	// Search rightward for left context
-	
-	for(size_t j = creditCandidates[i] + 1; j < Mappings.size() && j - creditCandidates[i] < maxContext; j++) {
-	    
-	    // What's the nearest position containing our candidate in its context?
-	  
-	    if(firstL == -1) {
-		if(Mappings[j].second.second > j - creditCandidates[i]) {
-		    firstBaseL = MappingBases[j];
-		    firstL = j;
-		}
-	    } else {
-	      
-		// Make sure our credit mapping is consistent
-		
-		if(Mappings[j].second.second > j - creditCandidates[i]) {
-		    if(!MappingBases[j].second) {
-			centeredOffset = j - firstL;
-		    } else {
-			centeredOffset = firstL - j;
-		    }
-		  
-		    if(MappingBases[j].first.second != firstBaseL.first.second + centeredOffset ||
-			  MappingBases[j].second != firstBaseL.second ||
-			  MappingBases[j].first.first != firstBaseL.first.first) {
-		    
-			contextMappedL = false;
-			break;
-		    }
-		}
-	    }
+	// And the same for the right.
+	firstL = sourcesL[creditCandidates[i]];
+	contextMappedL = consistentL[creditCandidates[i]];
+	if(firstL != -1) {
+	    firstBaseL = MappingBases[firstL];
 	}
 	
 	// Check if our position was credit mapped on the left, and if this mapping
@@ -406,7 +454,7 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
 			  firstBaseR.second != firstBaseL.second) {
 		  generateMerge(queryContig, creditCandidates[i] + 1, firstBaseR.first.first, 
                         firstBaseR.first.second, firstBaseR.second);
-		  Log::info() << "Left-Right Credit Merged pos " << creditCandidates[i] << ", a(n) " << contig[creditCandidates[i]] << " on contig " << queryContig << " to " << firstBaseR.first.second << " on contig " << firstBaseR.first.first << " with orientation " << firstBaseR.second << std::endl;
+		  Log::debug() << "Left-Right Credit Merged pos " << creditCandidates[i] << ", a(n) " << contig[creditCandidates[i]] << " on contig " << queryContig << " to " << firstBaseR.first.second << " on contig " << firstBaseR.first.first << " with orientation " << firstBaseR.second << std::endl;
 	    	  mappedBases++;
 		  unmappedBases--;
 		  creditBases++;
@@ -415,7 +463,7 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
 	    } else {
 		  generateMerge(queryContig, creditCandidates[i] + 1, firstBaseR.first.first, 
                         firstBaseR.first.second, firstBaseR.second);
-		  Log::info() << "Right Credit Merged pos " << creditCandidates[i] << ", a(n) " << contig[creditCandidates[i]] << " on contig " << queryContig << " to " << firstBaseR.first.second << " on contig " << firstBaseR.first.first << " with orientation " << firstBaseR.second << std::endl;
+		  Log::debug() << "Right Credit Merged pos " << creditCandidates[i] << ", a(n) " << contig[creditCandidates[i]] << " on contig " << queryContig << " to " << firstBaseR.first.second << " on contig " << firstBaseR.first.first << " with orientation " << firstBaseR.second << std::endl;
 		  mappedBases++;
 		  unmappedBases--;
 		  creditBases++;
@@ -425,15 +473,12 @@ void MappingMergeScheme::CgenerateMerges(size_t queryContig) const {
 	    firstBaseL.first.second = firstBaseL.first.second + creditCandidates[i] - firstL;
 	    generateMerge(queryContig, creditCandidates[i] + 1, firstBaseL.first.first, 
                         firstBaseL.first.second, firstBaseL.second);
-	    Log::info() << "Left Credit Merged pos " << creditCandidates[i] << ", a(n) " << contig[creditCandidates[i]] << " on contig " << queryContig << " to " << firstBaseL.first.second << " on contig " << firstBaseL.first.first << " with orientation " << firstBaseL.second << std::endl;
+	    Log::debug() << "Left Credit Merged pos " << creditCandidates[i] << ", a(n) " << contig[creditCandidates[i]] << " on contig " << queryContig << " to " << firstBaseL.first.second << " on contig " << firstBaseL.first.first << " with orientation " << firstBaseL.second << std::endl;
 	    mappedBases++;
 	    unmappedBases--;
 	    creditBases++;
 	  
 	}
-	
-	firstR = -1;
-	firstL = -1;
 		
     }
     
@@ -454,6 +499,8 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
     // What's our thread name?
     std::string threadName = "T" + std::to_string(genome) + "." + 
         std::to_string(queryContig);
+    Trace::nameThread(threadName);
+    TraceSpan span("map contig " + std::to_string(queryContig));
         
     // How many bases have we mapped or not mapped
     size_t mappedBases = 0;
@@ -468,7 +515,7 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
     
     // How many positions are available to map to?
     Log::info() << threadName << " mapping " << contig.size() << 
-        " bases via " << BitVectorIterator(includedPositions).rank(
+        " bases via " << includedPositions.rank(
         includedPositions.getSize()) << " bottom-level positions" << std::endl;
     
     std::vector<std::pair<int64_t,size_t>> rightMappings;
@@ -500,8 +547,9 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
     // other-side ranges.
     std::reverse(leftMappings.begin(), leftMappings.end());
     
-    int64_t leftSentinel;
-    int64_t rightSentinel;
+    // If there aren't suitable sentinels, nothing is between them.
+    int64_t leftSentinel = leftMappings.size();
+    int64_t rightSentinel = 0;
     std::vector<size_t> creditCandidates;
     
     for(size_t i = 0; i < leftMappings.size(); i++) {
@@ -541,7 +589,7 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
     }
 
     
-    Log::info() << "Left sentinel is " << leftSentinel << ", right sentinel is " << rightSentinel << std::endl;
+    Log::debug() << "Left sentinel is " << leftSentinel << ", right sentinel is " << rightSentinel << std::endl;
     
     // Now identify and merged mapped bases from the individual left and
     // right mappings
@@ -577,7 +625,7 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
                     generateMerge(queryContig, i + 1, leftBase.first.first, 
                         leftBase.first.second, !leftBase.second);
 		    
-		    Log::info() << "Anchor Merged pos " << i << ", a(n) " << contig[i]
+		    Log::debug() << "Anchor Merged pos " << i << ", a(n) " << contig[i]
 			<< " on contig " << queryContig << " to " << leftBase.first.second
 			<< " on contig " << leftBase.first.first << " with orientation "
 			<< !leftBase.second << std::endl;
@@ -590,7 +638,7 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
 		    if(i > leftSentinel && rightSentinel > i) {
 			creditCandidates.push_back(i);
 		    }
-		    Log::info() << "Conflicted " << i << " " << contig[i] << std::endl;
+		    Log::debug() << "Conflicted " << i << " " << contig[i] << std::endl;
                 }
                 
             } else {
@@ -601,7 +649,7 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
                 // right-semantics, so flip it.
                 generateMerge(queryContig, i + 1, leftBase.first.first, 
                         leftBase.first.second, !leftBase.second);
-		Log::info() << "Anchor Merged pos " << i << ", a(n) " << contig[i]
+		Log::debug() << "Anchor Merged pos " << i << ", a(n) " << contig[i]
 		    << " on contig " << queryContig << " to " << leftBase.first.second
 		    << " on contig " << leftBase.first.first << " with orientation "
 		    << !leftBase.second << std::endl;
@@ -620,7 +668,7 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
             // (since it's backwards to start with).
             generateMerge(queryContig, i + 1, rightBase.first.first, 
                         rightBase.first.second, rightBase.second);
-	    Log::info() << "Anchor Merged pos " << i << ", a(n) " << contig[i] << " on contig " << queryContig << " to " << rightBase.first.second << " on contig " << rightBase.first.first << " with orientation " << rightBase.second << std::endl;
+	    Log::debug() << "Anchor Merged pos " << i << ", a(n) " << contig[i] << " on contig " << queryContig << " to " << rightBase.first.second << " on contig " << rightBase.first.first << " with orientation " << rightBase.second << std::endl;
             
             mappedBases++; 
         } else {
@@ -645,77 +693,60 @@ void MappingMergeScheme::generateMerges(size_t queryContig) const {
     std::pair<std::pair<size_t,size_t>,bool> firstBaseL;    
     int64_t LROffset;
     
-    size_t maxRContext = 0;
-    size_t maxLContext = 0;
-    
     Log::info() << "Checking " << creditCandidates.size() << " unmapped positions \"in the middle\"" << std::endl;
     
-    // Scan for the maximum 
-    
-    for(size_t i; i < rightMappings.size(); i++) {
-	if(rightMappings[i].second > maxRContext) {
-	    maxRContext = rightMappings[i].second;
+    // Right contexts cover bases to their right, and agree if they map along
+    // the same diagonal running backwards. Left contexts cover bases to their
+    // left, and agree along the same diagonal running forwards.
+    std::vector<size_t> contextsR(rightMappings.size());
+    std::vector<std::pair<std::pair<size_t, size_t>, bool> > keysR(
+        rightMappings.size());
+    std::vector<size_t> contextsL(leftMappings.size());
+    std::vector<std::pair<std::pair<size_t, size_t>, bool> > keysL(
+        leftMappings.size());
+    for(size_t j = 0; j < rightMappings.size(); j++) {
+	if(rightMappings[j].first != -1) {
+	    auto base = rangeBases[rightMappings[j].first];
+	    contextsR[j] = rightMappings[j].second;
+	    keysR[j] = std::make_pair(std::make_pair(base.first.first,
+		base.first.second + j), base.second);
 	}
-	if(leftMappings[i].second > maxLContext) {
-	    maxLContext = leftMappings[i].second;
+	if(leftMappings[j].first != -1) {
+	    auto base = rangeBases[leftMappings[j].first];
+	    contextsL[j] = leftMappings[j].second;
+	    keysL[j] = std::make_pair(std::make_pair(base.first.first,
+		base.first.second - j), base.second);
 	}
     }
+    
+    // Find the nearest covering position on each side of every position, and
+    // whether all the covering positions on that side agree, in one sweep
+    // each.
+    std::vector<int64_t> sourcesR;
+    std::vector<bool> consistentR;
+    findCreditSources(contextsR, keysR, true, sourcesR, consistentR);
+    std::vector<int64_t> sourcesL;
+    std::vector<bool> consistentL;
+    findCreditSources(contextsL, keysL, false, sourcesL, consistentL);
         
     for(size_t i = 0; i < creditCandidates.size(); i++) {
-	firstR = -1;
-	firstL = -1;
-	contextMappedR = true;
-	contextMappedL = true;
 	firstBaseL = std::make_pair(std::make_pair(0,0),0);
 	firstBaseR = std::make_pair(std::make_pair(0,0),0);
 	
-	for(size_t j = creditCandidates[i] - 1; j > 0 && creditCandidates[i] - j < maxRContext; j--) {
-	    // Search leftward from each position until you find a position
-	    // whose context includes creditCandidates[i]
-	  
-	    if(firstR == -1) {
-		if(rightMappings[j].second > creditCandidates[i] - j) {
-		    firstBaseR = rangeBases[rightMappings[j].first];
-		    firstR = j;
-		}
-		
-	    // Then continue to search left. If a position has creditCandidates[i]
-	    // in its right context we want to see if subsequent positions map to
-	    // the same place
-	    
-	    // Terminate the search at the first base you come to which no longer
-	    // has our base in its right context. It is not possible that a position
-	    // farther to the left has our base in its right context and continues
-	    // to map to the same place as before
-		
-	    } else {
-		if(rightMappings[j].second > creditCandidates[i] - j) {
-		    if(rangeBases[rightMappings[j].first].first.second != firstBaseR.first.second  + firstR - j ||
-			    rangeBases[rightMappings[j].first].second != firstBaseR.second ||
-			    rangeBases[rightMappings[j].first].first.first != firstBaseR.first.first) {
-			contextMappedR = false;
-			break;
-		    }
-		}
-	    }
+	// Find the first position to the left whose right context includes
+	// creditCandidates[i], and see if all the ones that do map to the same
+	// place.
+	firstR = sourcesR[creditCandidates[i]];
+	contextMappedR = consistentR[creditCandidates[i]];
+	if(firstR != -1) {
+	    firstBaseR = rangeBases[rightMappings[firstR].first];
 	}
 	
-	for(size_t j = creditCandidates[i] + 1; j < leftMappings.size() && j - creditCandidates[i] < maxLContext; j++) {
-	    if(firstL == -1) {
-		if(leftMappings[j].second > j - creditCandidates[i]) {
-		    firstBaseL = rangeBases[leftMappings[j].first];
-		    firstL = j;
-		}
-	    } else {
-		if(leftMappings[j].second > j - creditCandidates[i]) {
-		    if(rangeBases[leftMappings[j].first].first.second != firstBaseL.first.second + j - firstL ||
-			    rangeBases[leftMappings[j].first].second != firstBaseL.second ||
-			    rangeBases[leftMappings[j].first].first.first != firstBaseL.first.first) {
-			contextMappedL = false;
-			break;
-		    }
-		}
-	    }
+	// And the same for left contexts to the right.
+	firstL = sourcesL[creditCandidates[i]];
+	contextMappedL = consistentL[creditCandidates[i]];
+	if(firstL != -1) {
+	    firstBaseL = rangeBases[leftMappings[firstL].first];
 	}
 			    
 	if(firstR != -1 && contextMappedR) {
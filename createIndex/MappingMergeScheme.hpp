@@ -3,6 +3,8 @@
 
 #include <thread>
 #include <vector>
+#include <utility>
+#include <cstdint>
 
 #include "MergeScheme.hpp"
 
@@ -100,6 +102,29 @@ protected:
     void generateMerge(size_t queryContig, size_t queryBase, 
         size_t referenceContig, size_t referenceBase, bool orientation) const;
     
+    /**
+     * Find, for every position in a contig, the nearest position on one side
+     * whose mapped context covers it, for mapping on credit. Position j covers
+     * position c if it is within contexts[j] - 1 bases of it, on the side
+     * being searched. Covering positions agree if they have the same key,
+     * which should identify the contig, orientation, and diagonal of their
+     * mapping.
+     *
+     * If leftward is true, looks for covering positions to the left of each
+     * position (which provide right context), not counting position 0.
+     * Otherwise looks to the right.
+     *
+     * Fills sources with the nearest covering position, or -1 if there is
+     * none, and consistent with whether all covering positions on that side
+     * share a key. Runs in one linear sweep, keeping the covering positions in
+     * a monotone stack, and the ones still covering in a list that counts
+     * how many neighbors disagree.
+     */
+    static void findCreditSources(const std::vector<size_t>& contexts,
+        const std::vector<std::pair<std::pair<size_t, size_t>, bool> >& keys,
+        bool leftward, std::vector<int64_t>& sources,
+        std::vector<bool>& consistent);
+    
     /**
      * Run as a thread. Generates merges by mapping a query contig to the target
      * genome; left-right exact contexts
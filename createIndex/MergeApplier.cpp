@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include <Log.hpp>
+#include <Trace.hpp>
 
 #include "MergeApplier.hpp"
 
@@ -17,6 +18,10 @@ void MergeApplier::join() {
 }
 
 void MergeApplier::run() {
+    // Show the whole time we spend applying merges on the timeline.
+    Trace::nameThread("MergeApplier");
+    TraceSpan span("applyMerges");
+    
     // OK, do the actual merging.
     
     while(true) {
@@ -0,0 +1,419 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include <Log.hpp>
+
+#include "MergeCheckpoint.hpp"
+
+MergeCheckpoint::MergeCheckpoint(std::string directory): directory(directory),
+    round(0), settings(), fastas(), bwtLength(0), contigs(), blocks() {
+
+    // Read the manifest one line at a time. Every line is a key, a tab, and a
+    // value.
+    std::ifstream manifest((directory + "/manifest").c_str());
+    if(!manifest.good()) {
+        throw std::runtime_error("Could not open checkpoint manifest in " +
+            directory);
+    }
+
+    std::string line;
+    while(std::getline(manifest, line)) {
+        // Split off the key.
+        size_t tab = line.find('\t');
+        if(tab == std::string::npos) {
+            // Skip anything malformed, like blank lines.
+            continue;
+        }
+        std::string key = line.substr(0, tab);
+        std::string value = line.substr(tab + 1);
+
+        if(key == "round") {
+            round = std::stoull(value);
+        } else if(key == "settings") {
+            settings = value;
+        } else if(key == "fasta") {
+            // FASTA filenames can have spaces, so take the whole rest of the
+            // line.
+            fastas.push_back(value);
+        } else if(key == "bwt") {
+            bwtLength = std::stoll(value);
+        } else if(key == "contig") {
+            // Contig names never have whitespace in them.
+            std::stringstream contigData(value);
+            std::string name;
+            size_t length;
+            contigData >> name;
+            contigData >> length;
+            contigs.push_back(std::make_pair(name, length));
+        }
+    }
+    manifest.close();
+
+    // Now load all the blocks in one go.
+    std::ifstream blockStream((directory + "/blocks.bin").c_str(),
+        std::ios::binary | std::ios::ate);
+    if(!blockStream.good()) {
+        throw std::runtime_error("Could not open checkpoint blocks in " +
+            directory);
+    }
+
+    // The file is nothing but int64_ts, so we know how many there are from the
+    // size.
+    size_t fileSize = blockStream.tellg();
+    blocks.resize(fileSize / sizeof(int64_t));
+    blockStream.seekg(0);
+    blockStream.read((char*)blocks.data(), blocks.size() * sizeof(int64_t));
+    if(!blockStream.good()) {
+        throw std::runtime_error("Could not read checkpoint blocks in " +
+            directory);
+    }
+    blockStream.close();
+
+    Log::info() << "Loaded checkpoint for round " << round << " with " <<
+        contigs.size() << " contigs" << std::endl;
+}
+
+/**
+ * Make sure the given output stream, which has been closed, wrote everything.
+ * Throws an exception naming the file if it didn't.
+ */
+static void checkWritten(const std::ofstream& stream,
+    const std::string& filename) {
+    if(stream.fail()) {
+        throw std::runtime_error("Could not write checkpoint file " +
+            filename);
+    }
+}
+
+/**
+ * Make sure the given file or directory is on disk, so it survives a crash.
+ */
+static void syncToDisk(const std::string& path) {
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if(descriptor == -1) {
+        throw std::runtime_error("Could not open " + path + " to sync it");
+    }
+    int result = fsync(descriptor);
+    close(descriptor);
+    if(result != 0) {
+        throw std::runtime_error("Could not sync " + path + " to disk");
+    }
+}
+
+/**
+ * Make sure the given input stream opened, or throw an exception naming the
+ * file.
+ */
+static void checkOpened(const std::ifstream& stream,
+    const std::string& filename) {
+    if(!stream.good()) {
+        throw std::runtime_error("Could not open checkpoint file " +
+            filename);
+    }
+}
+
+void MergeCheckpoint::save(std::string directory, size_t round,
+    const std::string& settings, const std::vector<std::string>& fastas,
+    const FMDIndex& index, stPinchThreadSet* threadSet,
+    const BitVector& includedPositions,
+    const std::pair<BitVector*, std::vector<std::pair<std::pair<size_t,
+    size_t>, bool> > >& mergedRuns) {
+
+    Log::info() << "Saving checkpoint for round " << round << "..." <<
+        std::endl;
+
+    // We write everything to a temporary directory first, so a crash part way
+    // through never leaves a half-written checkpoint in place.
+    std::string tempDirectory = directory + ".tmp";
+    if(boost::filesystem::exists(tempDirectory)) {
+        boost::filesystem::remove_all(tempDirectory);
+    }
+    boost::filesystem::create_directory(tempDirectory);
+
+    // Write all the blocks. Bare segments are implied by the contigs.
+    std::string blockFile = tempDirectory + "/blocks.bin";
+    std::ofstream blockStream(blockFile.c_str(), std::ios::binary);
+
+    // Buffer up each block so we only call write once per block.
+    std::vector<int64_t> blockData;
+
+    stPinchThreadSetBlockIt blockIterator = stPinchThreadSet_getBlockIt(
+        threadSet);
+    stPinchBlock* block;
+    while((block = stPinchThreadSetBlockIt_getNext(&blockIterator)) != NULL) {
+        // For each block, say how long it is and how many segments it has.
+        blockData.clear();
+        blockData.push_back(stPinchBlock_getLength(block));
+        blockData.push_back(stPinchBlock_getDegree(block));
+
+        stPinchBlockIt segmentIterator = stPinchBlock_getSegmentIterator(block);
+        stPinchSegment* segment;
+        while((segment = stPinchBlockIt_getNext(&segmentIterator)) != NULL) {
+            // Then say where each segment is and which way it goes.
+            blockData.push_back(stPinchSegment_getName(segment));
+            blockData.push_back(stPinchSegment_getStart(segment));
+            blockData.push_back(stPinchSegment_getBlockOrientation(segment));
+        }
+
+        blockStream.write((const char*)blockData.data(),
+            blockData.size() * sizeof(int64_t));
+    }
+    blockStream.close();
+    checkWritten(blockStream, blockFile);
+
+    // Save the included positions mask.
+    std::string maskFile = tempDirectory + "/mask.bin";
+    std::ofstream maskStream(maskFile.c_str(), std::ios::binary);
+    includedPositions.writeTo(maskStream);
+    maskStream.close();
+    checkWritten(maskStream, maskFile);
+
+    // Save the merged runs: first the range vector...
+    std::string vectorFile = tempDirectory + "/vector.bin";
+    std::ofstream vectorStream(vectorFile.c_str(), std::ios::binary);
+    mergedRuns.first->writeTo(vectorStream);
+    vectorStream.close();
+    checkWritten(vectorStream, vectorFile);
+
+    // And then the canonical positions.
+    std::vector<int64_t> runData;
+    runData.reserve(mergedRuns.second.size() * 3);
+    for(auto canonicalized : mergedRuns.second) {
+        runData.push_back(canonicalized.first.first);
+        runData.push_back(canonicalized.first.second);
+        runData.push_back(canonicalized.second);
+    }
+    std::string runFile = tempDirectory + "/runs.bin";
+    std::ofstream runStream(runFile.c_str(), std::ios::binary);
+    runStream.write((const char*)runData.data(),
+        runData.size() * sizeof(int64_t));
+    runStream.close();
+    checkWritten(runStream, runFile);
+
+    // The manifest must never get to disk before the data it vouches for.
+    for(const std::string& file : {blockFile, maskFile, vectorFile, runFile}) {
+        syncToDisk(file);
+    }
+
+    // Write the manifest last, so a directory with a manifest has everything.
+    std::string manifestFile = tempDirectory + "/manifest";
+    std::ofstream manifest(manifestFile.c_str());
+    manifest << "round\t" << round << "\n";
+    manifest << "settings\t" << settings << "\n";
+    for(auto fasta : fastas) {
+        manifest << "fasta\t" << fasta << "\n";
+    }
+    manifest << "bwt\t" << index.getBWTLength() << "\n";
+    for(size_t i = 0; i < index.getNumberOfContigs(); i++) {
+        manifest << "contig\t" << index.getContigName(i) << "\t" <<
+            index.getContigLength(i) << "\n";
+    }
+    manifest.close();
+    checkWritten(manifest, manifestFile);
+    syncToDisk(manifestFile);
+    syncToDisk(tempDirectory);
+
+    // Swap the new checkpoint in for the old one. Move the old one aside
+    // rather than deleting it, so there is a complete checkpoint on disk at
+    // every moment.
+    std::string oldDirectory = directory + ".old";
+    if(boost::filesystem::exists(oldDirectory)) {
+        boost::filesystem::remove_all(oldDirectory);
+    }
+    if(boost::filesystem::exists(directory)) {
+        boost::filesystem::rename(directory, oldDirectory);
+    }
+    boost::filesystem::rename(tempDirectory, directory);
+
+    // Make the renames stick before we throw away the old checkpoint.
+    boost::filesystem::path parent = boost::filesystem::absolute(
+        directory).parent_path();
+    syncToDisk(parent.string());
+
+    if(boost::filesystem::exists(oldDirectory)) {
+        boost::filesystem::remove_all(oldDirectory);
+    }
+}
+
+/**
+ * Returns true if the given directory holds a completely written checkpoint.
+ */
+static bool isComplete(const std::string& directory) {
+    // The manifest is written last.
+    return boost::filesystem::exists(directory + "/manifest") &&
+        boost::filesystem::exists(directory + "/blocks.bin");
+}
+
+bool MergeCheckpoint::exists(std::string directory) {
+    return isComplete(directory) || isComplete(directory + ".tmp") ||
+        isComplete(directory + ".old");
+}
+
+void MergeCheckpoint::recover(std::string directory) {
+    std::string tempDirectory = directory + ".tmp";
+    std::string oldDirectory = directory + ".old";
+
+    // A complete temporary directory is the newest checkpoint, since saves
+    // clear it out before starting. Otherwise, if we crashed while swapping
+    // checkpoints, fall back on the old one.
+    std::string survivor = "";
+    if(isComplete(tempDirectory)) {
+        survivor = tempDirectory;
+    } else if(!isComplete(directory) && isComplete(oldDirectory)) {
+        survivor = oldDirectory;
+    }
+
+    if(survivor != "") {
+        Log::info() << "Recovering checkpoint from " << survivor << std::endl;
+        if(boost::filesystem::exists(directory)) {
+            boost::filesystem::remove_all(directory);
+        }
+        boost::filesystem::rename(survivor, directory);
+    }
+
+    // Whatever is left over was either half-written or superseded.
+    if(boost::filesystem::exists(tempDirectory)) {
+        boost::filesystem::remove_all(tempDirectory);
+    }
+    if(boost::filesystem::exists(oldDirectory)) {
+        boost::filesystem::remove_all(oldDirectory);
+    }
+}
+
+size_t MergeCheckpoint::getRound() const {
+    return round;
+}
+
+const std::string& MergeCheckpoint::getSettings() const {
+    return settings;
+}
+
+const std::vector<std::string>& MergeCheckpoint::getFastas() const {
+    return fastas;
+}
+
+bool MergeCheckpoint::matchesIndex(const FMDIndex& index) const {
+    // We need the same contigs and nothing else, in a BWT of the same size.
+    return index.getNumberOfContigs() == contigs.size() &&
+        index.getBWTLength() == bwtLength && extendsIndex(index);
+}
+
+bool MergeCheckpoint::extendsIndex(const FMDIndex& index) const {
+    if(index.getNumberOfContigs() < contigs.size()) {
+        // We had contigs that aren't there anymore.
+        return false;
+    }
+
+    for(size_t i = 0; i < contigs.size(); i++) {
+        if(index.getContigName(i) != contigs[i].first ||
+            index.getContigLength(i) != contigs[i].second) {
+
+            // This contig changed.
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MergeCheckpoint::restoreGraph(stPinchThreadSet* threadSet) const {
+
+    Log::info() << "Restoring pinch graph from checkpoint..." << std::endl;
+
+    // Walk through the saved blocks.
+    size_t i = 0;
+    while(i < blocks.size()) {
+        // Read the block header.
+        int64_t length = blocks[i];
+        int64_t degree = blocks[i + 1];
+        i += 2;
+
+        if(i + degree * 3 > blocks.size()) {
+            throw std::runtime_error("Truncated block in checkpoint " +
+                directory);
+        }
+
+        // Pinch every other segment against the first one.
+        stPinchThread* firstThread = stPinchThreadSet_getThread(threadSet,
+            blocks[i]);
+        int64_t firstStart = blocks[i + 1];
+        bool firstOrientation = blocks[i + 2];
+
+        for(int64_t j = 1; j < degree; j++) {
+            const int64_t* segment = &blocks[i + j * 3];
+            stPinchThread* thread = stPinchThreadSet_getThread(threadSet,
+                segment[0]);
+
+            // Segments go the same way if they have the same orientation in
+            // the block.
+            stPinchThread_pinch(firstThread, thread, firstStart, segment[1],
+                length, firstOrientation == (bool)segment[2]);
+        }
+
+        i += degree * 3;
+    }
+
+    // Re-pinching can leave extra boundaries where adjacent blocks were
+    // saved separately.
+    stPinchThreadSet_joinTrivialBoundaries(threadSet);
+}
+
+BitVector* MergeCheckpoint::loadMask() const {
+    return loadVector(directory + "/mask.bin");
+}
+
+BitVector* MergeCheckpoint::loadVector(const std::string& filename) {
+    std::ifstream stream(filename.c_str(), std::ios::binary);
+    checkOpened(stream, filename);
+    if(stream.peek() == std::ifstream::traits_type::eof()) {
+        throw std::runtime_error("Empty checkpoint file " + filename);
+    }
+
+    BitVector* vector = new BitVector(stream);
+    if(stream.fail()) {
+        delete vector;
+        throw std::runtime_error("Could not read checkpoint file " +
+            filename);
+    }
+    return vector;
+}
+
+std::pair<BitVector*, std::vector<std::pair<std::pair<size_t, size_t>,
+    bool> > > MergeCheckpoint::loadMergedRuns() const {
+
+    // Load the canonical positions first, which are triples of int64_ts, so
+    // nothing needs cleaning up if they are bad.
+    std::string runFile = directory + "/runs.bin";
+    std::ifstream runStream(runFile.c_str(), std::ios::binary |
+        std::ios::ate);
+    checkOpened(runStream, runFile);
+    size_t fileSize = runStream.tellg();
+    if(fileSize % (3 * sizeof(int64_t)) != 0) {
+        throw std::runtime_error("Truncated checkpoint file " + runFile);
+    }
+    std::vector<int64_t> runData(fileSize / sizeof(int64_t));
+    runStream.seekg(0);
+    runStream.read((char*)runData.data(), runData.size() * sizeof(int64_t));
+    if(runStream.fail()) {
+        throw std::runtime_error("Could not read checkpoint file " + runFile);
+    }
+    runStream.close();
+
+    std::vector<std::pair<std::pair<size_t, size_t>, bool> > mappings;
+    mappings.reserve(runData.size() / 3);
+    for(size_t i = 0; i + 2 < runData.size(); i += 3) {
+        mappings.push_back(std::make_pair(std::make_pair(runData[i],
+            runData[i + 1]), (bool)runData[i + 2]));
+    }
+
+    // Then load the range vector.
+    BitVector* ranges = loadVector(directory + "/vector.bin");
+
+    return std::make_pair(ranges, mappings);
+}
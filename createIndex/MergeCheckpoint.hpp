@@ -0,0 +1,166 @@
+#ifndef MERGECHECKPOINT_HPP
+#define MERGECHECKPOINT_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include <stPinchGraphs.h>
+
+#include <FMDIndex.hpp>
+#include <BitVector.hpp>
+
+/**
+ * A snapshot of the state of a greedy merge after some number of genomes have
+ * been merged in. Holds the pinch graph as a list of blocks with segment
+ * coordinates, and knows where to find the included-positions mask and the
+ * merged run level index that were saved along with it.
+ *
+ * A checkpoint lives in its own directory, which contains:
+ *
+ * manifest: text file with the round number, merge settings, FASTAs indexed,
+ * BWT length, and the name and length of every contig.
+ *
+ * blocks.bin: binary list of pinch blocks. For each block, its length and
+ * degree, then for each segment the contig number, 1-based start, and
+ * orientation in the block, all as int64_t.
+ *
+ * mask.bin: the included-positions BitVector.
+ *
+ * vector.bin and runs.bin: the merged run BitVector and the canonical ((contig,
+ * base), face) for each run, as int64_t triples.
+ *
+ * Checkpoints are written to <directory>.tmp, with the manifest last. The old
+ * checkpoint is then renamed to <directory>.old, the new one is renamed into
+ * place, and the old one is deleted. A crash at any point leaves at least one
+ * of the three directories complete, and recover() puts the newest complete
+ * one back in place.
+ */
+class MergeCheckpoint {
+
+public:
+    /**
+     * Load the checkpoint manifest and pinch blocks from the given directory.
+     * The mask and merged runs are not loaded until asked for.
+     */
+    MergeCheckpoint(std::string directory);
+
+    /**
+     * Save a checkpoint of the given greedy merge state to the given directory,
+     * replacing any checkpoint already there. round is the number of the last
+     * genome merged in, and settings is a string describing the merge options,
+     * which must match for a resume.
+     */
+    static void save(std::string directory, size_t round,
+        const std::string& settings, const std::vector<std::string>& fastas,
+        const FMDIndex& index, stPinchThreadSet* threadSet,
+        const BitVector& includedPositions,
+        const std::pair<BitVector*, std::vector<std::pair<std::pair<size_t,
+        size_t>, bool> > >& mergedRuns);
+
+    /**
+     * Returns true if there is a complete checkpoint in the given directory, or
+     * in the temporary or old directory a save was interrupted between.
+     */
+    static bool exists(std::string directory);
+
+    /**
+     * If a save into the given directory was interrupted, put the newest
+     * complete checkpoint back in the directory, and clean up the temporary and
+     * old directories. Must be called before loading a checkpoint that
+     * exists() reports.
+     */
+    static void recover(std::string directory);
+
+    /**
+     * Get the number of the last genome merged in when the checkpoint was made.
+     */
+    size_t getRound() const;
+
+    /**
+     * Get the merge settings string the checkpoint was made with.
+     */
+    const std::string& getSettings() const;
+
+    /**
+     * Get the FASTA files that were indexed when the checkpoint was made.
+     */
+    const std::vector<std::string>& getFastas() const;
+
+    /**
+     * Returns true if the given index has exactly the contigs and BWT the
+     * checkpoint was made against, so the saved mask and merged runs can be
+     * used as-is.
+     */
+    bool matchesIndex(const FMDIndex& index) const;
+
+    /**
+     * Returns true if the given index starts with all the contigs the
+     * checkpoint was made against, so that the pinch graph can be restored
+     * onto it, even if more genomes were added after them.
+     */
+    bool extendsIndex(const FMDIndex& index) const;
+
+    /**
+     * Re-apply all the saved pinch blocks to the given thread set, which must
+     * have been made with makeThreadSet on an index that this checkpoint
+     * extends.
+     */
+    void restoreGraph(stPinchThreadSet* threadSet) const;
+
+    /**
+     * Load the saved included-positions mask. The caller must delete it.
+     * Throws an exception if the file is missing or truncated.
+     */
+    BitVector* loadMask() const;
+
+    /**
+     * Load the saved merged runs. The caller must delete the BitVector.
+     * Throws an exception if the files are missing or truncated.
+     */
+    std::pair<BitVector*, std::vector<std::pair<std::pair<size_t, size_t>,
+        bool> > > loadMergedRuns() const;
+
+protected:
+    // Where is the checkpoint on disk?
+    std::string directory;
+
+    // What was the last genome merged in?
+    size_t round;
+
+    // What settings was the merge run with?
+    std::string settings;
+
+    // What FASTAs made up the index?
+    std::vector<std::string> fastas;
+
+    // How long was the BWT?
+    int64_t bwtLength;
+
+    // What were the names and lengths of all the contigs?
+    std::vector<std::pair<std::string, size_t> > contigs;
+
+    // Hold all the pinch block data as it was saved: for each block, its
+    // length, degree, and then (contig, start, orientation) for each segment.
+    std::vector<int64_t> blocks;
+
+    /**
+     * Load a saved BitVector from the given file, throwing an exception if it
+     * can't be read completely. The caller must delete it.
+     */
+    static BitVector* loadVector(const std::string& filename);
+
+private:
+    /**
+     * Disallow copying.
+     */
+    MergeCheckpoint(const MergeCheckpoint& other);
+
+    /**
+     * Disallow assignment.
+     */
+    MergeCheckpoint& operator=(const MergeCheckpoint& other);
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "OverlapMergeScheme.hpp"
 
 #include <Log.hpp>
+#include <Trace.hpp>
 
 OverlapMergeScheme::OverlapMergeScheme(const FMDIndex& index,
     size_t minContext): MergeScheme(index), threads(), queue(NULL), 
@@ -30,14 +31,14 @@ ConcurrentQueue<Merge>& OverlapMergeScheme::run() {
             "Called run() twice on a OverlapMergeScheme.");
     }
     
-    // Figure out how many threads to run. Let's do one per pair of genomes (not
-    // counting pairs of the same genome), because more threads is better.
+    // Figure out how many threads to run. Each genome gets a thread to map it
+    // to all the others at once, if there are any others.
     
     // TODO: If we scale to large numbers of genomes, this may make OS thread
     // limits angry, and we may have to sequence these somehow so we don't try
     // to run them all at once.
-    size_t threadCount = index.getNumberOfGenomes() * 
-        (index.getNumberOfGenomes() - 1);
+    size_t threadCount = index.getNumberOfGenomes() > 1 ?
+        index.getNumberOfGenomes() : 0;
     
     Log::info() << "Running Overlap merge on " << threadCount << " threads" <<
         std::endl;
@@ -45,21 +46,18 @@ ConcurrentQueue<Merge>& OverlapMergeScheme::run() {
     // Make the queue    
     queue = new ConcurrentQueue<Merge>(threadCount);
     
-    // Start some threads.
-    for(size_t i = 0; i < index.getNumberOfGenomes(); i++) {
-        for(size_t j = 0; j < index.getNumberOfGenomes(); j++) {
-            if(i == j) {
-                // Don't map genomes to themselves; that's silly.
-                continue;
-            }
-            
-            // Otherwise, for each pair of genomes in each order, start a thread
-            // to map the one to the other.
-            threads.push_back(std::thread(&OverlapMergeScheme::generateMerges,
-                this, i, j));
-        }
+    {
+        // Put its length on the timeline if we're tracing.
+        auto lock = queue->lock();
+        queue->traceAs("merge queue", lock);
     }
-
+    
+    for(size_t i = 0; i < threadCount; i++) {
+        // Start a thread to map each genome to all the others.
+        threads.push_back(std::thread(&OverlapMergeScheme::generateMerges,
+            this, i));
+    }
+    
     // Return a reference to it.
     return *queue;
     
@@ -80,17 +78,25 @@ void OverlapMergeScheme::join() {
     
 }
 
-void OverlapMergeScheme::generateMerges(size_t targetGenome,
-    size_t queryGenome) {
+void OverlapMergeScheme::generateMerges(size_t queryGenome) {
     
     // What's our thread name?
-    std::string threadName = "T" + std::to_string(queryGenome) + "->" + 
-        std::to_string(targetGenome);
+    std::string threadName = "T" + std::to_string(queryGenome) + "->*";
+    Trace::nameThread(threadName);
+    
+    // Which genomes do we map to? All the others.
+    std::vector<size_t> targetGenomes;
+    for(size_t i = 0; i < index.getNumberOfGenomes(); i++) {
+        if(i != queryGenome) {
+            // Don't map genomes to themselves; that's silly.
+            targetGenomes.push_back(i);
+        }
+    }
     
     // Now we just have to generate some merges by mapping each contig in the
-    // query to the target, and write them to the queue.
+    // query to the targets, and write them to the queue.
     
-    // Keep track of total bases mapped and unmapped
+    // Keep track of total bases mapped and unmapped, summed over targets
     size_t basesMapped = 0;
     size_t basesUnmapped = 0;
     
@@ -106,6 +112,7 @@ void OverlapMergeScheme::generateMerges(size_t targetGenome,
     
     for(size_t i = contigRange.first; i < contigRange.second; i++) {
         Log::debug() << threadName << " mapping contig " << i << std::endl;
+        TraceSpan span("map contig " + std::to_string(i));
         
         // Keep track of mapped and unmapped bases per contig.
         size_t basesMappedInContig = 0;
@@ -114,34 +121,40 @@ void OverlapMergeScheme::generateMerges(size_t targetGenome,
         // Grab each contig as a string
         std::string contig = index.displayContig(i);
         
-        // Map it to the target genome in both orientations, with a minimum
-        // context as specified when we were constructed, and disambiguate.
-        std::vector<Mapping> mappings = index.mapBoth(contig, targetGenome,
-            minContext);
+        // Map it to all the target genomes in both orientations, with a
+        // minimum context as specified when we were constructed, and
+        // disambiguate. The searches for different targets are shared
+        // wherever they agree.
+        std::vector<std::vector<Mapping>> targetMappings = index.mapBoth(
+            contig, targetGenomes, minContext);
         
-        for(size_t base = 0; base < mappings.size(); base++) {
-            // For each base that we tried to map
-            
-            if(!mappings[base].is_mapped) {
-                // Skip the unmapped ones
-                basesUnmappedInContig++;
-                continue;
+        for(const std::vector<Mapping>& mappings : targetMappings) {
+            for(size_t base = 0; base < mappings.size(); base++) {
+                // For each base that we tried to map to each target
+                
+                if(!mappings[base].is_mapped) {
+                    // Skip the unmapped ones
+                    basesUnmappedInContig++;
+                    continue;
+                }
+                
+                // If we get here, we mapped a base.
+                basesMappedInContig++;
+                Log::debug() << threadName << " mapped base " << base <<
+                    std::endl;
+                
+                // Produce a merge between the base we're looking at on the
+                // forward strand of this contig, and the location (and strand)
+                // it mapped to in the other genome.
+                Merge merge(TextPosition(i * 2, base),
+                    mappings[base].location);
+                
+                // Send that merge to the queue.
+                // Lock the queue.
+                auto lock = queue->lock();
+                // Spend our lock to add something to it.
+                queue->enqueue(merge, lock);
             }
-            
-            // If we get here, we mapped a base.
-            basesMappedInContig++;
-            Log::debug() << threadName << " mapped base " << base << std::endl;
-            
-            // Produce a merge between the base we're looking at on the forward
-            // strand of this contig, and the location (and strand) it mapped to
-            // in the other genome.
-            Merge merge(TextPosition(i * 2, base), mappings[base].location);
-            
-            // Send that merge to the queue.
-            // Lock the queue.
-            auto lock = queue->lock();
-            // Spend our lock to add something to it.
-            queue->enqueue(merge, lock);
         }
         
         // Put bases from this contig into total stats
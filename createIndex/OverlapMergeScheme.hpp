@@ -61,9 +61,11 @@ protected:
     
     /**
      * Run as a thread. Generates merges by mapping the contigs of the query
-     * genome to the target genome.
+     * genome to every other genome. Each target gets its own search, but the
+     * searches for a contig run together and share the extensions they have
+     * in common.
      */
-    virtual void generateMerges(size_t targetGenome, size_t queryGenome);
+    virtual void generateMerges(size_t queryGenome);
     
 };
 
@@ -8,8 +8,12 @@
 #include <utility>
 #include <ctime>
 #include <csignal>
+#include <pthread.h>
 #include <iterator>
 #include <cstdint> 
+#include <thread>
+#include <exception>
+#include <cctype>
 #include <sys/resource.h>
 
 
@@ -27,8 +31,10 @@
 #include <TextPosition.hpp>
 #include <util.hpp>
 #include <Mapping.hpp>
-#include <SmallSide.hpp>
+#include <LevelIndex.hpp>
 #include <Log.hpp>
+#include <MemoryReport.hpp>
+#include <Trace.hpp>
 
 // Grab timers from libsuffixtools
 #include <Timer.h>
@@ -39,6 +45,10 @@
 #include "OverlapMergeScheme.hpp"
 #include "MappingMergeScheme.hpp"
 #include "MergeApplier.hpp"
+#include "MergeCheckpoint.hpp"
+#include "CanonicalTable.hpp"
+#include "AlignmentWriter.hpp"
+#include "Benchmark.hpp"
 
 
 // TODO: replace with cppunit!
@@ -95,10 +105,127 @@ void logMemory() {
 }
 
 /**
- * Signal handler to exit with exit(), preserving gprof profiling data if
- * applicable.
+ * Estimate the memory used by the given pinch thread set, which can't tell us
+ * itself, from how many threads, segments and blocks it has.
  */
-void exitOnSignal(int signalNumber) {
+MemoryReport
+reportPinchMemory(
+    stPinchThreadSet* threadSet
+) {
+    // About how big is each thing, with allocator overhead? Segments also
+    // have an entry in their thread's sorted set.
+    const size_t THREAD_BYTES = 64;
+    const size_t SEGMENT_BYTES = 104;
+    const size_t BLOCK_BYTES = 48;
+
+    size_t threads = 0;
+    size_t segments = 0;
+    stPinchThreadSetIt threadIterator = stPinchThreadSet_getIt(threadSet);
+    stPinchThread* thread;
+    while((thread = stPinchThreadSetIt_getNext(&threadIterator)) != NULL) {
+        threads++;
+        for(stPinchSegment* segment = stPinchThread_getFirst(thread);
+            segment != NULL; segment = stPinchSegment_get3Prime(segment)) {
+
+            segments++;
+        }
+    }
+
+    MemoryReport report;
+    report.add("threads", threads * THREAD_BYTES);
+    report.add("segments", segments * SEGMENT_BYTES);
+    report.add("blocks", stPinchThreadSet_getTotalBlockNumber(threadSet) *
+        BLOCK_BYTES);
+    return report;
+}
+
+/**
+ * Log what the given structures are using at the end of the given phase, and
+ * what the system says we are using. If a budget is given (nonzero), complain
+ * if the structures are over it. Returns true if they are.
+ */
+bool
+logPhaseMemory(
+    std::string phase,
+    const MemoryReport& report,
+    size_t budget = 0
+) {
+    report.log("Memory used after " + phase);
+    logMemory();
+
+    if(budget != 0 && report.getTotal() > budget) {
+        Log::error() << "Using " << report.getTotal() << " bytes after " <<
+            phase << ", over the budget of " << budget << std::endl;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Log memory use at the end of the given phase, like logPhaseMemory. If the
+ * structures are over the budget, drop the index's full suffix array, if it
+ * still has one, since that is by far the biggest thing we can do without.
+ * Locating is slower from then on.
+ */
+void
+fitMemoryBudget(
+    std::string phase,
+    const MemoryReport& report,
+    FMDIndex& index,
+    size_t budget
+) {
+    if(logPhaseMemory(phase, report, budget) &&
+        index.dropFullSuffixArray() > 0) {
+        
+        logPhaseMemory("dropping the full suffix array", index.reportMemory(),
+            budget);
+    }
+}
+
+/**
+ * Parse a number of bytes, like "500000", "200M" or "64G", with an optional
+ * (binary) K, M, G or T suffix. Throws std::runtime_error if it can't.
+ */
+size_t
+parseByteCount(
+    std::string text
+) {
+    // How far did the number go?
+    size_t used = 0;
+    size_t bytes;
+    try {
+        bytes = std::stoull(text, &used);
+    } catch(std::exception& error) {
+        throw std::runtime_error("Not a number of bytes: " + text);
+    }
+
+    std::string suffix = text.substr(used);
+    const std::string suffixes = "KMGT";
+    if(suffix.size() == 1 && suffixes.find(toupper(suffix[0])) !=
+        std::string::npos) {
+        // Scale by 1024 for every step up the list.
+        for(size_t i = 0; i <= suffixes.find(toupper(suffix[0])); i++) {
+            bytes *= 1024;
+        }
+    } else if(suffix != "") {
+        throw std::runtime_error("Not a number of bytes: " + text);
+    }
+
+    return bytes;
+}
+
+/**
+ * Wait in a thread of its own for one of the given signals, and then exit with
+ * exit(), saving the trace timeline if applicable. This is not a signal
+ * handler, so logging and the exit handlers can safely take locks.
+ */
+void exitOnSignal(sigset_t signals) {
+    int signalNumber;
+    if(sigwait(&signals, &signalNumber) != 0) {
+        // We can't wait, so let the signals go unhandled.
+        return;
+    }
+
     // Log the signal.
     Log::info() << "Exiting on signal " << signalNumber << std::endl;
     
@@ -126,17 +253,45 @@ getArrow(
 /**
  * Start a new index in the given directory (by replacing it), and index the
  * given FASTAs for the bottom level FMD index. Optionally takes a suffix array
- * sample rate to use. Returns the basename of the FMD index that gets created.
+ * sample rate to use, an inverse suffix array sample rate (or 0 to not
+ * sample the inverse suffix array), whether to build an LCP array so
+ * mapping can contract searches instead of restarting them, whether to build
+ * a table of how much context each position needs to be unique in its genome,
+ * and whether to save the full suffix array for fast locating. Returns the
+ * basename of the FMD index that gets created.
+ *
+ * If keep is nonempty, that entry in the index directory (e.g. a checkpoint) is
+ * left in place, and everything else is replaced.
  */
 FMDIndex*
 buildIndex(
     std::string indexDirectory,
     std::vector<std::string> fastas,
-    int sampleRate = 128
+    int sampleRate = 128,
+    size_t isaSampleRate = 0,
+    bool buildLCP = false,
+    bool buildContexts = false,
+    bool saveSuffixArray = false,
+    std::string keep = ""
 ) {
 
+    TraceSpan span("buildIndex");
+
     // Make sure an empty indexDirectory exists.
-    if(boost::filesystem::exists(indexDirectory)) {
+    if(boost::filesystem::exists(indexDirectory) && keep != "") {
+        // Get rid of everything in it except what we want to keep.
+        std::vector<boost::filesystem::path> toRemove;
+        for(boost::filesystem::directory_iterator i(indexDirectory); 
+            i != boost::filesystem::directory_iterator(); ++i) {
+            
+            if(i->path().filename() != keep) {
+                toRemove.push_back(i->path());
+            }
+        }
+        for(auto path : toRemove) {
+            boost::filesystem::remove_all(path);
+        }
+    } else if(boost::filesystem::exists(indexDirectory)) {
         // Get rid of it if it exists already.
         boost::filesystem::remove_all(indexDirectory);
     }
@@ -148,8 +303,10 @@ buildIndex(
     // Work out its basename
     std::string basename(indexDirectory + "/index.basename");
 
-    // Make a new builder
-    FMDIndexBuilder builder(basename, sampleRate);
+    // Make a new builder. Pack the contig text so merge schemes can get at it
+    // without walking the BWT.
+    FMDIndexBuilder builder(basename, sampleRate, true, isaSampleRate,
+        buildLCP, buildContexts, saveSuffixArray);
     for(std::vector<std::string>::iterator i = fastas.begin(); i < fastas.end();
         ++i) {
         
@@ -191,13 +348,19 @@ makeThreadSet(
  * 
  * If a context is specified, will not merge on fewer than that many bases of
  * context on a side, whether there is a unique mapping or not.
+ *
+ * If a memory budget is specified (nonzero), and the merge leaves us over it,
+ * drops the index's full suffix array.
  */
 stPinchThreadSet*
 mergeOverlap(
-    const FMDIndex& index,
-    size_t context = 0
+    FMDIndex& index,
+    size_t context = 0,
+    size_t memoryBudget = 0
 ) {
 
+    TraceSpan span("mergeOverlap");
+
     Log::info() << "Creating initial pinch thread set" << std::endl;
     
     // Make a thread set from our index.
@@ -220,11 +383,21 @@ mergeOverlap(
     Log::output() << "Before joining boundaries:" << std::endl;
     Log::output() << "Pinch Blocks: " <<
         stPinchThreadSet_getTotalBlockNumber(threadSet) << std::endl;
-    logMemory();
+    {
+        auto lock = queue.lock();
+        Log::output() << "Merge queue peaked at " << queue.getPeakBytes(lock) <<
+            " bytes" << std::endl;
+    }
+    MemoryReport memory;
+    memory.add("index", index.reportMemory());
+    memory.add("pinchGraph", reportPinchMemory(threadSet));
+    fitMemoryBudget("overlap merging", memory, index, memoryBudget);
     
     // Now GC the boundaries in the pinch set
     Log::info() << "Joining trivial boundaries..." << std::endl;
+    TraceSpan joinSpan("joinTrivialBoundaries");
     stPinchThreadSet_joinTrivialBoundaries(threadSet);
+    joinSpan.finish();
     
     // Write a similar report afterwards.
     Log::output() << "After joining boundaries:" << std::endl;
@@ -237,146 +410,6 @@ mergeOverlap(
 
 }
 
-/**
- * Turn the given (contig number, 1-based offset from start, orientation)
- * position into the same sort of structure for the canonical base that
- * represents all the bases it has been pinched with.
- */
-std::pair<std::pair<size_t, size_t>, bool>
-canonicalize(
-    stPinchThreadSet* threadSet, 
-    size_t contigNumber,
-    size_t offset,
-    bool strand
-) {
-    
-    Log::debug() << "Canonicalizing " << contigNumber << ":" << offset << 
-        "." << strand << std::endl;
-        
-    // Now we need to look up what the pinch set says is the canonical
-    // position for this base, and what orientation it should be in. All the
-    // bases in this range have the same context and should thus all be
-    // pointing to the canonical base's replacement.
-    
-    // Get the segment (using the 1-based position).
-    stPinchSegment* segment = stPinchThreadSet_getSegment(threadSet, 
-        contigNumber, offset);
-        
-    if(segment == NULL) {
-        throw std::runtime_error("Found position in null segment!");
-    }
-        
-    // How is it oriented in its block?
-    bool segmentOrientation = stPinchSegment_getBlockOrientation(segment);
-    // How far into the segment are we? 0-based, from subtracting 1-based
-    // positions.
-    size_t segmentOffset = offset - stPinchSegment_getStart(segment);
-        
-    // Get the first segment in the segment's block, or just this segment if
-    // it isn't in a block.
-    stPinchSegment* firstSegment = segment;
-    
-    // Get the block that that segment is in
-    stPinchBlock* block = stPinchSegment_getBlock(segment);
-    if(block != NULL) {
-        // Put the first segment in the block as the canonical segment.
-        firstSegment = stPinchBlock_getFirst(block);
-    }
-    
-    // Work out what the official contig number for this block is (the name
-    // of the first segment).
-    size_t canonicalContig = stPinchSegment_getName(firstSegment);
-    // How should it be oriented?
-    bool canonicalOrientation = stPinchSegment_getBlockOrientation(
-        firstSegment);
-    
-    // We need to calculate an offset into the canonical segment. If the
-    // segments are pinched together backwards, this will count in opposite
-    // directions on the two segments, so we'll need to flip the within-sement
-    // offset around.
-    size_t canonicalSegmentOffset = segmentOffset;
-    if(segmentOrientation != canonicalOrientation) {
-        // We really want this many bases in from the end of the segment, not
-        // out from the start of the segment. Keep it 0-based.
-        canonicalSegmentOffset = stPinchSegment_getLength(firstSegment) - 
-            canonicalSegmentOffset - 1;
-    }
-    
-    Log::debug() << "Canonicalized segment offset " << segmentOffset << 
-        " to " << canonicalSegmentOffset << std::endl;
-    
-    // What's the offset into the canonical contig? 1-based because we add a
-    // 0-based offset to a 1-based position.
-    size_t canonicalOffset = stPinchSegment_getStart(firstSegment) + 
-        canonicalSegmentOffset;
-    
-    Log::debug() << "Canonicalized contig " << contigNumber << " offset " <<
-        offset << " to contig " << canonicalContig << " offset " << 
-        canonicalOffset << std::endl;
-    
-    // Return all three values, and be sad about not having real tuples. What
-    // orientation should we use?  Well, we have the canonical position's
-    // orientation within the block, our position's orientation within the
-    // block, and the orientation that this context attaches to the position in.
-    // Flipping any of those will flip the orientation in which we need to map,
-    // so we need to xor them all together, which for bools is done with !=.
-    Log::debug() << "Canonical orientation: " << canonicalOrientation << 
-            std::endl;
-    Log::debug() << "Segment orientation: " << segmentOrientation << 
-            std::endl;
-    Log::debug() << "Strand: " << strand << std::endl;
-
-    if(canonicalOffset <= 0 || 
-        canonicalOffset > stPinchThread_getLength(
-        stPinchSegment_getThread(firstSegment))) {
-        
-        // The answer is supposed to be a 1-based offset. Make sure that is
-        // true.
-        throw std::runtime_error("Canonical offset " + 
-            std::to_string(canonicalOffset) + 
-            " out of range for 1-based position");
-    }
-
-    return std::make_pair(std::make_pair(canonicalContig, canonicalOffset),
-        canonicalOrientation != segmentOrientation != strand);
-}
-
-/**
- * Turn the given (text, 0-based offset offset) pair into a canonical (contig
- * number, 1-based offset from contig start, orientation), using the given
- * FMDIndex and the given thread set. The orientation is which face of the
- * canonical base this (text, offset) pair means.
- */
-std::pair<std::pair<size_t, size_t>, bool>
-canonicalize(
-    const FMDIndex& index, 
-    stPinchThreadSet* threadSet, 
-    TextPosition base
-) {
-    
-    Log::debug() << "Canonicalizing 0-based " << base << std::endl;
-    
-    // What contig corresponds to that text?
-    size_t contigNumber = index.getContigNumber(base);
-    // And what strand corresponds to that text? This tells us what
-    // orientation we're actually looking at the base in.
-    bool strand = (bool) index.getStrand(base);
-    // And what base position is that from the front of the contig? This is
-    // 1-based.
-    size_t offset = index.getOffset(base);
-    
-    if(offset <= 0 || offset > index.getContigLength(contigNumber)) {
-        // Complain that we got an out of bounds offset from this thing.
-        throw std::runtime_error("Tried to canonicalize text" +
-            std::to_string(base.getText()) + " offset " + 
-            std::to_string(base.getOffset()) + " which is out of bounds");
-    }
-    
-    // Canonicalize that pinch thread set position.
-    return canonicalize(threadSet, contigNumber, offset, strand);
-    
-}
-
 /**
  * Given a pinch thread set and a filename, write the degree of each pinch block
  * or segment without a block (always degree 2, except at the ends) to the file,
@@ -457,304 +490,76 @@ writeDegrees(
 }
 
 /**
- * Write the given threadSet on the contigs in the given index out as a multiple
- * alignment. Produces a cactus2hal (.c2h) file as described in
- * <https://github.com/benedictpaten/cactus/blob/development/hal/impl/hal.c>/
- *
- * Such a file looks like this.
- * 
- * s    'event1'   'seq1'    1
- * a    1 10   10
- * s    'event1'    'seq2'  0
- * a    20  10  1    0
- *
- * These files describe trees of sequences, with an alignment of each child onto
- * its parent. Each sequence has two ways of dividing it up into "segments", or
- * blocks: one which applies for alignments mapping upwards, and one which
- * appplies for alignments mapping downwards. 
- * 
- * The s lines define sequences. Sequences can be bottom or not. Each sequence
- * is defined by an event name, a contig name/FASTA header, and a bottom-or-not
- * flag. After each s line there are a series of a lines, which define alignment
- * segments on that sequence.
- * 
- * "Bottom" alignment lines define "bottom" segments, which are mapped down;
- * they consist only of a name (really a number), a start, and a length. Bottom
- * sequences only have bottom segments.
- *
- * "Top" alignment lines define "top" segments, which have a start, a length, a
- * name (which is numerical) of a bottom alignment block which they are aligned
- * to, and a flag for the relative orientation of the alignment (0 for same
- * direction, right for different directions). If the segment is an insertion
- * (i.e. unaligned) it has only a start and a length. Top sequences only have
- * top segments.
- *
- * All segments in a sequence are sorted by position. Each sequence appears only
- * once. Every base in a sequence is part of some segment. All positions are
- * 0-based. Ancestors must come before descendants.
- *
- * Returns the total number of bases in the made-up root node used to tie the
- * actual sequences together.
+ * Scan the BWT positions from start to end, canonicalizing each one not masked
+ * out against the given snapshot of the pinch graph, and record the BWT
+ * position and canonicalized position every time the canonicalized position
+ * changes. The first unmasked position in the scan always starts a new run.
+ * Used by identifyMergedRuns to scan a chunk of the BWT; runs that continue
+ * across chunk boundaries are stitched back together there.
  */
-size_t
-writeAlignment(
-    stPinchThreadSet* threadSet, 
-    const FMDIndex& index, 
-    std::string filename) 
-{
+void
+scanMergedRuns(
+    const CanonicalTable& table, 
+    const FMDIndex& index,
+    const BitVector* mask,
+    int64_t start,
+    int64_t end,
+    std::vector<int64_t>& runStarts,
+    std::vector<std::pair<std::pair<size_t, size_t>, bool> >& mappings
+) {
 
-    // We're going to lay out the segments in our root sequence with some
-    // locality. We're going to scan through all threads, and put each new block
-    // as it is encountered. So we need a set of the encountered blocks.
-    // TODO: When we get c++11, make this an unordered_set
-    std::set<stPinchBlock*> seen;
-    
-    // Open up the file to write.
-    std::ofstream c2h(filename.c_str());
-    
-    // First, make a hacked-up consensus reference sequence to be the root of
-    // the tree. It just has all the pinch blocks in some order.
-    
-    // Write the root sequence line. It is a bottom sequence since it has bottom
-    // segments.
-    c2h << "s\t'rootSeq'\t'rootSeq'\t1" << std::endl;
-    
-    // Keep track of the total root sequence space already used
-    size_t nextBlockStart = 0;
+    // Keep track of the ID and relative orientation for the last position we
+    // canonicalized.
+    // TODO: typedef this! It is getting silly.
+    std::pair<std::pair<size_t, size_t>, bool> lastCanonicalized;
     
-    // Make an iterator over pinch threads
-    stPinchThreadSetIt threadIterator = stPinchThreadSet_getIt(threadSet);
+    // Locate positions a block at a time, so their LF walks can share the BWT.
+    const int64_t LOCATE_BLOCK = 4096;
+    std::vector<int64_t> indices;
     
-    // And a pointer to hold the current thread
-    stPinchThread* thread;
-    while((thread = stPinchThreadSetIt_getNext(&threadIterator)) != NULL) {
-        // For each pinch thread
-        
-        // Go through all its pinch segments in order. There's no iterator so we
-        // have to keep looking 3'
+    for(int64_t blockStart = start; blockStart < end; 
+        blockStart += LOCATE_BLOCK) {
         
-        // Get the first segment in the thread.
-        stPinchSegment* segment = stPinchThread_getFirst(thread);
-        while(segment != NULL) {
+        int64_t blockEnd = std::min(end, blockStart + LOCATE_BLOCK);
         
-            stPinchBlock* block;
-            if((block = stPinchSegment_getBlock(segment)) != NULL) {
-                // Look at its block if it has one
-                
-                if(seen.count(block) == 0) {
-                    // This is a new block we haven't allocated a range for yet.
-                    
-                    // For each block, put a bottom segment. Just name the
-                    // segment after the block's address. We need block name
-                    // (number), start, and length.
-                    c2h << "a\t" << (uintptr_t)block << "\t" << 
-                        nextBlockStart << "\t" << 
-                        stPinchBlock_getLength(block) << std::endl;
-                        
-                    // Advance nextBlockStart.
-                    nextBlockStart += stPinchBlock_getLength(block);
-                    
-                    // Record that we have seen this block now.
-                    seen.insert(block);
-                }
+        indices.clear();
+        for(int64_t j = blockStart; j < blockEnd; j++) {
+            if(mask != NULL && !mask->isSet(j)) {
+                // This position is masked out. We don't allow it to break up
+                // ranges, so no range needs to start here. Skip it and pretend
+                // it doesn't exist.
+                continue;
             }
-            
-            // Jump to the next 3' segment. This needs to return NULL if we go
-            // off the end.
-            segment = stPinchSegment_get3Prime(segment);
+            indices.push_back(j);
         }
         
-    }
+        // Where are they all located?
+        std::vector<TextPosition> bases = index.locateBatch(indices);
     
-    // Keep a mapping from scaffold name to event name. Event name will be
-    // either the contig scaffold name if all the contigs are from a single
-    // scaffold, or "genome-<number>" if there are multiple scaffolds involved.
-    std::map<std::string, std::string> eventNames;
-    
-    // Keep track of the original source sequence
-    std::string sourceSequence;
-    
-    // Go through contigs in order. The index spec requires them to be grouped
-    // by original source sequence.
-    for(size_t contig = 0; contig < index.getNumberOfContigs(); contig++) {
-        // Grab the sequence name that the contig is on
-        std::string contigName = index.getContigName(contig);
-        
-        if(eventNames.count(contigName) == 0) {
-            // We need to figure out the event name for this contig.
-            
-            // Start by naming the event after the contig.
-            eventNames[contigName] = contigName;
-            
-            // What genome does it belong to?
-            size_t genomeNumber = index.getContigGenome(contig);
-            
-            // What contigs are in that genome?
-            auto genomeRange = index.getGenomeContigs(genomeNumber);
-            
-            for(size_t i = genomeRange.first; i < genomeRange.second; i++) {
-                // For every contig in that genome
-                if(index.getContigName(i) != contigName) {
-                    // One of them doesn't match this contig's name; they are
-                    // not all from the same scaffold. Re-name the event with a
-                    // new generic name.
-                    
-                    eventNames[contigName] = "genome-" + 
-                        std::to_string(index.getContigGenome(contig));
-                        
-                    // Now we're done
-                    break;
-                }
-            }
-        }
-        
-        if(contigName != sourceSequence || contig == 0) {
-            // This is a new scaffold, not the same as the one we were on last.
-            
-            // Start a new sequence with a sequence line. The sequence is a top
-            // sequence, since it is only connected up.
-            c2h << "s\t'" << eventNames[contigName] << "'\t'" << contigName <<
-                "'\t0" << std::endl;
-            
-            // Remember that we are on this sequence
-            sourceSequence = contigName;
-        } else {
-            // This is the same sequence as before, but we need an unaligned
-            // segment to cover the distance from the last contig to the start
-            // of this one.
-            
-            // What's 1 base after the end of the last contig? Leave as 0-based.
-            size_t prevContigEnd = index.getContigStart(contig - 1) + 
-                index.getContigLength(contig - 1);
-            
-            // Unaligned top segments are "a <start> <length>" only. Leave as
-            // 0-based.
-            c2h << "a\t" << prevContigEnd << "\t" << 
-                index.getContigStart(contig) - prevContigEnd << std::endl;
-            
-        }
-        
-        // Regardless of whether we changed sequence or not, we need an
-        // alignment segment for every segment in this thread.
-        
-        // Each segment has to account for the offset of the contig on the
-        // sequence.
-        size_t contigStart = index.getContigStart(contig);
-        
-        // So first get the thread by name.
-        stPinchThread* thread = stPinchThreadSet_getThread(threadSet, contig);
-        
-        // Go through all its pinch segments in order. There's no iterator so we
-        // have to keep looking 3'
-        
-        // Get the first segment in the thread.
-        stPinchSegment* segment = stPinchThread_getFirst(thread);
-        while(segment != NULL) {
+        for(size_t k = 0; k < indices.size(); k++) {
             
-            // Start where the next segment starts. Convert from 1-based pinch
-            // segments to 0-based HAL.
-            size_t segmentStart = contigStart +
-                stPinchSegment_getStart(segment) - 1;
-            
-            if(stPinchSegment_getBlock(segment) != NULL) {
-                // It actually aligned
-            
-                // Write a top segment mapping to the segment named after the
-                // address of the block this segment belongs to.
-                c2h << "a\t" << segmentStart << "\t" << 
-                    stPinchSegment_getLength(segment) << "\t" << 
-                    (uintptr_t)stPinchSegment_getBlock(segment) << "\t" << 
-                    stPinchSegment_getBlockOrientation(segment) << std::endl;
-            } else {
-                // Write a segment for the unaligned sequence.
-                c2h << "a\t" << segmentStart << "\t" << 
-                    stPinchSegment_getLength(segment) << std::endl;
-            }
-            
-            // Jump to the next 3' segment. This needs to return NULL if we go
-            // off the end.
-            segment = stPinchSegment_get3Prime(segment);
-        }
-        
-    }
-    
-    // Close up the finished file
-    c2h.close();
-    
-    // Return the total length of the made-up root sequence. Later we will
-    // probably need a FASTA with this many Ns in order to turn this c2h into a
-    // HAL file.
-    return nextBlockStart;
-}
-
-/**
- * Write a FASTA file that goes with the .c2h file written by writeAlignment, so
- * that the halAppendCactusSubtree tool can turn both into a HAL file.
- *
- * Strips out newlines so halAppendCactusSubtree will be happy with the
- * resulting FASTA.
- *
- * TODO: Drop this and just use the HAL API directly
- */
-void
-writeAlignmentFasta(
-    std::vector<std::string> inputFastas,
-    size_t rootBases,
-    std::string filename
-) {
-
-    // Open the FASTA to write
-    std::ofstream fasta(filename.c_str());
-    
-    Log::info() << "Generating " << rootBases << 
-        " bases of root node sequence." << std::endl;
-    
-    // First we put the right number of Ns in a sequence named "rootSeq"
-    fasta << ">rootSeq" << std::endl;
-    for(size_t i = 0; i < rootBases; i++) {
-        fasta << "N";
-        // Entire sequence must be on one line.
-    }
-    
-    for(std::vector<std::string>::iterator i = inputFastas.begin(); 
-        i != inputFastas.end(); ++i) {
-        
-        Log::info() << "Copying over " << *i << std::endl;
-        
-        // Then we just copy all the other FASTAs in order.
-        
-        // Open the input FASTA
-        std::ifstream inputFasta((*i).c_str());
-        
-        // Read it line by line. See <http://stackoverflow.com/a/7868998/402891>
-        std::string line;
-        while(std::getline(inputFasta, line)) {
-            // For each line (without trailing newline)
-        
-            if(line.size() == 0) {
-                // Drop blank lines
-                continue;
-            }
+            // For each unmasked base in the block...
+            int64_t j = indices[k];
             
-            if(line[0] == '>') {
-                // Make sure there are newlines before and after header lines.
-                fasta << std::endl << line << std::endl;
-            } else {
-                // Don't put any newlines.
-                fasta << line;
+            // Canonicalize it. The second field here will be the relative
+            // orientation and determine the Side.
+            std::pair<std::pair<size_t, size_t>, bool> canonicalized = 
+                table.canonicalize(index, bases[k]);
+                
+            if(mappings.empty() || canonicalized != lastCanonicalized) {
+                // We need to start a new range here, because this BWT base maps
+                // to a different position than the last one.
+                runStarts.push_back(j);
+                mappings.push_back(canonicalized);
+                
+                // Remember what canonical base and face we're doing for this
+                // range.
+                lastCanonicalized = canonicalized;
             }
+            // Otherwise we had the same canonical base, so we want this in the
+            // same range we already started.
         }
-            
-        // Close up this input file and move to the next one.
-        inputFasta.close();
     }
-    
-    // Insert a linebreak at the end of the file.
-    fasta << std::endl;
-    
-    // Now we're done.
-    fasta.close();
-
 }
 
 /**
@@ -772,19 +577,19 @@ writeAlignmentFasta(
  *
  * All BWT positions must be represented in the pinch set.
  *
- * Scans through the entire BWT.
+ * Scans through the entire BWT, in parallel chunks on the given number of
+ * threads (or one per core if 0), with the same result as a serial scan.
+ * Canonicalization is done against a CanonicalTable snapshot, since the pinch
+ * graph itself can't be queried from multiple threads.
  */
 std::pair<BitVector*, std::vector<std::pair<std::pair<size_t, size_t>, bool> > > 
 identifyMergedRuns(
     stPinchThreadSet* threadSet, 
     const FMDIndex& index,
-    const BitVector* mask = NULL
+    const BitVector* mask = NULL,
+    size_t threadCount = 0
 ) {
     
-    // We need an iterator over the mask, if applicable.
-    BitVectorIterator* maskIterator = (mask != NULL ? 
-        new BitVectorIterator(*mask) : NULL);
-    
     // We need to make bit vector denoting ranges, which we encode with this
     // encoder, which has 32 byte blocks.
     BitVectorEncoder encoder(32);
@@ -793,62 +598,96 @@ identifyMergedRuns(
     std::vector<std::pair<std::pair<size_t, size_t>, bool> > mappings;
     
     Log::info() << "Building merged run index by scan..." << std::endl;
+    TraceSpan span("identifyMergedRuns");
     
-    // Do the thing where we locate each base and, when the canonical position
+    // Do the thing where we locate each base and, when the canonical position
     // changes, add a 1 to start a new range and add a mapping.
-
-    // Keep track of the ID and relative orientation for the last position we
-    // canonicalized.
-    // TODO: typedef this! It is getting silly.
-    std::pair<std::pair<size_t, size_t>, bool> lastCanonicalized;
     
-    for(int64_t j = index.getNumberOfContigs() * 2; j < index.getBWTLength();
-        j++) {
-        
-        // For each base in the BWT (skipping over the 2*contigs stop
-        // characters)... 
-        
-        // Note: stop characters aren't at the front in the last column, only
-        // the first.
+    // We skip over the 2*contigs stop characters. Note: stop characters aren't
+    // at the front in the last column, only the first.
+    int64_t start = index.getNumberOfContigs() * 2;
+    int64_t end = index.getBWTLength();
+    
+    if(threadCount == 0) {
+        // Use one thread per core.
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    // Don't make more chunks than there are positions.
+    threadCount = std::max((int64_t)1, std::min((int64_t)threadCount,
+        end - start));
+    
+    // Snapshot the pinch graph so all the threads can canonicalize at once.
+    TraceSpan tableSpan("snapshotPinchGraph");
+    CanonicalTable table(threadSet);
+    tableSpan.finish();
+    
+    // Each chunk gets its own list of run starts and canonical positions.
+    std::vector<std::vector<int64_t> > chunkRunStarts(threadCount);
+    std::vector<std::vector<std::pair<std::pair<size_t, size_t>, bool> > >
+        chunkMappings(threadCount);
+    
+    // If any chunk fails, we need to pass the error along.
+    std::vector<std::exception_ptr> errors(threadCount);
+    
+    // Scan all the chunks at once.
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < threadCount; i++) {
+        // Split the BWT evenly.
+        int64_t chunkStart = start + (end - start) * i / threadCount;
+        int64_t chunkEnd = start + (end - start) * (i + 1) / threadCount;
         
-        if(maskIterator != NULL && !maskIterator->isSet(j)) {
-            // This position is masked out. We don't allow it to break up
-            // ranges, so no range needs to start here. Skip it and pretend it
-            // doesn't exist.
-            continue;
+        threads.push_back(std::thread([&, i, chunkStart, chunkEnd]() {
+            Trace::nameThread("scanner " + std::to_string(i));
+            TraceSpan chunkSpan("scan chunk " + std::to_string(i));
+            try {
+                scanMergedRuns(table, index, mask, chunkStart, chunkEnd,
+                    chunkRunStarts[i], chunkMappings[i]);
+            } catch(...) {
+                errors[i] = std::current_exception();
+            }
+        }));
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    for(auto& error : errors) {
+        if(error) {
+            // Throw the first thing that went wrong.
+            std::rethrow_exception(error);
         }
-        
-        // Where is it located?
-        TextPosition base = index.locate(j);
-        
-        // Canonicalize it. The second field here will be the relative
-        // orientation and determine the Side.
-        std::pair<std::pair<size_t, size_t>, bool> canonicalized = 
-            canonicalize(index, threadSet, base);
+    }
+
+    // Now stitch the chunks together, in order.
+    TraceSpan stitchSpan("stitchChunks");
+    for(size_t i = 0; i < threadCount; i++) {
+        for(size_t k = 0; k < chunkRunStarts[i].size(); k++) {
             
-        if(j == 0 || canonicalized != lastCanonicalized) {
-            // We need to start a new range here, because this BWT base maps to
-            // a different position than the last one.
+            if(k == 0 && !mappings.empty() && 
+                chunkMappings[i][k] == mappings.back()) {
+                
+                // This chunk starts out still in the last chunk's last range,
+                // so don't start a new one.
+                continue;
+            }
             
             // Say this range is going to belong to the canonical base.
-            mappings.push_back(canonicalized);
+            mappings.push_back(chunkMappings[i][k]);
             
-            if(j != index.getNumberOfContigs() * 2) {
+            if(chunkRunStarts[i][k] != start) {
                 // Record a 1 in the vector at the start of every range except
                 // the first. The first needs no 1 before it so it will be rank
                 // 0 (and match up with mapping 0), and it's OK not to split it
                 // off from the stop characters since they can't ever be
                 // searched.
-                encoder.addBit(j);
-                Log::debug() << "Set bit " << j << std::endl;
+                encoder.addBit(chunkRunStarts[i][k]);
+                Log::debug() << "Set bit " << chunkRunStarts[i][k] << std::endl;
             }
-            
-            
-            // Remember what canonical base and face we're doing for this range.
-            lastCanonicalized = canonicalized;
         }
-        // Otherwise we had the same canonical base, so we want this in the same
-        // range we already started.
+        
+        // Free up the chunk as we go.
+        std::vector<int64_t>().swap(chunkRunStarts[i]);
+        std::vector<std::pair<std::pair<size_t, size_t>, bool> >().swap(
+            chunkMappings[i]);
     }
             
     // Set a bit after the end of the last range (i.e. at the end of the BWT).
@@ -860,113 +699,113 @@ identifyMergedRuns(
     BitVector* bitVector = new BitVector(encoder,
         index.getBWTLength() + 1);
     
-    // If we made a mask iterator, get rid of it.
-    if(maskIterator != NULL) {
-        delete maskIterator;
-    }
-    
     // Return the bit vector and the canonicalized base vector
     return std::make_pair(bitVector, mappings);
 }
 
 /**
- * Make the range vector and list of matching Sides for the hierarchy level
- * implied by the given thread set in the given index. Gets IDs for created
- * positions from the given source.
+ * Make the range vector and matching Sides for the hierarchy level implied by
+ * the given thread set in the given index. Gets IDs for created positions from
+ * the given source.
  * 
  * Manages this by scanning the BWT from left to right, seeing what cannonical
  * position and orientation each base belongs to, and putting 1s in the range
  * vector every time a new one starts.
  *
- * Don't forget to delete the bit vector when done!
+ * Don't forget to delete the level index when done!
  */
-std::pair<BitVector*, std::vector<SmallSide> > 
+LevelIndex*
 makeLevelIndexScanning(
     stPinchThreadSet* threadSet, 
     const FMDIndex& index, 
     IDSource<long long int>& source
 ) {
     
+    TraceSpan span("makeLevelIndexScanning");
+    
     // First, canonicalize everything, yielding a bitvector of ranges and a
     // vector of canonicalized positions.
     auto mergedRuns = identifyMergedRuns(threadSet, index);
     
-    // We also need to make a vector of SmallSides, which are the things that
-    // get matched to by the corresponding ranges in the bit vector.
-    std::vector<SmallSide> mappings;
-    
-    // We also need this map of position IDs (long long ints) by canonical
-    // contig name (a size_t) and base index (also a size_t). Relative
-    // orientation is always forward.
-    std::map<std::pair<size_t, size_t>, long long int>
-        idReservations;
-
-    
-    size_t runNumber = 0;
-
     Log::info() << "Building mapping data structure..." << std::endl;
     
+    // Every canonical position is a base in the index, so we can keep the ID
+    // reservations in a packed array by base ID instead of in a map. Each slot
+    // holds 1 more than the ID's offset from the first ID we allocated, or 0 if
+    // no ID has been allocated for that base. IDs come out of the source in
+    // order, so the offsets are dense.
+    size_t totalBases = index.getTotalLength() / 2;
+    size_t slotBits = std::max(CSA::length(totalBases), (size_t)1);
+    std::vector<size_t> reservationData((totalBases * slotBits +
+        CSA::WORD_BITS - 1) / CSA::WORD_BITS, 0);
+    CSA::WriteBuffer reservationWriter(reservationData.data(), totalBases,
+        slotBits);
+    CSA::ReadBuffer reservations(reservationData.data(), totalBases,
+        slotBits);
+    
+    // What's the first ID we allocated, and how many have we allocated?
+    long long int idBase = 0;
+    size_t idCount = 0;
+    
     for(auto canonicalized : mergedRuns.second) {
-        
         // For each canonical 1-based ((contig, base), face) corresponding to a
-        // merged range...
+        // merged range, find its slot.
+        size_t slot = index.getBaseID(TextPosition(
+            canonicalized.first.first * 2, canonicalized.first.second - 1));
         
-        // What position is that?
-        long long int positionCoordinate;
-        if(idReservations.count(canonicalized.first) > 0) {
-            // Load the previously chosen ID
-            positionCoordinate = 
-                idReservations[canonicalized.first];
-        } else {
+        if(reservations.readItemConst(slot) == 0) {
             // Allocate and remember a new ID.
-            positionCoordinate = 
-                idReservations[canonicalized.first] = 
-                source.next();
-        }
+            long long int id = source.next();
+            if(idCount == 0) {
+                idBase = id;
+            }
+            idCount++;
             
-        // Say this range is going to belong to the ID we just looked up, on
-        // the appropriate face.
-        mappings.push_back(
-            SmallSide(positionCoordinate, canonicalized.second));
+            reservationWriter.goToItem(slot);
+            reservationWriter.writeItem(id - idBase + 1);
+        }
     }
+    
+    // Now we know how many IDs there are, so we know how wide to pack the
+    // Sides. The level index takes the bit vector.
+    LevelIndex* levelIndex = new LevelIndex(mergedRuns.first,
+        mergedRuns.second.size(), idBase, idCount);
+    
+    for(size_t i = 0; i < mergedRuns.second.size(); i++) {
+        // Say each range is going to belong to the ID we allocated for its
+        // canonical base, on the appropriate face.
+        auto& canonicalized = mergedRuns.second[i];
+        size_t slot = index.getBaseID(TextPosition(
+            canonicalized.first.first * 2, canonicalized.first.second - 1));
+        
+        levelIndex->setSide(i, idBase + reservations.readItemConst(slot) - 1,
+            canonicalized.second);
+    }
+    
+    Log::info() << "Packed " << mergedRuns.second.size() << " Sides on " <<
+        idCount << " IDs into " << levelIndex->reportSize() << " bytes" <<
+        std::endl;
             
-    // Return the bit vector and the Side vector
-    return std::make_pair(mergedRuns.first, mappings);
+    return levelIndex;
 }
 
 /**
- * Save both parts of the given level index to files in the given directory,
- * which must not yet exist. Does not delete the bit vector from the level
- * index, so it can be reused.
+ * Save the given level index to a level.idx file in the given directory, which
+ * must not yet exist.
  */
 void saveLevelIndex(
-    std::pair<BitVector*, std::vector<SmallSide> > levelIndex,
+    const LevelIndex& levelIndex,
     std::string directory
 ) {
     
     Log::info() << "Saving index to disk..." << std::endl;
+    TraceSpan span("saveLevelIndex");
     
     // Make the directory
     boost::filesystem::create_directory(directory);
     
-    // Save the bit vector to a file.
-    std::ofstream vectorStream((directory + "/vector.bin").c_str(), 
-        std::ios::binary);
-    levelIndex.first->writeTo(vectorStream);
-    vectorStream.close();
-    
-    // Open a file to save all the sides to
-    std::ofstream sideStream((directory + "/mappings.bin").c_str(), 
-        std::ios::binary);
-    for(std::vector<SmallSide>::iterator i = levelIndex.second.begin(); 
-        i != levelIndex.second.end(); ++i) {
-        
-        // For each side, write it. We can't write them all at once since we
-        // might have more than an int's worth of bytes.
-        (*i).write(sideStream);
-    
-    }
-    sideStream.close();
+    // Save the whole index in one go.
+    levelIndex.save(directory + "/level.idx");
 }
 
 /**
@@ -979,17 +818,32 @@ void saveLevelIndex(
  * 
  * If a context is specified, will not merge on fewer than that many bases of
  * context on a side, whether there is a unique mapping or not.
+ *
+ * If a checkpoint directory is specified, saves a MergeCheckpoint there (under
+ * the given settings string and FASTA list) after every genome is merged in. If
+ * a checkpoint to resume from is specified, restores its state and starts with
+ * the genome after the last one it had merged in.
+ *
+ * If a memory budget is specified (nonzero), checks it after every genome is
+ * merged in, and drops the index's full suffix array once it is exceeded.
  */
 stPinchThreadSet*
 mergeGreedy(
-    const FMDIndex& index,
+    FMDIndex& index,
     size_t context = 0,
     bool credit = false,
     std::string mapType = "LRexact",
     bool mismatch = false,
-    int z_max = 0
+    int z_max = 0,
+    std::string checkpointDirectory = "",
+    std::string settings = "",
+    std::vector<std::string> fastas = std::vector<std::string>(),
+    const MergeCheckpoint* resumeFrom = NULL,
+    size_t memoryBudget = 0
 ) {
 
+    TraceSpan span("mergeGreedy");
+
     Log::info() << "Creating initial pinch thread set" << std::endl;
     
     // Make a thread set from our index.
@@ -1003,13 +857,71 @@ mergeGreedy(
     // Keep around a bit vector of all the positions that are in. This will
     // start with the very first genome, which we know exists.
     const BitVector* includedPositions = &index.getGenomeMask(0);
+    // Remember if we allocated it ourselves and need to delete it.
+    bool ownIncludedPositions = false;
     
-    // Canonicalize everything, yielding a bitvector (pointer) of ranges and a
-    // vector of canonicalized positions.
-    auto mergedRuns = identifyMergedRuns(threadSet, index);
+    // What genome do we start merging in?
+    size_t firstGenome = 1;
+    
+    // This will hold a bitvector (pointer) of ranges and a vector of
+    // canonicalized positions.
+    std::pair<BitVector*, std::vector<std::pair<std::pair<size_t, size_t>,
+        bool> > > mergedRuns;
+    
+    if(resumeFrom != NULL) {
+        // We need to pick up where a previous run left off.
+        
+        if(resumeFrom->getSettings() != settings) {
+            // Merging the rest with different settings would make a mess.
+            throw std::runtime_error("Checkpoint was made with settings \"" +
+                resumeFrom->getSettings() + "\", not \"" + settings + "\"");
+        }
+        
+        if(!resumeFrom->extendsIndex(index)) {
+            // The contigs it pinched aren't where they used to be.
+            throw std::runtime_error(
+                "Checkpoint contigs do not match the index");
+        }
+        
+        // Put back all the merges already made.
+        resumeFrom->restoreGraph(threadSet);
+        firstGenome = resumeFrom->getRound() + 1;
+        
+        Log::info() << "Resuming greedy merge at genome " << firstGenome <<
+            std::endl;
+        
+        if(resumeFrom->matchesIndex(index)) {
+            // The BWT is the same, so the saved mask and level index are still
+            // good.
+            includedPositions = resumeFrom->loadMask();
+            mergedRuns = resumeFrom->loadMergedRuns();
+        } else {
+            // More genomes have been added, so BWT coordinates have changed.
+            // Rebuild the mask of the genomes already merged...
+            for(size_t genome = 1; genome < firstGenome; genome++) {
+                BitVector* newIncludedPositions = 
+                    includedPositions->createUnion(index.getGenomeMask(genome));
+                if(ownIncludedPositions) {
+                    delete includedPositions;
+                }
+                includedPositions = newIncludedPositions;
+                ownIncludedPositions = true;
+            }
+            
+            // And then the level index over them.
+            mergedRuns = identifyMergedRuns(threadSet, index,
+                includedPositions);
+        }
+        ownIncludedPositions = true;
+    } else {
+        // Canonicalize everything.
+        mergedRuns = identifyMergedRuns(threadSet, index);
+    }
     
-    for(size_t genome = 1; genome < index.getNumberOfGenomes(); genome++) {
+    for(size_t genome = firstGenome; genome < index.getNumberOfGenomes();
+        genome++) {
         // For each genome that we have to merge in...
+        TraceSpan genomeSpan("merge genome " + std::to_string(genome));
         
         // Make the merge scheme we want to use. We choose a mapping-to-second-
         // level-based merge scheme, to which we need to feed the details of the
@@ -1053,19 +965,58 @@ mergeGreedy(
             ": " << basesAligned << " / " << basesAlignable << " = " <<
             ((double)basesAligned) / basesAlignable << std::endl;
         
-        // Join any trivial boundaries.
-        stPinchThreadSet_joinTrivialBoundaries(threadSet);
+        // Say how much everything took up at the peak of this round.
+        Log::output() << "Merge queue peaked at " << queue.getPeakBytes(lock) <<
+            " bytes" << std::endl;
+        MemoryReport memory;
+        memory.add("index", index.reportMemory());
+        memory.add("mergedRuns.ranges", mergedRuns.first->reportSize());
+        memory.add("mergedRuns.positions", mergedRuns.second.capacity() *
+            sizeof(mergedRuns.second[0]));
+        memory.add("pinchGraph", reportPinchMemory(threadSet));
+        fitMemoryBudget("merging genome " + std::to_string(genome), memory,
+            index, memoryBudget);
         
         // Merge the new genome into includedPositions, replacing the old
-        // bitvector.
-        BitVector* newIncludedPositions = includedPositions->createUnion(
-            index.getGenomeMask(genome));
-        if(genome > 1) {
+        // bitvector. This only looks at the genome masks, so we can do it
+        // while we join trivial boundaries in the pinch graph.
+        BitVector* newIncludedPositions = NULL;
+        // If the union fails (say it runs out of memory), we need to pass the
+        // error along.
+        std::exception_ptr unionError;
+        std::thread unionThread([&]() {
+            try {
+                newIncludedPositions = includedPositions->createUnion(
+                    index.getGenomeMask(genome));
+            } catch(...) {
+                unionError = std::current_exception();
+            }
+        });
+        
+        try {
+            // Join any trivial boundaries.
+            TraceSpan joinSpan("joinTrivialBoundaries");
+            stPinchThreadSet_joinTrivialBoundaries(threadSet);
+        } catch(...) {
+            // Destroying a thread that hasn't been joined would abort, so wait
+            // for the union before passing this along.
+            unionThread.join();
+            delete newIncludedPositions;
+            throw;
+        }
+        
+        // Wait for the union.
+        unionThread.join();
+        if(unionError) {
+            std::rethrow_exception(unionError);
+        }
+        if(ownIncludedPositions) {
             // If we already alocated a new BitVector that wasn't the one that
             // came when we loaded in the genomes, we need to delete it.
             delete includedPositions;
         }
         includedPositions = newIncludedPositions;
+        ownIncludedPositions = true;
         
         // Delete the old merged runs bit vector and recalculate merged runs on
         // the newly updated thread set. Make sure to specify the new mask of
@@ -1074,12 +1025,19 @@ mergeGreedy(
         delete mergedRuns.first;
         mergedRuns = identifyMergedRuns(threadSet, index, includedPositions);
         
+        if(checkpointDirectory != "") {
+            // Save everything we would need to carry on from here.
+            TraceSpan checkpointSpan("saveCheckpoint");
+            MergeCheckpoint::save(checkpointDirectory, genome, settings, fastas,
+                index, threadSet, *includedPositions, mergedRuns);
+        }
+        
     }
     
     // Delete the final merged run vector
     delete mergedRuns.first;
     
-    if(index.getNumberOfGenomes() > 1) {
+    if(ownIncludedPositions) {
         // And, if we had to make any additional included position BitVectors,
         // get the last one of those too.
         delete includedPositions;
@@ -1138,6 +1096,170 @@ testMergedMapping(
         " ms per call" << std::endl;
 }
 
+/**
+ * Find SMEMs in reads with different numbers of changes repeatedly, and compare
+ * that to mapping each base in them, which is how seeds were found before.
+ */
+void
+testSMEMFinding(
+    const FMDIndex& index
+) {
+    // Use all the test reads, from perfect to unrelated.
+    std::vector<std::string> reads = {TEST_READ, TEST_READ2, TEST_READ3,
+        TEST_READ4};
+        
+    // Count up the bases we look at so we can report throughput.
+    size_t bases = 0;
+    for(auto& read : reads) {
+        bases += read.size();
+    }
+    
+    // Start the timer
+    clock_t start = clock();
+    // Keep the SMEM count so the calls can't be optimized out.
+    size_t smemCount = 0;
+    for(int i = 0; i < TEST_ITERATIONS; i++) {
+        for(auto& read : reads) {
+            // Find SMEMs repeatedly
+            smemCount += index.findSMEMs(read).size();
+        }
+    }
+    // Stop the timer
+    clock_t end = clock();
+    
+    // Work out how many bases per second we did
+    double seconds = ((double)(end - start)) / CLOCKS_PER_SEC;
+    Log::output() << "Finding SMEMs: " << bases * TEST_ITERATIONS / seconds <<
+        " bases per second (" << smemCount / TEST_ITERATIONS << 
+        " SMEMs per pass)" << std::endl;
+        
+    // Time mapping every base of the same reads
+    start = clock();
+    for(int i = 0; i < TEST_ITERATIONS; i++) {
+        for(auto& read : reads) {
+            index.map(read);
+        }
+    }
+    end = clock();
+    
+    seconds = ((double)(end - start)) / CLOCKS_PER_SEC;
+    Log::output() << "Mapping every base: " << 
+        bases * TEST_ITERATIONS / seconds << " bases per second" << std::endl;
+}
+
+/**
+ * Benchmark the index and the merge pipeline on synthetic genomes, made in the
+ * given index directory, and save the results as JSON to the given file.
+ *
+ * Makes the given number of haplotypes of a random genome of the given number
+ * of bases, differing by the given fraction of bases, indexes them, and times
+ * searching, identifyMergedRuns, greedy and overlap merging, and mapping to
+ * the greedily merged level. Reads come from the last haplotype and map to
+ * the first, like in a greedy merge. The label (e.g. a commit) is saved with
+ * the results.
+ */
+void
+runBenchmarks(
+    std::string indexDirectory,
+    std::string outputFile,
+    size_t bases,
+    size_t haplotypes,
+    double divergence,
+    uint64_t seed,
+    size_t readCount,
+    size_t repetitions,
+    size_t context,
+    std::string label
+) {
+
+    if(haplotypes < 2) {
+        throw std::runtime_error("Benchmarking needs at least 2 haplotypes");
+    }
+
+    Benchmark benchmark(repetitions, seed);
+    benchmark.setParameter("label", label);
+    benchmark.setParameter("bases", bases);
+    benchmark.setParameter("haplotypes", haplotypes);
+    benchmark.setParameter("divergence", divergence);
+    benchmark.setParameter("seed", (size_t)seed);
+    benchmark.setParameter("reads", readCount);
+    benchmark.setParameter("context", context);
+
+    // Make the genomes in a directory in the index directory that building
+    // the index will leave alone.
+    Log::info() << "Making " << haplotypes << " synthetic haplotypes of " <<
+        bases << " bases" << std::endl;
+    std::vector<std::string> fastas = benchmark.writeGenomes(
+        indexDirectory + "/synthetic", bases, haplotypes, divergence);
+
+    // Index them, once, since that's slow.
+    FMDIndex* indexPointer = NULL;
+    benchmark.time("buildIndex", [&](size_t& operations) {
+        delete indexPointer;
+        indexPointer = buildIndex(indexDirectory, fastas, 64, 0, false,
+            false, false, "synthetic");
+        operations = indexPointer->getTotalLength();
+        return (size_t)indexPointer->getBWTLength();
+    }, 1);
+    FMDIndex& index = *indexPointer;
+
+    // Reads from the last genome, exact and with changes, to map to the first
+    std::vector<std::string> reads = benchmark.sampleReads(index,
+        haplotypes - 1, readCount, 0);
+    std::vector<std::string> changedReads = benchmark.sampleReads(index,
+        haplotypes - 1, readCount, 2);
+
+    benchmark.timeSearching(index, reads, 0);
+    benchmark.timeBitVector("genomeMask", index.getGenomeMask(0));
+
+    // Canonicalize the unmerged thread set.
+    stPinchThreadSet* threadSet = makeThreadSet(index);
+    benchmark.time("identifyMergedRuns.unmerged", [&](size_t& operations) {
+        auto mergedRuns = identifyMergedRuns(threadSet, index);
+        delete mergedRuns.first;
+        operations = index.getBWTLength();
+        return mergedRuns.second.size();
+    });
+    stPinchThreadSet_destruct(threadSet);
+
+    // Merge end to end, once each.
+    benchmark.time("mergeOverlap", [&](size_t& operations) {
+        stPinchThreadSet* merged = mergeOverlap(index, context);
+        size_t blocks = stPinchThreadSet_getTotalBlockNumber(merged);
+        stPinchThreadSet_destruct(merged);
+        operations = index.getTotalLength();
+        return blocks;
+    }, 1);
+
+    threadSet = NULL;
+    benchmark.time("mergeGreedy", [&](size_t& operations) {
+        threadSet = mergeGreedy(index, context);
+        operations = index.getTotalLength();
+        return (size_t)stPinchThreadSet_getTotalBlockNumber(threadSet);
+    }, 1);
+
+    // Canonicalize the merged thread set, and keep the last result to map to.
+    std::pair<BitVector*, std::vector<std::pair<std::pair<size_t, size_t>,
+        bool> > > mergedRuns(NULL, {});
+    benchmark.time("identifyMergedRuns.merged", [&](size_t& operations) {
+        delete mergedRuns.first;
+        mergedRuns = identifyMergedRuns(threadSet, index);
+        operations = index.getBWTLength();
+        return mergedRuns.second.size();
+    });
+    stPinchThreadSet_destruct(threadSet);
+
+    benchmark.timeBitVector("ranges", *mergedRuns.first);
+    benchmark.timeRangeMapping(index, *mergedRuns.first,
+        &index.getGenomeMask(0), reads, changedReads);
+
+    delete mergedRuns.first;
+    delete indexPointer;
+
+    benchmark.save(outputFile);
+    Log::output() << "Saved benchmarks to " << outputFile << std::endl;
+}
+
 /**
  * createIndex: command-line tool to create a multi-level reference structure.
  */
@@ -1147,9 +1269,14 @@ main(
     char** argv
 ) {
 
-    // Register ctrl+c handler. See
-    // <http://www.yolinux.com/TUTORIALS/C++Signals.html>
-    signal(SIGINT, exitOnSignal);
+    // Handle ctrl+c in a thread that waits for it, rather than in a signal
+    // handler. Block it first, before any other threads start, so they all
+    // leave it to that thread.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    std::thread(exitOnSignal, signals).detach();
 
     // Parse options with boost::programOptions. See
     // <http://www.radmangames.com/programming/how-to-use-boost-program_options>
@@ -1170,6 +1297,8 @@ main(
             "Merging scheme (\"overlap\" or \"greedy\")")
         ("alignment", boost::program_options::value<std::string>(), 
             "File to save .c2h-format alignment in")
+        ("alignmentBinary", boost::program_options::value<std::string>(), 
+            "File to save binary-format alignment in")
         ("alignmentFasta", boost::program_options::value<std::string>(), 
             "File in which to save FASTA records for building HAL from .c2h")
         ("degrees", boost::program_options::value<std::string>(), 
@@ -1180,6 +1309,14 @@ main(
         ("sampleRate", boost::program_options::value<unsigned int>()
             ->default_value(64), 
             "Set the suffix array sample rate to use")
+        ("isaSampleRate", boost::program_options::value<size_t>()
+            ->default_value(0), 
+            "Set the inverse suffix array sample rate to use, or 0 for none")
+        ("lcp", "Build an LCP array to speed up mapping divergent sequences")
+        ("uniqueContexts", "Build a table of the shortest unique context at "
+            "each position")
+        ("fullSuffixArray", "Save the full suffix array, for fast locating "
+            "when the index is reloaded")
         // These next two options should be ->required(), but that's not in the
         // Boost version I can convince our cluster admins to install. From now
         // on I shall work exclusively in Docker containers or something.
@@ -1195,7 +1332,43 @@ main(
 	("mismatches", boost::program_options::value<size_t>()
             ->default_value(0), 
             "Maximum allowed number of mismatches")
-	("mismatch", "Allow for mismatches");
+	("mismatch", "Allow for mismatches")
+        ("logLevel", boost::program_options::value<std::string>()
+            ->default_value("info"),
+            "Least important messages to log (\"critical\", \"error\", "
+            "\"output\", \"info\", \"debug\" or \"trace\")")
+        ("memoryBudget", boost::program_options::value<std::string>(),
+            "Bytes of memory (with optional K, M, G or T suffix) to try to "
+            "fit the index and merge structures in")
+        ("trace", boost::program_options::value<std::string>(),
+            "File to save a timeline of build phases and threads in, as "
+            "Chrome trace JSON")
+        ("checkpoint", "Save a checkpoint after each greedy merge round")
+        ("resume", "Resume a greedy merge from the last saved checkpoint")
+        ("bench", boost::program_options::value<std::string>(),
+            "Benchmark on synthetic genomes made in the index directory "
+            "instead of indexing FASTAs, and save the results as JSON here")
+        ("benchBases", boost::program_options::value<size_t>()
+            ->default_value(1000000),
+            "Bases in each synthetic genome")
+        ("benchHaplotypes", boost::program_options::value<size_t>()
+            ->default_value(2),
+            "Number of synthetic haplotypes to merge")
+        ("benchDivergence", boost::program_options::value<double>()
+            ->default_value(0.01),
+            "Fraction of bases substituted in each haplotype")
+        ("benchSeed", boost::program_options::value<uint64_t>()
+            ->default_value(1),
+            "Seed for making synthetic genomes and queries")
+        ("benchReads", boost::program_options::value<size_t>()
+            ->default_value(1000),
+            "Number of reads to map in each mapping benchmark")
+        ("benchRepetitions", boost::program_options::value<size_t>()
+            ->default_value(3),
+            "Times to repeat each benchmark (merges run once)")
+        ("benchLabel", boost::program_options::value<std::string>()
+            ->default_value(""),
+            "Label, such as a commit, to save with the benchmark results");
         
     // And set up our positional arguments
     boost::program_options::positional_options_description positionals;
@@ -1228,9 +1401,24 @@ main(
             return 0; 
         }
         
-        if(!options.count("indexDirectory") || !options.count("fastas")) {
+        if(!options.count("indexDirectory") || (!options.count("fastas") &&
+            !options.count("bench"))) {
+
             throw boost::program_options::error("Missing important arguments!");
         }
+        
+        try {
+            // Log at the level asked for.
+            Log::setLevel(Log::parseLevel(
+                options["logLevel"].as<std::string>()));
+            
+            if(options.count("memoryBudget")) {
+                // Make sure the budget makes sense before doing any work.
+                parseByteCount(options["memoryBudget"].as<std::string>());
+            }
+        } catch(std::runtime_error& error) {
+            throw boost::program_options::error(error.what());
+        }
             
     } catch(boost::program_options::error& error) {
         // Something is bad about our options. Complain on stderr
@@ -1247,9 +1435,29 @@ main(
     
     // If we get here, we have the right arguments. Parse them.
     
+    if(options.count("trace")) {
+        // Record a timeline, to be saved when we exit.
+        Trace::start(options["trace"].as<std::string>());
+        Trace::nameThread("main");
+    }
+    
     // This holds the directory for the reference structure to build.
     std::string indexDirectory(options["indexDirectory"].as<std::string>());
     
+    if(options.count("bench")) {
+        // Benchmark on made-up genomes instead of doing a real run.
+        runBenchmarks(indexDirectory, options["bench"].as<std::string>(),
+            options["benchBases"].as<size_t>(),
+            options["benchHaplotypes"].as<size_t>(),
+            options["benchDivergence"].as<double>(),
+            options["benchSeed"].as<uint64_t>(),
+            options["benchReads"].as<size_t>(),
+            options["benchRepetitions"].as<size_t>(),
+            options["context"].as<size_t>(),
+            options["benchLabel"].as<std::string>());
+        return 0;
+    }
+    
     // This holds a list of FASTA filenames to load and index.
     std::vector<std::string> fastas(options["fastas"]
         .as<std::vector<std::string> >());
@@ -1264,18 +1472,53 @@ main(
         Log::output() << "Index file: " << *i << std::endl;
     }
     
-    // Index the bottom-level FASTAs. Use the
-    // sample rate the user specified.
-    FMDIndex* indexPointer = buildIndex(indexDirectory, fastas,
-        options["sampleRate"].as<unsigned int>());
+    // Checkpoints for greedy merging live here.
+    std::string checkpointDirectory(indexDirectory + "/checkpoint");
+    
+    // This holds the checkpoint to resume from, if any.
+    MergeCheckpoint* checkpoint = NULL;
+    if(options.count("resume")) {
+        if(MergeCheckpoint::exists(checkpointDirectory)) {
+            // Load up where we left off, finishing any interrupted save first.
+            MergeCheckpoint::recover(checkpointDirectory);
+            checkpoint = new MergeCheckpoint(checkpointDirectory);
+        } else {
+            Log::output() << "No checkpoint to resume from; starting over" <<
+                std::endl;
+        }
+    }
+    
+    // This holds the bottom-level index.
+    FMDIndex* indexPointer;
+    
+    if(checkpoint != NULL && checkpoint->getFastas() == fastas &&
+        boost::filesystem::exists(indexDirectory + "/index.basename.bwt")) {
+        
+        // We already indexed exactly these FASTAs, so load that index back.
+        Log::info() << "Loading existing index" << std::endl;
+        indexPointer = new FMDIndex(indexDirectory + "/index.basename");
+    } else {
+        // Index the bottom-level FASTAs. Use the sample rate the user
+        // specified. If we're resuming with more FASTAs, keep the checkpoint
+        // around while we re-index.
+        indexPointer = buildIndex(indexDirectory, fastas,
+            options["sampleRate"].as<unsigned int>(),
+            options["isaSampleRate"].as<size_t>(), options.count("lcp") > 0,
+            options.count("uniqueContexts") > 0,
+            options.count("fullSuffixArray") > 0,
+            checkpoint != NULL ? "checkpoint" : "");
+    }
         
     // Make a reference out of the index pointer because we're not letting it
     // out of our scope.
     FMDIndex& index = *indexPointer;
     
+    // How much memory should we try to stay under, if any?
+    size_t memoryBudget = options.count("memoryBudget") ?
+        parseByteCount(options["memoryBudget"].as<std::string>()) : 0;
+    
     // Log memory usage with no pinch graph stuff having yet happened.
-    Log::output() << "Memory usage with no merging:" << std::endl;
-    logMemory();
+    fitMemoryBudget("indexing", index.reportMemory(), index, memoryBudget);
     
     if(options.count("noMerge")) {
         // Skip merging any of the higher levels.
@@ -1310,11 +1553,23 @@ main(
     if(mergeScheme == "overlap") {
         // Make a thread set that's all merged, with the given minimum merge
         // context.
-        threadSet = mergeOverlap(index, options["context"].as<size_t>());
+        threadSet = mergeOverlap(index, options["context"].as<size_t>(),
+            memoryBudget);
     } else if(mergeScheme == "greedy") {
+        // Describe the options that affect merging, so we never resume a
+        // merge under different ones.
+        std::stringstream settings;
+        settings << "context=" << options["context"].as<size_t>() <<
+            " credit=" << creditBool << " mapType=" << mapType <<
+            " mismatch=" << mismatchb << " mismatches=" <<
+            options["mismatches"].as<size_t>();
+    
         // Use the greedy merge instead.
         threadSet = mergeGreedy(index, options["context"].as<size_t>(), creditBool, mapType,
-	    mismatchb, options["mismatches"].as<size_t>());
+	    mismatchb, options["mismatches"].as<size_t>(),
+            (options.count("checkpoint") || options.count("resume")) ?
+            checkpointDirectory : "", settings.str(), fastas, checkpoint,
+            memoryBudget);
     } else {
         // Complain that's not a real merge scheme. TODO: Can we make the
         // options parser parse an enum or something instead of this?
@@ -1324,6 +1579,17 @@ main(
     
     // Now the merge is done. Stop timing.
     delete mergeTimer;
+    
+    // See what the pinch graph added.
+    MemoryReport mergedMemory;
+    mergedMemory.add("index", index.reportMemory());
+    mergedMemory.add("pinchGraph", reportPinchMemory(threadSet));
+    fitMemoryBudget("merging", mergedMemory, index, memoryBudget);
+    
+    if(checkpoint != NULL) {
+        // We're done with the checkpoint we resumed from.
+        delete checkpoint;
+    }
         
     if(options.count("degrees")) {
         // Save a dump of pinch graph node degrees (for both blocks and bare
@@ -1331,12 +1597,27 @@ main(
         writeDegrees(threadSet, options["degrees"].as<std::string>());
     }
     
-    if(options.count("alignment")) {
-        // Save the alignment defined by the pinched pinch graph to the file the
-        // user specified. Save the number of bases of root sequence that were
-        // used in the center of the star tree.
-        size_t rootBases = writeAlignment(threadSet, index,
-            options["alignment"].as<std::string>());
+    if(options.count("alignment") || options.count("alignmentBinary")) {
+        // Save the alignment defined by the pinched pinch graph in binary,
+        // either where the user asked or next to the index if they only want
+        // .c2h. Save the number of bases of root sequence that were used in the
+        // center of the star tree.
+        std::string binaryFilename = options.count("alignmentBinary") ?
+            options["alignmentBinary"].as<std::string>() : 
+            indexDirectory + "/alignment.bin";
+        size_t rootBases = writeBinaryAlignment(threadSet, index,
+            binaryFilename);
+            
+        if(options.count("alignment")) {
+            // Convert it to the .c2h the user wanted.
+            convertAlignmentToC2h(binaryFilename, index,
+                options["alignment"].as<std::string>());
+                
+            if(!options.count("alignmentBinary")) {
+                // Nobody asked for the binary version.
+                boost::filesystem::remove(binaryFilename);
+            }
+        }
             
         if(options.count("alignmentFasta")) {
             // Also save a FASTA with the sequences necessary to generate a HAL
@@ -1350,7 +1631,7 @@ main(
     IDSource<long long int> source(index.getTotalLength());
     
     // This will hold the computed level index of the merged level.
-    std::pair<BitVector*, std::vector<SmallSide> > levelIndex;
+    LevelIndex* levelIndex;
     
     // We also want to time the merged level index building code
     Timer* levelIndexTimer = new Timer("Level Index Construction");
@@ -1359,9 +1640,15 @@ main(
     levelIndex = makeLevelIndexScanning(threadSet, index, source);
     
     delete levelIndexTimer;
+    
+    MemoryReport levelMemory;
+    levelMemory.add("index", index.reportMemory());
+    levelMemory.add("pinchGraph", reportPinchMemory(threadSet));
+    levelMemory.add("levelIndex", levelIndex->reportMemory());
+    logPhaseMemory("building the level index", levelMemory, memoryBudget);
         
-    // Write it out, deleting the bit vector in the process
-    saveLevelIndex(levelIndex, indexDirectory + "/level1");
+    // Write it out
+    saveLevelIndex(*levelIndex, indexDirectory + "/level1");
     
     // Clean up the thread set
     stPinchThreadSet_destruct(threadSet);
@@ -1370,11 +1657,12 @@ main(
     if(options.count("test")) {
         Log::output() << "Running performance tests..." << std::endl;
         testBottomMapping(index);
-        testMergedMapping(index, levelIndex.first);
+        testMergedMapping(index, &levelIndex->getRanges());
+        testSMEMFinding(index);
     }
     
-    // Get rid of the range vector
-    delete levelIndex.first;
+    // Get rid of the level index and its range vector
+    delete levelIndex;
     
     // Get rid of the index itself. Invalidates the index reference.
     delete indexPointer;
@@ -7,34 +7,140 @@
 namespace CSA {
 
 BitVector::BitVector(std::ifstream& file) :
-  BitVectorBase(file)
+  BitVectorBase(),
+  dense(0)
 {
+  std::streampos start = file.tellg();
+  size_t tag = 0;
+  file.read((char*)&tag, sizeof(tag));
+  if(tag == DENSE_TAG)
+  {
+    file.read((char*)&(this->block_size), sizeof(this->block_size));
+    this->setDense(new DenseBitVector(file));
+    return;
+  }
+
+  file.seekg(start);
+  this->load(file);
+  this->chooseLayout();
 }
 
 BitVector::BitVector(FILE* file) :
-  BitVectorBase(file)
+  BitVectorBase(),
+  dense(0)
 {
+  if(file == 0) { return; }
+
+  long start = std::ftell(file);
+  size_t tag = 0;
+  if(std::fread(&tag, sizeof(tag), 1, file) == 1 && tag == DENSE_TAG)
+  {
+    if(!std::fread(&(this->block_size), sizeof(this->block_size), 1, file)) { this->block_size = 0; }
+    this->setDense(new DenseBitVector(file));
+    return;
+  }
+
+  std::fseek(file, start, SEEK_SET);
+  this->load(file);
+  this->chooseLayout();
+}
+
+BitVector::BitVector(const size_t* buffer, size_t words) :
+  BitVectorBase(),
+  dense(0)
+{
+  // Borrowed data stays the way it was saved.
+  if(words > 0 && buffer[0] == DENSE_TAG)
+  {
+    if(words < 2)
+    {
+      throw std::runtime_error("BitVector: In-place data is truncated");
+    }
+    this->block_size = buffer[1];
+    this->setDense(new DenseBitVector(buffer + 2, words - 2));
+    return;
+  }
+
+  this->load(buffer, words);
 }
 
 BitVector::BitVector(Encoder& encoder, size_t universe_size) :
-  BitVectorBase(encoder, universe_size)
+  BitVectorBase(encoder, universe_size),
+  dense(0)
 {
+  this->chooseLayout();
 }
 
 BitVector::~BitVector()
 {
+  delete this->dense;
 }
 
 //--------------------------------------------------------------------------
 
+void
+BitVector::writeTo(std::ofstream& file) const
+{
+  if(this->dense == 0) { BitVectorBase::writeTo(file); return; }
+
+  size_t tag = DENSE_TAG;
+  file.write((char*)&tag, sizeof(tag));
+  file.write((char*)&(this->block_size), sizeof(this->block_size));
+  this->dense->writeTo(file);
+}
+
+void
+BitVector::writeTo(FILE* file) const
+{
+  if(this->dense == 0) { BitVectorBase::writeTo(file); return; }
+  if(file == 0) { return; }
+
+  size_t tag = DENSE_TAG;
+  std::fwrite(&tag, sizeof(tag), 1, file);
+  std::fwrite(&(this->block_size), sizeof(this->block_size), 1, file);
+  this->dense->writeTo(file);
+}
+
 size_t
 BitVector::reportSize() const
 {
   size_t bytes = sizeof(*this);
   bytes += BitVectorBase::reportSize();
+  if(this->dense != 0) { bytes += this->dense->reportSize(); }
   return bytes;
 }
 
+size_t
+BitVector::getCompressedSize() const
+{
+  if(this->dense != 0)
+  {
+    return DenseBitVector::bytesFor(this->size, this->items) - sizeof(DenseBitVector);
+  }
+  return BitVectorBase::getCompressedSize();
+}
+
+void
+BitVector::chooseLayout()
+{
+  if(this->items == 0 || !this->free_array) { return; }
+
+  // Only switch if the nibble codes aren't saving any space.
+  if(DenseBitVector::bytesFor(this->size, this->items) <= BitVectorBase::getCompressedSize())
+  {
+    this->setDense(new DenseBitVector(*this));
+    this->release();
+  }
+}
+
+void
+BitVector::setDense(DenseBitVector* vector)
+{
+  this->dense = vector;
+  this->size = vector->getSize();
+  this->items = vector->getNumberOfItems();
+}
+
 BitVector* 
 BitVector::createUnion(const BitVector& other) const
 {
@@ -72,6 +178,53 @@ BitVector::createUnion(const BitVector& other) const
 
 //--------------------------------------------------------------------------
 
+size_t
+BitVector::rank(size_t value, bool at_least) const
+{
+  if(this->dense != 0) { return this->dense->rank(value, at_least); }
+
+  Iterator iter(*this);
+  return iter.rank(value, at_least);
+}
+
+size_t
+BitVector::select(size_t index) const
+{
+  if(this->dense != 0) { return this->dense->select(index); }
+
+  Iterator iter(*this);
+  return iter.select(index);
+}
+
+pair_type
+BitVector::valueBefore(size_t value) const
+{
+  if(this->dense != 0) { return this->dense->valueBefore(value); }
+
+  Iterator iter(*this);
+  return iter.valueBefore(value);
+}
+
+pair_type
+BitVector::valueAfter(size_t value) const
+{
+  if(this->dense != 0) { return this->dense->valueAfter(value); }
+
+  Iterator iter(*this);
+  return iter.valueAfter(value);
+}
+
+bool
+BitVector::isSet(size_t value) const
+{
+  if(this->dense != 0) { return this->dense->isSet(value); }
+
+  Iterator iter(*this);
+  return iter.isSet(value);
+}
+
+//--------------------------------------------------------------------------
+
 BitVector::Iterator::Iterator(const BitVector& par) :
   BitVectorBase::Iterator(par),
   use_rle(false)
@@ -90,6 +243,7 @@ BitVector::Iterator::rank(size_t value, bool at_least)
   const BitVector& par = (const BitVector&)(this->parent);
 
   if(value >= par.size) { return par.items; }
+  if(par.dense != 0) { return par.dense->rank(value, at_least); }
 
   this->valueLoop(value);
 
@@ -112,6 +266,11 @@ BitVector::Iterator::select(size_t index)
   const BitVector& par = (const BitVector&)(this->parent);
 
   if(index >= par.items) { return par.size; }
+  if(par.dense != 0)
+  {
+    this->moveDense(index, par.dense->select(index));
+    return this->val;
+  }
   this->getSample(this->sampleForIndex(index));
 
   size_t lim = index - this->sample.first;
@@ -135,6 +294,19 @@ BitVector::Iterator::select(size_t index)
 size_t
 BitVector::Iterator::selectNext()
 {
+  const BitVector& par = (const BitVector&)(this->parent);
+
+  if(par.dense != 0)
+  {
+    if(this->cur + 1 >= par.items)
+    {
+      this->moveDense(par.items, par.size);
+      return this->val;
+    }
+    this->moveDense(this->cur + 1, par.dense->select(this->cur + 1));
+    return this->val;
+  }
+
   if(this->cur >= this->block_items)
   {
     this->getSample(this->block + 1);
@@ -162,6 +334,12 @@ BitVector::Iterator::valueBefore(size_t value)
   const BitVector& par = (const BitVector&)(this->parent);
 
   if(value >= par.size) { return pair_type(par.size, par.items); }
+  if(par.dense != 0)
+  {
+    pair_type result = par.dense->valueBefore(value);
+    this->moveDense(result.second, result.first);
+    return result;
+  }
 
   this->getSample(this->sampleForValue(value));
   if(this->val > value) { return pair_type(par.size, par.items); }
@@ -193,6 +371,12 @@ BitVector::Iterator::valueAfter(size_t value)
   const BitVector& par = (const BitVector&)(this->parent);
 
   if(value >= par.size) { return pair_type(par.size, par.items); }
+  if(par.dense != 0)
+  {
+    pair_type result = par.dense->valueAfter(value);
+    this->moveDense(result.second, result.first);
+    return result;
+  }
 
   this->valueLoop(value);
 
@@ -207,6 +391,14 @@ BitVector::Iterator::valueAfter(size_t value)
 pair_type
 BitVector::Iterator::nextValue()
 {
+  const BitVector& par = (const BitVector&)(this->parent);
+
+  if(par.dense != 0)
+  {
+    this->selectNext();
+    return pair_type(this->val, this->cur);
+  }
+
   if(this->cur >= this->block_items)
   {
     this->getSample(this->block + 1);
@@ -233,6 +425,15 @@ BitVector::Iterator::selectRun(size_t index, size_t max_length)
 {
   size_t value = this->select(index);
 
+  const BitVector& par = (const BitVector&)(this->parent);
+  if(par.dense != 0)
+  {
+    if(value >= par.size) { return pair_type(value, 0); }
+    size_t len = par.dense->runAfter(value, max_length);
+    this->cur += len; this->val += len;
+    return pair_type(value, len);
+  }
+
   size_t len = std::min(max_length, this->run);
   this->run -= len; this->cur += len; this->val += len;
 
@@ -244,6 +445,15 @@ BitVector::Iterator::selectNextRun(size_t max_length)
 {
   size_t value = this->selectNext();
 
+  const BitVector& par = (const BitVector&)(this->parent);
+  if(par.dense != 0)
+  {
+    if(value >= par.size) { return pair_type(value, 0); }
+    size_t len = par.dense->runAfter(value, max_length);
+    this->cur += len; this->val += len;
+    return pair_type(value, len);
+  }
+
   size_t len = std::min(max_length, this->run);
   this->run -= len; this->cur += len; this->val += len;
 
@@ -256,6 +466,7 @@ BitVector::Iterator::isSet(size_t value)
   const BitVector& par = (const BitVector&)(this->parent);
 
   if(value >= par.size) { return false; }
+  if(par.dense != 0) { return par.dense->isSet(value); }
 
   this->valueLoop(value);
 
@@ -4,6 +4,7 @@
 #include <fstream>
 
 #include "BitVectorBase.hpp"
+#include "DenseBitVector.hpp"
 
 namespace CSA {
 
@@ -47,6 +48,16 @@ class BitVectorEncoder : public VectorEncoder
   This bit vector uses nibble coding. Each block is either run-length encoded or
   gap encoded, depending on the first nibble.
 
+  Rank within a block means decoding it, which is slow for dense vectors. So
+  when a vector is dense enough that storing every bit takes no more space than
+  the nibble codes, we store it as a DenseBitVector instead, and drop the nibble
+  codes. Either way there is only one copy of the bits.
+
+  A dense vector is saved as DENSE_TAG, the block size, and the DenseBitVector.
+  The tag can't be the size of a nibble-coded vector, so the loaders can tell
+  the two apart, and older files still load. Data used in place is never
+  converted, since that would mean copying it.
+
   // FIXME reverting to gap encoding not implemented yet
 */
 
@@ -55,14 +66,26 @@ class BitVector : public BitVectorBase
   public:
     typedef BitVectorEncoder Encoder;
 
+    // Marks a saved DenseBitVector.
+    static const size_t DENSE_TAG = ~(size_t)0;
+
     explicit BitVector(std::ifstream& file);
     explicit BitVector(FILE* file);
+    // This version uses the data in place, as written by writeTo(), and does
+    // not delete it. The data must outlive the vector. Throws
+    // std::runtime_error if the vector doesn't fit in the given number of
+    // words.
+    BitVector(const size_t* buffer, size_t words);
     BitVector(Encoder& encoder, size_t universe_size);
     ~BitVector();
 
 //--------------------------------------------------------------------------
 
+    void writeTo(std::ofstream& file) const;
+    void writeTo(FILE* file) const;
+
     size_t reportSize() const;
+    size_t getCompressedSize() const;
     
     /**
      * Union all the 1s in this bit vector with those in that one (bitwise OR),
@@ -71,6 +94,27 @@ class BitVector : public BitVectorBase
      */
     BitVector* createUnion(const BitVector& other) const;
     
+    /**
+     * Get the constant-time form of this vector, or NULL if it is stored with
+     * nibble codes.
+     */
+    inline const DenseBitVector* getDense() const { return this->dense; }
+
+//--------------------------------------------------------------------------
+
+    /*
+      These answer single queries without an Iterator, with the same meanings
+      as in BitVectorBase::Iterator. They keep no state and allocate nothing,
+      so any number of threads can use the same vector at once. They use the
+      constant-time form if there is one, and otherwise decode on the stack.
+    */
+
+    size_t rank(size_t value, bool at_least = false) const;
+    size_t select(size_t index) const;
+    pair_type valueBefore(size_t value) const;
+    pair_type valueAfter(size_t value) const;
+    bool isSet(size_t value) const;
+
 //--------------------------------------------------------------------------
 
     class Iterator : public BitVectorBase::Iterator
@@ -102,6 +146,15 @@ class BitVector : public BitVectorBase
 
         void valueLoop(size_t value);
 
+        // Moves to the given 1-bit of a dense vector.
+        inline void moveDense(size_t index, size_t value)
+        {
+          this->sample.first = 0;
+          this->cur = index;
+          this->val = value;
+          this->run = 0;
+        }
+
         inline void getSample(size_t sample_number)
         {
           BitVectorBase::Iterator::getSample(sample_number);
@@ -126,6 +179,20 @@ class BitVector : public BitVectorBase
   
   protected:
 
+    // The constant-time form, if we use it
+    DenseBitVector* dense;
+
+    /**
+     * Switch to the constant-time form if the vector is dense enough. This
+     * frees the nibble codes.
+     */
+    void chooseLayout();
+
+    /**
+     * Use the given constant-time form, taking ownership of it.
+     */
+    void setDense(DenseBitVector* vector);
+
     // These are not allowed.
     BitVector();
     BitVector(const BitVector&);
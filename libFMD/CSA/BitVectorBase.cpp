@@ -1,39 +1,26 @@
 #include <cstring>
 #include <cstdlib>
+#include <stdexcept>
 
 #include "BitVector.hpp"
 
 namespace CSA {
 
 BitVectorBase::BitVectorBase(std::ifstream& file) :
-  rank_index(0), select_index(0)
+  free_array(true), rank_index(0), select_index(0)
 {
-  this->readHeader(file);
-  this->readArray(file);
-
-  this->integer_bits = length(this->size);
-  this->samples = new ReadBuffer(file, 2 * (this->number_of_blocks + 1), this->integer_bits);
-
-  this->indexForRank();
-  this->indexForSelect();
+  this->load(file);
 }
 
 BitVectorBase::BitVectorBase(FILE* file) :
-  rank_index(0), select_index(0)
+  free_array(true), rank_index(0), select_index(0)
 {
-  this->readHeader(file);
-  this->readArray(file);
-
-  this->integer_bits = length(this->size);
-  this->samples = new ReadBuffer(file, 2 * (this->number_of_blocks + 1), this->integer_bits);
-
-  this->indexForRank();
-  this->indexForSelect();
+  this->load(file);
 }
 
 BitVectorBase::BitVectorBase(VectorEncoder& encoder, size_t universe_size) :
   size(universe_size), items(encoder.items),
-  block_size(encoder.block_size),
+  free_array(true), block_size(encoder.block_size),
   number_of_blocks(encoder.blocks),
   rank_index(0), select_index(0)
 {
@@ -69,14 +56,24 @@ BitVectorBase::BitVectorBase(VectorEncoder& encoder, size_t universe_size) :
   this->indexForSelect();
 }
 
+BitVectorBase::BitVectorBase(const size_t* buffer, size_t words) :
+  samples(0), rank_index(0), select_index(0)
+{
+  this->load(buffer, words);
+}
+
 BitVectorBase::BitVectorBase() :
-  array(0), samples(0), rank_index(0), select_index(0)
+  size(0), items(0),
+  array(0), free_array(true), block_size(0), number_of_blocks(0),
+  samples(0), integer_bits(0),
+  rank_index(0), rank_rate(0),
+  select_index(0), select_rate(0)
 {
 }
 
 BitVectorBase::~BitVectorBase()
 {
-  delete[] this->array;
+  if(this->free_array) { delete[] this->array; }
   delete this->samples;
   delete this->rank_index;
   delete this->select_index;
@@ -84,6 +81,77 @@ BitVectorBase::~BitVectorBase()
 
 //--------------------------------------------------------------------------
 
+void
+BitVectorBase::load(std::ifstream& file)
+{
+  this->free_array = true;
+  this->readHeader(file);
+  this->readArray(file);
+
+  this->integer_bits = length(this->size);
+  this->samples = new ReadBuffer(file, 2 * (this->number_of_blocks + 1), this->integer_bits);
+
+  this->indexForRank();
+  this->indexForSelect();
+}
+
+void
+BitVectorBase::load(FILE* file)
+{
+  this->free_array = true;
+  this->readHeader(file);
+  this->readArray(file);
+
+  this->integer_bits = length(this->size);
+  this->samples = new ReadBuffer(file, 2 * (this->number_of_blocks + 1), this->integer_bits);
+
+  this->indexForRank();
+  this->indexForSelect();
+}
+
+void
+BitVectorBase::load(const size_t* buffer, size_t words)
+{
+  // Make sure everything we use is really there before we look at it.
+  if(words < 4)
+  {
+    throw std::runtime_error("BitVector: In-place data is truncated");
+  }
+  size_t array_words = buffer[2] * buffer[3];
+  if(buffer[1] == 0 || buffer[2] == 0 || buffer[3] == 0 ||
+    buffer[2] > words || buffer[3] > words || array_words / buffer[3] != buffer[2] ||
+    array_words > words - 4 ||
+    BITS_TO_WORDS(2 * (buffer[2] + 1) * length(buffer[0])) > words - 4 - array_words)
+  {
+    throw std::runtime_error("BitVector: In-place data is truncated");
+  }
+
+  this->size = buffer[0]; this->items = buffer[1];
+  this->number_of_blocks = buffer[2]; this->block_size = buffer[3];
+  this->array = buffer + 4; this->free_array = false;
+
+  // The samples follow the array, and we read them in place too.
+  this->integer_bits = length(this->size);
+  this->samples = new ReadBuffer(this->array + this->block_size * this->number_of_blocks,
+    2 * (this->number_of_blocks + 1), this->integer_bits);
+
+  this->indexForRank();
+  this->indexForSelect();
+}
+
+void
+BitVectorBase::release()
+{
+  if(this->free_array) { delete[] this->array; }
+  this->array = 0; this->free_array = true;
+  this->number_of_blocks = 0;
+  delete this->samples; this->samples = 0;
+  delete this->rank_index; this->rank_index = 0;
+  delete this->select_index; this->select_index = 0;
+}
+
+//--------------------------------------------------------------------------
+
 void
 BitVectorBase::writeTo(std::ofstream& file) const
 {
@@ -288,7 +356,7 @@ BitVectorBase::indexForSelect()
 BitVectorBase::Iterator::Iterator(const BitVectorBase& par) :
   parent(par),
   buffer(par.array, par.block_size),
-  samples(*(par.samples))
+  samples(par.samples != 0 ? *(par.samples) : ReadBuffer((const size_t*)0, (size_t)0))
 {
 }
 
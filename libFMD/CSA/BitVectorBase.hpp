@@ -84,21 +84,27 @@ class BitVectorBase
     explicit BitVectorBase(FILE* file);
     BitVectorBase(VectorEncoder& encoder, size_t universe_size);
     explicit BitVectorBase(WriteBuffer& vector);
-    ~BitVectorBase();
+
+    // This version uses the data in place, as written by writeTo(), and does
+    // not delete it. The data must outlive the vector. Throws
+    // std::runtime_error if the vector doesn't fit in the given number of
+    // words.
+    BitVectorBase(const size_t* buffer, size_t words);
+    virtual ~BitVectorBase();
 
 //--------------------------------------------------------------------------
 
-    void writeTo(std::ofstream& file) const;
-    void writeTo(FILE* file) const;
+    virtual void writeTo(std::ofstream& file) const;
+    virtual void writeTo(FILE* file) const;
 
     inline size_t getSize() const { return this->size; }
     inline size_t getNumberOfItems() const { return this->items; }
     inline size_t getBlockSize() const { return this->block_size; }
 
     // This returns only the sizes of the dynamically allocated structures.
-    size_t reportSize() const;
+    virtual size_t reportSize() const;
 
-    size_t getCompressedSize() const;
+    virtual size_t getCompressedSize() const;
 
     // Removes structures not necessary for merging.
     void strip();
@@ -206,6 +212,7 @@ class BitVectorBase
     size_t size, items;
 
     const size_t* array;
+    bool          free_array;
     size_t        block_size;
     size_t        number_of_blocks;
 
@@ -241,9 +248,19 @@ class BitVectorBase
     void readArray(FILE* file);
 
     void copyArray(VectorEncoder& encoder, bool use_directly = false);
+
+    // These let a derived class decide how to load the vector once it has
+    // looked at the data. The default constructor leaves everything empty.
+    BitVectorBase();
+    void load(std::ifstream& file);
+    void load(FILE* file);
+    void load(const size_t* buffer, size_t words);
+
+    // Frees the encoded vector, keeping only size, items and block_size.
+    void release();
+
 private:
     // These are not allowed.
-    BitVectorBase();
     BitVectorBase(const BitVectorBase&);
     BitVectorBase& operator = (const BitVectorBase&);
 };
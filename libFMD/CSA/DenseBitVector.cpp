@@ -0,0 +1,301 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "DenseBitVector.hpp"
+#include "BitVector.hpp"
+
+namespace CSA {
+
+DenseBitVector::DenseBitVector(std::ifstream& file) :
+  free_data(true)
+{
+  this->readHeader(file);
+
+  size_t data_words = dataWords(this->size, this->items);
+  size_t* buffer = new size_t[data_words];
+  memset(buffer, 0, data_words * sizeof(size_t));
+  file.read((char*)buffer, data_words * sizeof(size_t));
+  this->setData(buffer);
+}
+
+DenseBitVector::DenseBitVector(FILE* file) :
+  free_data(true)
+{
+  this->readHeader(file);
+
+  size_t data_words = dataWords(this->size, this->items);
+  size_t* buffer = new size_t[data_words];
+  memset(buffer, 0, data_words * sizeof(size_t));
+  if(file == 0 || std::fread(buffer, sizeof(size_t), data_words, file) != data_words)
+  {
+    // Anything we couldn't read is left as 0s.
+  }
+  this->setData(buffer);
+}
+
+DenseBitVector::DenseBitVector(const size_t* buffer, size_t words) :
+  free_data(false)
+{
+  // Make sure all the bits and directories are really there.
+  if(words < 2 || buffer[0] / WORD_BITS > words || buffer[1] > buffer[0] ||
+    dataWords(buffer[0], buffer[1]) > words - 2)
+  {
+    throw std::runtime_error("DenseBitVector: In-place data is truncated");
+  }
+
+  this->size = buffer[0]; this->items = buffer[1];
+  this->setData(buffer + 2);
+}
+
+DenseBitVector::DenseBitVector(const BitVector& source) :
+  size(source.getSize()), items(source.getNumberOfItems()),
+  free_data(true)
+{
+  size_t data_words = dataWords(this->size, this->items);
+  size_t* buffer = new size_t[data_words];
+  memset(buffer, 0, data_words * sizeof(size_t));
+
+  // Decode the runs of 1-bits in order.
+  BitVector::Iterator iter(source);
+  size_t done = 0;
+  while(done < this->items)
+  {
+    pair_type run = (done == 0 ? iter.selectRun(0, this->items) :
+      iter.selectNextRun(this->items));
+    for(size_t i = run.first; i <= run.first + run.second; i++)
+    {
+      buffer[i / WORD_BITS] |= (size_t)1 << (i % WORD_BITS);
+    }
+    done += run.second + 1;
+  }
+
+  this->buildDirectories(buffer);
+  this->setData(buffer);
+}
+
+DenseBitVector::~DenseBitVector()
+{
+  if(this->free_data) { delete[] this->data; }
+}
+
+//--------------------------------------------------------------------------
+
+void
+DenseBitVector::writeTo(std::ofstream& file) const
+{
+  file.write((char*)&(this->size), sizeof(this->size));
+  file.write((char*)&(this->items), sizeof(this->items));
+  file.write((char*)(this->data), dataWords(this->size, this->items) * sizeof(size_t));
+}
+
+void
+DenseBitVector::writeTo(FILE* file) const
+{
+  if(file == 0) { return; }
+  std::fwrite(&(this->size), sizeof(this->size), 1, file);
+  std::fwrite(&(this->items), sizeof(this->items), 1, file);
+  std::fwrite(this->data, sizeof(size_t), dataWords(this->size, this->items), file);
+}
+
+void
+DenseBitVector::readHeader(std::ifstream& file)
+{
+  this->size = 0; this->items = 0;
+  file.read((char*)&(this->size), sizeof(this->size));
+  file.read((char*)&(this->items), sizeof(this->items));
+}
+
+void
+DenseBitVector::readHeader(FILE* file)
+{
+  this->size = 0; this->items = 0;
+  if(file != 0)
+  {
+    if(!std::fread(&(this->size), sizeof(this->size), 1, file)) { this->size = 0; }
+    if(!std::fread(&(this->items), sizeof(this->items), 1, file)) { this->items = 0; }
+  }
+}
+
+void
+DenseBitVector::setData(const size_t* buffer)
+{
+  this->data = buffer;
+  this->words = BITS_TO_WORDS(this->size);
+  this->blocks = (this->words + WORDS_IN_BLOCK - 1) / WORDS_IN_BLOCK;
+
+  this->array = this->data;
+  this->block_ranks = this->array + this->words;
+  this->select_samples = this->block_ranks + this->blocks + 1;
+}
+
+//--------------------------------------------------------------------------
+
+size_t
+DenseBitVector::reportSize() const
+{
+  size_t bytes = sizeof(*this);
+  if(this->free_data) { bytes += dataWords(this->size, this->items) * sizeof(size_t); }
+  return bytes;
+}
+
+size_t
+DenseBitVector::dataWords(size_t universe_size, size_t items)
+{
+  size_t words = BITS_TO_WORDS(universe_size);
+  size_t blocks = (words + WORDS_IN_BLOCK - 1) / WORDS_IN_BLOCK + 1;
+  size_t samples = (items + SELECT_RATE - 1) / SELECT_RATE + 1;
+  return words + blocks + samples;
+}
+
+size_t
+DenseBitVector::bytesFor(size_t universe_size, size_t items)
+{
+  return sizeof(DenseBitVector) + dataWords(universe_size, items) * sizeof(size_t);
+}
+
+//--------------------------------------------------------------------------
+
+void
+DenseBitVector::buildDirectories(size_t* buffer)
+{
+  size_t words = BITS_TO_WORDS(this->size);
+  size_t blocks = (words + WORDS_IN_BLOCK - 1) / WORDS_IN_BLOCK;
+  size_t* ranks = buffer + words;
+  size_t* samples = ranks + blocks + 1;
+
+  // Count up the 1-bits, noting the block every SELECT_RATE-th one is in.
+  size_t total = 0, sampled = 0;
+  for(size_t block = 0; block < blocks; block++)
+  {
+    ranks[block] = total;
+    size_t limit = std::min(words, (block + 1) * WORDS_IN_BLOCK);
+    for(size_t word = block * WORDS_IN_BLOCK; word < limit; word++)
+    {
+      size_t count = popcount(buffer[word]);
+      while(sampled * SELECT_RATE < total + count)
+      {
+        samples[sampled] = block; sampled++;
+      }
+      total += count;
+    }
+  }
+  ranks[blocks] = total;
+  samples[sampled] = (blocks == 0 ? 0 : blocks - 1);
+}
+
+size_t
+DenseBitVector::rankBefore(size_t value) const
+{
+  size_t block = value / BLOCK_BITS;
+  size_t result = this->block_ranks[block];
+
+  size_t last = value / WORD_BITS;
+  for(size_t word = block * WORDS_IN_BLOCK; word < last; word++)
+  {
+    result += popcount(this->array[word]);
+  }
+  if(value % WORD_BITS != 0)
+  {
+    result += popcount(this->array[last] & (((size_t)1 << (value % WORD_BITS)) - 1));
+  }
+
+  return result;
+}
+
+size_t
+DenseBitVector::rank(size_t value, bool at_least) const
+{
+  if(value >= this->size) { return this->items; }
+
+  if(at_least) { return this->rankBefore(value) + 1; }
+  return this->rankBefore(value + 1);
+}
+
+size_t
+DenseBitVector::select(size_t index) const
+{
+  if(index >= this->items) { return this->size; }
+
+  // Find the last block starting at or before the 1-bit, between the blocks
+  // holding the samples around it.
+  size_t low = this->select_samples[index / SELECT_RATE];
+  size_t high = this->select_samples[index / SELECT_RATE + 1];
+  while(low < high)
+  {
+    size_t mid = low + (high - low + 1) / 2;
+    if(this->block_ranks[mid] <= index) { low = mid; }
+    else { high = mid - 1; }
+  }
+
+  // Then find the word it is in.
+  size_t remaining = index - this->block_ranks[low];
+  size_t word = low * WORDS_IN_BLOCK;
+  size_t count = popcount(this->array[word]);
+  while(count <= remaining)
+  {
+    remaining -= count;
+    word++;
+    count = popcount(this->array[word]);
+  }
+
+  // And then the byte, and the bit.
+  size_t field = this->array[word];
+  size_t offset = 0;
+  count = popcount(field & 0xFF);
+  while(count <= remaining)
+  {
+    remaining -= count;
+    offset += CHAR_BIT;
+    count = popcount((field >> offset) & 0xFF);
+  }
+  field >>= offset;
+  for(; remaining > 0; remaining--) { field &= field - 1; }
+
+  return word * WORD_BITS + offset + __builtin_ctzl(field);
+}
+
+pair_type
+DenseBitVector::valueBefore(size_t value) const
+{
+  if(value >= this->size) { return pair_type(this->size, this->items); }
+
+  size_t index = this->rankBefore(value + 1);
+  if(index == 0) { return pair_type(this->size, this->items); }
+  return pair_type(this->select(index - 1), index - 1);
+}
+
+pair_type
+DenseBitVector::valueAfter(size_t value) const
+{
+  if(value >= this->size) { return pair_type(this->size, this->items); }
+
+  size_t index = this->rankBefore(value);
+  if(index >= this->items) { return pair_type(this->size, this->items); }
+  return pair_type(this->select(index), index);
+}
+
+bool
+DenseBitVector::isSet(size_t value) const
+{
+  if(value >= this->size) { return false; }
+  return (this->array[value / WORD_BITS] >> (value % WORD_BITS)) & 1;
+}
+
+size_t
+DenseBitVector::runAfter(size_t value, size_t max_length) const
+{
+  // Bits past the end are 0s, so the run stops there by itself.
+  size_t length = 0, pos = value + 1;
+  while(length < max_length && pos < this->size)
+  {
+    size_t offset = pos % WORD_BITS;
+    size_t zeros = ~(this->array[pos / WORD_BITS] >> offset);
+    size_t ones = (zeros == 0 ? WORD_BITS : __builtin_ctzl(zeros));
+    length += ones; pos += ones;
+    if(ones < WORD_BITS - offset) { break; }
+  }
+
+  return std::min(length, max_length);
+}
+
+}
@@ -0,0 +1,124 @@
+#ifndef CSA_DENSEBITVECTOR_HPP
+#define CSA_DENSEBITVECTOR_HPP
+
+#include <cstdio>
+#include <fstream>
+
+#include "BitBuffer.hpp"
+
+namespace CSA {
+
+class BitVector;
+
+/*
+  This bit vector stores every bit as it is, with directories that answer rank
+  and select in constant time: the number of 1-bits before every block of
+  BLOCK_BITS bits, and the block holding every SELECT_RATE-th 1-bit. It takes
+  a little over a bit per position whatever the density, so it only pays off
+  for dense vectors.
+
+  The directories are saved along with the bits, so a saved vector can be used
+  in place without any setup.
+
+  Queries have the same meaning as in BitVectorBase::Iterator, but they are
+  const, so any number of threads can use the same vector at once.
+*/
+
+class DenseBitVector
+{
+  public:
+    static const size_t BLOCK_BITS = 512;
+    static const size_t SELECT_RATE = 512;
+
+    explicit DenseBitVector(std::ifstream& file);
+    explicit DenseBitVector(FILE* file);
+
+    // This version uses the data in place, as written by writeTo(), and does
+    // not delete it. The data must outlive the vector. Throws
+    // std::runtime_error if the vector doesn't fit in the given number of
+    // words.
+    DenseBitVector(const size_t* buffer, size_t words);
+
+    // Copy all the 1-bits of a nibble-coded vector.
+    explicit DenseBitVector(const BitVector& source);
+    ~DenseBitVector();
+
+//--------------------------------------------------------------------------
+
+    void writeTo(std::ofstream& file) const;
+    void writeTo(FILE* file) const;
+
+    inline size_t getSize() const { return this->size; }
+    inline size_t getNumberOfItems() const { return this->items; }
+
+    // This returns only the sizes of the dynamically allocated structures.
+    size_t reportSize() const;
+
+    // How many bytes would a vector of the given size with the given number of
+    // 1-bits take?
+    static size_t bytesFor(size_t universe_size, size_t items);
+
+//--------------------------------------------------------------------------
+
+    // regular:   \sum_{i = 0}^{value} V[i]
+    // at_least:  \sum_{i = 0}^{value - 1} V[i] + 1
+    size_t rank(size_t value, bool at_least = false) const;
+
+    // \min value: \sum_{i = 0}^{value} V[i] = index + 1
+    size_t select(size_t index) const;
+
+    // (\max i <= value: V[i] = 1, rank(i) - 1)
+    // Returns (size, items) if not found.
+    pair_type valueBefore(size_t value) const;
+
+    // (\min i >= value: V[i] = 1, rank(i) - 1)
+    // Returns (size, items) if not found.
+    pair_type valueAfter(size_t value) const;
+
+    bool isSet(size_t value) const; // V[value]
+
+    // Number of 1-bits directly after V[value], up to max_length.
+    size_t runAfter(size_t value, size_t max_length) const;
+
+//--------------------------------------------------------------------------
+
+  protected:
+    size_t size, items;
+
+    // The bits and directories, in one block as they are saved.
+    const size_t* data;
+    bool          free_data;
+    size_t        words, blocks;
+
+    // The bits, least significant first in each word.
+    const size_t* array;
+
+    // Number of 1-bits before each block, and then the total.
+    const size_t* block_ranks;
+
+    // Block holding each SELECT_RATE-th 1-bit, and then the last block.
+    const size_t* select_samples;
+
+    static const size_t WORDS_IN_BLOCK = BLOCK_BITS / WORD_BITS;
+
+    // Number of words of bits and directories after the size and item count.
+    static size_t dataWords(size_t universe_size, size_t items);
+
+    // Number of 1-bits before the given position.
+    size_t rankBefore(size_t value) const;
+
+    void readHeader(std::ifstream& file);
+    void readHeader(FILE* file);
+    void setData(const size_t* buffer);
+    void buildDirectories(size_t* buffer);
+
+  private:
+    // These are not allowed.
+    DenseBitVector();
+    DenseBitVector(const DenseBitVector&);
+    DenseBitVector& operator = (const DenseBitVector&);
+};
+
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef FMDEXTENSIONS_HPP
+#define FMDEXTENSIONS_HPP
+
+#include <string>
+#include <stdexcept>
+#include <stdint.h>
+
+#include "FMDPosition.hpp"
+#include "util.hpp"
+
+/**
+ * Holds the return values from FMDIndex::extendAll(): the FMDPosition reached
+ * by extending with each base, in the order of the bases in BASES, and the
+ * number of things in the extended range that ran into the end of the text
+ * instead.
+ */
+struct FMDExtensions
+{
+    FMDPosition children[NUM_BASES];
+    int64_t endOfTextLength;
+
+    /**
+     * Get the FMDPosition reached by extending with the given base.
+     */
+    inline const FMDPosition& get(char base) const {
+        for(size_t i = 0; i < NUM_BASES; i++) {
+            if(BASES[i] == base) {
+                return children[i];
+            }
+        }
+        throw std::runtime_error(std::string("Character #") + base +
+            std::string(" is not a DNA base."));
+    }
+};
+
+#endif
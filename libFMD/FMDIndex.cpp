@@ -4,17 +4,21 @@
 #include <sstream>
 #include <stdexcept>
 #include <algorithm>
+#include <map>
 
 #include <Util.h>
 
 #include "FMDIndex.hpp"
+#include "InterleavedMapper.hpp"
 #include "util.hpp"
 #include "Log.hpp"
 
 FMDIndex::FMDIndex(std::string basename, SuffixArray* fullSuffixArray): 
-    names(), starts(), lengths(), cumulativeLengths(), genomeAssignments(),
+    basename(basename), names(), starts(), lengths(), cumulativeLengths(), genomeAssignments(),
     endIndices(), genomeRanges(), genomeMasks(), bwt(basename + ".bwt"), 
-    suffixArray(basename + ".ssa"), fullSuffixArray(fullSuffixArray) {
+    suffixArray(basename + ".ssa"), fullSuffixArray(fullSuffixArray),
+    packedText(NULL), isa(NULL), lcp(NULL), contexts(NULL),
+    packedSuffixArray(NULL) {
     
     // TODO: Too many initializers
 
@@ -74,6 +78,62 @@ FMDIndex::FMDIndex(std::string basename, SuffixArray* fullSuffixArray):
     // Close up the contig file. We read our contig metadata.
     contigFile.close();
     
+    if(std::ifstream((basename + ".pak").c_str()).good()) {
+        // We have the contig text packed, so we don't have to walk the BWT for
+        // it.
+        packedText = new PackedText(basename + ".pak");
+        
+        if(packedText->getNumberOfContigs() != names.size()) {
+            throw std::runtime_error("Packed text for " + basename + 
+                " has the wrong number of contigs");
+        }
+    }
+    
+    if(std::ifstream((basename + ".isa").c_str()).good()) {
+        // We have a sampled inverse suffix array, so we can unlocate.
+        isa = new SampledISA(basename + ".isa");
+        
+        if(isa->getNumberOfTexts() != names.size() * 2) {
+            throw std::runtime_error("Sampled ISA for " + basename + 
+                " has the wrong number of texts");
+        }
+    }
+    
+    if(std::ifstream((basename + ".lcp").c_str()).good()) {
+        // We have an LCP array, so we can contract searches.
+        lcp = new LCPArray(basename + ".lcp");
+        
+        if(lcp->getLength() != bwt.getBWLen() + 1) {
+            throw std::runtime_error("LCP array for " + basename + 
+                " has the wrong length");
+        }
+    }
+    
+    if(fullSuffixArray == NULL &&
+        std::ifstream((basename + ".sa").c_str()).good()) {
+        // We have a saved full suffix array, so we can locate without walking
+        // the BWT.
+        packedSuffixArray = new PackedSuffixArray(basename + ".sa");
+        
+        if(packedSuffixArray->getLength() != bwt.getBWLen() ||
+            packedSuffixArray->getNumberOfTexts() != names.size() * 2) {
+            
+            throw std::runtime_error("Full suffix array for " + basename + 
+                " doesn't match the index");
+        }
+    }
+    
+    if(std::ifstream((basename + ".uct").c_str()).good()) {
+        // We have a unique context table, so we can say how much context
+        // positions need.
+        contexts = new UniqueContextTable(basename + ".uct");
+        
+        if(contexts->getNumberOfTexts() != names.size() * 2) {
+            throw std::runtime_error("Unique context table for " + basename + 
+                " has the wrong number of texts");
+        }
+    }
+    
     // Now read the genome bit masks.
     
     // What file are they in? Make sure to hold onto it while we construct the
@@ -149,13 +209,15 @@ FMDIndex::FMDIndex(std::string basename, SuffixArray* fullSuffixArray):
     // First make sure the vector is big enough for them.
     endIndices.resize(getNumberOfContigs());
     
+    // The first #-of-texts rows in the BWT table have a '$' in the F column, so
+    // the L column (what our BWT string actually is) will have the last real
+    // character in some text. Locate them all to texts and offsets.
+    std::vector<TextPosition> textEnds = locateRange(
+        FMDPosition(0, 0, (int64_t)getNumberOfContigs() * 2 - 1));
+    
     for(int64_t i = 0; i < getNumberOfContigs() * 2; i++) {
-        // The first #-of-texts rows in the BWT table have a '$' in the F
-        // column, so the L column (what our BWT string actually is) will have
-        // the last real character in some text.
-        
-        // Locate it to a text and offset
-        TextPosition position = locate(i);
+        // Look at where each one is.
+        const TextPosition& position = textEnds[i];
         
         if(position.getText() % 2 == 0) {
             // This is a forward strand. Save the index of the last real
@@ -175,6 +237,31 @@ FMDIndex::~FMDIndex() {
         delete fullSuffixArray;
     }
     
+    if(packedText != NULL) {
+        // Same for a packed text.
+        delete packedText;
+    }
+    
+    if(isa != NULL) {
+        // And a sampled ISA.
+        delete isa;
+    }
+    
+    if(lcp != NULL) {
+        // And an LCP array.
+        delete lcp;
+    }
+    
+    if(contexts != NULL) {
+        // And a unique context table.
+        delete contexts;
+    }
+    
+    if(packedSuffixArray != NULL) {
+        // And a saved full suffix array.
+        delete packedSuffixArray;
+    }
+    
     for(std::vector<BitVector*>::iterator i = genomeMasks.begin(); 
         i != genomeMasks.end(); ++i) {
         
@@ -266,7 +353,7 @@ std::pair<size_t, size_t> FMDIndex::getGenomeContigs(size_t genome) const {
 }
 
 bool FMDIndex::isInGenome(int64_t bwtIndex, size_t genome) const {
-    return BitVectorIterator(*genomeMasks[genome]).isSet(bwtIndex);
+    return genomeMasks[genome]->isSet(bwtIndex);
 }
 
 const BitVector& FMDIndex::getGenomeMask(size_t genome) const {
@@ -276,7 +363,7 @@ const BitVector& FMDIndex::getGenomeMask(size_t genome) const {
 int64_t FMDIndex::getTotalLength() const {
     // Sum all the contig lengths and double (to make it be for both strands).
     // See <http://stackoverflow.com/a/3221813/402891>
-    return std::accumulate(lengths.begin(), lengths.end(), 0) * 2;
+    return std::accumulate(lengths.begin(), lengths.end(), (int64_t)0) * 2;
 }
 
 int64_t FMDIndex::getBWTLength() const {
@@ -375,23 +462,30 @@ void FMDIndex::extendFast(FMDPosition& range, char c, bool backward) const {
     
 }
    
+void FMDIndex::prefetchExtendMarkers(const FMDPosition& range,
+    bool backward) const {
+    
+    // Extension works on the forward interval for backward extension, and the
+    // reverse interval otherwise, and looks up occurrences just before and at
+    // the end of it. See extendFast.
+    int64_t start = backward ? range.getForwardStart() : 
+        range.getReverseStart();
+    bwt.prefetchMarkers(start - 1);
+    bwt.prefetchMarkers(start + range.getEndOffset());
+}
+
+void FMDIndex::prefetchExtendRuns(const FMDPosition& range,
+    bool backward) const {
+    
+    // Look at the same places as prefetchExtendMarkers.
+    int64_t start = backward ? range.getForwardStart() : 
+        range.getReverseStart();
+    bwt.prefetchRuns(start - 1);
+    bwt.prefetchRuns(start + range.getEndOffset());
+}
+   
 FMDPosition FMDIndex::extend(FMDPosition range, char c, bool backward) const {
     // Extend the search with this character.
-    
-    // More or less directly implemented off of algorithms 2 and 3 in "Exploring
-    // single-sample SNP and INDEL calling with whole-genome de novo assembly"
-    // (Li, 2012). However, our character indices are one less, since we don't
-    // allow search patterns to include the end-of-text symbol. We also use
-    // alphabetical ordering instead of the paper's N-last ordering in the FM-
-    // index, and consequently need to assign reverse ranges in alphabetical
-    // order by reverse complement.
-  
-    if(!backward) {
-        // We only really want to implement backwards search. Flip the interval,
-        // do backwards search with the complement of the base, and then flip
-        // back.
-        return extend(range.flip(), complement(c), true).flip();        
-    }
 
     if(c == '\0') {
         throw std::runtime_error("Can't extend with null byte!");
@@ -404,103 +498,129 @@ FMDPosition FMDIndex::extend(FMDPosition range, char c, bool backward) const {
         throw std::runtime_error(errorMessage);
     }
 
-    Log::trace() << "Extending " << range << " backwards with " << c <<
-        std::endl;
-
-    // We have an array of FMDPositions, one per base, that we will fill in by a
-    // tiny dynamic programming.
-    FMDPosition answers[NUM_BASES];
+    // Work out where every base would go, and keep the one we want.
+    FMDPosition answer = extendAll(range, backward).get(c);
+    
+    Log::trace() << "Moving " << range << " to " << answer << " on " << c <<
+        (backward ? " backwards" : " forwards") << std::endl;
+    
+    return answer;
+}
 
+FMDExtensions FMDIndex::extendAll(const FMDPosition& range,
+    bool backward) const {
+    
+    // Extend the search with every base.
+    
+    // More or less directly implemented off of algorithms 2 and 3 in "Exploring
+    // single-sample SNP and INDEL calling with whole-genome de novo assembly"
+    // (Li, 2012). However, our character indices are one less, since we don't
+    // allow search patterns to include the end-of-text symbol. We also use
+    // alphabetical ordering instead of the paper's N-last ordering in the FM-
+    // index, and consequently need to assign reverse ranges in alphabetical
+    // order by reverse complement.
+    
+    if(!backward) {
+        // We only really want to implement backwards search. Flip the interval
+        // and do backwards search.
+        FMDExtensions flipped = extendAll(range.flip(), true);
+        
+        // Now the answer for each base is the flipped answer for its
+        // complement. BASES is its own reverse complement, so that's the base
+        // at the mirror image index.
+        FMDExtensions extensions;
+        for(size_t base = 0; base < NUM_BASES; base++) {
+            extensions.children[base] = 
+                flipped.children[NUM_BASES - 1 - base].flip();
+        }
+        extensions.endOfTextLength = flipped.endOfTextLength;
+        
+        return extensions;
+    }
+    
+    // Read occurrences of everything from the BWT, just like extendFast.
+    
+    // What rank among occurrences is the first instance of every character in
+    // the BWT range?
+    AlphaCount64 startRanks = bwt.getFullOcc(range.getForwardStart() - 1);
+    
+    // And the last? If endOffset() is 0, this will be 1 character later than
+    // the call for startRanks, which is what we want.
+    AlphaCount64 endRanks = bwt.getFullOcc(range.getForwardStart() + 
+        range.getEndOffset());
+    
+    FMDExtensions extensions;
+    
+    // Get the number of suffixes that had '$' (end of text) next. It's the very
+    // first character we need to account for when subdividing the reverse
+    // range.
+    extensions.endOfTextLength = endRanks.get('$') - startRanks.get('$');
+    int64_t reverseStart = range.getReverseStart() + 
+        extensions.endOfTextLength;
+    
     for(size_t base = 0; base < NUM_BASES; base++) {
-        // Go through the bases in arbitrary order.
-
-        Log::trace() << "\tThinking about base " << base << "(" << 
-            BASES[base] << ")" << std::endl;
-
-        // Count up the number of characters < this base.
-        int64_t start = bwt.getPC(c);
-
-        Log::trace() << "\t\tstart = " << start << std::endl;
-
-        // Get the rank among occurrences of the first instance of this base in
-        // this slice.
-        int64_t forwardStartRank = bwt.getOcc(BASES[base], 
-            range.getForwardStart() - 1);
+        // For each base in alphabetical order by reverse complement (as stored
+        // in BASES), allocate it the next part of the reverse range.
         
-        // Get the same rank for the last instance. TODO: Is the -1 right here?
-        int64_t forwardEndRank = bwt.getOcc(BASES[base], 
-            range.getForwardStart() + range.getEndOffset()) - 1;
-
-        // Fill in the forward-strand start position and range end offset for
-        // this base's answer.
-        answers[base].setForwardStart(start + forwardStartRank);
-        answers[base].setEndOffset(forwardEndRank - forwardStartRank);
-
-        Log::trace() << "\t\tWould go to: " << answers[base] << std::endl;
+        // Work out the length of the interval this base gets.
+        int64_t intervalLength = endRanks.get(BASES[base]) - 
+            startRanks.get(BASES[base]);
+            
+        extensions.children[base] = FMDPosition(bwt.getPC(BASES[base]) + 
+            startRanks.get(BASES[base]), reverseStart, intervalLength - 1);
+            
+        // Budge the reverse strand interval over by the length of the
+        // interval, to account for the bit this base took up.
+        reverseStart += intervalLength;
     }
+    
+    return extensions;
+}
 
-    // Since we don't keep an FMDPosition for the non-base end-of-text
-    // character, we need to track its length separately in order for the DP
-    // algorithm given in the paper to be implementable. We calculate
-    // occurrences of the text end character (i.e. how much of the current range
-    // is devoted to things where an endOfText comes next) implicitly: it's
-    // whatever part of the length of the range is unaccounted-for by the other
-    // characters. We need to use the length accessor because ranges with one
-    // thing have the .end_offset set to 0.
-    int64_t endOfTextLength = range.getLength();
+bool FMDIndex::hasLCP() const {
+    return lcp != NULL;
+}
 
-    for(size_t base = 0; base < NUM_BASES; base++)
-    {
-        // Go through the bases in order and account for their lengths.
-        endOfTextLength -= answers[base].getLength();
+FMDPosition FMDIndex::contract(const FMDPosition& range, size_t& length,
+    bool backward) const {
+    
+    if(lcp == NULL || range.isEmpty()) {
+        // We can't do anything.
+        return EMPTY_FMD_POSITION;
     }
-
-
-    Log::trace() << "\tendOfTextLength = " << endOfTextLength << std::endl;
-
-    // The endOfText character is the very first character we need to account
-    // for when subdividing the reverse range and picking which subdivision to
-    // take.
-    Log::trace() << "\tendOfText reverse_start would be " << 
-        range.getReverseStart() << std::endl;
-
-    // Next, allocate the range for the base that comes first in alphabetical
-    // order by reverse complement.
-    answers[0].setReverseStart(range.getReverseStart() + endOfTextLength);
-    Log::trace() << "\t" << BASES[0] << " reverse_start is " << 
-        answers[0].getReverseStart() << std::endl;
-
-    for(size_t base = 1; base < NUM_BASES; base++)
-    {
-        // For each subsequent base in alphabetical order by reverse complement
-        // (as stored in BASES), allocate it the next part of the reverse range.
-
-        answers[base].setReverseStart(answers[base - 1].getReverseStart() + 
-            answers[base - 1].getLength());
-        Log::trace() << "\t" << BASES[base] << " reverse_start is " << 
-        answers[base].getReverseStart() << std::endl;
-    }
-
-    // Now all the per-base answers are filled in.
-
-    for(size_t base = 0; base < NUM_BASES; base++)
-    {
-        // For each base in arbitrary order
-        if(BASES[base] == c)
-        {
-            // This is the base we're actually supposed to be extending with. Return
-            // its answer.
-            
-            Log::trace() << "Moving " << range << " to " << answers[base] << 
-                " on " << BASES[base] << std::endl;
-            
-            return answers[base];
-        }
+    
+    // Dropping characters from the right end of a pattern is widening its
+    // forward interval to a suffix tree parent. Dropping from the left is the
+    // same for the reverse complement, on the reverse interval.
+    size_t start = backward ? range.getReverseStart() : 
+        range.getForwardStart();
+    size_t end = start + range.getEndOffset();
+    
+    // The parent is as deep as the suffixes just outside match ours.
+    size_t parentLength = std::max(lcp->get(start), lcp->get(end + 1));
+    
+    if(parentLength >= LCPArray::MAX_VALUE || parentLength >= length) {
+        // The LCP array doesn't know how deep the parent is, or the range
+        // wasn't really for a pattern of that length.
+        return EMPTY_FMD_POSITION;
+    }
+    
+    length = parentLength;
+    
+    if(parentLength == 0) {
+        // Nothing is left, so everything matches.
+        return getCoveringPosition();
+    }
+    
+    // Widen out to everything that matches that much of the pattern.
+    size_t newStart = lcp->findBefore(start, parentLength);
+    size_t newEnd = lcp->findAfter(end + 1, parentLength) - 1;
+    
+    if(backward) {
+        return FMDPosition(0, newStart, newEnd - newStart);
+    } else {
+        return FMDPosition(newStart, 0, newEnd - newStart);
     }
-
-    // If we get here, they gave us something not in BASES somehow, even though
-    // we checked already.
-    throw std::runtime_error("Unrecognized base");
 }
 
 FMDPosition FMDIndex::count(std::string pattern) const {
@@ -534,6 +654,10 @@ TextPosition FMDIndex::locate(int64_t index) const {
         // We can just look at the full suffix array cheat sheet.
         bitfield = fullSuffixArray->get(index);
         
+    } else if(packedSuffixArray != NULL) {
+        // Or the one we loaded, which is already in our format.
+        return packedSuffixArray->get(index);
+        
     } else {
         // We need to use the sampled suffix array.
         
@@ -546,6 +670,101 @@ TextPosition FMDIndex::locate(int64_t index) const {
     return TextPosition(bitfield.getID(), bitfield.getPos());
 }
 
+std::vector<TextPosition> FMDIndex::locateBatch(
+    const std::vector<int64_t>& indices) const {
+    
+    std::vector<TextPosition> positions;
+    positions.reserve(indices.size());
+    
+    if(fullSuffixArray != NULL) {
+        // We can just look everything up in the full suffix array.
+        for(size_t i = 0; i < indices.size(); i++) {
+            SAElem bitfield = fullSuffixArray->get(indices[i]);
+            positions.push_back(TextPosition(bitfield.getID(),
+                bitfield.getPos()));
+        }
+        return positions;
+    }
+    
+    if(packedSuffixArray != NULL) {
+        // Or in the one we loaded.
+        for(size_t i = 0; i < indices.size(); i++) {
+            positions.push_back(packedSuffixArray->get(indices[i]));
+        }
+        return positions;
+    }
+    
+    // Walk all the indices back to samples at once.
+    std::vector<SAElem> bitfields;
+    suffixArray.calcSABatch(indices, &bwt, bitfields);
+    
+    for(size_t i = 0; i < bitfields.size(); i++) {
+        // Unpack each and convert to our own format.
+        positions.push_back(TextPosition(bitfields[i].getID(),
+            bitfields[i].getPos()));
+    }
+    
+    return positions;
+}
+
+std::vector<TextPosition> FMDIndex::locateRange(
+    const FMDPosition& range) const {
+    
+    // Make a list of all the indices in the range.
+    std::vector<int64_t> indices;
+    for(int64_t i = 0; i < range.getLength(); i++) {
+        indices.push_back(range.getForwardStart() + i);
+    }
+    
+    // And locate them all together.
+    return locateBatch(indices);
+}
+
+int64_t FMDIndex::unlocate(const TextPosition& position) const {
+    if(isa == NULL) {
+        throw std::runtime_error("Can't unlocate without a sampled ISA");
+    }
+    
+    // Find the closest sample at or after the position, which is where the
+    // LF-mapping walk back to it starts.
+    TextPosition sampled = isa->getNextSampled(position);
+    int64_t index = isa->getSample(sampled);
+    
+    for(size_t i = position.getOffset(); i < sampled.getOffset(); i++) {
+        // Each LF-mapping goes back one position in the text.
+        index = getLF(index);
+    }
+    
+    return index;
+}
+
+bool FMDIndex::hasUniqueContexts() const {
+    return contexts != NULL;
+}
+
+size_t FMDIndex::getUniqueContextLength(const TextPosition& position,
+    bool leftward) const {
+    
+    if(contexts == NULL) {
+        throw std::runtime_error(
+            "Can't get context lengths without a unique context table");
+    }
+    
+    if(leftward) {
+        // A context ending here on this strand is one starting at the same base
+        // on the other strand.
+        size_t length = getContigLength(position.getText() / 2);
+        if(position.getOffset() >= length) {
+            throw std::runtime_error(
+                "Position out of bounds for unique context table");
+        }
+        return contexts->get(TextPosition(position.getText() ^ 1,
+            length - position.getOffset() - 1));
+    }
+    
+    return contexts->get(position);
+}
+
 int64_t FMDIndex::getContigEndIndex(size_t contig) const {
     // Looks a bit like the metadata functions from earlier. Actually pulls info
     // from the same file.
@@ -563,8 +782,13 @@ char FMDIndex::displayFirst(int64_t index) const {
 }
 
 std::string FMDIndex::displayContig(size_t index) const {
-    // We can't efficiently un-locate, so we just use a vector of the last BWT
-    // index in every contig. This works since there are no 0-length contigs.
+    if(packedText != NULL) {
+        // Just unpack the whole thing.
+        return packedText->extract(index, 0, getContigLength(index));
+    }
+
+    // We don't need to un-locate, since we keep a vector of the last BWT index
+    // in every contig. This works since there are no 0-length contigs.
     int64_t bwtIndex = getContigEndIndex(index);
     
     // Make a string to hold all the bases.
@@ -588,19 +812,51 @@ std::string FMDIndex::displayContig(size_t index) const {
     
 }
 
+std::string FMDIndex::extract(size_t contig, size_t start,
+    size_t length) const {
+    
+    if(packedText != NULL) {
+        // Just unpack the part we want.
+        return packedText->extract(contig, start, length);
+    }
+    
+    if(start + length > getContigLength(contig)) {
+        throw std::runtime_error("Can't extract past the end of contig " +
+            std::to_string(contig));
+    }
+    
+    if(isa == NULL) {
+        // Otherwise we have to walk the whole contig and cut out the part we
+        // want.
+        return displayContig(contig).substr(start, length);
+    }
+    
+    // Start just after the end of the part we want, on the forward strand.
+    int64_t bwtIndex = unlocate(TextPosition(contig * 2, start + length));
+    
+    // Walk back through the part we want, filling it in from the end.
+    std::string bases(length, '\0');
+    for(size_t i = length; i > 0; i--) {
+        // The last column has the character before this suffix.
+        bases[i - 1] = display(bwtIndex);
+        bwtIndex = getLF(bwtIndex);
+    }
+    
+    return bases;
+}
+
 int64_t FMDIndex::getLF(int64_t index) const {
-    // Find the character we're looking at
-    char toFind = display(index);
+    // Find the character we're looking at, and the rank of that instance of
+    // that character among instances of the same character in the last column,
+    // in one pass over the BWT. The rank counts only earlier copies, so the
+    // first copy is rank 0.
+    BaseCount instanceRank;
+    char toFind = bwt.getCharAndOcc(index, instanceRank);
     
     // Find the start of that character in the first column. It's just the
     // number of characters less than it, counting text stops.
     int64_t charBlockStart = bwt.getPC(toFind);
     
-    // Find the rank of that instance of that character among instances of the
-    // same character in the last column. Subtract 1 from occurrences since the
-    // first copy should be rank 0.
-    int64_t instanceRank = bwt.getOcc(toFind, index) - 1;
-    
     // Add that to the start position to produce the LF mapping.
     return charBlockStart + instanceRank;
 }
@@ -614,11 +870,7 @@ std::vector<Mapping> FMDIndex::map(const std::string& query,
         length = query.length() - start;
     }
 
-    // Make an itarator for the mask, if needed, so we can query it.
-    BitVectorIterator* maskIterator = (mask == NULL) ? NULL : 
-        new BitVectorIterator(*mask);
-        
-    if(maskIterator == NULL) {
+    if(mask == NULL) {
         Log::debug() << "Mapping " << length << " bases to all genomes." <<
             std::endl;
     } else {
@@ -629,122 +881,15 @@ std::vector<Mapping> FMDIndex::map(const std::string& query,
     Log::debug() << "Mapping with minimum " << minContext << " context." <<
         std::endl;
 
-    // We need a vector to return.
-    std::vector<Mapping> mappings;
-
-    // Keep around the result that we get from the single-character mapping
-    // function. We use it as our working state to track our FMDPosition and how
-    // many characters we've extended by. We use the is_mapped flag to indicate
-    // whether the current iteration is an extension or a restart.
-    MapAttemptResult location;
-    // Make sure the scratch position is empty so we re-start on the first base.
-    // Other fields get overwritten.
-    location.position = EMPTY_FMD_POSITION;
-
-    for(size_t i = start; i < start + length; i++)
-    {
-        if(location.position.isEmpty(maskIterator))
-        {
-            Log::debug() << "Starting over by mapping position " << i <<
-                std::endl;
-            // We do not currently have a non-empty FMDPosition to extend. Start
-            // over by mapping this character by itself.
-            location = this->mapPosition(query, i, maskIterator);
-        } else {
-            Log::debug() << "Extending with position " << i << std::endl;
-            // The last base either mapped successfully or failed due to multi-
-            // mapping. Try to extend the FMDPosition we have to the right (not
-            // backwards) with the next base.
-            location.position = this->extend(location.position, query[i],
-                false);
-            location.characters++;
-        }
-
-        if(location.is_mapped && location.characters >= minContext &&
-            location.position.getLength(maskIterator) == 1) {
-            
-            // It mapped. We didn't do a re-start and fail, we have enough
-            // context to be confident, and there's exactly one thing in our
-            // interval.
-
-            // Take the first (only) thing in the bi-interval's forward strand
-            // side, not accounting for the mask.
-            int64_t start = location.position.getForwardStart();
-            
-            if(maskIterator != NULL) {
-                // Account for the mask. The start position of the interval may
-                // be masked out. Get the first 1 after (or at) the start,
-                // instead of the start itself. Since the interval is nonempty
-                // under the mask, we know this will exist.
-                start = maskIterator->valueAfter(start).first;
-            }
-
-            // Locate it, and then report position as a (text, offset) pair.
-            // This will give us the position of the first base in the pattern,
-            // which lets us infer the position of the last base in the pattern.
-            TextPosition textPosition = locate(start);
-
-            Log::debug() << "Mapped " << location.characters << "/" << 
-                minContext << " context to text " << textPosition.getText() << 
-                " position " << textPosition.getOffset() << std::endl;
-
-            // Correct to the position of the last base in the pattern, by
-            // offsetting by the length of the pattern that was used. A
-            // 2-character pattern means we need to go 1 further right in the
-            // string it maps to to find where its rightmost character maps.
-            textPosition.setOffset(textPosition.getOffset() + 
-                (location.characters - 1));
-
-            // Add a Mapping for this mapped base.
-            mappings.push_back(Mapping(textPosition));
-
-            // We definitely have a non-empty FMDPosition to continue from
-
-        } else {
-
-            Log::debug() << "Failed (" << 
-                location.position.getLength(maskIterator) << " options for " <<
-                location.characters << " context)." << std::endl;
-
-            if(location.is_mapped && location.position.isEmpty(maskIterator)) {
-                // We extended right until we got no results. We need to try
-                // this base again, in case we tried with a too-long left
-                // context.
-
-                Log::debug() << "Restarting from here..." << std::endl;
-
-                // Move the loop index back
-                i--;
-
-                // Since the FMDPosition is empty, on the next iteration we will
-                // retry this base.
-
-            } else {
-                // It didn't map for some other reason:
-                // - It was an initial mapping with too little left context to 
-                //   be unique
-                // - It was an initial mapping with a nonexistent left context
-                // - It was an extension that was multimapped and still is
-
-                // In none of these cases will re-starting from this base help
-                // at all. If we just restarted here, we don't want to do it
-                // again. If it was multimapped before, it had as much left
-                // context as it could take without running out of string or
-                // getting no results.
-
-                // It didn't map. Add an empty/unmapped Mapping.
-                mappings.push_back(Mapping());
-
-                // Mark that the next iteration will be an extension (if we had
-                // any results this iteration; if not it will just restart)
-                location.is_mapped = true;
-
-            }
-        }
-    }
-
-    // We've gone through and attempted the whole string. Give back our answers.
-    return mappings;
+    // Run the query through the interleaved mapper on its own. For each base,
+    // we extend the search we have to the right, or start over by searching
+    // left from the base until we have a unique context.
+    std::vector<MapQuery> queries(1);
+    queries[0].text = &query;
+    queries[0].start = start;
+    queries[0].length = length;
+    
+    return InterleavedMapper(*this).map(queries, mask, minContext)[0];
 
 }
 
@@ -756,25 +901,31 @@ std::vector<Mapping> FMDIndex::map(const std::string& query, int64_t genome,
         start, length);    
 }
 
-char op_increase (char i) { return ++i; }
-
-std::vector<Mapping> FMDIndex::mapBoth(const std::string& query, int64_t genome, 
-    int minContext, int start, int length) const {
+std::vector<Mapping> FMDIndex::mapContig(size_t contig, int64_t genome,
+    int minContext) const {
     
-    if(length == -1) {
-        // Fix up the length parameter if it is -1: that means the whole rest of
-        // the string.
-        
-        // We need to do this ourselves since we go clipping out that bit of the
-        // string to reverse complement.
-        length = query.length() - start;
-    }
+    std::string query = displayContig(contig);
     
-    // Map it forward
-    std::vector<Mapping> forward = map(query, genome, minContext, start,
-        length);
+    // Say where the query came from, so the mapper can look its bases up
+    // instead of searching when it can.
+    std::vector<MapQuery> queries(1);
+    queries[0].text = &query;
+    queries[0].start = 0;
+    queries[0].length = query.size();
+    queries[0].isIndexed = true;
+    queries[0].indexText = contig * 2;
     
-    // Make a reversed copy of the appropriate region of the query string.
+    return InterleavedMapper(*this).map(queries,
+        genome == -1 ? NULL : genomeMasks[genome], minContext)[0];
+}
+
+char op_increase (char i) { return ++i; }
+
+/**
+ * Get the reverse complement of length bases of the query, starting at start.
+ */
+static std::string reverseComplementRegion(const std::string& query,
+    int start, int length) {
     
     // Where does our selected region end (as a reverse iterator)?
     std::string::const_reverse_iterator reverseStart = query.rbegin() + 
@@ -790,9 +941,40 @@ std::vector<Mapping> FMDIndex::mapBoth(const std::string& query, int64_t genome,
     std::string reverseComplemented;
     std::transform(reverseStart, reverseEnd, 
         std::back_inserter(reverseComplemented), (char(*)(char))complement);
+    
+    return reverseComplemented;
+}
+
+std::vector<Mapping> FMDIndex::mapBoth(const std::string& query, int64_t genome, 
+    int minContext, int start, int length) const {
+    
+    if(length == -1) {
+        // Fix up the length parameter if it is -1: that means the whole rest of
+        // the string.
+        
+        // We need to do this ourselves since we go clipping out that bit of the
+        // string to reverse complement.
+        length = query.length() - start;
+    }
+    
+    // Make a reverse complemented copy of the appropriate region.
+    std::string reverseComplemented = reverseComplementRegion(query, start,
+        length);
         
-    // Map it backward
-    std::vector<Mapping> reverse = map(reverseComplemented, genome, minContext);
+    // Map it forward and backward at the same time, so the two searches can
+    // overlap their waits on memory.
+    std::vector<MapQuery> queries(2);
+    queries[0].text = &query;
+    queries[0].start = start;
+    queries[0].length = length;
+    queries[1].text = &reverseComplemented;
+    queries[1].start = 0;
+    queries[1].length = reverseComplemented.size();
+    
+    std::vector<std::vector<Mapping>> results = InterleavedMapper(*this).map(
+        queries, genome == -1 ? NULL : genomeMasks[genome], minContext);
+    std::vector<Mapping>& forward = results[0];
+    std::vector<Mapping>& reverse = results[1];
     
     if(forward.size() != reverse.size()) {
         throw std::runtime_error("Forward and reverse region size mismatch!");
@@ -810,148 +992,233 @@ std::vector<Mapping> FMDIndex::mapBoth(const std::string& query, int64_t genome,
     
 }
 
-std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> FMDIndex::Cmap(const BitVector& ranges,
-    const std::string& query, const BitVector* mask, int minContext, int start,
+std::vector<std::vector<Mapping>> FMDIndex::mapBoth(const std::string& query,
+    const std::vector<size_t>& genomes, int minContext, int start,
     int length) const {
     
-    // Map to a range.
-    
     if(length == -1) {
         // Fix up the length parameter if it is -1: that means the whole rest of
         // the string.
         length = query.length() - start;
     }
     
-    Log::debug() << "Mapping with (two-sided) minimum " << minContext << " context." <<
-        std::endl;
-
-    // Make an iterator for ranges, so we can query it.
-    BitVectorIterator rangeIterator(ranges);
+    // Get the mask for each genome.
+    std::vector<const BitVector*> masks;
+    for(size_t genome : genomes) {
+        if(genome >= genomeMasks.size()) {
+            throw std::runtime_error("Genome " + std::to_string(genome) +
+                " out of bounds");
+        }
+        masks.push_back(genomeMasks[genome]);
+    }
     
-    // And one for the mask, if needed
-    BitVectorIterator* maskIterator = (mask == NULL) ? NULL : 
-        new BitVectorIterator(*mask);
-
-    // We need a vector to return.
-    std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> mappings;
+    std::string reverseComplemented = reverseComplementRegion(query, start,
+        length);
+    
+    // Map it forward and backward, under all the masks together, so the
+    // genomes' searches can share extensions while they agree.
+    std::vector<MapQuery> queries(2);
+    queries[0].text = &query;
+    queries[0].start = start;
+    queries[0].length = length;
+    queries[1].text = &reverseComplemented;
+    queries[1].start = 0;
+    queries[1].length = reverseComplemented.size();
+    
+    std::vector<std::vector<std::vector<Mapping>>> results =
+        InterleavedMapper(*this).mapMasks(masks, queries, minContext);
+    
+    for(size_t k = 0; k < genomes.size(); k++) {
+        std::vector<Mapping>& forward = results[0][k];
+        std::vector<Mapping>& reverse = results[1][k];
+        
+        if(forward.size() != reverse.size()) {
+            throw std::runtime_error("Forward and reverse region size mismatch!");
+        }
+        
+        for(size_t i = 0; i < forward.size(); i++) {
+            // Disambiguate in place, reading reverse backwards.
+            forward[i] = disambiguate(forward[i], reverse[reverse.size() - i - 1]);
+        }
+    }
+    
+    // Give back the disambiguated vectors for each genome.
+    return results[0];
+}
 
-    // Keep around the result that we get from the single-character mapping
-    // function. We use it as our working state to trackour FMDPosition and how
-    // many characters we've extended by. We use the is_mapped flag to indicate
-    // whether the current iteration is an extension or a restart.
-    creditMapAttemptResult location;
-    // Make sure the scratch position is empty so we re-start on the first base
-    location.position = EMPTY_FMD_POSITION;
+std::vector<std::vector<Mapping>> FMDIndex::mapBatch(
+    const std::vector<std::string>& queries, const BitVector* mask,
+    int minContext) const {
+    
+    // Map the whole of every query.
+    std::vector<MapQuery> regions(queries.size());
+    for(size_t i = 0; i < queries.size(); i++) {
+        regions[i].text = &queries[i];
+        regions[i].start = 0;
+        regions[i].length = queries[i].size();
+    }
+    
+    return InterleavedMapper(*this).map(regions, mask, minContext);
+}
 
-    for(int i = start + length - 1; i >= start; i--) {
-        // Go from the end of our selected region to the beginning.
-	
-        Log::trace() << "On position " << i << " from " <<
-            start + length - 1 << " to " << start << std::endl;
-	    
-	// Need to prevent an extension from overrunning the query contig, if
-	// this will happen, also trigger a restart
-	    	    
-        if(location.position.isEmpty() || i < location.characters) {
-            Log::debug() << "Starting over by mapping position " << i << std::endl;
-            // We do not currently have a non-empty FMDPosition to extend. Start
-            // over by mapping this character by itself.
-            location = this->CmapPosition(rangeIterator, query, i, maskIterator);
-        } else {
-            Log::debug() << "Extending with position " << i << " with characters = " << location.characters << std::endl;
-	    // The last base either mapped successfully or failed due to multi-
-            // mapping. Try to extend the FMDPosition we have to the left
-            // (backwards) with the next base.
-            location.position = this->extend(location.position, query[i - location.characters + 1], true);
-	    location.position = this->extend(location.position, query[i - location.characters], true);
-            location.characters++;
-	    if(location.characters > location.maxCharacters) {
-		location.maxCharacters++;
-	    }
+std::vector<SMEM> FMDIndex::findSMEMs(const std::string& query,
+    size_t minLength, const BitVector* mask) const {
+    
+    // We need a vector to return.
+    std::vector<SMEM> smems;
+    
+    // And scratch space for the matches still being extended, which we reuse
+    // for every query position we look at.
+    std::vector<SMEM> live;
+    std::vector<SMEM> next;
+    
+    size_t x = 0;
+    while(x < query.size()) {
+        if(!isBase(query[x])) {
+            // No match can contain this, so skip it.
+            x++;
+            continue;
         }
+        
+        // Find all the SMEMs that contain this position, and skip to the first
+        // position that could be in an SMEM we haven't found.
+        x = findSMEMsAt(query, x, minLength, mask, smems, live, next);
+    }
+    
+    return smems;
+}
 
-        // What range index does our current left-side position (the one we just
-        // moved) correspond to, if any?
-        int64_t range = location.position.range(rangeIterator, maskIterator);
-	
-	if(location.characters < minContext && location.maxCharacters >=minContext) {
-	    location.characters = minContext;
-	}
-
-        if(location.is_mapped && location.characters >= minContext && 
-            !location.position.isEmpty(maskIterator) && range != -1) {
+size_t FMDIndex::findSMEMsAt(const std::string& query, size_t x,
+    size_t minLength, const BitVector* mask, std::vector<SMEM>& smems,
+    std::vector<SMEM>& live, std::vector<SMEM>& next) const {
+    
+    // Start with just the base at x.
+    SMEM match;
+    match.start = x;
+    match.length = 1;
+    match.position = getCharPosition(query[x]);
+    
+    if(match.position.isEmpty(mask)) {
+        // The base never appears, so nothing here matches.
+        return x + 1;
+    }
+    
+    // Extend forward as far as we can, keeping every match from x that has
+    // more occurrences than the next longer one. Those are the only ones that
+    // could extend further backward than it.
+    live.clear();
+    size_t i;
+    for(i = x + 1; i < query.size() && isBase(query[i]); i++) {
+        FMDPosition extended = extend(match.position, query[i], false);
+        
+        if(extended.getLength(mask) != match.position.getLength(mask)) {
+            // We lost some occurrences, so keep the shorter match.
+            live.push_back(match);
             
-            // It mapped. We didn't do a re-start and fail, we have sufficient
-            // context to be confident, and our interval is nonempty and
-            // subsumed by a range.
-
-            Log::debug() << i << " Mapped " << location.characters << 
-                " context to " << location.position << " in range #" << range <<
-                std::endl;
-
-            // Remember that this base mapped to this range
-            mappings.push_back(std::make_pair(range,std::make_pair(location.characters,location.maxCharacters)));
+            if(extended.isEmpty(mask)) {
+                // And we can't go any further.
+                break;
+            }
+        }
+        
+        match.position = extended;
+        match.length++;
+    }
+    
+    if(i == query.size() || !isBase(query[i])) {
+        // We ran out of query rather than occurrences, so keep the longest
+        // match too.
+        live.push_back(match);
+    }
+    
+    // Look at the longest matches first, since they contain the shorter ones.
+    std::reverse(live.begin(), live.end());
+    
+    // Everything we find here ends at or before the end of the longest match.
+    size_t nextStart = x + live.front().length;
+    
+    // SMEMs come out right to left, so we flip them when we're done.
+    size_t firstFound = smems.size();
+    // Where did the last SMEM we found start? Any match that starts there too
+    // is shorter, and so contained in it.
+    size_t lastStart = x + 1;
+    
+    for(int64_t j = (int64_t)x - 1; j >= -1; j--) {
+        // Extend all the live matches backward by the query base at j, or
+        // finish them all if there isn't one.
+        bool canExtend = j >= 0 && isBase(query[j]);
+        
+        next.clear();
+        for(size_t k = 0; k < live.size(); k++) {
+            FMDPosition extended;
+            if(canExtend) {
+                extended = extend(live[k].position, query[j], true);
+            }
             
-            // We definitely have a non-empty FMDPosition to continue from
-
-        } else {
-
-            Log::debug() << "Failed at " << i << " " << location.position << " (" << 
-                location.position.ranges(rangeIterator, maskIterator) <<
-                " options for " << location.characters << " context)." << 
-                std::endl;
+            if(!canExtend || extended.isEmpty(mask)) {
+                // This match is as long backward as it gets.
                 
-            if(location.is_mapped && location.position.isEmpty(maskIterator)) {
-                // We extended right until we got no results. We need to try
-                // this base again, in case we tried with a too-long left
-                // context.
-
-                Log::debug() << "Restarting from here..." << std::endl;
-
-                // Move the loop index towards the end we started from (right)
-                i++;
-		
-                // Since the FMDPosition is empty, on the next iteration we will
-                // retry this base.
-
-            } else {
-                // It didn't map for some other reason:
-                // - It was an initial mapping with too little right context to 
-                //   be unique to a range.
-                // - It was an initial mapping with a nonexistent right context
-                // - It was an extension that was multimapped and still is
-
-                // In none of these cases will re-starting from this base help
-                // at all. If we just restarted here, we don't want to do it
-                // again. If it was multimapped before, it had as much left
-                // context as it could take without running out of string or
-                // getting no results.
-
-                // It didn't map. Say it corresponds to no range.
-                mappings.push_back(std::make_pair(-1,std::make_pair(0,0)));
-
-                // Mark that the next iteration will be an extension (if we had
-                // any results this iteration; if not it will just restart)
-                location.is_mapped = true;
-
+                if(next.empty() && live[k].start < lastStart) {
+                    // And no longer match made it through this round, and
+                    // it's not in the last SMEM we found, so it's super-
+                    // maximal.
+                    if(live[k].length >= minLength) {
+                        smems.push_back(live[k]);
+                    }
+                    lastStart = live[k].start;
+                }
+            } else if(next.empty() || extended.getLength(mask) !=
+                next.back().position.getLength(mask)) {
+                
+                // This match extends, and it has more occurrences than the
+                // longer ones that also extended, so it could go further.
+                SMEM grown = live[k];
+                grown.start--;
+                grown.length++;
+                grown.position = extended;
+                next.push_back(grown);
             }
         }
+        
+        if(next.empty()) {
+            // Nothing is left to extend.
+            break;
+        }
+        live.swap(next);
     }
+    
+    // Put what we found in query order.
+    std::reverse(smems.begin() + firstFound, smems.end());
+    
+    return nextStart;
+}
 
-    // We've gone through and attempted the whole string. Put our results in the
-    // same order as the string, instead of the backwards order we got them in.
-    // See <http://www.cplusplus.com/reference/algorithm/reverse/>
-    std::reverse(mappings.begin(), mappings.end());
-
-    // Get rid of the mask iterator if needed
-    if(maskIterator != NULL) {
-        delete maskIterator;
-    }
-
-    // Give back our answers.
-    return mappings;
+std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> FMDIndex::Cmap(const BitVector& ranges,
+    const std::string& query, const BitVector* mask, int minContext, int start,
+    int length) const {
     
+    // Map to a range.
     
+    if(length == -1) {
+        // Fix up the length parameter if it is -1: that means the whole rest of
+        // the string.
+        length = query.length() - start;
+    }
+    
+    Log::debug() << "Mapping with (two-sided) minimum " << minContext << " context." <<
+        std::endl;
+
+    // Run the query through the interleaved mapper on its own. Going from the
+    // end of the selected region to the beginning, we extend the search we
+    // have to the left, or start over by searching out from the base in both
+    // directions until we are in a single range.
+    std::vector<MapQuery> queries(1);
+    queries[0].text = &query;
+    queries[0].start = start;
+    queries[0].length = length;
+    
+    return InterleavedMapper(*this).creditMap(ranges, queries, mask,
+        minContext)[0];
 }
 
 std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> FMDIndex::Cmap(const BitVector& ranges, 
@@ -978,124 +1245,16 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::map(const BitVector& ranges,
     Log::debug() << "Mapping with minimum " << minContext << " context." <<
         std::endl;
 
-    // Make an iterator for ranges, so we can query it.
-    BitVectorIterator rangeIterator(ranges);
-    
-    // And one for the mask, if needed
-    BitVectorIterator* maskIterator = (mask == NULL) ? NULL : 
-        new BitVectorIterator(*mask);
-
-    // We need a vector to return.
-    std::vector<std::pair<int64_t,size_t>> mappings;
-
-    // Keep around the result that we get from the single-character mapping
-    // function. We use it as our working state to trackour FMDPosition and how
-    // many characters we've extended by. We use the is_mapped flag to indicate
-    // whether the current iteration is an extension or a restart.
-    MapAttemptResult location;
-    // Make sure the scratch position is empty so we re-start on the first base
-    location.position = EMPTY_FMD_POSITION;
-
-    for(int i = start + length - 1; i >= start; i--) {
-        // Go from the end of our selected region to the beginning.
-
-        Log::trace() << "On position " << i << " from " <<
-            start + length - 1 << " to " << start << std::endl;
-
-        if(location.position.isEmpty()) {
-            Log::debug() << "Starting over by mapping position " << i <<
-                std::endl;
-            // We do not currently have a non-empty FMDPosition to extend. Start
-            // over by mapping this character by itself.
-            location = this->mapPosition(rangeIterator, query, i, maskIterator);
-        } else {
-            Log::debug() << "Extending with position " << i << std::endl;
-            // The last base either mapped successfully or failed due to multi-
-            // mapping. Try to extend the FMDPosition we have to the left
-            // (backwards) with the next base.
-            location.position = this->extend(location.position, query[i], true);
-            location.characters++;
-        }
-
-        // What range index does our current left-side position (the one we just
-        // moved) correspond to, if any?
-        int64_t range = location.position.range(rangeIterator, maskIterator);
-
-        if(location.is_mapped && location.characters >= minContext && 
-            !location.position.isEmpty(maskIterator) && range != -1) {
-            
-            // It mapped. We didn't do a re-start and fail, we have sufficient
-            // context to be confident, and our interval is nonempty and
-            // subsumed by a range.
-
-            Log::debug() << "Mapped " << location.characters << 
-                " context to " << location.position << " in range #" << range <<
-                std::endl;
-
-            // Remember that this base mapped to this range
-            mappings.push_back(std::make_pair(range,location.characters - 1));
-	    
-            
-            // We definitely have a non-empty FMDPosition to continue from
-
-        } else {
-
-            Log::debug() << "Failed at " << location.position << " (" << 
-                location.position.ranges(rangeIterator, maskIterator) <<
-                " options for " << location.characters << " context)." << 
-                std::endl;
-                
-            if(location.is_mapped && location.position.isEmpty(maskIterator)) {
-                // We extended right until we got no results. We need to try
-                // this base again, in case we tried with a too-long left
-                // context.
-
-                Log::debug() << "Restarting from here..." << std::endl;
-
-                // Move the loop index towards the end we started from (right)
-                i++;
-
-                // Since the FMDPosition is empty, on the next iteration we will
-                // retry this base.
-
-            } else {
-                // It didn't map for some other reason:
-                // - It was an initial mapping with too little right context to 
-                //   be unique to a range.
-                // - It was an initial mapping with a nonexistent right context
-                // - It was an extension that was multimapped and still is
-
-                // In none of these cases will re-starting from this base help
-                // at all. If we just restarted here, we don't want to do it
-                // again. If it was multimapped before, it had as much left
-                // context as it could take without running out of string or
-                // getting no results.
-
-                // It didn't map. Say it corresponds to no range.
-                mappings.push_back(std::make_pair(-1,0));
-
-                // Mark that the next iteration will be an extension (if we had
-                // any results this iteration; if not it will just restart)
-                location.is_mapped = true;
-
-            }
-        }
-    }
-
-    // We've gone through and attempted the whole string. Put our results in the
-    // same order as the string, instead of the backwards order we got them in.
-    // See <http://www.cplusplus.com/reference/algorithm/reverse/>
-    std::reverse(mappings.begin(), mappings.end());
-
-    // Get rid of the mask iterator if needed
-    if(maskIterator != NULL) {
-        delete maskIterator;
-    }
-
-    // Give back our answers.
-    return mappings;
-    
+    // Run the query through the interleaved mapper on its own. Going from the
+    // end of the selected region to the beginning, we extend the search we
+    // have to the left, or start over by searching right from the base until
+    // we are in a single range.
+    std::vector<MapQuery> queries(1);
+    queries[0].text = &query;
+    queries[0].start = start;
+    queries[0].length = length;
     
+    return InterleavedMapper(*this).map(ranges, queries, mask, minContext)[0];
 }
 
 std::vector<std::pair<int64_t,size_t>> FMDIndex::map(const BitVector& ranges, 
@@ -1106,258 +1265,143 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::map(const BitVector& ranges,
     return map(ranges, query, genome == -1 ? NULL : genomeMasks[genome], 
         minContext, start, length);    
 }
-
-FMDIndex::iterator FMDIndex::begin(size_t depth, bool reportDeadEnds) const {
-    // Make a new suffix tree iterator that automatically searches out the first
-    // suffix of the right length.
-    return FMDIndex::iterator(*this, depth, false, reportDeadEnds);
-}
-     
-FMDIndex::iterator FMDIndex::end(size_t depth, bool reportDeadEnds) const {
-    // Make a new suffix tree iterator that is just a 1-past-the-end sentinel.
-    return FMDIndex::iterator(*this, depth, true, reportDeadEnds);
-}
-
-MapAttemptResult FMDIndex::mapPosition(const std::string& pattern,
-    size_t index, BitVectorIterator* mask) const {
-
-    Log::debug() << "Mapping " << index << " in " << pattern << std::endl;
-  
-    // Initialize the struct we will use to return our somewhat complex result.
-    // Contains the FMDPosition (which we work in), an is_mapped flag, and a
-    // variable counting the number of extensions made to the FMDPosition.
-    MapAttemptResult result;
-
-    // Do a backward search.
-    // Start at the given index, and get the starting range for that character.
-    result.is_mapped = false;
-    result.position = this->getCharPosition(pattern[index]);
-    result.characters = 1;
-    if(result.position.isEmpty(mask)) {
-        // This character isn't even in it. Just return the result with an empty
-        // FMDPosition; the next character we want to map is going to have to
-        // deal with having some never-before-seen character right upstream of
-        // it.
-        return result;
-    } else if(result.position.getLength(mask) == 1) {
-        // We've already mapped.
-        result.is_mapped = true;
-        return result;
-    }
-
-    if(index == 0) {
-        // The rest of the function deals with characters to the left of the one
-        // we start at. If we start at position 0 there can be none.
-        return result;
-    }
-
-    Log::trace() << "Starting with " << result.position << std::endl;
-
-    do {
-        // Now consider the next character to the left.
-        index--;
-
-        // Grab the character to extend with.
-        char character = pattern[index];
-
-        Log::trace() << "Index " << index << " in " << pattern << " is " << 
-            character << "(" << character << ")" << std::endl;
-
-        // Backwards extend with subsequent characters.
-        FMDPosition next_position = this->extend(result.position, character,
-            true);
-
-        Log::trace() << "Now at " << next_position << " after " << 
-            pattern[index] << std::endl;
-        if(next_position.isEmpty(mask)) {
-            // The next place we would go is empty, so return the result holding
-            // the last position.
-            return result;
-        } else if(next_position.getLength(mask) == 1) {
-            // We have successfully mapped to exactly one place. Update our
-            // result to reflect the additional extension and our success, and
-            // return it.
-            result.position = next_position;
-            result.characters++;
-            result.is_mapped = true;
-            return result;      
-        }
-
-        // Otherwise, we still map to a plurality of places. Record the
-        // extension and loop again.
-        result.position = next_position;
-        result.characters++;
-
-    } while(index > 0);
-    // Continue considering characters to the left until we hit the start of the
-    // string.
-
-    // If we get here, we ran out of upstream context and still map to multiple
-    // places. Just give our multi-mapping FMDPosition and unmapped result.
-    return result;
-}
-
-creditMapAttemptResult FMDIndex::CmapPosition(BitVectorIterator& ranges, 
-    const std::string& pattern, size_t index, BitVectorIterator* mask) const {
-    
-    // We're going to right-map so ranges match up with the things we can map to
-    // (downstream contexts)
-
-    // Initialize the struct we will use to return our somewhat complex result.
-    // Contains the FMDPosition (which we work in), an is_mapped flag, and a
-    // variable counting the number of extensions made to the FMDPosition.
-    creditMapAttemptResult result;
-
-    // Do a forward search.
-    // Start at the given index, and get the starting range for that character.
-    result.is_mapped = false;
-    result.position = this->getCharPosition(pattern[index]);    
-    result.characters = 1;
-    result.maxCharacters = 1;
-    if(result.position.isEmpty(mask)) {
-        // This character isn't even in it. Just return the result with an empty
-        // FMDPosition; the next character we want to map is going to have to
-        // deal with having some never-before-seen character right upstream of
-        // it.
-        return result;
-    } else if (result.position.range(ranges, mask) != -1) {
-        // We've already mapped.
-        result.is_mapped = true;
-    }
-
-    Log::trace() << "Starting with " << result.position << std::endl;
-
-    FMDPosition found_position;
-    FMDPosition next_position;
-    
-    for(size_t i = 1; index + i < pattern.size() && 1 + index > i; i++) {
-		
-        // Dual extend with subsequent characters.
-        next_position = this->extend(result.position,
-            pattern[index + i], false);
-	next_position = this->extend(next_position,pattern[index - i], true);
-	
-        Log::debug() << "Now at " << next_position << " after " << pattern[i] << std::endl;
-        if(next_position.isEmpty(mask)) {
-            // The next place we would go is empty, so return the result holding
-            // the last position.
-	    Log::debug() << "Couldn't find more context" << std::endl;
-	    result.characters = result.maxCharacters;
-            return result;
-        }
-
-        if(!result.is_mapped && next_position.range(ranges, mask) != -1) {
-            // We have successfully mapped to exactly one range. Update our
-            // result to reflect the additional extension and our success, and
-            // return it.
-    
-    	    result.position = next_position;
-	    result.maxCharacters++;
-	    result.characters = result.maxCharacters;
-	    Log::debug() << "Extended " << i << " times" << std::endl;
-	    result.is_mapped = true;
-	    found_position = result.position;
-	    
-        } else if(result.is_mapped && next_position.range(ranges, mask) != -1) {
-	    result.position = next_position;
-	    result.maxCharacters++;
-	    Log::debug() << "Restart continue " << i << std::endl;
-
-	} else {
-	    // Otherwise, we still map to a plurality of ranges. Record the
-	    // extension and loop again.
-	
-	    result.position = next_position;
-	    result.maxCharacters++;
-	    result.characters = result.maxCharacters;
-	    
-	}
-    }
+
+std::vector<std::vector<std::pair<int64_t,size_t>>> FMDIndex::mapBatch(
+    const BitVector& ranges, const std::vector<std::string>& queries,
+    const BitVector* mask, int minContext) const {
     
-    if(result.is_mapped) {
-	result.position = found_position;
+    // Map the whole of every query.
+    std::vector<MapQuery> regions(queries.size());
+    for(size_t i = 0; i < queries.size(); i++) {
+        regions[i].text = &queries[i];
+        regions[i].start = 0;
+        regions[i].length = queries[i].size();
     }
+    
+    return InterleavedMapper(*this).map(ranges, regions, mask, minContext);
+}
 
-    // If we get here, we ran out of downstream context and still map to
-    // multiple ranges. Just give our multi-mapping FMDPosition and unmapped
-    // result.
-    return result;
+std::vector<std::vector<std::pair<int64_t,size_t>>> FMDIndex::mapLevels(
+    const std::vector<const BitVector*>& levels, const std::string& query,
+    const BitVector* mask, int minContext, int start, int length) const {
+    
+    if(length == -1) {
+        // Fix up the length parameter if it is -1: that means the whole rest of
+        // the string.
+        length = query.length() - start;
+    }
+    
+    Log::debug() << "Mapping to " << levels.size() << " levels with minimum " <<
+        minContext << " context." << std::endl;
+    
+    // Run the query through the interleaved mapper on its own, sharing
+    // extensions between levels.
+    std::vector<MapQuery> queries(1);
+    queries[0].text = &query;
+    queries[0].start = start;
+    queries[0].length = length;
+    
+    return InterleavedMapper(*this).mapLevels(levels, queries, mask,
+        minContext)[0];
+}
 
+std::vector<std::vector<std::pair<int64_t,size_t>>> FMDIndex::mapLevels(
+    const std::vector<const BitVector*>& levels, const std::string& query,
+    int64_t genome, int minContext, int start, int length) const {
+    
+    // Get the appropriate mask, or NULL if given the special all-genomes value.
+    return mapLevels(levels, query, genome == -1 ? NULL : genomeMasks[genome],
+        minContext, start, length);
+}
 
+FMDIndex::iterator FMDIndex::begin(size_t depth, bool reportDeadEnds) const {
+    // Make a new suffix tree iterator that automatically searches out the first
+    // suffix of the right length.
+    return FMDIndex::iterator(*this, depth, false, reportDeadEnds);
+}
+     
+FMDIndex::iterator FMDIndex::end(size_t depth, bool reportDeadEnds) const {
+    // Make a new suffix tree iterator that is just a 1-past-the-end sentinel.
+    return FMDIndex::iterator(*this, depth, true, reportDeadEnds);
 }
 
-MapAttemptResult FMDIndex::mapPosition(BitVectorIterator& ranges, 
-    const std::string& pattern, size_t index, BitVectorIterator* mask) const {
-    
+void FMDIndex::traverse(SuffixTreeVisitor& visitor, size_t depth,
+    bool reportDeadEnds, size_t splitDepth, size_t threadCount) const {
     
-    // We're going to right-map so ranges match up with the things we can map to
-    // (downstream contexts)
+    // Split the tree up and go through it in parallel.
+    SuffixTreeTraversal(*this, depth, reportDeadEnds).run(visitor, splitDepth,
+        threadCount);
+}
 
-    // Initialize the struct we will use to return our somewhat complex result.
-    // Contains the FMDPosition (which we work in), an is_mapped flag, and a
-    // variable counting the number of extensions made to the FMDPosition.
-    MapAttemptResult result;
+MemoryReport FMDIndex::reportMemory() const {
+    MemoryReport report;
 
-    // Do a forward search.
-    // Start at the given index, and get the starting range for that character.
-    result.is_mapped = false;
-    result.position = this->getCharPosition(pattern[index]);
-    result.characters = 1;
-    if(result.position.isEmpty(mask)) {
-        // This character isn't even in it. Just return the result with an empty
-        // FMDPosition; the next character we want to map is going to have to
-        // deal with having some never-before-seen character right upstream of
-        // it.
-        return result;
-    } else if (result.position.range(ranges, mask) != -1) {
-        // We've already mapped.
-        result.is_mapped = true;
-        return result;
+    report.add("bwt.runs", bwt.getRunBytes());
+    report.add("bwt.markers", bwt.getMarkerBytes());
+    report.add("sampledSuffixArray", suffixArray.getSampleBytes());
+
+    if(fullSuffixArray != NULL) {
+        report.add("fullSuffixArray", fullSuffixArray->getByteSize());
+    }
+    if(packedSuffixArray != NULL) {
+        report.add("packedSuffixArray", packedSuffixArray->reportSize());
     }
 
-    Log::trace() << "Starting with " << result.position << std::endl;
-    
-    FMDPosition found_position;
+    // All the genome masks go together.
+    size_t maskBytes = 0;
+    for(auto mask : genomeMasks) {
+        maskBytes += mask->reportSize();
+    }
+    report.add("genomeMasks", maskBytes);
 
-    for(index++; index < pattern.size(); index++) {
-        // Forwards extend with subsequent characters.
-        FMDPosition next_position = this->extend(result.position,
-            pattern[index], false);
-
-        Log::trace() << "Now at " << next_position << " after " << 
-            pattern[index] << std::endl;
-        if(next_position.isEmpty(mask)) {
-            // The next place we would go is empty, so return the result holding
-            // the last position.
-            return result;
-        }
+    // So does everything we know about the contigs.
+    size_t contigBytes = names.capacity() * sizeof(std::string) +
+        starts.capacity() * sizeof(size_t) +
+        lengths.capacity() * sizeof(size_t) +
+        cumulativeLengths.capacity() * sizeof(size_t) +
+        genomeAssignments.capacity() * sizeof(size_t) +
+        endIndices.capacity() * sizeof(int64_t) +
+        genomeRanges.capacity() * sizeof(std::pair<size_t, size_t>);
+    for(auto& name : names) {
+        contigBytes += name.capacity();
+    }
+    report.add("contigs", contigBytes);
 
-        if(next_position.range(ranges, mask) != -1) {
-            // We have successfully mapped to exactly one range. Update our
-            // result to reflect the additional extension and our success, 
-            // but continue the search
-	  
-	    result.position = next_position;
-	    result.characters++;
-	    result.is_mapped = true;
-	    found_position = result.position;
-	    
-        } else {
-	    // Otherwise, we still map to a plurality of ranges. Record the
-	    // extension and loop again.
-	
-	    result.position = next_position;
-	    result.characters++;
-	
-	}
+    if(packedText != NULL) {
+        report.add("packedText", packedText->reportSize());
     }
-    
-    if(result.is_mapped) {
-	result.position = found_position;
+    if(isa != NULL) {
+        report.add("isa", isa->reportSize());
+    }
+    if(lcp != NULL) {
+        report.add("lcp", lcp->reportSize());
+    }
+    if(contexts != NULL) {
+        report.add("uniqueContexts", contexts->reportSize());
+    }
+
+    return report;
+}
+
+size_t FMDIndex::dropFullSuffixArray() {
+    if(fullSuffixArray == NULL) {
+        // Nothing to drop.
+        return 0;
+    }
+
+    size_t bytes = fullSuffixArray->getByteSize();
+    delete fullSuffixArray;
+    fullSuffixArray = NULL;
+
+    if(std::ifstream((basename + ".sa").c_str()).good()) {
+        // Fall back on the saved one, which is packed and mapped.
+        packedSuffixArray = new PackedSuffixArray(basename + ".sa");
     }
-    
-    return result;
 
+    Log::info() << "Dropped " << bytes << " byte full suffix array" <<
+        std::endl;
+
+    return bytes;
 }
 
 Mapping FMDIndex::disambiguate(const Mapping& left, 
@@ -1412,14 +1456,13 @@ Mapping FMDIndex::disambiguate(const Mapping& left,
 }
 
 MisMatchAttemptResults FMDIndex::misMatchExtend(MisMatchAttemptResults& prevMisMatches,
-	char c, bool backward, size_t z_max, BitVectorIterator* mask, bool startExtension, bool finishExtension) const {
+	char c, bool backward, size_t z_max, const BitVector* mask, bool startExtension, bool finishExtension) const {
     MisMatchAttemptResults nextMisMatches;
     nextMisMatches.is_mapped = prevMisMatches.is_mapped;
     nextMisMatches.characters = prevMisMatches.characters;
     
     // Note that we do not flip parameters when !backward since
-    // FMDIndex::misMatchExtend uses FMDIndex::extend which performs
-    // this step itself
+    // FMDIndex::extendAll performs this step itself
     
     if(prevMisMatches.positions.size() == 0) {
 	throw std::runtime_error("Tried to extend zero length mismatch vector");
@@ -1450,6 +1493,10 @@ MisMatchAttemptResults FMDIndex::misMatchExtend(MisMatchAttemptResults& prevMisM
 
 	m_position.first = it->first;
 	m_position.second = it->second;
+	
+	// Extend m_position by every base at once. We pick out the
+	// extensions we want below.
+	FMDExtensions extensions = extendAll(m_position.first, backward);
 		
 	// extend m_position by correct base. Do not do this if the
 	// finishExtension flag is true--in this case it's already been
@@ -1457,7 +1504,7 @@ MisMatchAttemptResults FMDIndex::misMatchExtend(MisMatchAttemptResults& prevMisM
     
 	if(startExtension) {
 		
-	    m_position2.first = extend(m_position.first, c, backward);
+	    m_position2.first = extensions.get(c);
 	    m_position2.second = m_position.second;
 	
 	    if(m_position2.first.getLength(mask) > 0) {
@@ -1469,7 +1516,7 @@ MisMatchAttemptResults FMDIndex::misMatchExtend(MisMatchAttemptResults& prevMisM
 	    if(m_position.second < z_max) {
 		for(size_t base = 0; base < NUM_BASES; base++) {
 		    if(BASES[base] != c) {
-			m_position2.first = extend(m_position.first, BASES[base], backward);
+			m_position2.first = extensions.children[base];
 			m_position2.second = m_position.second;
 			m_position2.second++;
 		    
@@ -1484,7 +1531,7 @@ MisMatchAttemptResults FMDIndex::misMatchExtend(MisMatchAttemptResults& prevMisM
 	    }
 	} else {
 	  
-	    m_position2.first = extend(m_position.first, c, backward);
+	    m_position2.first = extensions.get(c);
 	    m_position2.second = m_position.second;
 	
 	    if(m_position2.first.getLength(mask) > 0) {
@@ -1495,7 +1542,7 @@ MisMatchAttemptResults FMDIndex::misMatchExtend(MisMatchAttemptResults& prevMisM
 	    if(m_position.second < z_max) {
 		for(size_t base = 0; base < NUM_BASES; base++) {
 		    if(BASES[base] != c) {
-			m_position2.first = extend(m_position.first, BASES[base], backward);
+			m_position2.first = extensions.children[base];
 			m_position2.second = m_position.second;
 			m_position2.second++;
 		    
@@ -1542,13 +1589,6 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::misMatchMap(const BitVector& ra
     Log::debug() << "Mapping with minimum " << minContext << " context." <<
 	std::endl;
 	
-    // Make an iterator for ranges, so we can query it.
-    BitVectorIterator rangeIterator(ranges);
-
-    // And one for the mask, if needed
-    BitVectorIterator* maskIterator = (mask == NULL) ? NULL : 
-    new BitVectorIterator(*mask);
-    
     // We need a vector to return.
     std::vector<std::pair<int64_t,size_t>> mappings;
     
@@ -1575,27 +1615,27 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::misMatchMap(const BitVector& ra
     for(int i = start + length - 1; i >= start; i--) {
 	// Go from the end of our selected region to the beginning.
 
-	Log::info() << "On position " << i << " from " <<
+	Log::debug() << "On position " << i << " from " <<
 	    start + length - 1 << " to " << start << std::endl;
 
 	if(search.positions.size() == 1 && search.positions.front().first.isEmpty()) {
-	    Log::info() << "Starting over by mapping position " << i << std::endl;
+	    Log::debug() << "Starting over by mapping position " << i << std::endl;
 	    // We do not currently have a non-empty FMDPosition to extend. Start
 	    // over by mapping this character by itself.
-	    search = this->misMatchMapPosition(rangeIterator, query, i, minContext,
-		z_max, maskIterator);
+	    search = this->misMatchMapPosition(ranges, query, i, minContext,
+		z_max, mask);
 
 	    if(search.is_mapped && search.characters >= minContext && 
-		!search.positions.front().first.isEmpty(maskIterator) && range != -1
+		!search.positions.front().first.isEmpty(mask) && range != -1
 		&& search.positions.size() == 1) {
 
 		// It mapped. We didn't do a re-start and fail, we have sufficient
 		// context to be confident, and our interval is nonempty and
 		// subsumed by a range.
 		
-		range = search.positions.front().first.range(rangeIterator, maskIterator);
+		range = search.positions.front().first.range(ranges, mask);
 		
-		Log::info() << "Mapped " << search.characters << 
+		Log::debug() << "Mapped " << search.characters << 
 		" context to " << search.positions.front().first << " in range #" << range <<
 		std::endl;
 	    
@@ -1618,7 +1658,7 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::misMatchMap(const BitVector& ra
 	    // (backwards) with the next base.
 	    
 	    // Extend by *only* mismatched bases. Do not extend by the correct base yet.
-	    searchExtend = this->misMatchExtend(search, query[i], true, z_max, maskIterator, false, true);
+	    searchExtend = this->misMatchExtend(search, query[i], true, z_max, mask, false, true);
 	    
 	    // Check if mismatch extension gives you any results. If so, restart. See discussion
 	    // of mis-identifying mapped positions in the email thread
@@ -1635,24 +1675,24 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::misMatchMap(const BitVector& ra
 		// If no mismatch extension results exist, we can safely extend by the correct base
 		// and be assured we are passing forward a complete set of search results
 		
-		Log::info() << "Extending with position " << i << std::endl;
+		Log::debug() << "Extending with position " << i << std::endl;
 		
-		search = this->misMatchExtend(search, query[i], true, z_max, maskIterator, true, false);
+		search = this->misMatchExtend(search, query[i], true, z_max, mask, true, false);
 		search.characters++;
 		
 		// What range index does our current left-side position (the one we just
 		// moved) correspond to, if any?
-		range = search.positions.front().first.range(rangeIterator, maskIterator);
+		range = search.positions.front().first.range(ranges, mask);
 		
 		if(search.is_mapped && search.characters >= minContext && 
-		    !search.positions.front().first.isEmpty(maskIterator) && range != -1
+		    !search.positions.front().first.isEmpty(mask) && range != -1
 		    && search.positions.size() == 1) {
 		    
 		    // It mapped. We didn't do a re-start and fail, we have sufficient
 		    // context to be confident, and our interval is nonempty and
 		    // subsumed by a range.
 		    
-		    Log::info() << "Mapped " << search.characters << 
+		    Log::debug() << "Mapped " << search.characters << 
 		    " context to " << search.positions.front().first << " in range #" << range <<
 		    std::endl;
 		
@@ -1664,17 +1704,17 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::misMatchMap(const BitVector& ra
 		   
 		} else {
 		
-		    if(search.is_mapped && search.positions.front().first.isEmpty(maskIterator)
+		    if(search.is_mapped && search.positions.front().first.isEmpty(mask)
 			&& searchExtend.positions.size() == 1) {
 		    
-			Log::info() << "Failed at " << searchExtend.positions.front().first << " (" << 
+			Log::debug() << "Failed at " << searchExtend.positions.front().first << " (" << 
 			searchExtend.positions.size() << " mismatch search results for " <<
 			searchExtend.characters << " context)." << std::endl;
 			// We extended right until we got no results. We need to try
 			// this base again, in case we tried with a too-long left
 			// context.
 		
-			Log::info() << "Restarting from here..." << std::endl;
+			Log::debug() << "Restarting from here..." << std::endl;
 		
 			search = searchExtend;
 		
@@ -1686,7 +1726,7 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::misMatchMap(const BitVector& ra
 
 		    } else {
 			    
-			Log::info() << "Failed at " << search.positions.front().first << " (" << 
+			Log::debug() << "Failed at " << search.positions.front().first << " (" << 
 			search.positions.size() <<
 			" mismatch search results for " << search.characters << " context)." << 
 			std::endl;
@@ -1720,11 +1760,6 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::misMatchMap(const BitVector& ra
     // See <http://www.cplusplus.com/reference/algorithm/reverse/>
     std::reverse(mappings.begin(), mappings.end());
     
-    // Get rid of the mask iterator if needed
-    if(maskIterator != NULL) {
-	delete maskIterator;
-    }
-
     // Give back our answers.
     return mappings;
 }
@@ -1737,9 +1772,9 @@ std::vector<std::pair<int64_t,size_t>> FMDIndex::misMatchMap(const BitVector& ra
         minContext, z_max, start, length);    
 }
 
-MisMatchAttemptResults FMDIndex::misMatchMapPosition(BitVectorIterator& ranges, 
+MisMatchAttemptResults FMDIndex::misMatchMapPosition(const BitVector& ranges, 
     const std::string& pattern, size_t index, size_t minContext, size_t z_max,
-    BitVectorIterator* mask) const {
+    const BitVector* mask) const {
     
     // We're going to right-map so ranges match up with the things we can map to
     // (downstream contexts)
@@ -1860,13 +1895,6 @@ std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> FMDIndex::CmisMap(const
     Log::debug() << "Mapping with (two-sided) minimum " << minContext << " context." <<
         std::endl;
 
-    // Make an iterator for ranges, so we can query it.
-    BitVectorIterator rangeIterator(ranges);
-    
-    // And one for the mask, if needed
-    BitVectorIterator* maskIterator = (mask == NULL) ? NULL : 
-        new BitVectorIterator(*mask);
-
     // We need a vector to return.
     std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> mappings;
 
@@ -1890,11 +1918,11 @@ std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> FMDIndex::CmisMap(const
         Log::debug() << "On position " << i << " from " <<
             start + length - 1 << " to " << start << std::endl;
 	    
-        location = this->CmisMatchMapPosition(rangeIterator, query, i, minContext, z_max, maskIterator);
+        location = this->CmisMatchMapPosition(ranges, query, i, minContext, z_max, mask);
 
         // What range index does our current left-side position (the one we just
         // moved) correspond to, if any?
-        int64_t range = location.positions.front().first.range(rangeIterator, maskIterator);
+        int64_t range = location.positions.front().first.range(ranges, mask);
 
         if(location.is_mapped) {
             
@@ -1919,11 +1947,6 @@ std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> FMDIndex::CmisMap(const
     // See <http://www.cplusplus.com/reference/algorithm/reverse/>
     std::reverse(mappings.begin(), mappings.end());
 
-    // Get rid of the mask iterator if needed
-    if(maskIterator != NULL) {
-        delete maskIterator;
-    }
-
     // Give back our answers.
     return mappings;
     
@@ -1937,8 +1960,8 @@ std::vector<std::pair<int64_t,std::pair<size_t,size_t>>> FMDIndex::CmisMap(const
         minContext, start, length);    
 }
 
-MisMatchAttemptResults FMDIndex::CmisMatchMapPosition(BitVectorIterator& ranges, 
-	const std::string& pattern, size_t index, size_t z_max, size_t minContext, BitVectorIterator* mask) const {
+MisMatchAttemptResults FMDIndex::CmisMatchMapPosition(const BitVector& ranges, 
+	const std::string& pattern, size_t index, size_t z_max, size_t minContext, const BitVector* mask) const {
     
     // We're going to right-map so ranges match up with the things we can map to
     // (downstream contexts)
@@ -2060,14 +2083,13 @@ MisMatchAttemptResults FMDIndex::CmisMatchMapPosition(BitVectorIterator& ranges,
 // mismatch extend which returns results sorted by number of mismatches
 
 MisMatchAttemptResults FMDIndex::sortedMisMatchExtend(MisMatchAttemptResults& prevMisMatches,
-	char c, bool backward, size_t z_max, BitVectorIterator* mask) const {
+	char c, bool backward, size_t z_max, const BitVector* mask) const {
     MisMatchAttemptResults nextMisMatches;
     nextMisMatches.is_mapped = false;
     nextMisMatches.characters = prevMisMatches.characters;
     
     // Note that we do not flip parameters when !backward since
-    // FMDIndex::misMatchExtend uses FMDIndex::extend which performs
-    // this step itself
+    // FMDIndex::extendAll performs this step itself
     
     if(prevMisMatches.positions.size() == 0) {
 	throw std::runtime_error("Tried to extend zero length mismatch vector");
@@ -2145,16 +2167,19 @@ MisMatchAttemptResults FMDIndex::sortedMisMatchExtend(MisMatchAttemptResults& pr
 	    
 	}
 
-	// extend m_position by correct base
+	// extend m_position by every base at once, and take the correct
+	// base first
+	
+	FMDExtensions extensions = extendAll(m_position.first, backward);
 		
-	m_position2.first = extend(m_position.first, c, backward);
+	m_position2.first = extensions.get(c);
 	m_position2.second = z;
 	waitingMatches.push_back(m_position2);
 	
 	if(z < z_max) {
 	    for(size_t base = 0; base < NUM_BASES; base++) {
 		if(BASES[base] != c) {
-		    m_position2.first = extend(m_position.first, BASES[base], backward);
+		    m_position2.first = extensions.children[base];
 		    m_position2.second = z;
 		    m_position2.second++;
 		    waitingMisMatches.push_back(m_position2);
@@ -2190,7 +2215,7 @@ void FMDIndex::processMisMatchPositions(
 		MisMatchAttemptResults& nextMisMatches,
 		std::vector<std::pair<FMDPosition,size_t>>& waitingMatches,
 		std::vector<std::pair<FMDPosition,size_t>>& waitingMisMatches,
-		BitVectorIterator* mask) const {
+		const BitVector* mask) const {
 		  
     while(!waitingMatches.empty()) {
 	if(waitingMatches.back().first.getLength(mask) > 0) {
@@ -2209,4 +2234,477 @@ void FMDIndex::processMisMatchPositions(
   }
   
   return;
-  }
\ No newline at end of file
+  }
+/**
+ * Patterns found by an edit search, by the BWT intervals they occupy, with the
+ * fewest edits used to find each.
+ */
+typedef std::map<std::pair<std::pair<int64_t,int64_t>,int64_t>,
+    std::pair<FMDPosition,size_t>> EditFrontier;
+
+/**
+ * Add a pattern to an EditFrontier, if it occurs under the mask at all and
+ * isn't already there with as few edits.
+ */
+static void addEdited(EditFrontier& frontier, const FMDPosition& position,
+    size_t edits, const BitVector* mask) {
+    
+    if(position.getLength(mask) <= 0) {
+        // This pattern doesn't occur.
+        return;
+    }
+    
+    // Two different patterns with the same interval occur the same places, so
+    // we only need one of them.
+    std::pair<std::pair<int64_t,int64_t>,int64_t> key(std::make_pair(
+        position.getForwardStart(), position.getReverseStart()),
+        position.getEndOffset());
+    
+    EditFrontier::iterator found = frontier.find(key);
+    if(found == frontier.end()) {
+        frontier[key] = std::make_pair(position, edits);
+    } else if(found->second.second > edits) {
+        found->second.second = edits;
+    }
+}
+
+/**
+ * Get all the patterns in an EditFrontier, in a vector.
+ */
+static std::vector<std::pair<FMDPosition,size_t>> listEdited(
+    const EditFrontier& frontier) {
+    
+    std::vector<std::pair<FMDPosition,size_t>> list;
+    for(EditFrontier::const_iterator i = frontier.begin(); i != frontier.end();
+        ++i) {
+        
+        list.push_back(i->second);
+    }
+    return list;
+}
+
+/**
+ * Get the fewest edits any of the given patterns has, or -1 if there are none.
+ */
+static size_t fewestEdits(
+    const std::vector<std::pair<FMDPosition,size_t>>& patterns) {
+    
+    size_t fewest = (size_t)-1;
+    for(std::vector<std::pair<FMDPosition,size_t>>::const_iterator i =
+        patterns.begin(); i != patterns.end(); ++i) {
+        
+        fewest = std::min(fewest, i->second);
+    }
+    return fewest;
+}
+
+/**
+ * Get the range of the one pattern with the fewest edits, or -1 if there isn't
+ * exactly one or it isn't in a range.
+ */
+static int64_t fewestEditedRange(
+    const std::vector<std::pair<FMDPosition,size_t>>& patterns,
+    const BitVector& ranges, const BitVector* mask) {
+    
+    size_t fewest = fewestEdits(patterns);
+    const FMDPosition* best = NULL;
+    for(std::vector<std::pair<FMDPosition,size_t>>::const_iterator i =
+        patterns.begin(); i != patterns.end(); ++i) {
+        
+        if(i->second == fewest) {
+            if(best != NULL) {
+                // It's a tie.
+                return -1;
+            }
+            best = &i->first;
+        }
+    }
+    
+    return best == NULL ? -1 : best->range(ranges, mask);
+}
+
+/**
+ * Throw out patterns that would need more than z_max edits, given that they
+ * need at least bound more.
+ */
+static void pruneEdited(std::vector<std::pair<FMDPosition,size_t>>& patterns,
+    size_t bound, size_t z_max) {
+    
+    size_t kept = 0;
+    for(size_t i = 0; i < patterns.size(); i++) {
+        if(patterns[i].second + bound <= z_max) {
+            patterns[kept] = patterns[i];
+            kept++;
+        }
+    }
+    patterns.resize(kept);
+}
+
+EditAttemptResults FMDIndex::editExtend(const EditAttemptResults& previous,
+    char c, bool backward, size_t z_max, const BitVector* mask,
+    bool startExtension, bool finishExtension) const {
+    
+    // The patterns we find that end by aligning a query character, and those
+    // that end by skipping one.
+    EditFrontier aligned;
+    EditFrontier inserted;
+    
+    // Anything that isn't a base (like N) can't match, but can still be
+    // substituted or inserted.
+    bool cIsBase = isBase(c);
+    
+    for(int pendingPass = 0; pendingPass < 2; pendingPass++) {
+        // Look at the aligned patterns, and then the pending ones.
+        const std::vector<std::pair<FMDPosition,size_t>>& patterns =
+            pendingPass ? previous.pending : previous.positions;
+        
+        // If we're extending at the end we're searching from, everything that
+        // uses c ends up aligned. Otherwise patterns stay where they were.
+        EditFrontier& landed = (startExtension || finishExtension) ?
+            (pendingPass ? inserted : aligned) : aligned;
+        
+        for(std::vector<std::pair<FMDPosition,size_t>>::const_iterator it =
+            patterns.begin(); it != patterns.end(); ++it) {
+            
+            size_t edits = it->second;
+            
+            // Extend by every base at once. We pick out the extensions we want
+            // below.
+            FMDExtensions extensions = extendAll(it->first, backward);
+            
+            if(!finishExtension && cIsBase) {
+                // Extend by the correct base.
+                addEdited(landed, extensions.get(c), edits, mask);
+            }
+            
+            if(startExtension || edits >= z_max) {
+                // No edits allowed for this one.
+                continue;
+            }
+            
+            for(size_t base = 0; base < NUM_BASES; base++) {
+                if(BASES[base] != c) {
+                    // Substitute each other base for c.
+                    addEdited(landed, extensions.children[base], edits + 1,
+                        mask);
+                }
+            }
+            
+            if(!finishExtension) {
+                // Skip c as an insertion.
+                addEdited(inserted, it->first, edits + 1, mask);
+            }
+            
+            if(pendingPass && !finishExtension) {
+                // Deleting right after an insertion is just a substitution.
+                continue;
+            }
+            
+            // Delete one or more reference characters before aligning c. This
+            // vector grows as we go, until we run out of edits.
+            std::vector<std::pair<FMDPosition,size_t>> deleted;
+            for(size_t base = 0; base < NUM_BASES; base++) {
+                if(extensions.children[base].getLength(mask) > 0) {
+                    deleted.push_back(std::make_pair(extensions.children[base],
+                        edits + 1));
+                }
+            }
+            
+            for(size_t i = 0; i < deleted.size(); i++) {
+                // Copy it, since deleted may move when we add to it.
+                std::pair<FMDPosition,size_t> deletion = deleted[i];
+                FMDExtensions further = extendAll(deletion.first, backward);
+                
+                for(size_t base = 0; base < NUM_BASES; base++) {
+                    // Align c, correctly or not.
+                    size_t cost = deletion.second + (BASES[base] != c);
+                    if(cost <= z_max) {
+                        addEdited(landed, further.children[base], cost, mask);
+                    }
+                    
+                    if(deletion.second < z_max &&
+                        further.children[base].getLength(mask) > 0) {
+                        
+                        // Or delete another character first.
+                        deleted.push_back(std::make_pair(
+                            further.children[base], deletion.second + 1));
+                    }
+                }
+            }
+        }
+    }
+    
+    EditAttemptResults next;
+    next.is_mapped = previous.is_mapped;
+    next.characters = previous.characters;
+    next.maxCharacters = previous.maxCharacters;
+    next.positions = listEdited(aligned);
+    next.pending = listEdited(inserted);
+    return next;
+}
+
+std::vector<std::pair<int64_t,size_t>> FMDIndex::editMap(
+    const BitVector& ranges, const std::string& query, const BitVector* mask,
+    int minContext, size_t z_max, int start, int length) const {
+    
+    if(length == -1) {
+        // Fix up the length parameter if it is -1: that means the whole rest of
+        // the string.
+        length = query.length() - start;
+    }
+    
+    Log::debug() << "Edit mapping with minimum " << minContext <<
+        " context and " << z_max << " edits." << std::endl;
+    
+    // Context lengths are unsigned, so compare them against an unsigned
+    // minimum.
+    size_t contextNeeded = std::max(minContext, 0);
+    
+    // We need a vector to return.
+    std::vector<std::pair<int64_t,size_t>> mappings;
+    
+    // How far does an exact match go from each query index? Filled in as
+    // restarts need it.
+    std::vector<int64_t> matchLengths(query.size(), -1);
+    
+    // The search we are extending left, if any. When it has no aligned
+    // patterns, we restart.
+    EditAttemptResults search;
+    search.is_mapped = false;
+    search.characters = 0;
+    search.maxCharacters = 0;
+    
+    for(int i = start + length - 1; i >= start; i--) {
+        // Go from the end of our selected region to the beginning.
+        
+        if(search.positions.empty()) {
+            Log::debug() << "Starting over by mapping position " << i <<
+                std::endl;
+            
+            // Search right from here.
+            search = editMapPosition(ranges, query, i, z_max,
+                contextNeeded, mask, matchLengths);
+            
+            if(search.is_mapped && search.characters >= contextNeeded) {
+                // It mapped with enough context.
+                int64_t range = fewestEditedRange(search.positions,
+                    ranges, mask);
+                
+                Log::debug() << "Mapped " << search.characters <<
+                    " context to range #" << range << std::endl;
+                
+                mappings.push_back(std::make_pair(range,
+                    search.characters - 1));
+            } else {
+                // It didn't map. Say it corresponds to no range. If the
+                // search found anything, we extend it next time.
+                mappings.push_back(std::make_pair(-1, 0));
+            }
+            continue;
+        }
+        
+        // Otherwise try to extend the search we have left with this base.
+        EditAttemptResults extended = editExtend(search, query[i], true, z_max,
+            mask, true, false);
+        
+        // See if anything aligns to this base with an edit, and could do as
+        // well as what we extended. If so, the search doesn't cover everything
+        // that could be here, so start over.
+        EditAttemptResults alternatives = editExtend(search, query[i], true,
+            z_max, mask, false, true);
+        size_t fewest = fewestEdits(extended.positions);
+        
+        if(extended.positions.empty() ||
+            fewestEdits(alternatives.positions) <= fewest ||
+            fewestEdits(alternatives.pending) <= fewest) {
+            
+            // We extended until nothing aligned, or something else could be
+            // here. Retry this base, in case the right context was too long.
+            Log::debug() << "Extension failed at " << i << "; restarting" <<
+                std::endl;
+            search.positions.clear();
+            search.pending.clear();
+            i++;
+            continue;
+        }
+        
+        search = extended;
+        search.characters++;
+        
+        // What range does our best pattern belong to, if it is alone?
+        int64_t range = fewestEditedRange(search.positions, ranges,
+            mask);
+        
+        if(search.characters >= contextNeeded && range != -1) {
+            // It mapped.
+            Log::debug() << "Mapped " << search.characters <<
+                " context to range #" << range << std::endl;
+            mappings.push_back(std::make_pair(range, search.characters - 1));
+        } else {
+            // It didn't map, because it has too little context or multimapped.
+            // Restarting won't help, so keep extending.
+            mappings.push_back(std::make_pair(-1, 0));
+        }
+    }
+    
+    // We've gone through and attempted the whole string. Put our results in the
+    // same order as the string, instead of the backwards order we got them in.
+    std::reverse(mappings.begin(), mappings.end());
+    
+    // Give back our answers.
+    return mappings;
+}
+
+std::vector<std::pair<int64_t,size_t>> FMDIndex::editMap(
+    const BitVector& ranges, const std::string& query, int64_t genome,
+    int minContext, size_t z_max, int start, int length) const {
+    
+    // Get the appropriate mask, or NULL if given the special all-genomes value.
+    return editMap(ranges, query, genome == -1 ? NULL : genomeMasks[genome],
+        minContext, z_max, start, length);
+}
+
+EditAttemptResults FMDIndex::editMapPosition(const BitVector& ranges,
+    const std::string& pattern, size_t index, size_t z_max, size_t minContext,
+    const BitVector* mask, std::vector<int64_t>& matchLengths) const {
+    
+    // We're going to right-map so ranges match up with the things we can map
+    // to (downstream contexts).
+    EditAttemptResults result;
+    result.is_mapped = false;
+    result.characters = 1;
+    result.maxCharacters = 1;
+    
+    if(!isBase(pattern[index])) {
+        // Nothing can start here. Leave the search empty so the next base
+        // restarts.
+        return result;
+    }
+    
+    // The base itself has to be aligned, or we would really be mapping the
+    // next one.
+    FMDPosition position = getCharPosition(pattern[index]);
+    if(position.isEmpty(mask)) {
+        // This character isn't even in it.
+        return result;
+    }
+    result.positions.push_back(std::make_pair(position, 0));
+    
+    if(position.range(ranges, mask) != -1) {
+        // We've already mapped.
+        result.is_mapped = true;
+        return result;
+    }
+    
+    // Until the search is this long, nothing can map, so patterns that can't
+    // make it that far don't matter.
+    size_t window = std::min(index + minContext, pattern.size());
+    
+    if(editLowerBound(pattern, index + 1, window, z_max, mask,
+        matchLengths) > z_max) {
+        
+        // Nothing can get enough context to map, so don't bother searching.
+        result.positions.clear();
+        return result;
+    }
+    
+    for(index++; index < pattern.size(); index++) {
+        // Forwards extend with subsequent characters.
+        EditAttemptResults next = editExtend(result, pattern[index], false,
+            z_max, mask);
+        
+        if(index + 1 < window) {
+            // Drop patterns that can't get through the rest of the window.
+            size_t bound = editLowerBound(pattern, index + 1, window, z_max,
+                mask, matchLengths);
+            pruneEdited(next.positions, bound, z_max);
+            pruneEdited(next.pending, bound, z_max);
+        }
+        
+        if(next.positions.empty() && next.pending.empty()) {
+            // Nothing got this far.
+            break;
+        }
+        
+        // Are we down to one best pattern, in one range?
+        bool unique = fewestEditedRange(next.positions, ranges, mask) != -1;
+        
+        if(!result.is_mapped) {
+            // Keep searching with more context.
+            result.positions = next.positions;
+            result.pending = next.pending;
+            result.characters++;
+            result.maxCharacters++;
+            
+            if(unique && result.characters >= minContext) {
+                // Now we have mapped.
+                result.is_mapped = true;
+            }
+        } else if(unique) {
+            // We're still mapped. Keep the longer context, so extending left
+            // has less to consider.
+            result.positions = next.positions;
+            result.pending = next.pending;
+            result.maxCharacters++;
+        } else {
+            // We mapped, and more context won't change that.
+            break;
+        }
+    }
+    
+    if(result.is_mapped) {
+        // Report all the context we found, like map() does.
+        result.characters = result.maxCharacters;
+    } else {
+        // We ran out of context or patterns without mapping. Leave the search
+        // empty so the next base restarts.
+        result.positions.clear();
+        result.pending.clear();
+    }
+    
+    return result;
+}
+
+size_t FMDIndex::editLowerBound(const std::string& query, size_t start,
+    size_t end, size_t z_max, const BitVector* mask,
+    std::vector<int64_t>& matchLengths) const {
+    
+    size_t edits = 0;
+    while(start < end) {
+        if(matchLengths[start] == -1) {
+            // Find how long an exact match starting here can be.
+            int64_t matchLength = 0;
+            if(isBase(query[start])) {
+                FMDPosition position = getCharPosition(query[start]);
+                while(!position.isEmpty(mask)) {
+                    matchLength++;
+                    if(start + matchLength == query.size() ||
+                        !isBase(query[start + matchLength])) {
+                        
+                        break;
+                    }
+                    position = extend(position, query[start + matchLength],
+                        false);
+                }
+            }
+            matchLengths[start] = matchLength;
+        }
+        
+        // Take the whole exact piece.
+        start += matchLengths[start];
+        
+        if(start < end) {
+            // Something has to break here. At best it's an edit that takes
+            // out the character that stopped the piece.
+            edits++;
+            start++;
+            
+            if(edits > z_max) {
+                // That's already too many.
+                break;
+            }
+        }
+    }
+    
+    return edits;
+}
@@ -11,9 +11,18 @@
 
 #include "TextPosition.hpp"
 #include "FMDIndexIterator.hpp"
+#include "SuffixTreeTraversal.hpp"
 #include "BitVector.hpp"
 #include "Mapping.hpp"
 #include "MapAttemptResult.hpp"
+#include "FMDExtensions.hpp"
+#include "PackedText.hpp"
+#include "SampledISA.hpp"
+#include "LCPArray.hpp"
+#include "UniqueContextTable.hpp"
+#include "PackedSuffixArray.hpp"
+#include "SMEM.hpp"
+#include "MemoryReport.hpp"
 
 // State that the test cases class exists, even though we can't see it.
 class FMDIndexTests;
@@ -37,7 +46,9 @@ public:
     /**
      * Load an FMD and metadata from the given basename. Optionally, specify a
      * complete suffix array that the index can use. The index takes ownership
-     * of that suffix array, and will free it on destruction.
+     * of that suffix array, and will free it on destruction. If the index was
+     * built with a packed text, that is loaded too, and so is a saved full
+     * suffix array, if no suffix array was given.
      */
     FMDIndex(std::string basename, SuffixArray* fullSuffixArray = NULL);
     
@@ -164,6 +175,48 @@ public:
      */
     void extendFast(FMDPosition& range, char c, bool backward) const;
     
+    /**
+     * Extend a search by every base at once, either backward or forward, from
+     * a single pair of occurrence lookups. Also reports how much of the range
+     * runs into the end of the text on the side being extended.
+     */
+    FMDExtensions extendAll(const FMDPosition& range, bool backward) const;
+    
+    /**
+     * Start loading the BWT markers that extending the given range in the
+     * given direction will need, without waiting for them.
+     */
+    void prefetchExtendMarkers(const FMDPosition& range, bool backward) const;
+    
+    /**
+     * Start loading the BWT runs that extending the given range in the given
+     * direction will need, without waiting for them. This has to read the
+     * markers, so call prefetchExtendMarkers some time before.
+     */
+    void prefetchExtendRuns(const FMDPosition& range, bool backward) const;
+    
+    /**
+     * Does the index have an LCP array, so searches can be contracted?
+     */
+    bool hasLCP() const;
+    
+    /**
+     * Undo extensions of a search, either backward or forward: given the
+     * nonempty range for a pattern of the given length, get the range for the
+     * longest part of the pattern with more occurrences, dropping characters
+     * from the left end if backward is true and from the right end otherwise.
+     * Sets length to the length of that part, which may be 0.
+     *
+     * Only one side of the result is known: the reverse interval if backward
+     * is true, and the forward interval otherwise. The other start is 0, and
+     * extensions on the known side will keep it meaningless.
+     *
+     * Returns an empty range if the index has no LCP array, or the part is too
+     * long for the LCP array to say.
+     */
+    FMDPosition contract(const FMDPosition& range, size_t& length,
+        bool backward) const;
+    
     /**
      * Select all the occurrences of the given pattern, using FMD backwards
      * search.
@@ -176,12 +229,53 @@ public:
      **************************************************************************/
  
     /**
-     * Find the (text, offset) position for an index in the BWT.
+     * Find the (text, offset) position for an index in the BWT. This takes
+     * constant time if the index has a full suffix array, either from being
+     * just built or saved with it.
      */
     TextPosition locate(int64_t index) const;
     
-    // Unfortunately, unlocate cannot be efficiently implemented with
-    // libsuffixtools's SampledSuffixArray.
+    /**
+     * Find the (text, offset) positions for many indices in the BWT at once,
+     * in the same order. This walks all the indices back to their suffix
+     * array samples together, which is much faster than locating them one at
+     * a time.
+     */
+    std::vector<TextPosition> locateBatch(
+        const std::vector<int64_t>& indices) const;
+    
+    /**
+     * Find the (text, offset) positions for everything in the forward range of
+     * the given FMDPosition, in BWT order.
+     */
+    std::vector<TextPosition> locateRange(const FMDPosition& range) const;
+    
+    /**
+     * Find the index in the BWT of the given (text, offset) position, which may
+     * be at the end of its text. Only works if the index has a sampled inverse
+     * suffix array, and takes at most its sample rate LF-mappings.
+     */
+    int64_t unlocate(const TextPosition& position) const;
+    
+    /**
+     * Does the index have a unique context table, so it can say how much
+     * context positions need?
+     */
+    bool hasUniqueContexts() const;
+    
+    /**
+     * Get the length of the shortest context around the given position that
+     * occurs only once in the position's genome: starting at the position and
+     * going right, or, if leftward is true, ending at it and going left. Any
+     * mapping to the position under its genome's mask uses at least that much
+     * context, so this answers minimum context questions without searching.
+     *
+     * Returns 0 if there is no such context before the end of the text, and
+     * UniqueContextTable::MAX_VALUE if it is at least that long. Only works if
+     * the index has a unique context table.
+     */
+    size_t getUniqueContextLength(const TextPosition& position,
+        bool leftward = false) const;
     
     /**
      * Find the endpoint of the given contig in the BWT.
@@ -207,6 +301,15 @@ public:
      */
     std::string displayContig(size_t index) const;
     
+    /**
+     * Extract and return length bases of the forward strand of the given
+     * contig, starting at start. This is fast if the index has a packed text.
+     * Otherwise it walks the BWT, from the end of the part we want if the
+     * index has a sampled inverse suffix array, and from the end of the contig
+     * if not.
+     */
+    std::string extract(size_t contig, size_t start, size_t length) const;
+    
     /**
      * Given an index in the BWT, do an LF-mapping to get where the character
      * that appears in the first column at this index shows up in the last
@@ -241,6 +344,16 @@ public:
     std::vector<Mapping> map(const std::string& query, int64_t genome = -1, 
         int minContext = 0, int start = 0, int length = -1) const;
     
+    /**
+     * LEFT-map each base of the forward strand of one of the index's own
+     * contigs to a specific genome, or to all genomes if genome is -1, with the
+     * same results as mapping the string displayContig gives. Mapping a contig
+     * to its own genome needs no searching at all if the index has a unique
+     * context table.
+     */
+    std::vector<Mapping> mapContig(size_t contig, int64_t genome = -1,
+        int minContext = 0) const;
+    
     /**
      * Both left- and right-map the given string to the given genome (or all
      * genomes if genome is -1). Start and length can optionally be used to
@@ -249,6 +362,39 @@ public:
      */
     std::vector<Mapping> mapBoth(const std::string& query, int64_t genome = -1, 
         int minContext = 0, int start = 0, int length = -1) const;
+
+    /**
+     * Both left- and right-map the given string to each of the given genomes,
+     * as mapBoth does for each genome alone. Each genome still has its own
+     * search, but an extension that several of them need at once is only done
+     * once. Returns the mappings for each genome, in the order given.
+     */
+    std::vector<std::vector<Mapping>> mapBoth(const std::string& query,
+        const std::vector<size_t>& genomes, int minContext = 0, int start = 0,
+        int length = -1) const;
+    
+    /**
+     * LEFT-map each of the given query strings, as map does. The searches for
+     * all the queries are interleaved, which hides much of the time spent
+     * waiting for the BWT to come in from memory, so this is much faster than
+     * mapping the queries one at a time.
+     */
+    std::vector<std::vector<Mapping>> mapBatch(
+        const std::vector<std::string>& queries, const BitVector* mask = NULL,
+        int minContext = 0) const;
+    
+    /**
+     * Find all the super-maximal exact matches of at least minLength
+     * characters between the query and the index, in order of their starts in
+     * the query. Matches never span non-base characters. Uses the forward and
+     * backward extension schedule from Li 2012, which looks at each query
+     * position only a few times.
+     *
+     * If a mask is non-NULL, only positions in the index with a 1 in the mask
+     * count as occurrences. Like a genome mask, it has to cover whole texts.
+     */
+    std::vector<SMEM> findSMEMs(const std::string& query, size_t minLength = 1,
+        const BitVector* mask = NULL) const;
       
     /**
      * Try RIGHT-mapping each base in the query to one of the ranges represented
@@ -282,6 +428,35 @@ public:
     std::vector<std::pair<int64_t,size_t>> map(const BitVector& ranges,
         const std::string& query, const BitVector* mask, int minContext = 0, 
         int start = 0, int length = -1) const;
+    
+    /**
+     * RIGHT-map each of the given query strings to ranges, as map does, with
+     * all the searches interleaved like in mapBatch.
+     */
+    std::vector<std::vector<std::pair<int64_t,size_t>>> mapBatch(
+        const BitVector& ranges, const std::vector<std::string>& queries,
+        const BitVector* mask = NULL, int minContext = 0) const;
+
+    /**
+     * RIGHT-map each base in the query to ranges in each of several range
+     * vectors at once, such as the levels of a reference hierarchy. Returns,
+     * for each range vector, exactly what map would for it alone, but searches
+     * that would be the same for several range vectors are done only once.
+     */
+    std::vector<std::vector<std::pair<int64_t,size_t>>> mapLevels(
+        const std::vector<const BitVector*>& levels, const std::string& query,
+        const BitVector* mask, int minContext = 0, int start = 0,
+        int length = -1) const;
+
+    /**
+     * RIGHT-map to ranges at several levels at once, using contexts from a
+     * specific genome, or all genomes if genome is -1. Same semantics as the
+     * function above.
+     */
+    std::vector<std::vector<std::pair<int64_t,size_t>>> mapLevels(
+        const std::vector<const BitVector*>& levels, const std::string& query,
+        int64_t genome = -1, int minContext = 0, int start = 0,
+        int length = -1) const;
 
     /**
      * CENTERED VERSIONS of the functions described above
@@ -320,7 +495,7 @@ public:
      **/ 
 	
     MisMatchAttemptResults misMatchExtend(MisMatchAttemptResults& prevMisMatches,
-	char c, bool backward, size_t z_max, BitVectorIterator* mask,
+	char c, bool backward, size_t z_max, const BitVector* mask,
 	bool startExtension = false, bool finishExtension = false) const;
 	
     /**
@@ -330,7 +505,7 @@ public:
      **/
 	
     MisMatchAttemptResults sortedMisMatchExtend(MisMatchAttemptResults& prevMisMatches,
-	char c, bool backward, size_t z_max, BitVectorIterator* mask) const;
+	char c, bool backward, size_t z_max, const BitVector* mask) const;
 	
     /**
      * A submethod of sortedMisMatchExtend to check for existence and then sort
@@ -341,7 +516,7 @@ public:
 	MisMatchAttemptResults& nextMisMatches,
 	std::vector<std::pair<FMDPosition,size_t>>& waitingMatches,
 	std::vector<std::pair<FMDPosition,size_t>>& waitingMisMatches,
-	BitVectorIterator* mask) const;
+	const BitVector* mask) const;
 		
     /**
      * Implementing mismatch search for Left-Right exact contexts
@@ -355,9 +530,9 @@ public:
 	const std::string& query, int64_t genome = -1, int minContext = 0, size_t z_max = 0,
 	int start = 0, int length = -1) const;
 	
-    MisMatchAttemptResults misMatchMapPosition(BitVectorIterator& ranges, 
+    MisMatchAttemptResults misMatchMapPosition(const BitVector& ranges, 
 	const std::string& pattern, size_t index, size_t z_max, size_t minContext,
-	BitVectorIterator* mask = NULL) const;
+	const BitVector* mask = NULL) const;
     
     /**
      * Centered search versions of all the mismatch mapping functions
@@ -371,9 +546,77 @@ public:
 	const std::string& query, int64_t genome = -1, int minContext = 0, size_t z_max = 0,
 	int start = 0, int length = -1) const;
 	
-    MisMatchAttemptResults CmisMatchMapPosition(BitVectorIterator& ranges, 
+    MisMatchAttemptResults CmisMatchMapPosition(const BitVector& ranges, 
 	const std::string& pattern, size_t index, size_t z_max, size_t minContext,
-	BitVectorIterator* mask = NULL) const;
+	const BitVector* mask = NULL) const;
+
+    /***************************************************************************
+     * Edit distance
+     **************************************************************************/
+    
+    /**
+     * Given an edit search, extend every pattern in it by the given character,
+     * allowing up to z_max edits in total: substitutions, insertions of query
+     * characters, and deletions of reference characters just before the new
+     * one. Patterns that don't occur under the mask are thrown out, and
+     * patterns found more than one way are kept once, with their fewest edits.
+     * 
+     * startExtension and finishExtension work as in misMatchExtend(), for
+     * extending at the other end of the patterns than the one being searched
+     * from: the first only extends by the correct base, and the second only by
+     * edits that don't skip the character. Patterns extended that way keep
+     * whether they ended in an insertion.
+     */
+    EditAttemptResults editExtend(const EditAttemptResults& previous, char c,
+        bool backward, size_t z_max, const BitVector* mask,
+        bool startExtension = false, bool finishExtension = false) const;
+    
+    /**
+     * Like misMatchMap(), but allowing up to z_max edits, including small
+     * insertions and deletions, in the right context of each base. Returns
+     * the range each base maps to, or -1, and the context it took, less one.
+     * 
+     * A base maps when the pattern with the fewest edits is alone and in a
+     * range. Counting every pattern within z_max edits, as misMatchMap() does,
+     * would never map next to a homopolymer, since an indel there finds the
+     * same place shifted over by one.
+     * 
+     * Searches are pruned with a lower bound on the edits needed to get to
+     * minContext, which only holds if the mask, if any, covers whole texts, like
+     * a genome mask.
+     */
+    std::vector<std::pair<int64_t,size_t>> editMap(const BitVector& ranges,
+        const std::string& query, const BitVector* mask, int minContext = 0,
+        size_t z_max = 0, int start = 0, int length = -1) const;
+    
+    std::vector<std::pair<int64_t,size_t>> editMap(const BitVector& ranges,
+        const std::string& query, int64_t genome = -1, int minContext = 0,
+        size_t z_max = 0, int start = 0, int length = -1) const;
+    
+    /**
+     * Right-map the base at the given index with up to z_max edits, by forward
+     * search with the characters after it. Nothing can map until the search
+     * has minContext characters, so until then patterns are dropped when
+     * editLowerBound() says they can't last that long. The lengths of exact
+     * matches starting at each query index are cached in matchLengths, with -1
+     * for ones not found yet.
+     */
+    EditAttemptResults editMapPosition(const BitVector& ranges,
+        const std::string& pattern, size_t index, size_t z_max,
+        size_t minContext, const BitVector* mask,
+        std::vector<int64_t>& matchLengths) const;
+    
+    /**
+     * Get a lower bound on the edits needed for anything to align to the
+     * query from start to end, or anything over z_max if it is more than that.
+     * Each edit can only break the query in one place, and drop at most one
+     * character there, so greedily taking the longest exact matches, and
+     * counting the breaks between them, never counts too many. Exact match
+     * lengths are cached in matchLengths as for editMapPosition().
+     */
+    size_t editLowerBound(const std::string& query, size_t start, size_t end,
+        size_t z_max, const BitVector* mask,
+        std::vector<int64_t>& matchLengths) const;
 
         
     /***************************************************************************
@@ -405,8 +648,43 @@ public:
      */
     iterator end(size_t depth, bool reportDeadEnds = false) const;
     
+    /**
+     * Show the given visitor every range in the suffix tree at the given depth
+     * (and the shorter-than-depth contexts that happen before end of texts, if
+     * reportDeadEnds is set), like iterating would. The tree is split into
+     * subtrees at splitDepth, which are visited in parallel on threadCount
+     * threads (or one per core if 0). See SuffixTreeTraversal.
+     */
+    void traverse(SuffixTreeVisitor& visitor, size_t depth,
+        bool reportDeadEnds = false, size_t splitDepth = 4,
+        size_t threadCount = 0) const;
+    
+    /***************************************************************************
+     * Memory Functions
+     **************************************************************************/
+    
+    /**
+     * Get a breakdown of the bytes used by each part of the index: the BWT
+     * runs and markers, the suffix array samples, any full suffix array, the
+     * genome masks, the contig metadata, and any optional structures loaded.
+     */
+    MemoryReport reportMemory() const;
+    
+    /**
+     * Free the full suffix array the index was built with, if it has one, to
+     * save memory. After this, locating uses the saved full suffix array, if
+     * one was saved with the index, or else the much slower sampled one.
+     * Returns the number of bytes freed.
+     */
+    size_t dropFullSuffixArray();
+    
 protected:
     
+    /**
+     * Holds the basename the index was loaded from.
+     */
+    std::string basename;
+    
     /**
      * Holds the sequence names of all the contigs.
      */
@@ -475,55 +753,48 @@ protected:
     SuffixArray* fullSuffixArray;
     
     /**
-     * Try left-mapping the given index in the given string, starting from
-     * scratch. Start a backwards search at that index in the string and extend
-     * left until we map to exactly one or zero places. Returns true or false
-     * depending on whether we map, an FMDPosition (in BWT coordinates) that, if
-     * nonempty, can be extended right to try and map the next base to the
-     * right, and the number of characters in the pattern used to make that
-     * FMDPosition.
-     *
-     * If the mapping succeeded, the FMDPosition returned has one thing in it,
-     * which is the mapping upstream context.
-     *
-     * Index must be a valid character position in the string.
-     *
-     * If a mask is specified, only positions in the index with a 1 in the mask
-     * will be counted for mapping purposes.
+     * Holds the packed forward strands of all the contigs, if the index has
+     * them, for extracting text without walking the BWT. Owned by this object,
+     * if not null.
      */
-    MapAttemptResult mapPosition(const std::string& pattern,
-        size_t index, BitVectorIterator* mask = NULL) const;
-      
+    PackedText* packedText;
+    
     /**
-     * Try RIGHT-mapping the given index in the given string to a unique forward-
-     * strand range according to the bit vector of range start points, starting
-     * from scratch. Start a backwards search at that index in the string and
-     * extend left until we map to exactly one or zero ranges. Returns true or
-     * false depending on whether we map, an FMDPosition (in BWT coordinates)
-     * that, if nonempty, can be extended right to try and map the next base to
-     * the right, and the number of characters in the pattern used to make that
-     * FMDPosition.
-     *
-     * The range starting points must be such that the ranges described are "bi-
-     * ranges": each range has its reverse-complement range also present.
-     *
-     * If the mapping succeeded, the FMDPosition returned is completely
-     * contained within one range, which is the range to which the base has been
-     * mapped.
-     *
-     * Index must be a valid character position in the string.
-     *
-     * If a mask is specified, only positions in the index with a 1 in the mask
-     * will be counted for mapping purposes.
+     * Holds the sampled inverse suffix array, if the index has one, for
+     * unlocating positions and extracting text from the middle of contigs.
+     * Owned by this object, if not null.
      */
-    creditMapAttemptResult CmapPosition(BitVectorIterator& ranges, 
-        const std::string& pattern, size_t index, 
-        BitVectorIterator* mask = NULL) const;
-        
-    MapAttemptResult mapPosition(BitVectorIterator& ranges, 
-        const std::string& pattern, size_t index, 
-        BitVectorIterator* mask = NULL) const;
-	
+    SampledISA* isa;
+    
+    /**
+     * Holds the LCP array, if the index has one, for contracting searches
+     * instead of restarting them. Owned by this object, if not null.
+     */
+    LCPArray* lcp;
+    
+    /**
+     * Holds the shortest unique context length for every text position, if the
+     * index has them. Owned by this object, if not null.
+     */
+    UniqueContextTable* contexts;
+    
+    /**
+     * Holds the full suffix array saved with the index, if it has one and we
+     * weren't handed one when we were built. Owned by this object, if not
+     * null.
+     */
+    PackedSuffixArray* packedSuffixArray;
+    
+    /**
+     * Find the super-maximal exact matches of at least minLength characters
+     * that contain the query base at x, which must be a base, and add them to
+     * smems in query order. Returns where in the query the next SMEMs not
+     * found here can start. live and next are scratch space.
+     */
+    size_t findSMEMsAt(const std::string& query, size_t x, size_t minLength,
+        const BitVector* mask, std::vector<SMEM>& smems,
+        std::vector<SMEM>& live, std::vector<SMEM>& next) const;
+    
     /**
      * Given a left mapping and a right mapping for a base, disambiguate them to
      * produce one left mapping. If only one of them is actually mapped, returns
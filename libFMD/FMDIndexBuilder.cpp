@@ -20,8 +20,12 @@
 #include "kseq.h"
 #include "util.hpp"
 #include "Log.hpp"
+#include "Trace.hpp"
 
 #include "FMDIndexBuilder.hpp"
+#include "LCPArray.hpp"
+#include "UniqueContextTable.hpp"
+#include "PackedSuffixArray.hpp"
 
 /**
  * Utility function to report last error and kill the program.
@@ -45,18 +49,33 @@ void report_error(const std::string message) {
 // Don't hook in .gz support. See <http://stackoverflow.com/a/19390915/402891>
 KSEQ_INIT(int, read)
 
-FMDIndexBuilder::FMDIndexBuilder(const std::string& basename, int sampleRate):
-    basename(basename), tempDir(make_tempdir()), 
-    tempFastaName(tempDir + "/temp.fa"), tempFasta(tempFastaName.c_str()), 
+FMDIndexBuilder::FMDIndexBuilder(const std::string& basename, int sampleRate,
+    bool packText, size_t isaSampleRate, bool buildLCP, bool buildContexts,
+    bool saveSuffixArray): basename(basename),
+    tempDir(make_tempdir()), tempFastaName(tempDir + "/temp.fa"),
+    tempFasta(tempFastaName.c_str()), 
     contigFile((basename + ".contigs").c_str()), genomeAssignments(),
-    sampleRate(sampleRate) {
+    sampleRate(sampleRate), isaSampleRate(isaSampleRate), buildLCP(buildLCP),
+    buildContexts(buildContexts), saveSuffixArray(saveSuffixArray),
+    packedWriter(NULL) {
 
-    // Nothing to do, already made everything.
+    if(packText) {
+        // Start the packed text file, which the index will find by name.
+        packedWriter = new PackedText::Writer(basename + ".pak");
+    }
     
 }
 
+FMDIndexBuilder::~FMDIndexBuilder() {
+    // Get rid of the packed text writer if we never built.
+    delete packedWriter;
+}
+
 void FMDIndexBuilder::add(const std::string& filename) {
     
+    // Show each FASTA on the timeline.
+    TraceSpan span("addFasta " + filename);
+    
     // Open the FASTA for reading.
     FILE* fasta = fopen(filename.c_str(), "r");
     
@@ -101,6 +120,11 @@ void FMDIndexBuilder::add(const std::string& filename) {
                         std::endl;
                     tempFasta << run << std::endl;
                     
+                    if(packedWriter != NULL) {
+                        // Pack the forward strand too.
+                        packedWriter->addContig(run);
+                    }
+                    
                     // And the reverse strand    
                     tempFasta << ">" << name << "-" << runStart << "R" <<
                         std::endl;
@@ -137,12 +161,22 @@ FMDIndex* FMDIndexBuilder::build() {
     // And the contig sizes file
     contigFile.close();
     
+    if(packedWriter != NULL) {
+        // And the packed text
+        packedWriter->close();
+        delete packedWriter;
+        packedWriter = NULL;
+    }
+    
     // Compute what we want to save: BWT, sampled suffix array, and per-genome
     // BitVector masks.
     std::string bwtFile = basename + ".bwt";
     std::string ssaFile = basename + ".ssa";
     std::string bitmaskFile = basename + ".msk";
 
+    // Time building the suffix array and BWT together.
+    TraceSpan suffixArraySpan("buildSuffixArray");
+
     // Produce the index of the temp file
     // Load all the sequences into memory (again).
     // TODO: Just keep them there
@@ -157,6 +191,137 @@ FMDIndex* FMDIndexBuilder::build() {
     
     // Write the BWT to disk
     suffixArray->writeBWT(bwtFile, readTable);
+    suffixArraySpan.finish();
+    
+    if(buildLCP || buildContexts) {
+        TraceSpan span("buildLCPAndContexts");
+        
+        // We need the text to see how long adjacent suffixes match for, so do
+        // it while we have it.
+        std::string lcpFile = basename + ".lcp";
+        std::string contextFile = basename + ".uct";
+        
+        LCPArray::Writer* lcpWriter = NULL;
+        if(buildLCP) {
+            Log::info() << "Saving LCP array to " << lcpFile << std::endl;
+            lcpWriter = new LCPArray::Writer(lcpFile);
+        }
+        
+        std::vector<size_t> textLengths;
+        for(size_t i = 0; i < readTable->getCount(); i++) {
+            textLengths.push_back(readTable->getReadLength(i));
+        }
+        
+        UniqueContextTable* contexts = NULL;
+        if(buildContexts) {
+            // Every text gets a context length for each of its offsets.
+            contexts = new UniqueContextTable(textLengths);
+        }
+        
+        // A suffix is unique in its genome as soon as it stops matching the
+        // suffixes from the same genome just before and after it. Two suffixes
+        // match for as long as the least of the LCP values between them, so
+        // keep the positions where the LCP values since then hit new lows.
+        // Values are clipped, so this never gets long.
+        std::vector<std::pair<size_t, size_t>> lows;
+        
+        // Where was the last suffix from each genome, and how much did it
+        // match the one from its genome before it?
+        size_t numGenomes = (genomeAssignments.size() == 0) ? 0 :
+            genomeAssignments.back() + 1;
+        std::vector<int64_t> lastIndex(numGenomes, -1);
+        std::vector<size_t> lastMatch(numGenomes, 0);
+        
+        // Record the shortest unique context for a suffix, which matches its
+        // genome neighbors for the given number of characters.
+        auto finishSuffix = [&](size_t index, size_t match) {
+            SAElem element = suffixArray->get(index);
+            size_t left = textLengths[element.getID()] - element.getPos();
+            if(match < left) {
+                // The next character makes it unique, before the text ends.
+                contexts->set(TextPosition(element.getID(), element.getPos()),
+                    match + 1);
+            }
+        };
+        
+        for(size_t i = 0; i < suffixArray->getSize(); i++) {
+            SAElem current = suffixArray->get(i);
+            
+            // How many characters does this suffix share with the one before?
+            size_t length = 0;
+            
+            if(i > 0) {
+                SAElem previous = suffixArray->get(i - 1);
+            
+                // How far can each suffix go before its text ends?
+                size_t previousLeft = textLengths[previous.getID()] -
+                    previous.getPos();
+                size_t currentLeft = textLengths[current.getID()] -
+                    current.getPos();
+                
+                // Don't look further than we can store.
+                size_t limit = std::min(std::min(previousLeft, currentLeft),
+                    (size_t)LCPArray::MAX_VALUE);
+                
+                while(length < limit && readTable->getChar(previous.getID(),
+                    previous.getPos() + length) == readTable->getChar(
+                    current.getID(), current.getPos() + length)) {
+                    
+                    // Count up matching characters.
+                    length++;
+                }
+            }
+            
+            if(lcpWriter != NULL) {
+                lcpWriter->addValue(length);
+            }
+            
+            if(contexts == NULL) {
+                continue;
+            }
+            
+            // This value is a new low for everything since anything higher.
+            while(!lows.empty() && lows.back().second >= length) {
+                lows.pop_back();
+            }
+            lows.push_back(std::make_pair(i, length));
+            
+            size_t genome = genomeAssignments[current.getID() / 2];
+            size_t match = 0;
+            if(lastIndex[genome] != -1) {
+                // It matches the last suffix from its genome for as long as
+                // the lowest LCP value after that one.
+                match = std::lower_bound(lows.begin(), lows.end(),
+                    std::make_pair((size_t)lastIndex[genome] + 1, (size_t)0)
+                    )->second;
+                
+                // Now we know everything the last one matches.
+                finishSuffix(lastIndex[genome], std::max(lastMatch[genome],
+                    match));
+            }
+            lastIndex[genome] = i;
+            lastMatch[genome] = match;
+        }
+        
+        for(size_t genome = 0; genome < numGenomes; genome++) {
+            if(lastIndex[genome] != -1) {
+                // The last suffix from each genome has nothing after it.
+                finishSuffix(lastIndex[genome], lastMatch[genome]);
+            }
+        }
+        
+        if(lcpWriter != NULL) {
+            lcpWriter->close();
+            delete lcpWriter;
+        }
+        
+        if(contexts != NULL) {
+            Log::info() << "Saving unique context table to " << contextFile <<
+                std::endl;
+            contexts->save(contextFile);
+            delete contexts;
+        }
+    }
     
     // Delete the read table since we no lonfger need it. Keep the suffix array
     // around because the FMDIndex we return can cheat off it.
@@ -168,6 +333,7 @@ FMDIndex* FMDIndexBuilder::build() {
         
     Log::info() << "Creating " << numGenomes << " genome bitmasks..." <<
         std::endl;
+    TraceSpan maskSpan("buildGenomeMasks");
     
     // Holds a bit vector encoder for each genome. TODO: Make this a C++11
     // vector with emplace_back to work around non-copy-constructability of
@@ -225,6 +391,7 @@ FMDIndex* FMDIndexBuilder::build() {
     // Finish up the bitmask file.
     bitmaskStream.flush();
     bitmaskStream.close();
+    maskSpan.finish();
     
     Log::info() << "Re-loading BWT..." << std::endl;
     
@@ -237,6 +404,7 @@ FMDIndex* FMDIndexBuilder::build() {
     ReadInfoTable infoTable(tempFastaName);
     
     Log::info() << "Sampling suffix array..." << std::endl;
+    TraceSpan sampleSpan("sampleSuffixArray");
     
     // Make a sampled suffix array
     SampledSuffixArray sampled;
@@ -248,6 +416,60 @@ FMDIndex* FMDIndexBuilder::build() {
 
     // Save it to disk    
     sampled.writeSSA(ssaFile);
+    sampleSpan.finish();
+    
+    if(isaSampleRate > 0) {
+        // We also want to be able to go from text positions to BWT indices.
+        std::string isaFile = basename + ".isa";
+        
+        Log::info() << "Sampling inverse suffix array..." << std::endl;
+        TraceSpan span("sampleInverseSuffixArray");
+        
+        // Every text gets samples along its length.
+        std::vector<size_t> textLengths;
+        for(size_t i = 0; i < infoTable.getCount(); i++) {
+            textLengths.push_back(infoTable.getReadLength(i));
+        }
+        
+        SampledISA isa(isaSampleRate, textLengths, bwt.getBWLen());
+        
+        for(size_t i = 0; i < suffixArray->getSize(); i++) {
+            // The suffix array says where every BWT index is, so offer it up
+            // to be kept if it's at a sampled position.
+            SAElem element = suffixArray->get(i);
+            isa.offer(TextPosition(element.getID(), element.getPos()), i);
+        }
+        
+        Log::info() << "Saving sampled inverse suffix array to " << isaFile <<
+            std::endl;
+        
+        isa.save(isaFile);
+    }
+    
+    if(saveSuffixArray) {
+        // Keep the whole suffix array, so reloaded indexes can locate without
+        // walking the BWT.
+        std::string saFile = basename + ".sa";
+        
+        Log::info() << "Packing full suffix array..." << std::endl;
+        TraceSpan span("packSuffixArray");
+        
+        std::vector<size_t> textLengths;
+        for(size_t i = 0; i < infoTable.getCount(); i++) {
+            textLengths.push_back(infoTable.getReadLength(i));
+        }
+        
+        PackedSuffixArray packed(textLengths, suffixArray->getSize());
+        
+        for(size_t i = 0; i < suffixArray->getSize(); i++) {
+            SAElem element = suffixArray->get(i);
+            packed.set(i, TextPosition(element.getID(), element.getPos()));
+        }
+        
+        Log::info() << "Saving full suffix array to " << saFile << std::endl;
+        
+        packed.save(saFile);
+    }
     
     // Get rid of the temporary FASTA directory
     boost::filesystem::remove_all(tempDir);
@@ -6,6 +6,7 @@
 #include <fstream>
 
 #include "FMDIndex.hpp"
+#include "PackedText.hpp"
 
 /**
  * A class for building an FMD Index with libsuffixtools. Every index has a
@@ -18,9 +19,23 @@ class FMDIndexBuilder {
         /**
          * Create a new FMDIndexBuilder using the specified basename for its
          * index. If an index with that basename already exists, it will be
-         * replaced. Optionally, you can specify a suffix array sample rate.
+         * replaced. Optionally, you can specify a suffix array sample rate,
+         * and ask for the forward strands of the contigs to be saved as a
+         * PackedText, so the index can extract text without walking the BWT.
+         * You can also ask for a SampledISA at a given sample rate (or 0 for
+         * none), so the index can unlocate, for an LCPArray, so searches can
+         * be contracted instead of restarted, and for a UniqueContextTable, so
+         * the index can say how much context each position needs to be
+         * mapped to. Finally, you can ask for the full suffix array to be
+         * saved as a PackedSuffixArray, so the index can locate without
+         * walking the BWT even after it is reloaded.
          */
-        FMDIndexBuilder(const std::string& basename, int sampleRate = 64);
+        FMDIndexBuilder(const std::string& basename, int sampleRate = 64,
+            bool packText = false, size_t isaSampleRate = 0,
+            bool buildLCP = false, bool buildContexts = false,
+            bool saveSuffixArray = false);
+        
+        ~FMDIndexBuilder();
         
         /**
          * Add the contents of the given FASTA file to the index, both forwards
@@ -77,6 +92,33 @@ class FMDIndexBuilder {
          */
         int sampleRate;
         
+        /**
+         * Keep track of the sample rate to use for the sampled inverse suffix
+         * array, or 0 if we aren't making one.
+         */
+        size_t isaSampleRate;
+        
+        /**
+         * Keep track of whether we need to make an LCP array.
+         */
+        bool buildLCP;
+        
+        /**
+         * Keep track of whether we need to make a unique context table.
+         */
+        bool buildContexts;
+        
+        /**
+         * Keep track of whether we need to save the full suffix array.
+         */
+        bool saveSuffixArray;
+        
+        /**
+         * Keep around a writer to pack the contigs into, if we're packing
+         * them.
+         */
+        PackedText::Writer* packedWriter;
+        
         /**
          * How many threads should we use when building the index?
          */
@@ -11,7 +11,7 @@
 FMDIndexIterator::FMDIndexIterator(const FMDIndex& parent, size_t depth,
     bool beEnd, bool reportDeadEnds): 
     parent(parent), depth(depth), reportDeadEnds(reportDeadEnds), stack(),
-    pattern() {
+    extensions(), pattern() {
     
     // By default we start out with empty everything, which is what we should
     // have at the end.
@@ -25,7 +25,7 @@ FMDIndexIterator::FMDIndexIterator(const FMDIndex& parent, size_t depth,
 FMDIndexIterator::FMDIndexIterator(const FMDIndexIterator& toCopy): 
     parent(toCopy.parent), depth(toCopy.depth), 
     reportDeadEnds(toCopy.reportDeadEnds), stack(toCopy.stack),
-    pattern(toCopy.pattern) {
+    extensions(toCopy.extensions), pattern(toCopy.pattern) {
     
     // Already made a duplicate stack. Nothing to do.
 }
@@ -166,14 +166,11 @@ bool FMDIndexIterator::recurse(size_t baseNumber) {
         extension = parent.getCharPosition(ALPHABETICAL_BASES[baseNumber]);
     }
     else {
-        // Work out what we would select if we extended forwards with this
+        // Look up what we would select if we extended forwards with this
         // letter (i.e. appended it to the suffix).
-        extension = stack.back().first;
-        parent.extendFast(extension, ALPHABETICAL_BASES[baseNumber], false);
+        extension = extensions.back().get(ALPHABETICAL_BASES[baseNumber]);
     }
 
-
-
     if(extension.isEmpty()) {
         // This would be a suffix that doesn't appear.
         return false;
@@ -184,6 +181,12 @@ bool FMDIndexIterator::recurse(size_t baseNumber) {
     stack.push_back(std::make_pair(extension, baseNumber));
     // And record the change to the pattern.
     pattern.push_back(ALPHABETICAL_BASES[baseNumber]);
+    
+    if(stack.size() < depth) {
+        // We will be looking at the children of this place, so extend it by
+        // everything now.
+        extensions.push_back(parent.extendAll(extension, false));
+    }
 
     return true;
 }
@@ -217,17 +220,11 @@ bool FMDIndexIterator::tryRecurseToDepth(size_t baseNumber) {
                 // base), we have to stop so that we yield them. Those positions
                 // will be the first ones in our range if they exist.
                 
-                // TODO: replace with asking the BWT about the stop character
+                // Our extensions know how many things run into the stop
+                // character.
+                int64_t endOfTextLength = extensions.back().endOfTextLength;
 
-                // See what we would get if we extended. TODO: Can we show that
-                // this will always work? It seems to work when there are none
-                // of the first base, and should always work when there is some
-                // of the first base, but I'm not sure it won't break.
-                FMDPosition extension = stack.back().first;
-                parent.extendFast(extension, ALPHABETICAL_BASES[0], false);
-
-                if(extension.getForwardStart() != 
-                    stack.back().first.getForwardStart()) {
+                if(endOfTextLength > 0) {
                 
                     // There are some suffixes that come into this node and
                     // leave before the first real base. They must end the text.
@@ -235,7 +232,7 @@ bool FMDIndexIterator::tryRecurseToDepth(size_t baseNumber) {
                     INFO(
                         std::cout << "End of text: " << pattern << "$" << 
                             std::endl;
-                        std::cout << extension << " vs. " << 
+                        std::cout << endOfTextLength << " of " << 
                         stack.back().first << std::endl;
                     )
 
@@ -246,10 +243,9 @@ bool FMDIndexIterator::tryRecurseToDepth(size_t baseNumber) {
 
                     // Fix it up to indicate only the part we aren't covering.
                     // Forward start is going to be the same, but it is going to
-                    // run until the start of extension. Subtract 1 to keep this
-                    // as an offset where 0 = a 1-base interval.
-                    patternPosition.setEndOffset(extension.getForwardStart() - 
-                        patternPosition.getForwardStart() - 1);
+                    // run only over the things ending the text. Subtract 1 to
+                    // keep this as an offset where 0 = a 1-base interval.
+                    patternPosition.setEndOffset(endOfTextLength - 1);
 
                     // TODO: The reverse start can't be moved sanely and is thus
                     // going to be invalid (we can't search anchored to text
@@ -294,6 +290,11 @@ std::pair<FMDPosition, size_t> FMDIndexIterator::pop() {
     // Grab the stack frame to return
     std::pair<FMDPosition, size_t> toReturn(stack.back());
 
+    if(extensions.size() == stack.size()) {
+        // It had its extensions looked up, so drop them too.
+        extensions.pop_back();
+    }
+
     // Drop it from the stack.
     stack.pop_back();
 
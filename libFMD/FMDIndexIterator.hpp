@@ -5,6 +5,7 @@
 #include <deque>
 
 #include "FMDPosition.hpp"
+#include "FMDExtensions.hpp"
 
 // Forward declaration for circular dependency
 class FMDIndex;
@@ -97,6 +98,13 @@ private:
      */
     std::deque<std::pair<FMDPosition, size_t> > stack;
     
+    /**
+     * Holds the extensions with every base of each FMDPosition on the stack
+     * that isn't at the full depth, so each suffix tree node only needs to be
+     * looked up in the BWT once no matter how many of its children we visit.
+     */
+    std::deque<FMDExtensions> extensions;
+    
     /**
      * Holds the string corresponding to the current FMDPosition on top of the
      * stack.
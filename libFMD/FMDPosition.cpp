@@ -23,7 +23,7 @@ bool FMDPosition::operator==(const FMDPosition& other) const {
         end_offset == other.end_offset;
 }
 
-int64_t FMDPosition::range(BitVectorIterator& ranges, BitVectorIterator* mask)
+int64_t FMDPosition::range(const BitVector& ranges, const BitVector* mask)
     const {
 
     // What's the first index in the BWT that the range would need to cover?
@@ -100,7 +100,7 @@ int64_t FMDPosition::range(BitVectorIterator& ranges, BitVectorIterator* mask)
     }
 }
 
-int64_t FMDPosition::ranges(BitVectorIterator& ranges, BitVectorIterator* mask)
+int64_t FMDPosition::ranges(const BitVector& ranges, const BitVector* mask)
     const {
 
     if(end_offset < 0) {
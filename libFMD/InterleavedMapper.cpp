@@ -0,0 +1,1226 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "InterleavedMapper.hpp"
+#include "FMDIndex.hpp"
+#include "util.hpp"
+
+/**
+ * A query being left-mapped. For each base, extends the search we have to the
+ * right, or starts over by searching left from the base until it has a unique
+ * context, stopping and waiting whenever it needs an extension.
+ */
+template<typename Mask>
+class InterleavedMapper::LeftLane
+{
+public:
+    LeftLane(const FMDIndex& index, const MapQuery& query,
+        const BitVector* mask, int minContext, std::vector<Mapping>& mappings):
+        index(index), query(*query.text), mask(mask),
+        minContext(std::max(minContext, 0)), i(query.start),
+        end(query.start + query.length), restarting(false),
+        restartIndex(0), contracting(false), contractLength(0),
+        forwardStale(false), pending(false), pendingCharacter(0),
+        pendingBackward(false), mappings(mappings) {
+
+        // Make sure we re-start on the first base.
+        location.position = EMPTY_FMD_POSITION;
+        location.is_mapped = false;
+        location.characters = 0;
+
+        mappings.reserve(query.length);
+
+        // Go until we need our first extension.
+        settle();
+    }
+
+    inline bool isDone() const { return !pending; }
+    inline const FMDPosition& getPendingRange() const { return pendingRange; }
+    inline char getPendingCharacter() const { return pendingCharacter; }
+    inline bool isPendingBackward() const { return pendingBackward; }
+    /**
+     * Get how many bases we have finished.
+     */
+    inline size_t getProgress() const { return mappings.size(); }
+
+    /**
+     * Take the result of the extension we were waiting for, and go until we
+     * need another one.
+     */
+    void feed(const FMDPosition& result) {
+        pending = false;
+
+        if(contracting) {
+            // We extended a shorter left context right to base i.
+            if(mask.isEmpty(result)) {
+                // It still isn't short enough.
+                contract();
+            } else {
+                contracting = false;
+                finishContracting(result);
+            }
+        } else if(restarting) {
+            // We're searching left from base i for a unique context.
+            restartIndex--;
+
+            if(mask.isEmpty(result)) {
+                // Keep the last nonempty position.
+                restarting = false;
+                finishBase();
+            } else if(mask.getLength(result) == 1) {
+                // We found exactly one place.
+                location.position = result;
+                location.characters++;
+                location.is_mapped = true;
+                restarting = false;
+                finishBase();
+            } else {
+                // Still multi-mapped.
+                location.position = result;
+                location.characters++;
+                if(restartIndex == 0) {
+                    // But we ran out of string.
+                    restarting = false;
+                    finishBase();
+                }
+            }
+        } else {
+            // We extended right to base i.
+            location.position = result;
+            location.characters++;
+            finishBase();
+        }
+
+        settle();
+    }
+
+protected:
+    /**
+     * Go through bases until we need an extension or are done.
+     */
+    void settle() {
+        while(!pending && i < end) {
+            if(restarting) {
+                // Extend left with the next character.
+                pend(location.position, query[restartIndex - 1], true);
+            } else if(mask.isEmpty(location.position)) {
+                // Start over by mapping this character by itself.
+                forwardStale = false;
+                location.is_mapped = false;
+                location.position = index.getCharPosition(query[i]);
+                location.characters = 1;
+
+                if(mask.isEmpty(location.position)) {
+                    // This character isn't even in it.
+                    finishBase();
+                } else if(mask.getLength(location.position) == 1) {
+                    // We've already mapped.
+                    location.is_mapped = true;
+                    finishBase();
+                } else if(i == 0) {
+                    // There's no left context to search.
+                    finishBase();
+                } else {
+                    // Search left for enough context.
+                    restarting = true;
+                    restartIndex = i;
+                }
+            } else {
+                // Extend right with this base.
+                pend(location.position, query[i], false);
+            }
+        }
+    }
+
+    /**
+     * Say we need the given extension.
+     */
+    inline void pend(const FMDPosition& range, char character, bool backward) {
+        pendingRange = range;
+        pendingCharacter = character;
+        pendingBackward = backward;
+        pending = true;
+    }
+
+    /**
+     * Decide what to do with base i given where its search ended up.
+     */
+    void finishBase() {
+        if(location.is_mapped && location.characters >= minContext &&
+            mask.getLength(location.position) == 1) {
+
+            // It mapped.
+            mappings.push_back(Mapping(locateLast()));
+            i++;
+        } else if(location.is_mapped && mask.isEmpty(location.position)) {
+            // We extended right until we got no results. Try this base again,
+            // in case we had too much left context.
+            if(Mask::CONTRACTS && index.hasLCP()) {
+                // Try dropping just enough left context, instead of starting
+                // over from scratch.
+                startContracting();
+            }
+        } else {
+            // It didn't map, and restarting won't help.
+            mappings.push_back(Mapping());
+
+            // The next base will be an extension, if we have results.
+            location.is_mapped = true;
+            i++;
+        }
+    }
+
+    /**
+     * Locate the last base of the pattern our position is for, which must have
+     * exactly one occurrence.
+     */
+    TextPosition locateLast() {
+        if(forwardStale) {
+            // We only know where the reverse complement is, so locate that
+            // and flip it over to the other strand.
+            TextPosition reversed = index.locate(
+                mask.getFirstReverse(location.position));
+            return TextPosition(reversed.getText() ^ 1,
+                index.getContigLength(reversed.getText() / 2) -
+                reversed.getOffset() - 1);
+        }
+
+        // Take the first (only) thing in the bi-interval's forward strand
+        // side, accounting for the mask.
+        int64_t start = mask.getFirst(location.position);
+
+        // Locate it, and correct to the position of the last base in the
+        // pattern.
+        TextPosition textPosition = index.locate(start);
+        textPosition.setOffset(textPosition.getOffset() +
+            (location.characters - 1));
+        return textPosition;
+    }
+
+    /**
+     * Having failed to extend right to base i, get where a restart from base i
+     * would end up by dropping left context from the search we had, which is
+     * still waiting in pendingRange. Only used if the mask policy can count
+     * the reverse side.
+     */
+    void startContracting() {
+        // A restart does a single character without searching, so do the
+        // same.
+        FMDPosition single = index.getCharPosition(query[i]);
+        if(mask.getLength(single) < 2) {
+            // Make sure we restart.
+            location.position = EMPTY_FMD_POSITION;
+            return;
+        }
+
+        contracting = true;
+        contractRange = pendingRange;
+        contractLength = location.characters - 1;
+        contract();
+    }
+
+    /**
+     * Drop left context from contractRange until it is short enough to
+     * possibly be followed by base i, and ask to extend it with that base. If
+     * the LCP array can't help, restart instead.
+     */
+    void contract() {
+        contractRange = index.contract(contractRange, contractLength, true);
+
+        if(contractRange.isEmpty() || contractLength == 0) {
+            // Restarting from one character is as good as we can do.
+            contracting = false;
+            location.position = EMPTY_FMD_POSITION;
+            return;
+        }
+
+        pend(contractRange, query[i], false);
+    }
+
+    /**
+     * Finish base i from the longest left context it has, as a restart would
+     * have.
+     */
+    void finishContracting(const FMDPosition& result) {
+        // Only the reverse side of the result is meaningful now.
+        forwardStale = true;
+        location.position = result;
+        location.characters = contractLength + 1;
+
+        if(mask.getLength(result) > 1) {
+            // There's no unique context at all. A restart would have run out
+            // of string or results here.
+            location.is_mapped = false;
+            finishBase();
+            return;
+        }
+
+        // A restart would have stopped as soon as the context was unique,
+        // which is one past where the occurrence stops being unique. Under a
+        // mask, dropping context can add only unmasked occurrences, so we may
+        // have to go up more than one parent to find that.
+        size_t uniqueLength = location.characters;
+        while(true) {
+            FMDPosition parent = index.contract(location.position,
+                uniqueLength, true);
+            if(parent.isEmpty()) {
+                // We can't tell where that is, so restart after all.
+                location.position = EMPTY_FMD_POSITION;
+                return;
+            }
+            if(mask.getLength(parent) > 1) {
+                break;
+            }
+            // This shorter context is still unique, so the restart would have
+            // stopped here or sooner.
+            location.position = parent;
+        }
+
+        location.characters = uniqueLength + 1;
+        location.is_mapped = true;
+        finishBase();
+    }
+
+    const FMDIndex& index;
+    const std::string& query;
+    Mask mask;
+    // Kept unsigned, like the context lengths it is compared against.
+    size_t minContext;
+
+    // Which base are we mapping, and where do we stop?
+    size_t i;
+    size_t end;
+
+    // Where our search is
+    MapAttemptResult location;
+
+    // Are we searching left from base i, and if so, what's the leftmost base
+    // we have used?
+    bool restarting;
+    size_t restartIndex;
+
+    // Are we shortening our left context instead of restarting, and if so,
+    // what is the shorter context, and how long is it?
+    bool contracting;
+    FMDPosition contractRange;
+    size_t contractLength;
+
+    // Have we contracted since we last restarted, so only the reverse side of
+    // our position is meaningful?
+    bool forwardStale;
+
+    // What extension are we waiting for, if any?
+    bool pending;
+    FMDPosition pendingRange;
+    char pendingCharacter;
+    bool pendingBackward;
+
+    // Where do our results go?
+    std::vector<Mapping>& mappings;
+};
+
+/**
+ * A query being right-mapped to ranges. Going from the end of the region to
+ * the beginning, extends the search we have to the left, or starts over by
+ * searching right from the base as far as it can while in a single range,
+ * stopping and waiting whenever it needs an extension. Results come out in
+ * reverse order.
+ */
+template<typename Mask>
+class InterleavedMapper::RangeLane
+{
+public:
+    RangeLane(const FMDIndex& index, const BitVector& ranges,
+        const MapQuery& query, const BitVector* mask, int minContext,
+        std::vector<std::pair<int64_t, size_t> >& mappings):
+        index(index), query(*query.text), ranges(ranges), mask(mask),
+        minContext(std::max(minContext, 0)),
+        i((int64_t)(query.start + query.length) - 1), stop(query.start),
+        restarting(false), restartIndex(0), contracting(false),
+        contractLength(0), pending(false),
+        pendingCharacter(0), pendingBackward(false), mappings(mappings) {
+
+        // Make sure we re-start on the first base.
+        location.position = EMPTY_FMD_POSITION;
+        location.is_mapped = false;
+        location.characters = 0;
+
+        mappings.reserve(query.length);
+
+        // Go until we need our first extension.
+        settle();
+    }
+
+    inline bool isDone() const { return !pending; }
+    inline const FMDPosition& getPendingRange() const { return pendingRange; }
+    inline char getPendingCharacter() const { return pendingCharacter; }
+    inline bool isPendingBackward() const { return pendingBackward; }
+    /**
+     * Get how many bases we have finished.
+     */
+    inline size_t getProgress() const { return mappings.size(); }
+
+    /**
+     * Take the result of the extension we were waiting for, and go until we
+     * need another one.
+     */
+    void feed(const FMDPosition& result) {
+        pending = false;
+
+        if(contracting) {
+            // We extended a shorter right context left to base i.
+            if(mask.isEmpty(result)) {
+                // It still isn't short enough.
+                contract();
+            } else {
+                // A restart would have searched right this far and no further.
+                contracting = false;
+                location.position = result;
+                location.characters = contractLength + 1;
+                location.is_mapped = mask.range(result, ranges) != -1;
+                finishBase();
+            }
+        } else if(restarting) {
+            // We're searching right from base i.
+            if(mask.isEmpty(result)) {
+                // Keep the last nonempty position.
+                restarting = false;
+                finishBase();
+            } else {
+                location.position = result;
+                location.characters++;
+                if(mask.range(result, ranges) != -1) {
+                    // We're in exactly one range, but keep going as far as we
+                    // can.
+                    location.is_mapped = true;
+                    foundPosition = location.position;
+                }
+                restartIndex++;
+            }
+        } else {
+            // We extended left to base i.
+            location.position = result;
+            location.characters++;
+            finishBase();
+        }
+
+        settle();
+    }
+
+protected:
+    /**
+     * Go through bases until we need an extension or are done.
+     */
+    void settle() {
+        while(!pending && i >= stop) {
+            if(restarting) {
+                if(restartIndex >= query.size()) {
+                    // We ran out of string. Go back to the last position that
+                    // was in a range, if any.
+                    restarting = false;
+                    if(location.is_mapped) {
+                        location.position = foundPosition;
+                    }
+                    finishBase();
+                } else {
+                    // Extend right with the next character.
+                    pend(location.position, query[restartIndex], false);
+                }
+            } else if(location.position.isEmpty()) {
+                // Start over by mapping this character by itself.
+                location.is_mapped = false;
+                location.position = index.getCharPosition(query[i]);
+                location.characters = 1;
+
+                if(mask.isEmpty(location.position)) {
+                    // This character isn't even in it.
+                    finishBase();
+                } else if(mask.range(location.position, ranges) != -1) {
+                    // We've already mapped.
+                    location.is_mapped = true;
+                    finishBase();
+                } else {
+                    // Search right for enough context.
+                    restarting = true;
+                    restartIndex = i + 1;
+                }
+            } else {
+                // Extend left with this base.
+                pend(location.position, query[i], true);
+            }
+        }
+    }
+
+    /**
+     * Say we need the given extension.
+     */
+    inline void pend(const FMDPosition& range, char character, bool backward) {
+        pendingRange = range;
+        pendingCharacter = character;
+        pendingBackward = backward;
+        pending = true;
+    }
+
+    /**
+     * Decide what to do with base i given where its search ended up.
+     */
+    void finishBase() {
+        // What range does our position correspond to, if any?
+        int64_t range = mask.range(location.position, ranges);
+
+        if(location.is_mapped && location.characters >= minContext &&
+            !mask.isEmpty(location.position) && range != -1) {
+
+            // It mapped to this range.
+            mappings.push_back(std::make_pair(range,
+                location.characters - 1));
+            i--;
+        } else if(location.is_mapped && mask.isEmpty(location.position)) {
+            // We extended left until we got no results. Try this base again,
+            // in case we had too much right context.
+            if(index.hasLCP()) {
+                // Try dropping just enough right context, instead of starting
+                // over from scratch.
+                startContracting();
+            } else {
+                // Under a mask the position may still have unmasked results,
+                // and extending those again wouldn't be a search for anything
+                // in the query, so make sure we restart.
+                location.position = EMPTY_FMD_POSITION;
+            }
+        } else {
+            // It didn't map, and restarting won't help.
+            mappings.push_back(std::make_pair(-1, 0));
+
+            // The next base will be an extension, if we have results.
+            location.is_mapped = true;
+            i--;
+        }
+    }
+
+    /**
+     * Having failed to extend left to base i, get where a restart from base i
+     * would end up by dropping right context from the search we had, which is
+     * still waiting in pendingRange. The forward side is all we use, and it
+     * survives contraction, so the mask only needs to check the results.
+     */
+    void startContracting() {
+        // A restart stops at one character if that's in a range, and a
+        // contracted search wouldn't, so leave those to a restart.
+        FMDPosition single = index.getCharPosition(query[i]);
+        if(mask.isEmpty(single) || mask.range(single, ranges) != -1) {
+            // Make sure we restart.
+            location.position = EMPTY_FMD_POSITION;
+            return;
+        }
+
+        contracting = true;
+        contractRange = pendingRange;
+        contractLength = location.characters - 1;
+        contract();
+    }
+
+    /**
+     * Drop right context from contractRange until it is short enough to
+     * possibly be preceded by base i, and ask to extend it with that base. If
+     * the LCP array can't help, restart instead.
+     */
+    void contract() {
+        contractRange = index.contract(contractRange, contractLength, false);
+
+        if(contractRange.isEmpty() || contractLength == 0) {
+            // Restarting from one character is as good as we can do.
+            contracting = false;
+            location.position = EMPTY_FMD_POSITION;
+            return;
+        }
+
+        pend(contractRange, query[i], true);
+    }
+
+    const FMDIndex& index;
+    const std::string& query;
+    const BitVector& ranges;
+    Mask mask;
+    // Kept unsigned, like the context lengths it is compared against.
+    size_t minContext;
+
+    // Which base are we mapping, and where do we stop? We go right to left.
+    int64_t i;
+    int64_t stop;
+
+    // Where our search is
+    MapAttemptResult location;
+
+    // Are we searching right from base i, and if so, what's the next base to
+    // use? Also, where was the search when it was last in a range?
+    bool restarting;
+    size_t restartIndex;
+    FMDPosition foundPosition;
+
+    // Are we shortening our right context instead of restarting, and if so,
+    // what is the shorter context, and how long is it?
+    bool contracting;
+    FMDPosition contractRange;
+    size_t contractLength;
+
+    // What extension are we waiting for, if any?
+    bool pending;
+    FMDPosition pendingRange;
+    char pendingCharacter;
+    bool pendingBackward;
+
+    // Where do our results go?
+    std::vector<std::pair<int64_t, size_t> >& mappings;
+};
+
+/**
+ * Several lanes mapping the same query in different ways, such as to different
+ * levels of ranges or under different masks. Whenever several of them are
+ * waiting on the same extension, does it once and feeds it to all of them.
+ * They only search differently after their searches stop in different places,
+ * so one search serves them all until then. Takes ownership of the lanes.
+ */
+template<typename Lane>
+class InterleavedMapper::SharedLane
+{
+public:
+    SharedLane(const std::vector<Lane*>& lanes): lanes(lanes), next(NULL) {
+        choose();
+    }
+
+    ~SharedLane() {
+        for(Lane* lane : lanes) {
+            delete lane;
+        }
+    }
+
+    inline bool isDone() const { return next == NULL; }
+    inline const FMDPosition& getPendingRange() const {
+        return next->getPendingRange();
+    }
+    inline char getPendingCharacter() const {
+        return next->getPendingCharacter();
+    }
+    inline bool isPendingBackward() const {
+        return next->isPendingBackward();
+    }
+
+    /**
+     * Take the result of the extension we were waiting for, give it to every
+     * lane that wanted it, and pick the next extension to do.
+     */
+    void feed(const FMDPosition& result) {
+        // Copy what we asked for, since feeding the lane changes it.
+        FMDPosition range = next->getPendingRange();
+        char character = next->getPendingCharacter();
+        bool backward = next->isPendingBackward();
+
+        for(Lane* lane : lanes) {
+            if(!lane->isDone() && lane->isPendingBackward() == backward &&
+                lane->getPendingCharacter() == character &&
+                lane->getPendingRange() == range) {
+
+                // This lane was waiting for exactly this.
+                lane->feed(result);
+            }
+        }
+
+        choose();
+    }
+
+protected:
+    /**
+     * Pick the lane whose extension we do next, or NULL if all are done.
+     */
+    void choose() {
+        next = NULL;
+        for(Lane* lane : lanes) {
+            // Serve the lane that is furthest behind first, so lanes that got
+            // ahead wait for it and can share extensions again if they line
+            // back up.
+            if(!lane->isDone() && (next == NULL ||
+                lane->getProgress() < next->getProgress())) {
+
+                next = lane;
+            }
+        }
+    }
+
+    // The lanes we are running
+    std::vector<Lane*> lanes;
+    // The lane whose extension is pending
+    Lane* next;
+
+private:
+    // Can't copy, since we own the lanes.
+    SharedLane(const SharedLane& other);
+    SharedLane& operator=(const SharedLane& other);
+};
+
+/**
+ * A query being mapped to ranges with context on both sides. Going from the end
+ * of the region to the beginning, extends the search we have to the left by
+ * two bases, or starts over by searching out from the base in both directions
+ * at once, stopping and waiting whenever it needs an extension. Results come
+ * out in reverse order, with the context used and the most context found.
+ */
+template<typename Mask>
+class InterleavedMapper::CreditLane
+{
+public:
+    CreditLane(const FMDIndex& index, const BitVector& ranges,
+        const MapQuery& query, const BitVector* mask, int minContext,
+        std::vector<std::pair<int64_t, std::pair<size_t, size_t> > >& mappings):
+        index(index), query(*query.text), ranges(ranges), mask(mask),
+        minContext(std::max(minContext, 0)),
+        i((int64_t)(query.start + query.length) - 1), stop(query.start),
+        restarting(false), restartIndex(0), step(0),
+        secondHalf(false), pending(false), pendingCharacter(0),
+        pendingBackward(false), mappings(mappings) {
+
+        // Make sure we re-start on the first base.
+        location.position = EMPTY_FMD_POSITION;
+        location.is_mapped = false;
+        location.characters = 0;
+        location.maxCharacters = 0;
+
+        mappings.reserve(query.length);
+
+        // Go until we need our first extension.
+        settle();
+    }
+
+    inline bool isDone() const { return !pending; }
+    inline const FMDPosition& getPendingRange() const { return pendingRange; }
+    inline char getPendingCharacter() const { return pendingCharacter; }
+    inline bool isPendingBackward() const { return pendingBackward; }
+
+    /**
+     * Take the result of the extension we were waiting for, and go until we
+     * need another one.
+     */
+    void feed(const FMDPosition& result) {
+        pending = false;
+
+        if(!secondHalf) {
+            // Every step is two extensions, and this was the first. Do the
+            // second from its result, whatever it was.
+            secondHalf = true;
+            if(restarting) {
+                // We went right; now go left.
+                pend(result, query[restartIndex - step], true);
+            } else {
+                // We went left once; go left again.
+                pend(result, query[i - location.characters], true);
+            }
+            return;
+        }
+        secondHalf = false;
+
+        if(restarting) {
+            // We're searching out from base i in both directions.
+            if(mask.isEmpty(result)) {
+                // Keep the last nonempty position, and all the context we
+                // found for it.
+                location.characters = location.maxCharacters;
+                restarting = false;
+                finishBase();
+            } else {
+                bool inRange = mask.range(result, ranges) != -1;
+                location.position = result;
+                location.maxCharacters++;
+
+                if(!location.is_mapped && inRange) {
+                    // This is the first time we're in just one range, so this
+                    // is all the context we need.
+                    location.characters = location.maxCharacters;
+                    location.is_mapped = true;
+                    foundPosition = location.position;
+                } else if(!inRange) {
+                    // We still need more context.
+                    location.characters = location.maxCharacters;
+                }
+                step++;
+            }
+        } else {
+            // We extended left past base i.
+            location.position = result;
+            location.characters++;
+            if(location.characters > location.maxCharacters) {
+                location.maxCharacters++;
+            }
+            finishBase();
+        }
+
+        settle();
+    }
+
+protected:
+    /**
+     * Go through bases until we need an extension or are done.
+     */
+    void settle() {
+        while(!pending && i >= stop) {
+            if(restarting) {
+                if(restartIndex + step < query.size() &&
+                    restartIndex + 1 > step) {
+
+                    // Extend right with the next character on that side.
+                    pend(location.position, query[restartIndex + step], false);
+                } else {
+                    // We ran out of string on one side. Go back to where we
+                    // first got into a range, if we did.
+                    restarting = false;
+                    if(location.is_mapped) {
+                        location.position = foundPosition;
+                    }
+                    finishBase();
+                }
+            } else if(location.position.isEmpty() ||
+                (size_t)i < location.characters) {
+
+                // Start over by mapping this character by itself, unless
+                // there's too little string left to extend into.
+                location.is_mapped = false;
+                location.position = index.getCharPosition(query[i]);
+                location.characters = 1;
+                location.maxCharacters = 1;
+
+                if(mask.isEmpty(location.position)) {
+                    // This character isn't even in it.
+                    finishBase();
+                } else {
+                    if(mask.range(location.position, ranges) != -1) {
+                        // We've already mapped, but we want to know how much
+                        // context there is.
+                        location.is_mapped = true;
+                    }
+                    // Search out from here.
+                    foundPosition = FMDPosition();
+                    restarting = true;
+                    restartIndex = i;
+                    step = 1;
+                }
+            } else {
+                // Extend left, starting with the base on the left end of the
+                // context we used.
+                pend(location.position, query[i - location.characters + 1],
+                    true);
+            }
+        }
+    }
+
+    /**
+     * Say we need the given extension.
+     */
+    inline void pend(const FMDPosition& range, char character, bool backward) {
+        pendingRange = range;
+        pendingCharacter = character;
+        pendingBackward = backward;
+        pending = true;
+    }
+
+    /**
+     * Decide what to do with base i given where its search ended up.
+     */
+    void finishBase() {
+        // What range does our position correspond to, if any?
+        int64_t range = mask.range(location.position, ranges);
+
+        if(location.characters < minContext &&
+            location.maxCharacters >= minContext) {
+            // We have enough context if we count what we found.
+            location.characters = minContext;
+        }
+
+        if(location.is_mapped && location.characters >= minContext &&
+            !mask.isEmpty(location.position) && range != -1) {
+
+            // It mapped to this range.
+            mappings.push_back(std::make_pair(range, std::make_pair(
+                location.characters, location.maxCharacters)));
+            i--;
+        } else if(location.is_mapped && mask.isEmpty(location.position)) {
+            // We extended left until we got no results. Try this base again,
+            // in case we had too much context.
+        } else {
+            // It didn't map, and restarting won't help.
+            mappings.push_back(std::make_pair(-1, std::make_pair(0, 0)));
+
+            // The next base will be an extension, if we have results.
+            location.is_mapped = true;
+            i--;
+        }
+    }
+
+    const FMDIndex& index;
+    const std::string& query;
+    const BitVector& ranges;
+    Mask mask;
+    // Kept unsigned, like the context lengths it is compared against.
+    size_t minContext;
+
+    // Which base are we mapping, and where do we stop? We go right to left.
+    int64_t i;
+    int64_t stop;
+
+    // Where our search is
+    creditMapAttemptResult location;
+
+    // Are we searching out from a base, and if so, which base, and how far out
+    // is the next step? Also, where was the search when it first got into a
+    // range?
+    bool restarting;
+    size_t restartIndex;
+    size_t step;
+    FMDPosition foundPosition;
+
+    // Are we waiting on the second of the two extensions in a step?
+    bool secondHalf;
+
+    // What extension are we waiting for, if any?
+    bool pending;
+    FMDPosition pendingRange;
+    char pendingCharacter;
+    bool pendingBackward;
+
+    // Where do our results go?
+    std::vector<std::pair<int64_t, std::pair<size_t, size_t> > >& mappings;
+};
+
+InterleavedMapper::InterleavedMapper(const FMDIndex& index): index(index) {
+    // Nothing to do
+}
+
+std::vector<std::vector<Mapping> > InterleavedMapper::map(
+    const std::vector<MapQuery>& queries, const BitVector* mask,
+    int minContext) const {
+
+    std::vector<std::vector<Mapping> > mappings(queries.size());
+
+    // Which queries actually need searching?
+    std::vector<size_t> searched;
+    for(size_t j = 0; j < queries.size(); j++) {
+        if(!mapFromContexts(queries[j], mask, minContext, mappings[j])) {
+            searched.push_back(j);
+        }
+    }
+
+    // Pick the mask policy once, instead of checking on every step.
+    if(mask == NULL) {
+        run<LeftLane<Unmasked> >(searched.size(), [&](size_t j) {
+            return new LeftLane<Unmasked>(index, queries[searched[j]], mask,
+                minContext, mappings[searched[j]]);
+        });
+    } else if(isGenomeMask(mask)) {
+        run<LeftLane<GenomeMasked> >(searched.size(), [&](size_t j) {
+            return new LeftLane<GenomeMasked>(index, queries[searched[j]],
+                mask, minContext, mappings[searched[j]]);
+        });
+    } else {
+        run<LeftLane<Masked> >(searched.size(), [&](size_t j) {
+            return new LeftLane<Masked>(index, queries[searched[j]], mask,
+                minContext, mappings[searched[j]]);
+        });
+    }
+
+    return mappings;
+}
+
+bool InterleavedMapper::mapFromContexts(const MapQuery& query,
+    const BitVector* mask, int minContext,
+    std::vector<Mapping>& mappings) const {
+
+    if(!query.isIndexed || !index.hasUniqueContexts() || mask == NULL ||
+        mask != &index.getGenomeMask(index.getContigGenome(
+        query.indexText / 2))) {
+
+        // The table only knows about uniqueness in the text's own genome.
+        return false;
+    }
+
+    const std::string& text = *query.text;
+    for(size_t i = 0; i < query.start + query.length; i++) {
+        if(!isBase(text[i])) {
+            // Let a search deal with anything odd.
+            return false;
+        }
+    }
+
+    // Every search a LeftLane does here finds the query's own occurrence, so
+    // it never runs out of results: after the first base it only ever extends
+    // right. A context ending at base i is unique exactly when it is at least
+    // the table's length for that base, so we can follow along without
+    // searching.
+    size_t neededContext = std::max(minContext, 0);
+    std::vector<Mapping> results;
+    results.reserve(query.length);
+    // How long is the context the LeftLane would have for this base? 0 means
+    // it hasn't started yet.
+    size_t context = 0;
+    for(size_t i = query.start; i < query.start + query.length; i++) {
+        size_t unique = index.getUniqueContextLength(
+            TextPosition(query.indexText, i), true);
+
+        if(context != 0) {
+            // Extend right.
+            context++;
+        } else if(unique == 1 || i == 0) {
+            // Map the base by itself.
+            context = 1;
+        } else {
+            // Search left until the context is unique or we run out.
+            context = (unique == 0 || unique > i + 1) ? i + 1 : unique;
+        }
+
+        if(unique == UniqueContextTable::MAX_VALUE &&
+            context >= UniqueContextTable::MAX_VALUE) {
+            // The real length could be longer than we have, so only a search
+            // can tell.
+            return false;
+        }
+
+        if(unique != 0 && unique <= context && context >= neededContext) {
+            results.push_back(Mapping(TextPosition(query.indexText, i)));
+        } else {
+            results.push_back(Mapping());
+        }
+    }
+
+    mappings = std::move(results);
+    return true;
+}
+
+std::vector<std::vector<std::pair<int64_t, size_t> > > InterleavedMapper::map(
+    const BitVector& ranges, const std::vector<MapQuery>& queries,
+    const BitVector* mask, int minContext) const {
+
+    std::vector<std::vector<std::pair<int64_t, size_t> > > mappings(
+        queries.size());
+
+    if(mask == NULL) {
+        run<RangeLane<Unmasked> >(queries.size(), [&](size_t j) {
+            return new RangeLane<Unmasked>(index, ranges, queries[j], mask,
+                minContext, mappings[j]);
+        });
+    } else {
+        run<RangeLane<Masked> >(queries.size(), [&](size_t j) {
+            return new RangeLane<Masked>(index, ranges, queries[j], mask,
+                minContext, mappings[j]);
+        });
+    }
+
+    for(auto& queryMappings : mappings) {
+        // We mapped right to left, so put results in string order.
+        std::reverse(queryMappings.begin(), queryMappings.end());
+    }
+
+    return mappings;
+}
+
+std::vector<std::vector<std::pair<int64_t, std::pair<size_t, size_t> > > >
+    InterleavedMapper::creditMap(const BitVector& ranges,
+    const std::vector<MapQuery>& queries, const BitVector* mask,
+    int minContext) const {
+
+    std::vector<std::vector<std::pair<int64_t, std::pair<size_t, size_t> > > >
+        mappings(queries.size());
+
+    if(mask == NULL) {
+        run<CreditLane<Unmasked> >(queries.size(), [&](size_t j) {
+            return new CreditLane<Unmasked>(index, ranges, queries[j], mask,
+                minContext, mappings[j]);
+        });
+    } else {
+        run<CreditLane<Masked> >(queries.size(), [&](size_t j) {
+            return new CreditLane<Masked>(index, ranges, queries[j], mask,
+                minContext, mappings[j]);
+        });
+    }
+
+    for(auto& queryMappings : mappings) {
+        // We mapped right to left, so put results in string order.
+        std::reverse(queryMappings.begin(), queryMappings.end());
+    }
+
+    return mappings;
+}
+
+std::vector<std::vector<std::vector<Mapping> > > InterleavedMapper::mapMasks(
+    const std::vector<const BitVector*>& masks,
+    const std::vector<MapQuery>& queries, int minContext) const {
+
+    for(const BitVector* mask : masks) {
+        if(mask == NULL) {
+            throw std::runtime_error("Can't map to a NULL mask among others");
+        }
+    }
+
+    std::vector<std::vector<std::vector<Mapping> > > mappings(queries.size());
+    for(auto& queryMappings : mappings) {
+        // Make room for every mask's results up front, since lanes hold on to
+        // where they go.
+        queryMappings.resize(masks.size());
+    }
+
+    // Contract searches if we can do it under every mask.
+    bool genomeMasks = true;
+    for(const BitVector* mask : masks) {
+        genomeMasks = genomeMasks && isGenomeMask(mask);
+    }
+
+    if(genomeMasks) {
+        run<SharedLane<LeftLane<GenomeMasked> > >(queries.size(),
+            [&](size_t j) {
+
+            std::vector<LeftLane<GenomeMasked>*> lanes;
+            for(size_t k = 0; k < masks.size(); k++) {
+                lanes.push_back(new LeftLane<GenomeMasked>(index, queries[j],
+                    masks[k], minContext, mappings[j][k]));
+            }
+            return new SharedLane<LeftLane<GenomeMasked> >(lanes);
+        });
+    } else {
+        run<SharedLane<LeftLane<Masked> > >(queries.size(), [&](size_t j) {
+            std::vector<LeftLane<Masked>*> lanes;
+            for(size_t k = 0; k < masks.size(); k++) {
+                lanes.push_back(new LeftLane<Masked>(index, queries[j],
+                    masks[k], minContext, mappings[j][k]));
+            }
+            return new SharedLane<LeftLane<Masked> >(lanes);
+        });
+    }
+
+    return mappings;
+}
+
+std::vector<std::vector<std::vector<std::pair<int64_t, size_t> > > >
+    InterleavedMapper::mapLevels(const std::vector<const BitVector*>& levels,
+    const std::vector<MapQuery>& queries, const BitVector* mask,
+    int minContext) const {
+
+    std::vector<std::vector<std::vector<std::pair<int64_t, size_t> > > >
+        mappings(queries.size());
+
+    for(auto& queryMappings : mappings) {
+        // Make room for every level's results up front, since lanes hold on to
+        // where they go.
+        queryMappings.resize(levels.size());
+    }
+
+    if(mask == NULL) {
+        run<SharedLane<RangeLane<Unmasked> > >(queries.size(), [&](size_t j) {
+            std::vector<RangeLane<Unmasked>*> lanes;
+            for(size_t level = 0; level < levels.size(); level++) {
+                lanes.push_back(new RangeLane<Unmasked>(index, *levels[level],
+                    queries[j], mask, minContext, mappings[j][level]));
+            }
+            return new SharedLane<RangeLane<Unmasked> >(lanes);
+        });
+    } else {
+        run<SharedLane<RangeLane<Masked> > >(queries.size(), [&](size_t j) {
+            std::vector<RangeLane<Masked>*> lanes;
+            for(size_t level = 0; level < levels.size(); level++) {
+                lanes.push_back(new RangeLane<Masked>(index, *levels[level],
+                    queries[j], mask, minContext, mappings[j][level]));
+            }
+            return new SharedLane<RangeLane<Masked> >(lanes);
+        });
+    }
+
+    for(auto& queryMappings : mappings) {
+        for(auto& levelMappings : queryMappings) {
+            // We mapped right to left, so put results in string order.
+            std::reverse(levelMappings.begin(), levelMappings.end());
+        }
+    }
+
+    return mappings;
+}
+
+bool InterleavedMapper::isGenomeMask(const BitVector* mask) const {
+    for(size_t genome = 0; genome < index.getNumberOfGenomes(); genome++) {
+        if(mask == &index.getGenomeMask(genome)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename Lane, typename Factory>
+void InterleavedMapper::run(size_t count, Factory makeLane) const {
+
+    // Which lanes are in flight?
+    std::vector<Lane*> active;
+    active.reserve(WIDTH);
+    // Which lane do we start next?
+    size_t next = 0;
+
+    try {
+        while(true) {
+            while(active.size() < WIDTH && next < count) {
+                // Top up the window. Lanes that never need an extension finish
+                // immediately.
+                Lane* lane = makeLane(next);
+                next++;
+                if(lane->isDone()) {
+                    delete lane;
+                } else {
+                    active.push_back(lane);
+                }
+            }
+
+            if(active.empty()) {
+                // Everything is finished.
+                break;
+            }
+
+            for(Lane* lane : active) {
+                // Start loading the markers every lane needs.
+                index.prefetchExtendMarkers(lane->getPendingRange(),
+                    lane->isPendingBackward());
+            }
+
+            for(Lane* lane : active) {
+                // By now the first markers should be in, so start loading the
+                // runs they point to.
+                index.prefetchExtendRuns(lane->getPendingRange(),
+                    lane->isPendingBackward());
+            }
+
+            for(size_t j = 0; j < active.size();) {
+                // Do all the extensions, which should find their data ready.
+                Lane* lane = active[j];
+                FMDPosition range = lane->getPendingRange();
+                char character = lane->getPendingCharacter();
+
+                if(isBase(character)) {
+                    index.extendFast(range, character,
+                        lane->isPendingBackward());
+                } else {
+                    // Let the checked version complain about the character.
+                    range = index.extend(range, character,
+                        lane->isPendingBackward());
+                }
+
+                lane->feed(range);
+
+                if(lane->isDone()) {
+                    // Retire the lane and fill its slot.
+                    delete lane;
+                    active[j] = active.back();
+                    active.pop_back();
+                } else {
+                    j++;
+                }
+            }
+        }
+    } catch(...) {
+        // Don't leak the lanes in flight.
+        for(Lane* lane : active) {
+            delete lane;
+        }
+        throw;
+    }
+}
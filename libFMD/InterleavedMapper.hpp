@@ -0,0 +1,249 @@
+#ifndef INTERLEAVEDMAPPER_HPP
+#define INTERLEAVEDMAPPER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+#include "FMDPosition.hpp"
+#include "Mapping.hpp"
+#include "MapAttemptResult.hpp"
+#include "BitVector.hpp"
+
+// Forward declaration for circular dependency
+class FMDIndex;
+
+/**
+ * A region of a query string to map. The whole string is available as context,
+ * but only the bases in [start, start + length) get mapped.
+ *
+ * If the string is all of one of the index's own texts, set isIndexed and say
+ * which text in indexText, and mapping can use what the index knows about it.
+ */
+struct MapQuery
+{
+    const std::string* text;
+    size_t start;
+    size_t length;
+    bool isIndexed;
+    size_t indexText;
+};
+
+/**
+ * Mask policy for mapping that counts every position in the index. Lanes are
+ * compiled separately for each policy, so this one has no mask checks at all.
+ */
+class Unmasked
+{
+public:
+    // Every occurrence of a pattern counts, so occurrences of anything it
+    // contains count too, and left searches can be contracted instead of
+    // restarted.
+    static const bool CONTRACTS = true;
+
+    inline Unmasked(const BitVector*) {}
+    inline bool isEmpty(const FMDPosition& position) {
+        return position.getEndOffset() < 0;
+    }
+    inline int64_t getLength(const FMDPosition& position) {
+        return position.getEndOffset() + 1;
+    }
+    inline int64_t range(const FMDPosition& position,
+        const BitVector& ranges) {
+        return position.range(ranges);
+    }
+    inline int64_t getFirst(const FMDPosition& position) {
+        return position.getForwardStart();
+    }
+    inline int64_t getFirstReverse(const FMDPosition& position) {
+        return position.getReverseStart();
+    }
+};
+
+/**
+ * Mask policy for mapping that only counts positions with a 1 in a mask.
+ */
+class Masked
+{
+public:
+    // Left searches are contracted on the reverse side of the bi-interval,
+    // and the mask only counts the forward side, so they have to restart.
+    // Right searches contract on the forward side, so they still can.
+    static const bool CONTRACTS = false;
+
+    inline Masked(const BitVector* mask): mask(mask) {}
+    inline bool isEmpty(const FMDPosition& position) {
+        return position.isEmpty(mask);
+    }
+    inline int64_t getLength(const FMDPosition& position) {
+        return position.getLength(mask);
+    }
+    inline int64_t range(const FMDPosition& position,
+        const BitVector& ranges) {
+        return position.range(ranges, mask);
+    }
+    inline int64_t getFirst(const FMDPosition& position) {
+        return mask->valueAfter(position.getForwardStart()).first;
+    }
+    inline int64_t getFirstReverse(const FMDPosition& position) {
+        return mask->valueAfter(position.getReverseStart()).first;
+    }
+protected:
+    // Queries on the mask are const, so all the lanes can share it.
+    const BitVector* mask;
+};
+
+/**
+ * Mask policy for a mask that treats both strands of every text alike, as
+ * genome masks do. A pattern then has as many masked occurrences as its
+ * reverse complement, so it can be counted on the reverse side of its
+ * bi-interval. That is the side that survives contracting a left search, so
+ * left searches can be contracted. Only for left mapping.
+ */
+class GenomeMasked : public Masked
+{
+public:
+    static const bool CONTRACTS = true;
+
+    inline GenomeMasked(const BitVector* mask): Masked(mask) {}
+    inline bool isEmpty(const FMDPosition& position) {
+        return position.flip().isEmpty(mask);
+    }
+    inline int64_t getLength(const FMDPosition& position) {
+        return position.flip().getLength(mask);
+    }
+};
+
+/**
+ * Maps many independent queries against an FMDIndex at once. All the exact
+ * mapping functions of FMDIndex go through here, even for single queries.
+ *
+ * Each extension of a search is a chain of dependent, essentially random reads
+ * from the BWT, so a single search spends most of its time waiting on memory.
+ * Here, each query is a small state machine that stops whenever it needs an
+ * extension. A window of queries is advanced in lockstep: first the BWT markers
+ * every query is about to need are prefetched, then the run-length data those
+ * markers point to, and only then is every query extended and moved along to
+ * its next extension. By the time any one query is extended, the data it needs
+ * has had the whole window's worth of work to arrive.
+ *
+ * Results are exactly those of mapping each query alone.
+ */
+class InterleavedMapper
+{
+public:
+    /**
+     * How many queries should be in flight at once?
+     */
+    static const size_t WIDTH = 16;
+
+    /**
+     * Make a new InterleavedMapper to map against the given index.
+     */
+    InterleavedMapper(const FMDIndex& index);
+
+    /**
+     * LEFT-map each base in each query to a (text, position) pair, as
+     * FMDIndex::map does. Only positions with a 1 in the mask count, if a mask
+     * is given.
+     */
+    std::vector<std::vector<Mapping> > map(
+        const std::vector<MapQuery>& queries, const BitVector* mask,
+        int minContext) const;
+
+    /**
+     * RIGHT-map each base in each query to a range in the given range vector,
+     * as FMDIndex::map does. Only positions with a 1 in the mask count, if a
+     * mask is given.
+     */
+    std::vector<std::vector<std::pair<int64_t, size_t> > > map(
+        const BitVector& ranges, const std::vector<MapQuery>& queries,
+        const BitVector* mask, int minContext) const;
+
+    /**
+     * Map each base in each query to a range in the given range vector, using
+     * context on both sides, as FMDIndex::Cmap does. Each result holds the
+     * range (or -1), and the context length used and found. Only positions
+     * with a 1 in the mask count, if a mask is given.
+     */
+    std::vector<std::vector<std::pair<int64_t, std::pair<size_t, size_t> > > >
+        creditMap(const BitVector& ranges,
+        const std::vector<MapQuery>& queries, const BitVector* mask,
+        int minContext) const;
+
+    /**
+     * LEFT-map each base in each query under each of the given masks, as
+     * FMDIndex::map does for each mask alone. Results are by query, then by
+     * mask. Masks may not be NULL.
+     */
+    std::vector<std::vector<std::vector<Mapping> > > mapMasks(
+        const std::vector<const BitVector*>& masks,
+        const std::vector<MapQuery>& queries, int minContext) const;
+
+    /**
+     * RIGHT-map each base in each query to a range in each of the given range
+     * vectors, as FMDIndex::mapLevels does. Results are by query, then by
+     * level. Only positions with a 1 in the mask count, if a mask is given.
+     */
+    std::vector<std::vector<std::vector<std::pair<int64_t, size_t> > > >
+        mapLevels(const std::vector<const BitVector*>& levels,
+        const std::vector<MapQuery>& queries, const BitVector* mask,
+        int minContext) const;
+
+protected:
+    /**
+     * LEFT-map a query that is one of the index's own texts, under its own
+     * genome's mask, using only the index's unique context table. Returns
+     * false, with nothing in mappings, if the table can't answer for it.
+     */
+    bool mapFromContexts(const MapQuery& query, const BitVector* mask,
+        int minContext, std::vector<Mapping>& mappings) const;
+
+    /**
+     * Is the given mask one of the index's genome masks, which count both
+     * strands of each text alike?
+     */
+    bool isGenomeMask(const BitVector* mask) const;
+
+    /**
+     * Run the given number of lanes to completion, WIDTH at a time,
+     * interleaving their extensions. Lanes are made on demand by calling
+     * makeLane with the lane number, and deleted as they finish. Each lane
+     * must provide isDone(), getPendingRange(), getPendingCharacter(),
+     * isPendingBackward(), and feed(FMDPosition).
+     */
+    template<typename Lane, typename Factory>
+    void run(size_t count, Factory makeLane) const;
+
+    /**
+     * A query being left-mapped, with the given mask policy.
+     */
+    template<typename Mask>
+    class LeftLane;
+
+    /**
+     * A query being right-mapped to ranges, with the given mask policy.
+     */
+    template<typename Mask>
+    class RangeLane;
+
+    /**
+     * Several lanes of the given type mapping the same query, which share the
+     * extensions they have in common.
+     */
+    template<typename Lane>
+    class SharedLane;
+
+    /**
+     * A query being mapped to ranges with context on both sides, with the
+     * given mask policy.
+     */
+    template<typename Mask>
+    class CreditLane;
+
+    // The index we map against
+    const FMDIndex& index;
+};
+
+#endif
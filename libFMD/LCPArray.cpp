@@ -0,0 +1,177 @@
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "LCPArray.hpp"
+#include "Log.hpp"
+
+LCPArray::Writer::Writer(const std::string& filename): filename(filename),
+    stream(filename.c_str(), std::ios::binary), numberOfValues(0),
+    blockMinimums() {
+
+    if(!stream.good()) {
+        throw std::runtime_error("Could not open " + filename +
+            " to save LCP array");
+    }
+
+    // Leave room for the header, which we only know at the end.
+    uint64_t header[HEADER_WORDS] = {0, 0, 0};
+    stream.write((const char*)header, sizeof(header));
+}
+
+void LCPArray::Writer::addValue(size_t value) {
+    unsigned char clipped = value > MAX_VALUE ? MAX_VALUE : value;
+
+    if(numberOfValues % BLOCK_SIZE == 0) {
+        // This starts a new block.
+        blockMinimums.push_back(clipped);
+    } else {
+        blockMinimums.back() = std::min(blockMinimums.back(), clipped);
+    }
+
+    stream.put(clipped);
+    numberOfValues++;
+}
+
+void LCPArray::Writer::close() {
+    // Every interval needs something after it.
+    addValue(0);
+
+    // Pad out to a word so the block minimums are aligned.
+    size_t bytes = numberOfValues;
+    for(; bytes % sizeof(uint64_t) != 0; bytes++) {
+        stream.put(0);
+    }
+
+    uint64_t minimumOffset = HEADER_WORDS + bytes / sizeof(uint64_t);
+    stream.write((const char*)blockMinimums.data(), blockMinimums.size());
+
+    // Go back and fill in the header.
+    uint64_t header[HEADER_WORDS] = {MAGIC, numberOfValues, minimumOffset};
+    stream.seekp(0);
+    stream.write((const char*)header, sizeof(header));
+
+    stream.close();
+    if(!stream.good()) {
+        throw std::runtime_error("Could not save LCP array to " + filename);
+    }
+}
+
+LCPArray::LCPArray(const std::string& filename): numberOfValues(0),
+    values(NULL), blockMinimums(NULL), mapped(NULL), mappedBytes(0) {
+
+    // Open the file and see how big it is.
+    int file = open(filename.c_str(), O_RDONLY);
+    if(file == -1) {
+        throw std::runtime_error("Could not open LCP array " + filename);
+    }
+    struct stat fileStats;
+    if(fstat(file, &fileStats) == -1) {
+        close(file);
+        throw std::runtime_error("Could not stat LCP array " + filename);
+    }
+    mappedBytes = fileStats.st_size;
+
+    if(mappedBytes < HEADER_WORDS * sizeof(uint64_t)) {
+        close(file);
+        throw std::runtime_error("LCP array " + filename + " is truncated");
+    }
+
+    // Map the whole thing. The mapping keeps the file open for us.
+    mapped = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if(mapped == MAP_FAILED) {
+        mapped = NULL;
+        throw std::runtime_error("Could not map LCP array " + filename);
+    }
+
+    // Look at it as words.
+    const uint64_t* words = (const uint64_t*)mapped;
+
+    if(words[0] != MAGIC) {
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error(filename + " is not an LCP array");
+    }
+
+    // Read the rest of the header.
+    numberOfValues = words[1];
+    size_t minimumOffset = words[2];
+
+    if(numberOfValues == 0 || minimumOffset < HEADER_WORDS ||
+        numberOfValues > (minimumOffset - HEADER_WORDS) *
+        sizeof(uint64_t) || minimumOffset * sizeof(uint64_t) +
+        (numberOfValues + BLOCK_SIZE - 1) / BLOCK_SIZE > mappedBytes) {
+
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error("LCP array " + filename + " is truncated");
+    }
+
+    // Use everything right where it is.
+    values = (const unsigned char*)(words + HEADER_WORDS);
+    blockMinimums = (const unsigned char*)(words + minimumOffset);
+
+    Log::info() << "Mapped LCP array of " << numberOfValues << " values" <<
+        std::endl;
+}
+
+LCPArray::~LCPArray() {
+    // Unmap the file now that nothing is looking at it.
+    munmap(mapped, mappedBytes);
+}
+
+size_t LCPArray::getLength() const {
+    return numberOfValues;
+}
+
+size_t LCPArray::get(size_t index) const {
+    return values[index];
+}
+
+size_t LCPArray::findBefore(size_t index, size_t bound) const {
+    while(true) {
+        if(values[index] < bound) {
+            // Found it.
+            return index;
+        }
+
+        if(index % BLOCK_SIZE == 0) {
+            // Skip whole blocks that have nothing small enough.
+            size_t block = index / BLOCK_SIZE - 1;
+            while(blockMinimums[block] >= bound) {
+                block--;
+            }
+            // Then look through the last value in the block that does.
+            index = block * BLOCK_SIZE + BLOCK_SIZE - 1;
+        } else {
+            index--;
+        }
+    }
+}
+
+size_t LCPArray::findAfter(size_t index, size_t bound) const {
+    while(true) {
+        if(values[index] < bound) {
+            // Found it.
+            return index;
+        }
+
+        index++;
+
+        if(index % BLOCK_SIZE == 0) {
+            // Skip whole blocks that have nothing small enough.
+            size_t block = index / BLOCK_SIZE;
+            while(blockMinimums[block] >= bound) {
+                block++;
+            }
+            index = block * BLOCK_SIZE;
+        }
+    }
+}
+
+size_t LCPArray::reportSize() const {
+    return sizeof(*this) + mappedBytes;
+}
@@ -0,0 +1,136 @@
+#ifndef LCPARRAY_HPP
+#define LCPARRAY_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+
+/**
+ * The longest common prefix array of an FMDIndex: for each BWT index, how many
+ * characters the suffix there shares with the suffix at the index before it.
+ * This lets a search interval be widened to that of a shorter pattern.
+ *
+ * Values are clipped to a byte, so MAX_VALUE means "at least MAX_VALUE".
+ * Mapping contexts are almost always much shorter than that. The minimum value
+ * in every block of BLOCK_SIZE values is also kept, so long runs of high
+ * values can be skipped over.
+ *
+ * There is one more value than there are BWT indices: a 0 at the end, so every
+ * interval has a value after it.
+ *
+ * On disk, the file can be mapped into memory and used in place:
+ *
+ * magic: "SGLCPAR1"
+ * number of values, word offset of the block minimums
+ * the values, one per byte, padded to a word
+ * the block minimums, one per byte
+ */
+class LCPArray {
+
+public:
+    /**
+     * Magic number at the start of every LCP array file.
+     */
+    static const uint64_t MAGIC = 0x315241504c434753ULL; // "SGLCPAR1"
+
+    /**
+     * Values are clipped to this.
+     */
+    static const size_t MAX_VALUE = 255;
+
+    /**
+     * How many values share a block minimum?
+     */
+    static const size_t BLOCK_SIZE = 256;
+
+    /**
+     * Writes an LCP array file one value at a time.
+     */
+    class Writer {
+    public:
+        /**
+         * Start writing an LCP array to the given file.
+         */
+        Writer(const std::string& filename);
+
+        /**
+         * Add the LCP value for the next BWT index. Values over MAX_VALUE are
+         * clipped.
+         */
+        void addValue(size_t value);
+
+        /**
+         * Finish the file, adding the 0 at the end. Must be called before the
+         * file can be loaded. After this is called, no other method on the
+         * same object may be called.
+         */
+        void close();
+
+    protected:
+        // The file we're writing
+        std::string filename;
+        std::ofstream stream;
+        // How many values have we written?
+        uint64_t numberOfValues;
+        // The minimum of each block so far, including the one we're in
+        std::vector<unsigned char> blockMinimums;
+    };
+
+    /**
+     * Load an LCPArray saved by a Writer from the given file, by mapping it
+     * into memory.
+     */
+    LCPArray(const std::string& filename);
+
+    ~LCPArray();
+
+    /**
+     * Get the number of values, including the 0 at the end.
+     */
+    size_t getLength() const;
+
+    /**
+     * Get the (clipped) LCP value at the given index.
+     */
+    size_t get(size_t index) const;
+
+    /**
+     * Find the last index at or before the given one with a value less than
+     * bound. There always is one if bound is not 0, since the first value is 0.
+     */
+    size_t findBefore(size_t index, size_t bound) const;
+
+    /**
+     * Find the first index at or after the given one with a value less than
+     * bound. There always is one if bound is not 0, since the last value is 0.
+     */
+    size_t findAfter(size_t index, size_t bound) const;
+
+    /**
+     * Get the number of bytes mapped.
+     */
+    size_t reportSize() const;
+
+protected:
+    // How many words of header come before the values?
+    static const size_t HEADER_WORDS = 3;
+
+    // How many values are there?
+    size_t numberOfValues;
+    // The values
+    const unsigned char* values;
+    // The minimum in each block of values
+    const unsigned char* blockMinimums;
+
+    // The file we have mapped, and how long it is in bytes.
+    void* mapped;
+    size_t mappedBytes;
+
+private:
+    // Can't copy, since we own the mapping.
+    LCPArray(const LCPArray& other);
+    LCPArray& operator=(const LCPArray& other);
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "LevelIndex.hpp"
+#include "Log.hpp"
+
+LevelIndex::LevelIndex(BitVector* ranges, size_t numberOfRanges,
+    size_t idBase, size_t idCount): ranges(ranges),
+    numberOfRanges(numberOfRanges), idBase(idBase), sideBits(0),
+    sideData(NULL), sideWords(NULL), sides(NULL), mapped(NULL),
+    mappedBytes(0) {
+
+    // We need enough bits to number all the positions from 0, plus one for the
+    // face.
+    sideBits = (idCount > 0 ? CSA::length(idCount - 1) : 0) + 1;
+
+    // Allocate the packed Sides, all 0, since writing ORs bits in.
+    size_t words = (numberOfRanges * sideBits + CSA::WORD_BITS - 1) /
+        CSA::WORD_BITS;
+    sideData = new size_t[words]();
+    sideWords = sideData;
+
+    // Make a buffer to read them back out.
+    sides = new CSA::ReadBuffer(sideWords, numberOfRanges, sideBits);
+}
+
+LevelIndex::LevelIndex(std::string filename): ranges(NULL),
+    numberOfRanges(0), idBase(0), sideBits(0), sideData(NULL),
+    sideWords(NULL), sides(NULL), mapped(NULL), mappedBytes(0) {
+
+    // Open the file and see how big it is.
+    int file = open(filename.c_str(), O_RDONLY);
+    if(file == -1) {
+        throw std::runtime_error("Could not open level index " + filename);
+    }
+    struct stat fileStats;
+    if(fstat(file, &fileStats) == -1) {
+        close(file);
+        throw std::runtime_error("Could not stat level index " + filename);
+    }
+    mappedBytes = fileStats.st_size;
+
+    if(mappedBytes < (HEADER_WORDS + 4) * sizeof(size_t)) {
+        close(file);
+        throw std::runtime_error("Level index " + filename + " is truncated");
+    }
+
+    // Map the whole thing. The mapping keeps the file open for us.
+    mapped = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if(mapped == MAP_FAILED) {
+        mapped = NULL;
+        throw std::runtime_error("Could not map level index " + filename);
+    }
+
+    // Look at it as words.
+    const size_t* words = (const size_t*)mapped;
+
+    if(words[0] != MAGIC) {
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error(filename + " is not a level index");
+    }
+
+    // Read the rest of the header.
+    numberOfRanges = words[1];
+    idBase = words[2];
+    sideBits = words[3];
+    size_t sideOffset = words[4];
+
+    if(sideOffset < HEADER_WORDS ||
+        (sideOffset * CSA::WORD_BITS + numberOfRanges * sideBits + 7) / 8 >
+        mappedBytes) {
+
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error("Level index " + filename + " is truncated");
+    }
+
+    // Use the range vector and the Sides right where they are. The range
+    // vector has to fit before the Sides.
+    try {
+        ranges = new BitVector(words + HEADER_WORDS,
+            sideOffset - HEADER_WORDS);
+    } catch(std::runtime_error&) {
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error("Level index " + filename + " is truncated");
+    }
+    sideWords = words + sideOffset;
+    sides = new CSA::ReadBuffer(sideWords, numberOfRanges,
+        sideBits);
+
+    Log::info() << "Mapped level index with " << numberOfRanges <<
+        " ranges at " << sideBits << " bits each" << std::endl;
+}
+
+LevelIndex::~LevelIndex() {
+    // The buffer and vector don't own any mapped data.
+    delete sides;
+    delete ranges;
+    delete[] sideData;
+
+    if(mapped != NULL) {
+        // Unmap the file now that nothing is looking at it.
+        munmap(mapped, mappedBytes);
+    }
+}
+
+void LevelIndex::setSide(size_t range, size_t coordinate, bool face) {
+    if(sideData == NULL) {
+        throw std::runtime_error("Can't set Sides in a loaded level index");
+    }
+    if(range >= numberOfRanges) {
+        throw std::runtime_error("Range " + std::to_string(range) +
+            " out of bounds");
+    }
+
+    // Make a temporary WriteBuffer on our data and OR in the packed Side.
+    CSA::WriteBuffer writer(sideData, numberOfRanges, sideBits);
+    writer.goToItem(range);
+    writer.writeItem(((coordinate - idBase) << 1) | face);
+}
+
+void LevelIndex::save(std::string filename) const {
+    std::ofstream stream(filename.c_str(), std::ios::binary);
+    if(!stream.good()) {
+        throw std::runtime_error("Could not open " + filename +
+            " to save level index");
+    }
+
+    // Write the header, with a placeholder for the Side offset, which we only
+    // know once we've written the range vector.
+    size_t header[HEADER_WORDS] = {MAGIC, numberOfRanges, idBase, sideBits, 0};
+    stream.write((const char*)header, sizeof(header));
+
+    ranges->writeTo(stream);
+
+    // Everything is whole words, so this is the word offset of the Sides.
+    header[4] = stream.tellp() / sizeof(size_t);
+
+    // Dump all the packed Sides at once.
+    size_t words = (numberOfRanges * sideBits + CSA::WORD_BITS - 1) /
+        CSA::WORD_BITS;
+    stream.write((const char*)sideWords, words * sizeof(size_t));
+
+    // Go back and fill in the offset.
+    stream.seekp(4 * sizeof(size_t));
+    stream.write((const char*)&header[4], sizeof(size_t));
+
+    stream.close();
+    if(!stream.good()) {
+        throw std::runtime_error("Could not save level index to " + filename);
+    }
+}
+
+const BitVector& LevelIndex::getRanges() const {
+    return *ranges;
+}
+
+size_t LevelIndex::getNumberOfRanges() const {
+    return numberOfRanges;
+}
+
+SmallSide LevelIndex::getSide(size_t range) const {
+    // Unpack the Side and put the base ID back on.
+    size_t packed = sides->readItemConst(range);
+    return SmallSide((packed >> 1) + idBase, packed & 1);
+}
+
+size_t LevelIndex::getCoordinate(size_t range) const {
+    return getSide(range).getCoordinate();
+}
+
+bool LevelIndex::getFace(size_t range) const {
+    return getSide(range).getFace();
+}
+
+size_t LevelIndex::reportSize() const {
+    return sizeof(*this) + ranges->reportSize() + sides->reportSize();
+}
+
+MemoryReport LevelIndex::reportMemory() const {
+    MemoryReport report;
+    report.add("ranges", ranges->reportSize());
+    report.add("sides", sizeof(*this) + sides->reportSize());
+    return report;
+}
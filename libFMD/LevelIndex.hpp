@@ -0,0 +1,131 @@
+#ifndef LEVELINDEX_HPP
+#define LEVELINDEX_HPP
+
+#include <string>
+#include <stdint.h>
+
+#include "BitVector.hpp"
+#include "SmallSide.hpp"
+#include "MemoryReport.hpp"
+
+/**
+ * The index for a merged level of a reference hierarchy: a BitVector of ranges
+ * in the BWT of an FMDIndex, and the Side that each range maps to.
+ *
+ * Sides are stored bit-packed, each taking only as many bits as it takes to
+ * number the positions in the level, plus one for the face. Positions are
+ * numbered consecutively from some base ID.
+ *
+ * On disk, everything is 64-bit words, laid out so the file can be mapped into
+ * memory and used in place:
+ *
+ * magic: "SGLEVEL1"
+ * number of ranges, base ID, bits per Side, word offset of the Sides
+ * the range BitVector, as written by BitVector::writeTo
+ * the packed Sides, one per range, high bits first
+ *
+ * Each packed Side is the position's offset from the base ID, shifted left by
+ * 1 and or-ed with the face.
+ */
+class LevelIndex {
+
+public:
+    /**
+     * Magic number at the start of every level index file.
+     */
+    static const uint64_t MAGIC = 0x314c4556454c4753ULL; // "SGLEVEL1"
+
+    /**
+     * Make a new LevelIndex to be filled in with setSide, for the given ranges,
+     * which the LevelIndex takes ownership of. There are numberOfRanges ranges,
+     * which map to positions numbered from idBase up to (but not including)
+     * idBase + idCount.
+     */
+    LevelIndex(BitVector* ranges, size_t numberOfRanges, size_t idBase,
+        size_t idCount);
+
+    /**
+     * Load a LevelIndex saved with save() from the given file, by mapping it
+     * into memory.
+     */
+    LevelIndex(std::string filename);
+
+    ~LevelIndex();
+
+    /**
+     * Say that the given range maps to the given position and face. Each range
+     * may only be set once. Not safe to call from multiple threads.
+     */
+    void setSide(size_t range, size_t coordinate, bool face);
+
+    /**
+     * Save the LevelIndex to the given file.
+     */
+    void save(std::string filename) const;
+
+    /**
+     * Get the BitVector of ranges, for mapping against an FMDIndex.
+     */
+    const BitVector& getRanges() const;
+
+    /**
+     * Get the number of ranges that Sides are stored for.
+     */
+    size_t getNumberOfRanges() const;
+
+    /**
+     * Get the Side that the given range maps to.
+     */
+    SmallSide getSide(size_t range) const;
+
+    /**
+     * Get the position that the given range maps to.
+     */
+    size_t getCoordinate(size_t range) const;
+
+    /**
+     * Get the face (0 for left, 1 for right) that the given range maps to.
+     */
+    bool getFace(size_t range) const;
+
+    /**
+     * Get the number of bytes used by the LevelIndex, in memory or mapped.
+     */
+    size_t reportSize() const;
+
+    /**
+     * Get a breakdown of the bytes used by the range vector and the Sides.
+     */
+    MemoryReport reportMemory() const;
+
+protected:
+    // How many words of header come before the range vector?
+    static const size_t HEADER_WORDS = 5;
+
+    // The vector of ranges
+    BitVector* ranges;
+    // How many ranges are there?
+    size_t numberOfRanges;
+    // What ID is position 0?
+    size_t idBase;
+    // How many bits does each Side take?
+    size_t sideBits;
+
+    // The packed Sides, if we own them because we're building
+    size_t* sideData;
+    // The packed Sides, wherever they live
+    const size_t* sideWords;
+    // A buffer to read Sides from sideData
+    CSA::ReadBuffer* sides;
+
+    // The file we have mapped, if any, and how long it is in bytes.
+    void* mapped;
+    size_t mappedBytes;
+
+private:
+    // Can't copy, since we own things.
+    LevelIndex(const LevelIndex& other);
+    LevelIndex& operator=(const LevelIndex& other);
+};
+
+#endif
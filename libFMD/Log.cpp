@@ -1,12 +1,425 @@
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <cstdlib>
+
 #include "Log.hpp"
 
 // Set the time format.
 const std::string Log::TIME_FORMAT = "[%m-%d-%Y %H:%M:%S] ";
 
 // Have static initializations of all the streams.
-CRITICAL_STREAM Log::criticalStream;
-ERROR_STREAM Log::errorStream;
-OUTPUT_STREAM Log::outputStream;
-INFO_STREAM Log::infoStream;
-DEBUG_STREAM Log::debugStream;
-TRACE_STREAM Log::traceStream;
+LogStream Log::criticalStream(Log::CRITICAL);
+LogStream Log::errorStream(Log::ERROR);
+LogStream Log::outputStream(Log::OUTPUT);
+LogStream Log::infoStream(Log::INFO);
+LogStream Log::debugStream(Log::DEBUG);
+LogStream Log::traceStream(Log::TRACE);
+
+// Log INFO and up unless told otherwise.
+std::atomic<int> Log::level(Log::INFO);
+
+/**
+ * A buffer of finished lines from one thread, waiting to be written. Only the
+ * owning thread adds to it and only the writer thread takes from it, so
+ * neither needs a lock.
+ */
+struct LogRing {
+    // How many bytes of lines can be waiting? Longer lines are written
+    // directly.
+    static const size_t CAPACITY = 1 << 14;
+
+    // The bytes, used circularly
+    char bytes[CAPACITY];
+    // How many bytes have ever been added, and ever been written? They only
+    // go up, so their difference is what's waiting.
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    // Set when the owning thread exits, so the writer can free this once it's
+    // empty.
+    std::atomic<bool> abandoned;
+
+    LogRing(): head(0), tail(0), abandoned(false) {}
+};
+
+/**
+ * Owns all the LogRings, and the thread that empties them to standard output.
+ * Never destroyed, so threads can still log while the program exits.
+ */
+class LogWriter {
+public:
+    LogWriter(): running(false), stopped(false), passes(0) {}
+
+    /**
+     * Add a new ring for a thread, starting the writer thread if needed.
+     */
+    LogRing* addRing() {
+        LogRing* ring = new LogRing();
+
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(ring);
+
+        if(!running && !stopped) {
+            // Start writing in the background, and stop before the program
+            // exits so nothing is lost.
+            running = true;
+            thread = std::thread(&LogWriter::run, this);
+            std::atexit(&LogWriter::stopAtExit);
+        }
+
+        return ring;
+    }
+
+    /**
+     * Add a finished line to the given ring, or write it directly if there's
+     * no background writer or it's too big. Returns how far the ring's tail
+     * must get for the line to be written.
+     */
+    size_t add(LogRing& ring, const std::string& line) {
+        if(!running || line.size() > LogRing::CAPACITY) {
+            // Wait for our earlier lines to go out first, and then write it
+            // ourselves.
+            while(running && ring.tail.load(std::memory_order_acquire) !=
+                ring.head.load(std::memory_order_relaxed)) {
+
+                wake.notify_one();
+                std::this_thread::yield();
+            }
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout.write(line.data(), line.size());
+            std::cout.flush();
+            return 0;
+        }
+
+        size_t head = ring.head.load(std::memory_order_relaxed);
+        while(head + line.size() - ring.tail.load(std::memory_order_acquire) >
+            LogRing::CAPACITY) {
+
+            if(!running) {
+                // The writer stopped, so nobody will make room. Write out
+                // what we have waiting, and then this line.
+                drain();
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout.write(line.data(), line.size());
+                std::cout.flush();
+                return 0;
+            }
+            
+            // Wait for the writer to make room.
+            wake.notify_one();
+            std::this_thread::yield();
+        }
+
+        // Copy it in, wrapping around the end if needed.
+        size_t start = head % LogRing::CAPACITY;
+        size_t firstPart = std::min(line.size(), LogRing::CAPACITY - start);
+        memcpy(ring.bytes + start, line.data(), firstPart);
+        memcpy(ring.bytes, line.data() + firstPart, line.size() - firstPart);
+
+        // Only now can the writer see it. This and the check of running
+        // below are sequentially consistent, so if stop() drains before it
+        // can see the line, we see that the writer has stopped.
+        ring.head.store(head + line.size());
+
+        if(!running) {
+            // The writer may have stopped before it saw the line, so write it
+            // ourselves.
+            drain();
+        } else if(head + line.size() - ring.tail.load(
+            std::memory_order_relaxed) > LogRing::CAPACITY / 2) {
+
+            // Getting full, so don't wait for the writer to look.
+            wake.notify_one();
+        }
+
+        return head + line.size();
+    }
+
+    /**
+     * Wait until the given ring's tail has reached the given position, as
+     * returned by add(). Lines other threads add meanwhile don't hold us up.
+     */
+    void waitFor(LogRing& ring, size_t position) {
+        while(running && ring.tail.load(std::memory_order_acquire) <
+            position) {
+
+            wake.notify_one();
+            std::this_thread::yield();
+        }
+
+        // Catch anything written directly too.
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout.flush();
+    }
+
+    /**
+     * Wait until everything added to any ring so far has been written.
+     */
+    void flush() {
+        // Any drain that starts after the one in progress now (if any) writes
+        // everything added before we were called. Other threads adding more
+        // meanwhile can't keep us waiting.
+        size_t target = passes.load() + 2;
+        while(running && passes.load() < target) {
+            wake.notify_one();
+            std::this_thread::yield();
+        }
+
+        // Catch anything written directly too.
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout.flush();
+    }
+
+    /**
+     * Stop the background writer, writing everything left.
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            if(!running) {
+                return;
+            }
+            running = false;
+            stopped = true;
+        }
+        wake.notify_one();
+        thread.join();
+
+        // Anything that came in while the writer was stopping is still here.
+        drain();
+    }
+
+    /**
+     * Get the one LogWriter.
+     */
+    static LogWriter& get() {
+        static LogWriter* writer = new LogWriter();
+        return *writer;
+    }
+
+protected:
+    // How long should the writer wait for something to happen?
+    static const int IDLE_MILLISECONDS = 5;
+
+    // The rings for all the threads that have logged, and a lock for the list
+    std::vector<LogRing*> rings;
+    std::mutex ringsMutex;
+
+    // Held while writing to standard output
+    std::mutex outputMutex;
+
+    // The writer thread, and whether it is running or has been stopped for
+    // good
+    std::thread thread;
+    std::atomic<bool> running;
+    bool stopped;
+
+    // How many times have the rings been drained?
+    std::atomic<size_t> passes;
+
+    // Used to wake the writer up early. Nobody holds the mutex while
+    // notifying, so it's just for waiting on.
+    std::condition_variable wake;
+    std::mutex wakeMutex;
+
+    /**
+     * Write out everything waiting in all the rings, and free the rings of
+     * threads that are gone. Returns true if anything was written.
+     */
+    bool drain() {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+
+        bool wroteAnything = false;
+        // Where each ring's data ended when we looked
+        std::vector<size_t> heads(rings.size());
+
+        {
+            std::lock_guard<std::mutex> outputLock(outputMutex);
+            for(size_t i = 0; i < rings.size(); i++) {
+                LogRing& ring = *rings[i];
+                size_t tail = ring.tail.load(std::memory_order_relaxed);
+                heads[i] = ring.head.load();
+
+                if(heads[i] != tail) {
+                    // Write what's there, in up to two pieces.
+                    size_t start = tail % LogRing::CAPACITY;
+                    size_t length = heads[i] - tail;
+                    size_t firstPart = std::min(length,
+                        LogRing::CAPACITY - start);
+                    std::cout.write(ring.bytes + start, firstPart);
+                    std::cout.write(ring.bytes, length - firstPart);
+                    wroteAnything = true;
+                }
+            }
+
+            if(wroteAnything) {
+                std::cout.flush();
+            }
+        }
+
+        // Only give back the space once it's really out.
+        size_t kept = 0;
+        for(size_t i = 0; i < rings.size(); i++) {
+            rings[i]->tail.store(heads[i], std::memory_order_release);
+
+            if(rings[i]->abandoned.load(std::memory_order_acquire) &&
+                rings[i]->head.load(std::memory_order_acquire) == heads[i]) {
+
+                // Its thread is gone and everything it said is written.
+                delete rings[i];
+            } else {
+                rings[kept] = rings[i];
+                kept++;
+            }
+        }
+        rings.resize(kept);
+        passes++;
+
+        return wroteAnything;
+    }
+
+    /**
+     * Keep draining until stopped.
+     */
+    void run() {
+        while(running) {
+            if(!drain()) {
+                // Nothing to do, so wait a bit or until woken.
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait_for(lock,
+                    std::chrono::milliseconds((int)IDLE_MILLISECONDS));
+            }
+        }
+    }
+
+    /**
+     * Stop the writer when the program exits.
+     */
+    static void stopAtExit() {
+        get().stop();
+    }
+};
+
+/**
+ * Everything one thread keeps for logging.
+ */
+struct LogThreadState {
+    // The line being built
+    std::ostringstream line;
+    // Where finished lines go, once we have logged anything
+    LogRing* ring;
+    // The last second we formatted a time for, and what we got
+    time_t lastTime;
+    std::string lastTimestamp;
+
+    LogThreadState(): line(), ring(NULL), lastTime(-1), lastTimestamp() {}
+
+    ~LogThreadState() {
+        if(ring != NULL) {
+            // Let the writer free the ring when it's done with it.
+            ring->abandoned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+/**
+ * Get the calling thread's logging state.
+ */
+static LogThreadState& getThreadState() {
+    static thread_local LogThreadState state;
+    return state;
+}
+
+LogStream::LogStream(int level): level(level) {
+    // Nothing to do
+}
+
+std::ostream& LogStream::getLine() {
+    return getThreadState().line;
+}
+
+void LogStream::finishLine() {
+    std::ostringstream& line = getThreadState().line;
+    line << '\n';
+
+    // Don't come back until CRITICAL and ERROR lines are actually out, since
+    // we may be about to crash.
+    Log::writeLine(line.str(), level <= Log::ERROR);
+
+    // Start the next line empty.
+    line.str(std::string());
+    line.clear();
+}
+
+void Log::setLevel(Level newLevel) {
+    level.store(newLevel, std::memory_order_relaxed);
+}
+
+Log::Level Log::parseLevel(const std::string& name) {
+    // These go in Level order.
+    const char* names[] = {"critical", "error", "output", "info", "debug",
+        "trace"};
+
+    for(int i = CRITICAL; i <= TRACE; i++) {
+        if(name == names[i]) {
+            return (Level)i;
+        }
+    }
+
+    throw std::runtime_error("Unknown log level: " + name);
+}
+
+void Log::flush() {
+    LogWriter::get().flush();
+}
+
+void Log::writeTimestamp(const char* label) {
+    LogThreadState& state = getThreadState();
+
+    // Get the current time. See <http://stackoverflow.com/a/16358264>
+    time_t globalTime;
+    time(&globalTime);
+
+    if(globalTime != state.lastTime) {
+        // Format the local time for this new second.
+        struct tm localTime;
+        localtime_r(&globalTime, &localTime);
+
+        // This holds the formatted time
+        char buffer[TIME_CHARS];
+        if(strftime(buffer, TIME_CHARS, TIME_FORMAT.c_str(), &localTime)) {
+            // It is null-terminated.
+            state.lastTimestamp = buffer;
+        } else {
+            // Complain (in the log) that we can't format the time. Maybe it's
+            // now the year 70 billion.
+            state.lastTimestamp = "(Time too long) ";
+        }
+        state.lastTime = globalTime;
+    }
+
+    state.line << state.lastTimestamp << label;
+}
+
+void Log::writeLine(const std::string& line, bool wait) {
+    LogThreadState& state = getThreadState();
+    LogWriter& writer = LogWriter::get();
+
+    if(state.ring == NULL) {
+        // This is the first line from this thread.
+        state.ring = writer.addRing();
+    }
+
+    size_t position = writer.add(*state.ring, line);
+
+    if(wait) {
+        writer.waitFor(*state.ring, position);
+    }
+}
@@ -8,23 +8,7 @@
 #include <string>
 #include <iostream>
 #include <ostream>
-#include <ctime>
-
-// Configure log levels to compile in and out. Levels with OutStreams go to
-// stdout, levels with NullStreams go nowhere.
-
-// Critical: Log messages that stop the program.
-#define CRITICAL_STREAM OutStream
-// Error: Log messages that indicate something is broken
-#define ERROR_STREAM OutStream
-// Output: Messages the user is supposed to see
-#define OUTPUT_STREAM OutStream
-// Info: Messages about the operation of the program
-#define INFO_STREAM OutStream
-// Debug: Messages about the internals of the program.
-#define DEBUG_STREAM NullStream
-// Trace: Messages that pedantically describe what the program is doing.
-#define TRACE_STREAM NullStream
+#include <atomic>
 
 /**
  * Define a typedef for the type of ostream manipulators like std::endl. They
@@ -34,155 +18,219 @@
 typedef std::ostream& (*OstreamManipulator)(std::ostream&);
 
 /**
- * A pretend stream discards all output.
+ * A stream for one log level. Each thread builds up its own line, and hands it
+ * off to be written to standard output in the background when it gets
+ * std::endl, so lines from different threads never run together. If the level
+ * is turned off, anything sent here is dropped after one check, without being
+ * formatted.
  */
-class NullStream {
+class LogStream {
 public:
     /**
-     * Define a template operator that eats anything you try to throw at it.
+     * Make a stream for the given Log::Level.
      */
-    template<typename T>
-    NullStream& operator<<(T thing) {
-        return *this;
-    }
-    
+    LogStream(int level);
+
     /**
-     * Define another template that passes stream manipulators (which are really
-     * functions) on to the underlying stream.
+     * Is this stream's level turned on?
      */
-    inline NullStream& operator<<(OstreamManipulator manipulator) {
-        // Ignore the manipulator
-        return *this;
-    }
-};
+    inline bool isEnabled() const;
 
-/**
- * A stream that sends output to stdout.
- */
-class OutStream {
-public:
     /**
-     * Define a template operator that sends everything to standard output.
+     * Define a template operator that adds anything to the current line.
      */
     template<typename T>
-    OutStream& operator<<(T thing) {
-        std::cout << thing;
+    inline LogStream& operator<<(const T& thing) {
+        if(isEnabled()) {
+            getLine() << thing;
+        }
         return *this;
     }
-    
+
     /**
-     * Define another template that passes stream manipulators (which are really
-     * functions) on to the underlying stream.
+     * Define another operator that passes stream manipulators (which are
+     * really functions) on to the line. std::endl finishes the line.
      */
-    inline OutStream& operator<<(OstreamManipulator manipulator) {
-        // Send the manipulator to standard output.
-        std::cout << manipulator;
+    inline LogStream& operator<<(OstreamManipulator manipulator) {
+        if(isEnabled()) {
+            if(manipulator == (OstreamManipulator)std::endl) {
+                finishLine();
+            } else {
+                getLine() << manipulator;
+            }
+        }
         return *this;
     }
-     
-    
+
+protected:
+    // What level are we for?
+    int level;
+
+    /**
+     * Get the line the calling thread is building.
+     */
+    static std::ostream& getLine();
+
+    /**
+     * Send off the line the calling thread was building.
+     */
+    void finishLine();
 };
 
 /**
  * A class that holds static methods for logging in a stream-like way.
+ *
+ * Lines are written by a background thread, from a buffer for each thread
+ * that logs, so logging doesn't wait on standard output. CRITICAL and ERROR
+ * lines are written before the call that finishes them returns, and
+ * everything logged is written by the time the program exits normally. Call
+ * flush() to wait for everything logged so far to be written at any other
+ * time.
  */
 class Log {
 public:
+    /**
+     * Levels to log at, from most to least important. Logging at a level also
+     * logs everything more important.
+     */
+    enum Level {
+        // Log messages that stop the program.
+        CRITICAL,
+        // Log messages that indicate something is broken
+        ERROR,
+        // Messages the user is supposed to see
+        OUTPUT,
+        // Messages about the operation of the program
+        INFO,
+        // Messages about the internals of the program.
+        DEBUG,
+        // Messages that pedantically describe what the program is doing.
+        TRACE
+    };
+
+    /**
+     * Log everything at the given level and more important levels, and nothing
+     * less important. The default is INFO.
+     */
+    static void setLevel(Level level);
+
+    /**
+     * Get the least important level we are logging.
+     */
+    static inline Level getLevel() {
+        return (Level)level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the level with the given name ("critical", "error", "output",
+     * "info", "debug" or "trace"). Throws std::runtime_error if there is no
+     * such level.
+     */
+    static Level parseLevel(const std::string& name);
+
+    /**
+     * Wait until everything logged so far, by any thread, has been written.
+     */
+    static void flush();
+
     /**
      * Function to get a stream to log CRITICAL-level massages to. Call once per
      * line.
      */
-    static inline CRITICAL_STREAM& critical() {
-        return criticalStream << timestamp << "CRITICAL: ";
+    static inline LogStream& critical() {
+        return startLine(criticalStream, CRITICAL, "CRITICAL: ");
     }
-    
+
     /**
      * Function to get a stream to log ERROR-level massages to. Call once per
      * line.
      */
-    static inline ERROR_STREAM& error() {
-        return errorStream << timestamp << "ERROR: ";
+    static inline LogStream& error() {
+        return startLine(errorStream, ERROR, "ERROR: ");
     }
-    
+
     /**
      * Function to get a stream to log OUTPUT-level massages to. Call once per
      * line.
      */
-    static inline OUTPUT_STREAM& output() {
-        return outputStream << timestamp << "OUTPUT: ";
+    static inline LogStream& output() {
+        return startLine(outputStream, OUTPUT, "OUTPUT: ");
     }
-    
+
     /**
      * Function to get a stream to log INFO-level massages to. Call once per
      * line.
      */
-    static inline INFO_STREAM& info() {
-        return infoStream << timestamp << "INFO: ";
+    static inline LogStream& info() {
+        return startLine(infoStream, INFO, "INFO: ");
     }
-    
+
     /**
-     * Function to get a stream to log INFO-level massages to. Call once per
+     * Function to get a stream to log DEBUG-level massages to. Call once per
      * line.
      */
-    static inline DEBUG_STREAM& debug() {
-        return debugStream << timestamp << "DEBUG: ";
+    static inline LogStream& debug() {
+        return startLine(debugStream, DEBUG, "DEBUG: ");
     }
-    
+
     /**
      * Function to get a stream to log TRACE-level massages to. Call once per
      * line.
      */
-    static inline TRACE_STREAM& trace() {
-        return traceStream << timestamp << "TRACE: ";
+    static inline LogStream& trace() {
+        return startLine(traceStream, TRACE, "TRACE: ");
     }
-    
+
 private:
-    
+    // LogStreams need to get at the buffers.
+    friend class LogStream;
+
     // Static streams for all the log levels.
-    static CRITICAL_STREAM criticalStream;
-    static ERROR_STREAM errorStream;
-    static OUTPUT_STREAM outputStream;
-    static INFO_STREAM infoStream;
-    static DEBUG_STREAM debugStream;
-    static TRACE_STREAM traceStream;
-    
+    static LogStream criticalStream;
+    static LogStream errorStream;
+    static LogStream outputStream;
+    static LogStream infoStream;
+    static LogStream debugStream;
+    static LogStream traceStream;
+
+    // What's the least important level we log?
+    static std::atomic<int> level;
+
     // How long can a time be?
     static const int TIME_CHARS = 80;
     static const std::string TIME_FORMAT;
-    
-    /**
-     * We define a manipulator which manipulates a stream into printing the
-     * current time. This way we only do the time formatting when an actual
-     * stream is getting printed to.
-     */
-    static inline std::ostream& timestamp(std::ostream& stream) {
-        // Get the current time. See <http://stackoverflow.com/a/16358264>
-        
-        // This holds the global time
-        time_t globalTime;
-        time(&globalTime);
-        
-        // This holds the local time
-        struct tm * localTime = localtime(&globalTime);
-        
-        // This holds the formatted time
-        char buffer[TIME_CHARS];
-        if(strftime(buffer, TIME_CHARS, TIME_FORMAT.c_str(), localTime)) {
-            // Send the time to the stream. It is null-terminated.
-            stream << buffer;
-        } else {
-            // Complain (in the log) that we can't format the time. Maybe it's
-            // now the year 70 billion.
-            stream << "(Time too long) ";
+
+    /**
+     * Start a line at the given level on the given stream, if the level is on,
+     * with the time and the given label.
+     */
+    static inline LogStream& startLine(LogStream& stream, Level lineLevel,
+        const char* label) {
+
+        if(lineLevel <= getLevel()) {
+            writeTimestamp(label);
         }
-        
-        // Pass on the stream.
         return stream;
-
     }
-    
+
+    /**
+     * Put the current time and the given label on the calling thread's line.
+     * The time is only formatted once a second per thread.
+     */
+    static void writeTimestamp(const char* label);
+
+    /**
+     * Hand off a finished line, newline and all, to be written. If wait is
+     * set, don't return until it has been.
+     */
+    static void writeLine(const std::string& line, bool wait);
+
     // Don't ever let anyone make a Log object.
     Log();
 };
 
+inline bool LogStream::isEnabled() const {
+    return level <= Log::getLevel();
+}
+
 #endif
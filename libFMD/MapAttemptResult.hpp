@@ -2,8 +2,8 @@
 #define MAPATTEMPTRESULT_HPP
 
 /**
- * A triple to hold the return values from FMD::mapPosition() or
- * FMD::partialMap(). Holds a flag for whether the mapping succeeded or not, an
+ * A triple to hold the state of one attempt to map a base in the
+ * InterleavedMapper's lanes. Holds a flag for whether the mapping succeeded or not, an
  * FMDPosition corresponding either to where the character mapped or the longest
  * search starting at the character that did actually return results, and the
  * number of characters in the FMDPosition's search pattern.
@@ -37,4 +37,24 @@ struct MisMatchAttemptResults
     
 };
 
+/**
+ * Holds the state of an edit distance search, from FMD::editExtend() and
+ * FMD::editMapPosition(). Each pattern found is kept once, with the fewest
+ * edits that reach it. Patterns whose last query character was skipped as an
+ * insertion are kept apart, since they don't say where the query has got to in
+ * the reference; only the aligned patterns can map.
+ */
+struct EditAttemptResults
+{
+    bool is_mapped;
+    // Patterns ending in an aligned query character, and their edit counts
+    std::vector<std::pair<FMDPosition,size_t>> positions;
+    // Patterns ending in an inserted query character, and their edit counts
+    std::vector<std::pair<FMDPosition,size_t>> pending;
+    
+    // How much context it took to map, and how much we have searched
+    size_t characters;
+    size_t maxCharacters;
+};
+
 #endif
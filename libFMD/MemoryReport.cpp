@@ -0,0 +1,34 @@
+#include "MemoryReport.hpp"
+#include "Log.hpp"
+
+void MemoryReport::add(const std::string& name, size_t bytes) {
+    parts.push_back(std::make_pair(name, bytes));
+}
+
+void MemoryReport::add(const std::string& name, const MemoryReport& other) {
+    for(auto& part : other.parts) {
+        parts.push_back(std::make_pair(name + "." + part.first, part.second));
+    }
+}
+
+size_t MemoryReport::getTotal() const {
+    size_t total = 0;
+    for(auto& part : parts) {
+        total += part.second;
+    }
+    return total;
+}
+
+const std::vector<std::pair<std::string, size_t>>&
+    MemoryReport::getParts() const {
+
+    return parts;
+}
+
+void MemoryReport::log(const std::string& title) const {
+    Log::output() << title << ": " << getTotal() << " bytes" << std::endl;
+    for(auto& part : parts) {
+        Log::info() << "    " << part.first << ": " << part.second <<
+            " bytes" << std::endl;
+    }
+}
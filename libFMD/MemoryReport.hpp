@@ -0,0 +1,52 @@
+#ifndef MEMORYREPORT_HPP
+#define MEMORYREPORT_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+
+/**
+ * A breakdown of how many bytes each part of some structure is using, so we
+ * can tell what is taking up memory. Parts that are mapped from files count
+ * their whole mapping, even though the system can page it out.
+ *
+ * Reports can be nested, in which case the parts of the inner report get the
+ * name of the outer part as a prefix ("index.bwt.runs").
+ */
+class MemoryReport {
+
+public:
+    /**
+     * Add a part with the given name and number of bytes.
+     */
+    void add(const std::string& name, size_t bytes);
+
+    /**
+     * Add all the parts of another report, with the given name and a "." in
+     * front of theirs.
+     */
+    void add(const std::string& name, const MemoryReport& other);
+
+    /**
+     * Get the total bytes used by all the parts.
+     */
+    size_t getTotal() const;
+
+    /**
+     * Get all the parts, as names and byte counts, in the order they were
+     * added.
+     */
+    const std::vector<std::pair<std::string, size_t>>& getParts() const;
+
+    /**
+     * Log the total under the given title at OUTPUT level, and every part at
+     * INFO level.
+     */
+    void log(const std::string& title) const;
+
+protected:
+    // The names and sizes of all the parts
+    std::vector<std::pair<std::string, size_t>> parts;
+};
+
+#endif
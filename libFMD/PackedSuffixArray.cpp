@@ -0,0 +1,199 @@
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "PackedSuffixArray.hpp"
+#include "Log.hpp"
+
+PackedSuffixArray::PackedSuffixArray(const std::vector<size_t>& lengths,
+    size_t bwtLength): numberOfTexts(lengths.size()), positionBits(0),
+    numberOfIndices(bwtLength), textStarts(NULL), textStartData(),
+    positionData(NULL), positionWords(NULL), positions(NULL), mapped(NULL),
+    mappedBytes(0) {
+
+    size_t total = 0;
+    for(size_t i = 0; i < numberOfTexts; i++) {
+        // Each text has a position for every offset, and one more for its
+        // end.
+        textStartData.push_back(total);
+        total += lengths[i] + 1;
+    }
+    textStartData.push_back(total);
+    textStarts = textStartData.data();
+
+    // We need enough bits to number all the positions.
+    positionBits = total > 1 ? CSA::length(total - 1) : 1;
+
+    // Allocate the packed positions, all 0, since writing ORs bits in.
+    size_t words = (numberOfIndices * positionBits + CSA::WORD_BITS - 1) /
+        CSA::WORD_BITS;
+    positionData = new size_t[words]();
+    positionWords = positionData;
+
+    // Make a buffer to read them back out.
+    positions = new CSA::ReadBuffer(positionWords, numberOfIndices,
+        positionBits);
+}
+
+PackedSuffixArray::PackedSuffixArray(const std::string& filename):
+    numberOfTexts(0), positionBits(0), numberOfIndices(0), textStarts(NULL),
+    textStartData(), positionData(NULL), positionWords(NULL), positions(NULL),
+    mapped(NULL), mappedBytes(0) {
+
+    // Open the file and see how big it is.
+    int file = open(filename.c_str(), O_RDONLY);
+    if(file == -1) {
+        throw std::runtime_error("Could not open packed suffix array " +
+            filename);
+    }
+    struct stat fileStats;
+    if(fstat(file, &fileStats) == -1) {
+        close(file);
+        throw std::runtime_error("Could not stat packed suffix array " +
+            filename);
+    }
+    mappedBytes = fileStats.st_size;
+
+    if(mappedBytes < (HEADER_WORDS + 1) * sizeof(uint64_t)) {
+        close(file);
+        throw std::runtime_error("Packed suffix array " + filename +
+            " is truncated");
+    }
+
+    // Map the whole thing. The mapping keeps the file open for us.
+    mapped = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if(mapped == MAP_FAILED) {
+        mapped = NULL;
+        throw std::runtime_error("Could not map packed suffix array " +
+            filename);
+    }
+
+    // Look at it as words.
+    const uint64_t* words = (const uint64_t*)mapped;
+
+    if(words[0] != MAGIC) {
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error(filename + " is not a packed suffix array");
+    }
+
+    // Read the rest of the header.
+    numberOfTexts = words[1];
+    positionBits = words[2];
+    numberOfIndices = words[3];
+
+    // The packed positions come after the text starts.
+    size_t positionOffset = HEADER_WORDS + numberOfTexts + 1;
+
+    if(positionBits == 0 || positionBits > CSA::WORD_BITS ||
+        (positionOffset * CSA::WORD_BITS + numberOfIndices * positionBits +
+        7) / 8 > mappedBytes) {
+
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error("Packed suffix array " + filename +
+            " is truncated");
+    }
+
+    // Use everything right where it is.
+    textStarts = words + HEADER_WORDS;
+    positionWords = (const size_t*)(words + positionOffset);
+    positions = new CSA::ReadBuffer(positionWords, numberOfIndices,
+        positionBits);
+
+    Log::info() << "Mapped packed suffix array of " << numberOfIndices <<
+        " positions at " << positionBits << " bits each" << std::endl;
+}
+
+PackedSuffixArray::~PackedSuffixArray() {
+    // The buffer doesn't own any mapped data.
+    delete positions;
+    delete[] positionData;
+
+    if(mapped != NULL) {
+        // Unmap the file now that nothing is looking at it.
+        munmap(mapped, mappedBytes);
+    }
+}
+
+void PackedSuffixArray::set(int64_t bwtIndex, const TextPosition& position) {
+    if(positionData == NULL) {
+        throw std::runtime_error(
+            "Can't set positions in a loaded packed suffix array");
+    }
+    if(bwtIndex < 0 || (size_t)bwtIndex >= numberOfIndices ||
+        position.getText() >= numberOfTexts ||
+        textStarts[position.getText()] + position.getOffset() >=
+        textStarts[position.getText() + 1]) {
+
+        throw std::runtime_error("Position out of bounds for packed suffix "
+            "array");
+    }
+
+    // Make a temporary WriteBuffer on our data and OR in the position.
+    CSA::WriteBuffer writer(positionData, numberOfIndices, positionBits);
+    writer.goToItem(bwtIndex);
+    writer.writeItem(textStarts[position.getText()] + position.getOffset());
+}
+
+void PackedSuffixArray::save(const std::string& filename) const {
+    std::ofstream stream(filename.c_str(), std::ios::binary);
+    if(!stream.good()) {
+        throw std::runtime_error("Could not open " + filename +
+            " to save packed suffix array");
+    }
+
+    uint64_t header[HEADER_WORDS] = {MAGIC, numberOfTexts, positionBits,
+        numberOfIndices};
+    stream.write((const char*)header, sizeof(header));
+
+    // Then the text starts, which are already words.
+    stream.write((const char*)textStarts,
+        (numberOfTexts + 1) * sizeof(uint64_t));
+
+    // Dump all the packed positions at once.
+    size_t words = (numberOfIndices * positionBits + CSA::WORD_BITS - 1) /
+        CSA::WORD_BITS;
+    stream.write((const char*)positionWords, words * sizeof(size_t));
+
+    stream.close();
+    if(!stream.good()) {
+        throw std::runtime_error("Could not save packed suffix array to " +
+            filename);
+    }
+}
+
+size_t PackedSuffixArray::getNumberOfTexts() const {
+    return numberOfTexts;
+}
+
+size_t PackedSuffixArray::getLength() const {
+    return numberOfIndices;
+}
+
+TextPosition PackedSuffixArray::get(int64_t bwtIndex) const {
+    size_t position = positions->readItemConst(bwtIndex);
+
+    // Find the last text starting at or before the position.
+    size_t text = std::upper_bound(textStarts, textStarts + numberOfTexts + 1,
+        position) - textStarts - 1;
+
+    return TextPosition(text, position - textStarts[text]);
+}
+
+size_t PackedSuffixArray::reportSize() const {
+    size_t bytes = sizeof(*this) + positions->reportSize() + mappedBytes;
+
+    if(positionData != NULL) {
+        // We're building, so we own everything in memory.
+        bytes += textStartData.size() * sizeof(uint64_t) +
+            (numberOfIndices * positionBits + CSA::WORD_BITS - 1) /
+            CSA::WORD_BITS * sizeof(size_t);
+    }
+
+    return bytes;
+}
@@ -0,0 +1,112 @@
+#ifndef PACKEDSUFFIXARRAY_HPP
+#define PACKEDSUFFIXARRAY_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "BitVector.hpp"
+#include "TextPosition.hpp"
+
+/**
+ * A full suffix array: the (text, offset) position of every BWT index, so
+ * locating takes no LF-mapping at all. Positions are numbered across all the
+ * texts, ends included, and stored bit-packed, each taking only as many bits
+ * as it takes to number every position.
+ *
+ * On disk, everything is 64-bit words, laid out so the file can be mapped into
+ * memory and used in place:
+ *
+ * magic: "SGPKDSA1"
+ * number of texts, bits per position, number of BWT indices
+ * the number of the first position in each text, plus the total at the end
+ * the packed positions, in BWT order
+ */
+class PackedSuffixArray {
+
+public:
+    /**
+     * Magic number at the start of every packed suffix array file.
+     */
+    static const uint64_t MAGIC = 0x314153444b504753ULL; // "SGPKDSA1"
+
+    /**
+     * Make a new PackedSuffixArray to be filled in with set, for texts of the
+     * given lengths, in a BWT of the given length.
+     */
+    PackedSuffixArray(const std::vector<size_t>& lengths, size_t bwtLength);
+
+    /**
+     * Load a PackedSuffixArray saved with save() from the given file, by
+     * mapping it into memory.
+     */
+    PackedSuffixArray(const std::string& filename);
+
+    ~PackedSuffixArray();
+
+    /**
+     * Store the position of the given BWT index, which may be at the end of
+     * its text. Not safe to call from multiple threads.
+     */
+    void set(int64_t bwtIndex, const TextPosition& position);
+
+    /**
+     * Save the PackedSuffixArray to the given file.
+     */
+    void save(const std::string& filename) const;
+
+    /**
+     * Get the number of texts.
+     */
+    size_t getNumberOfTexts() const;
+
+    /**
+     * Get the number of BWT indices.
+     */
+    size_t getLength() const;
+
+    /**
+     * Get the position of the given BWT index.
+     */
+    TextPosition get(int64_t bwtIndex) const;
+
+    /**
+     * Get the number of bytes used by the PackedSuffixArray, in memory or
+     * mapped.
+     */
+    size_t reportSize() const;
+
+protected:
+    // How many words of header come before the text starts?
+    static const size_t HEADER_WORDS = 4;
+
+    // How many texts are there?
+    size_t numberOfTexts;
+    // How many bits does each position take?
+    size_t positionBits;
+    // How many BWT indices are there?
+    size_t numberOfIndices;
+
+    // The number of the first position in each text, with the total at the end
+    const uint64_t* textStarts;
+    // The text starts, if we own them because we're building
+    std::vector<uint64_t> textStartData;
+
+    // The packed positions, if we own them because we're building
+    size_t* positionData;
+    // The packed positions, wherever they live
+    const size_t* positionWords;
+    // A buffer to read positions from positionWords
+    CSA::ReadBuffer* positions;
+
+    // The file we have mapped, if any, and how long it is in bytes.
+    void* mapped;
+    size_t mappedBytes;
+
+private:
+    // Can't copy, since we own things.
+    PackedSuffixArray(const PackedSuffixArray& other);
+    PackedSuffixArray& operator=(const PackedSuffixArray& other);
+};
+
+#endif
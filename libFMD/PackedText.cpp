@@ -0,0 +1,227 @@
+#include <stdexcept>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "PackedText.hpp"
+#include "Log.hpp"
+
+/**
+ * Get the 2-bit code for a base, or throw an exception if it isn't one.
+ */
+static unsigned char encodeBase(char base) {
+    switch(base) {
+    case 'A':
+        return 0;
+    case 'C':
+        return 1;
+    case 'G':
+        return 2;
+    case 'T':
+        return 3;
+    default:
+        throw std::runtime_error(std::string("Can't pack non-base ") + base);
+    }
+}
+
+/**
+ * Get a table of the 4 bases packed into every possible byte.
+ */
+static const char (&getDecodeTable())[256][4] {
+    // Made the first time anyone asks.
+    static struct DecodeTable {
+        char bases[256][4];
+        DecodeTable() {
+            for(size_t byte = 0; byte < 256; byte++) {
+                for(size_t i = 0; i < 4; i++) {
+                    bases[byte][i] = "ACGT"[(byte >> (2 * i)) & 3];
+                }
+            }
+        }
+    } table;
+    return table.bases;
+}
+
+PackedText::Writer::Writer(const std::string& filename): filename(filename),
+    stream(filename.c_str(), std::ios::binary), contigStarts(),
+    totalLength(0), partial(0) {
+
+    if(!stream.good()) {
+        throw std::runtime_error("Could not open " + filename +
+            " to save packed text");
+    }
+
+    // Leave room for the header, which we only know at the end.
+    uint64_t header[HEADER_WORDS] = {0, 0, 0, 0};
+    stream.write((const char*)header, sizeof(header));
+}
+
+void PackedText::Writer::addContig(const std::string& bases) {
+    contigStarts.push_back(totalLength);
+
+    for(size_t i = 0; i < bases.size(); i++) {
+        // Put each base in the next 2 bits.
+        partial |= encodeBase(bases[i]) << (2 * (totalLength % 4));
+        totalLength++;
+
+        if(totalLength % 4 == 0) {
+            // We filled up a byte.
+            stream.put(partial);
+            partial = 0;
+        }
+    }
+}
+
+void PackedText::Writer::close() {
+    if(totalLength % 4 != 0) {
+        // Write out the last partial byte.
+        stream.put(partial);
+    }
+
+    // Pad out to a word so the contig starts are aligned.
+    size_t bytes = (totalLength + 3) / 4;
+    for(; bytes % sizeof(uint64_t) != 0; bytes++) {
+        stream.put(0);
+    }
+
+    // Write the contig starts, and the end of the last contig.
+    uint64_t startOffset = HEADER_WORDS + bytes / sizeof(uint64_t);
+    contigStarts.push_back(totalLength);
+    stream.write((const char*)contigStarts.data(),
+        contigStarts.size() * sizeof(uint64_t));
+
+    // Go back and fill in the header.
+    uint64_t header[HEADER_WORDS] = {MAGIC, contigStarts.size() - 1,
+        totalLength, startOffset};
+    stream.seekp(0);
+    stream.write((const char*)header, sizeof(header));
+
+    stream.close();
+    if(!stream.good()) {
+        throw std::runtime_error("Could not save packed text to " + filename);
+    }
+}
+
+PackedText::PackedText(const std::string& filename): numberOfContigs(0),
+    totalLength(0), bases(NULL), contigStarts(NULL), mapped(NULL),
+    mappedBytes(0) {
+
+    // Open the file and see how big it is.
+    int file = open(filename.c_str(), O_RDONLY);
+    if(file == -1) {
+        throw std::runtime_error("Could not open packed text " + filename);
+    }
+    struct stat fileStats;
+    if(fstat(file, &fileStats) == -1) {
+        close(file);
+        throw std::runtime_error("Could not stat packed text " + filename);
+    }
+    mappedBytes = fileStats.st_size;
+
+    if(mappedBytes < (HEADER_WORDS + 1) * sizeof(uint64_t)) {
+        close(file);
+        throw std::runtime_error("Packed text " + filename + " is truncated");
+    }
+
+    // Map the whole thing. The mapping keeps the file open for us.
+    mapped = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if(mapped == MAP_FAILED) {
+        mapped = NULL;
+        throw std::runtime_error("Could not map packed text " + filename);
+    }
+
+    // Look at it as words.
+    const uint64_t* words = (const uint64_t*)mapped;
+
+    if(words[0] != MAGIC) {
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error(filename + " is not a packed text");
+    }
+
+    // Read the rest of the header.
+    numberOfContigs = words[1];
+    totalLength = words[2];
+    size_t startOffset = words[3];
+
+    if((startOffset + numberOfContigs + 1) * sizeof(uint64_t) > mappedBytes ||
+        (totalLength + 3) / 4 > (startOffset - HEADER_WORDS) *
+        sizeof(uint64_t)) {
+
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error("Packed text " + filename + " is truncated");
+    }
+
+    // Use everything right where it is.
+    bases = (const unsigned char*)(words + HEADER_WORDS);
+    contigStarts = words + startOffset;
+
+    Log::info() << "Mapped packed text of " << numberOfContigs <<
+        " contigs and " << totalLength << " bases" << std::endl;
+}
+
+PackedText::~PackedText() {
+    // Unmap the file now that nothing is looking at it.
+    munmap(mapped, mappedBytes);
+}
+
+size_t PackedText::getNumberOfContigs() const {
+    return numberOfContigs;
+}
+
+size_t PackedText::getContigLength(size_t contig) const {
+    if(contig >= numberOfContigs) {
+        throw std::runtime_error("Contig " + std::to_string(contig) +
+            " out of bounds");
+    }
+    return contigStarts[contig + 1] - contigStarts[contig];
+}
+
+std::string PackedText::extract(size_t contig, size_t start,
+    size_t length) const {
+
+    // Make a string the right size and fill it in place.
+    std::string extracted(length, '\0');
+    if(length > 0) {
+        extract(contig, start, length, &extracted[0]);
+    }
+    return extracted;
+}
+
+void PackedText::extract(size_t contig, size_t start, size_t length,
+    char* destination) const {
+
+    if(start + length > getContigLength(contig)) {
+        throw std::runtime_error("Can't extract past the end of contig " +
+            std::to_string(contig));
+    }
+
+    const char (&table)[256][4] = getDecodeTable();
+
+    // Where in the whole text do we start?
+    size_t position = contigStarts[contig] + start;
+
+    for(; length > 0 && position % 4 != 0; length--, position++) {
+        // Do single bases until we get to a byte boundary.
+        *destination++ = table[bases[position / 4]][position % 4];
+    }
+
+    for(const unsigned char* byte = bases + position / 4; length >= 4;
+        length -= 4, position += 4, byte++) {
+        // Then do whole bytes at a time.
+        memcpy(destination, table[*byte], 4);
+        destination += 4;
+    }
+
+    for(; length > 0; length--, position++) {
+        // And finish up with single bases.
+        *destination++ = table[bases[position / 4]][position % 4];
+    }
+}
+
+size_t PackedText::reportSize() const {
+    return sizeof(*this) + mappedBytes;
+}
@@ -0,0 +1,123 @@
+#ifndef PACKEDTEXT_HPP
+#define PACKEDTEXT_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+
+/**
+ * The forward strands of all the contigs in an FMDIndex, packed 2 bits to a
+ * base, so that any piece of any contig can be read back out directly instead
+ * of by walking the BWT.
+ *
+ * On disk, the file can be mapped into memory and used in place:
+ *
+ * magic: "SGPACKD1"
+ * number of contigs, total number of bases, word offset of the contig starts
+ * the packed bases, 4 to a byte, first base in the low bits, padded to a word
+ * the start of each contig in the packed bases, plus the total length at the
+ * end, as 64-bit words
+ *
+ * Bases are A = 0, C = 1, G = 2, T = 3.
+ */
+class PackedText {
+
+public:
+    /**
+     * Magic number at the start of every packed text file.
+     */
+    static const uint64_t MAGIC = 0x31444b4341504753ULL; // "SGPACKD1"
+
+    /**
+     * Writes a packed text file one contig at a time.
+     */
+    class Writer {
+    public:
+        /**
+         * Start writing a packed text to the given file.
+         */
+        Writer(const std::string& filename);
+
+        /**
+         * Add the next contig. It must consist of only A, C, G, and T.
+         */
+        void addContig(const std::string& bases);
+
+        /**
+         * Finish the file. Must be called before the file can be loaded. After
+         * this is called, no other method on the same object may be called.
+         */
+        void close();
+
+    protected:
+        // The file we're writing
+        std::string filename;
+        std::ofstream stream;
+        // The start of every contig so far
+        std::vector<uint64_t> contigStarts;
+        // How many bases have we written?
+        uint64_t totalLength;
+        // The byte we're filling in, which is written when full
+        unsigned char partial;
+    };
+
+    /**
+     * Load a PackedText saved by a Writer from the given file, by mapping it
+     * into memory.
+     */
+    PackedText(const std::string& filename);
+
+    ~PackedText();
+
+    /**
+     * Get the number of contigs stored.
+     */
+    size_t getNumberOfContigs() const;
+
+    /**
+     * Get the length of the given contig.
+     */
+    size_t getContigLength(size_t contig) const;
+
+    /**
+     * Get length bases of the given contig, starting at start.
+     */
+    std::string extract(size_t contig, size_t start, size_t length) const;
+
+    /**
+     * Put length bases of the given contig, starting at start, into the given
+     * buffer, which must have room for them.
+     */
+    void extract(size_t contig, size_t start, size_t length,
+        char* destination) const;
+
+    /**
+     * Get the number of bytes mapped.
+     */
+    size_t reportSize() const;
+
+protected:
+    // How many words of header come before the packed bases?
+    static const size_t HEADER_WORDS = 4;
+
+    // How many contigs are there?
+    size_t numberOfContigs;
+    // How many bases are there?
+    size_t totalLength;
+    // The packed bases
+    const unsigned char* bases;
+    // Where each contig starts, with the total length at the end
+    const uint64_t* contigStarts;
+
+    // The file we have mapped, and how long it is in bytes.
+    void* mapped;
+    size_t mappedBytes;
+
+private:
+    // Can't copy, since we own the mapping.
+    PackedText(const PackedText& other);
+    PackedText& operator=(const PackedText& other);
+};
+
+#endif
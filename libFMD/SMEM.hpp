@@ -0,0 +1,22 @@
+#ifndef SMEM_HPP
+#define SMEM_HPP
+
+#include "FMDPosition.hpp"
+
+/**
+ * A super-maximal exact match between part of a query and the index: a match
+ * that can't be extended in either direction, and isn't contained in any other
+ * match that can't be. Holds where the match is in the query, and the
+ * bi-interval of its occurrences in the index.
+ */
+struct SMEM
+{
+    // Where in the query does the match start?
+    size_t start;
+    // How many query characters does it cover?
+    size_t length;
+    // Where is it in the index?
+    FMDPosition position;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SampledISA.hpp"
+#include "Log.hpp"
+
+SampledISA::SampledISA(size_t sampleRate,
+    const std::vector<size_t>& lengths, size_t bwtLength):
+    sampleRate(sampleRate), numberOfTexts(lengths.size()), indexBits(0),
+    numberOfSamples(0), textLengths(NULL), textStarts(NULL),
+    textLengthData(lengths.begin(), lengths.end()), textStartData(),
+    sampleData(NULL), sampleWords(NULL), samples(NULL), mapped(NULL),
+    mappedBytes(0) {
+
+    if(sampleRate == 0) {
+        throw std::runtime_error("Can't sample the ISA at rate 0");
+    }
+
+    for(size_t i = 0; i < numberOfTexts; i++) {
+        // Each text gets a sample for every multiple of the sample rate in it,
+        // and one more for its end.
+        textStartData.push_back(numberOfSamples);
+        numberOfSamples += (lengths[i] + sampleRate - 1) / sampleRate + 1;
+    }
+    textStartData.push_back(numberOfSamples);
+
+    textLengths = textLengthData.data();
+    textStarts = textStartData.data();
+
+    // We need enough bits to number all the BWT indices.
+    indexBits = bwtLength > 1 ? CSA::length(bwtLength - 1) : 1;
+
+    // Allocate the packed indices, all 0, since writing ORs bits in.
+    size_t words = (numberOfSamples * indexBits + CSA::WORD_BITS - 1) /
+        CSA::WORD_BITS;
+    sampleData = new size_t[words]();
+    sampleWords = sampleData;
+
+    // Make a buffer to read them back out.
+    samples = new CSA::ReadBuffer(sampleWords, numberOfSamples, indexBits);
+}
+
+SampledISA::SampledISA(const std::string& filename): sampleRate(0),
+    numberOfTexts(0), indexBits(0), numberOfSamples(0), textLengths(NULL),
+    textStarts(NULL), textLengthData(), textStartData(), sampleData(NULL),
+    sampleWords(NULL), samples(NULL), mapped(NULL), mappedBytes(0) {
+
+    // Open the file and see how big it is.
+    int file = open(filename.c_str(), O_RDONLY);
+    if(file == -1) {
+        throw std::runtime_error("Could not open sampled ISA " + filename);
+    }
+    struct stat fileStats;
+    if(fstat(file, &fileStats) == -1) {
+        close(file);
+        throw std::runtime_error("Could not stat sampled ISA " + filename);
+    }
+    mappedBytes = fileStats.st_size;
+
+    if(mappedBytes < (HEADER_WORDS + 1) * sizeof(uint64_t)) {
+        close(file);
+        throw std::runtime_error("Sampled ISA " + filename + " is truncated");
+    }
+
+    // Map the whole thing. The mapping keeps the file open for us.
+    mapped = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if(mapped == MAP_FAILED) {
+        mapped = NULL;
+        throw std::runtime_error("Could not map sampled ISA " + filename);
+    }
+
+    // Look at it as words.
+    const uint64_t* words = (const uint64_t*)mapped;
+
+    if(words[0] != MAGIC) {
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error(filename + " is not a sampled ISA");
+    }
+
+    // Read the rest of the header.
+    sampleRate = words[1];
+    numberOfTexts = words[2];
+    indexBits = words[3];
+    numberOfSamples = words[4];
+
+    // The packed indices come after both per-text tables.
+    size_t sampleOffset = HEADER_WORDS + 2 * numberOfTexts + 1;
+
+    if(sampleRate == 0 || (sampleOffset * CSA::WORD_BITS +
+        numberOfSamples * indexBits + 7) / 8 > mappedBytes) {
+
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error("Sampled ISA " + filename + " is truncated");
+    }
+
+    // Use everything right where it is.
+    textLengths = words + HEADER_WORDS;
+    textStarts = textLengths + numberOfTexts;
+    sampleWords = (const size_t*)(words + sampleOffset);
+    samples = new CSA::ReadBuffer(sampleWords, numberOfSamples, indexBits);
+
+    Log::info() << "Mapped sampled ISA with " << numberOfSamples <<
+        " samples at " << indexBits << " bits each" << std::endl;
+}
+
+SampledISA::~SampledISA() {
+    // The buffer doesn't own any mapped data.
+    delete samples;
+    delete[] sampleData;
+
+    if(mapped != NULL) {
+        // Unmap the file now that nothing is looking at it.
+        munmap(mapped, mappedBytes);
+    }
+}
+
+void SampledISA::offer(const TextPosition& position, int64_t bwtIndex) {
+    if(sampleData == NULL) {
+        throw std::runtime_error("Can't set samples in a loaded sampled ISA");
+    }
+    if(position.getText() >= numberOfTexts ||
+        position.getOffset() > textLengths[position.getText()]) {
+
+        throw std::runtime_error("Position out of bounds for sampled ISA");
+    }
+
+    if(position.getOffset() % sampleRate != 0 &&
+        position.getOffset() != textLengths[position.getText()]) {
+        // We don't keep this one.
+        return;
+    }
+
+    // Make a temporary WriteBuffer on our data and OR in the index.
+    CSA::WriteBuffer writer(sampleData, numberOfSamples, indexBits);
+    writer.goToItem(getSampleNumber(position));
+    writer.writeItem(bwtIndex);
+}
+
+void SampledISA::save(const std::string& filename) const {
+    std::ofstream stream(filename.c_str(), std::ios::binary);
+    if(!stream.good()) {
+        throw std::runtime_error("Could not open " + filename +
+            " to save sampled ISA");
+    }
+
+    uint64_t header[HEADER_WORDS] = {MAGIC, sampleRate, numberOfTexts,
+        indexBits, numberOfSamples};
+    stream.write((const char*)header, sizeof(header));
+
+    // Then the lengths and sample starts, which are already words.
+    stream.write((const char*)textLengths, numberOfTexts * sizeof(uint64_t));
+    stream.write((const char*)textStarts,
+        (numberOfTexts + 1) * sizeof(uint64_t));
+
+    // Dump all the packed indices at once.
+    size_t words = (numberOfSamples * indexBits + CSA::WORD_BITS - 1) /
+        CSA::WORD_BITS;
+    stream.write((const char*)sampleWords, words * sizeof(size_t));
+
+    stream.close();
+    if(!stream.good()) {
+        throw std::runtime_error("Could not save sampled ISA to " + filename);
+    }
+}
+
+size_t SampledISA::getSampleRate() const {
+    return sampleRate;
+}
+
+size_t SampledISA::getNumberOfTexts() const {
+    return numberOfTexts;
+}
+
+TextPosition SampledISA::getNextSampled(const TextPosition& position) const {
+    if(position.getText() >= numberOfTexts ||
+        position.getOffset() > textLengths[position.getText()]) {
+
+        throw std::runtime_error("Position out of bounds for sampled ISA");
+    }
+
+    // Round up to the sample rate, but don't go past the end.
+    size_t offset = (position.getOffset() + sampleRate - 1) / sampleRate *
+        sampleRate;
+    if(offset > textLengths[position.getText()]) {
+        offset = textLengths[position.getText()];
+    }
+
+    return TextPosition(position.getText(), offset);
+}
+
+int64_t SampledISA::getSample(const TextPosition& position) const {
+    return samples->readItemConst(getSampleNumber(position));
+}
+
+size_t SampledISA::getSampleNumber(const TextPosition& position) const {
+    size_t text = position.getText();
+
+    if(position.getOffset() == textLengths[text]) {
+        // The end comes after all the multiples of the sample rate.
+        return textStarts[text + 1] - 1;
+    }
+
+    return textStarts[text] + position.getOffset() / sampleRate;
+}
+
+size_t SampledISA::reportSize() const {
+    size_t bytes = sizeof(*this) + samples->reportSize() + mappedBytes;
+
+    if(sampleData != NULL) {
+        // We're building, so we own all the tables in memory.
+        bytes += (textLengthData.size() + textStartData.size()) *
+            sizeof(uint64_t) + (numberOfSamples * indexBits +
+            CSA::WORD_BITS - 1) / CSA::WORD_BITS * sizeof(size_t);
+    }
+
+    return bytes;
+}
@@ -0,0 +1,135 @@
+#ifndef SAMPLEDISA_HPP
+#define SAMPLEDISA_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "BitVector.hpp"
+#include "TextPosition.hpp"
+
+/**
+ * A sampled inverse suffix array: the BWT index of every sampleRate-th offset
+ * in each text, plus that of each text's end. The BWT index of any (text,
+ * offset) position can be found from the next sample at or after it, by
+ * LF-mapping back at most sampleRate times.
+ *
+ * Indices are stored bit-packed, each taking only as many bits as it takes to
+ * number every BWT index.
+ *
+ * On disk, everything is 64-bit words, laid out so the file can be mapped into
+ * memory and used in place:
+ *
+ * magic: "SGISAMP1"
+ * sample rate, number of texts, bits per index, total number of samples
+ * the length of each text
+ * the number of the first sample for each text, plus the total at the end
+ * the packed indices, text by text, in offset order, ending with the end
+ */
+class SampledISA {
+
+public:
+    /**
+     * Magic number at the start of every sampled ISA file.
+     */
+    static const uint64_t MAGIC = 0x31504d4153495347ULL; // "SGISAMP1"
+
+    /**
+     * Make a new SampledISA to be filled in with offer, for texts of the
+     * given lengths, in a BWT of the given length, sampling every sampleRate-th
+     * offset.
+     */
+    SampledISA(size_t sampleRate, const std::vector<size_t>& lengths,
+        size_t bwtLength);
+
+    /**
+     * Load a SampledISA saved with save() from the given file, by mapping it
+     * into memory.
+     */
+    SampledISA(const std::string& filename);
+
+    ~SampledISA();
+
+    /**
+     * If the given position is one we sample (a multiple of the sample rate,
+     * or the end of its text), store the BWT index it is at. Otherwise do
+     * nothing. Not safe to call from multiple threads.
+     */
+    void offer(const TextPosition& position, int64_t bwtIndex);
+
+    /**
+     * Save the SampledISA to the given file.
+     */
+    void save(const std::string& filename) const;
+
+    /**
+     * Get the sample rate.
+     */
+    size_t getSampleRate() const;
+
+    /**
+     * Get the number of texts.
+     */
+    size_t getNumberOfTexts() const;
+
+    /**
+     * Get the first sampled position at or after the given position, which
+     * must be in a text, or at its end. LF-mapping back from the BWT index of
+     * the sampled position will get to the given position.
+     */
+    TextPosition getNextSampled(const TextPosition& position) const;
+
+    /**
+     * Get the BWT index of the given sampled position.
+     */
+    int64_t getSample(const TextPosition& position) const;
+
+    /**
+     * Get the number of bytes used by the SampledISA, in memory or mapped.
+     */
+    size_t reportSize() const;
+
+protected:
+    // How many words of header come before the text lengths?
+    static const size_t HEADER_WORDS = 5;
+
+    /**
+     * Get the number of the sample for the given sampled position.
+     */
+    size_t getSampleNumber(const TextPosition& position) const;
+
+    // Take a sample every this many offsets
+    size_t sampleRate;
+    // How many texts are there?
+    size_t numberOfTexts;
+    // How many bits does each index take?
+    size_t indexBits;
+    // How many samples are there?
+    size_t numberOfSamples;
+
+    // The length of each text
+    const uint64_t* textLengths;
+    // The number of the first sample for each text, with the total at the end
+    const uint64_t* textStarts;
+    // The text lengths and starts, if we own them because we're building
+    std::vector<uint64_t> textLengthData;
+    std::vector<uint64_t> textStartData;
+
+    // The packed indices, if we own them because we're building
+    size_t* sampleData;
+    // The packed indices, wherever they live
+    const size_t* sampleWords;
+    // A buffer to read indices from sampleWords
+    CSA::ReadBuffer* samples;
+
+    // The file we have mapped, if any, and how long it is in bytes.
+    void* mapped;
+    size_t mappedBytes;
+
+private:
+    // Can't copy, since we own things.
+    SampledISA(const SampledISA& other);
+    SampledISA& operator=(const SampledISA& other);
+};
+
+#endif
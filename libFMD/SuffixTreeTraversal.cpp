@@ -0,0 +1,183 @@
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+#include "SuffixTreeTraversal.hpp"
+#include "FMDIndex.hpp"
+#include "util.hpp"
+#include "Log.hpp"
+
+SuffixTreeTraversal::SuffixTreeTraversal(const FMDIndex& index, size_t depth,
+    bool reportDeadEnds): index(index), depth(depth),
+    reportDeadEnds(reportDeadEnds) {
+
+    if(depth == 0) {
+        throw std::runtime_error("Can't traverse the suffix tree to depth 0");
+    }
+}
+
+template<typename Found>
+void SuffixTreeTraversal::explore(const FMDPosition& root, size_t level,
+    size_t stopDepth, char* pattern, FMDExtensions* extensions,
+    size_t* nextBase, Found found) const {
+
+    if(level == stopDepth) {
+        // The root is already as deep as we want to go.
+        found(level, root, false);
+        return;
+    }
+
+    // Set up the stack frame for a node at the given level, which we are going
+    // to look at the children of.
+    auto enter = [&](size_t frame, const FMDPosition& position) {
+        if(frame > 0) {
+            // Look up all the children at once. The root's children are just
+            // the character ranges, so it doesn't need this.
+            extensions[frame] = index.extendAll(position, false);
+
+            if(reportDeadEnds && extensions[frame].endOfTextLength > 0) {
+                // Some suffixes come into this node and leave before the first
+                // real base. They must end the text. They're at the start of
+                // the range; the reverse start can't be moved sanely.
+                found(frame, FMDPosition(position.getForwardStart(),
+                    position.getReverseStart(),
+                    extensions[frame].endOfTextLength - 1), true);
+            }
+        }
+        // Start on the first base.
+        nextBase[frame] = 0;
+    };
+
+    enter(level, root);
+    size_t top = level;
+
+    while(true) {
+        if(nextBase[top] == NUM_BASES) {
+            // We've done all the children here.
+            if(top == level) {
+                // And this is the root, so we're done.
+                break;
+            }
+            // Go back up.
+            top--;
+            continue;
+        }
+
+        // Go through children in alphabetical order, like the iterator.
+        char base = ALPHABETICAL_BASES[nextBase[top]];
+        nextBase[top]++;
+
+        FMDPosition child = top == 0 ? index.getCharPosition(base) :
+            extensions[top].get(base);
+
+        if(child.isEmpty()) {
+            // This would be a suffix that doesn't appear.
+            continue;
+        }
+
+        // Record the change to the pattern.
+        pattern[top] = base;
+
+        if(top + 1 == stopDepth) {
+            // We got to the right depth.
+            found(top + 1, child, false);
+        } else {
+            // Go down into the child.
+            top++;
+            enter(top, child);
+        }
+    }
+}
+
+void SuffixTreeTraversal::run(SuffixTreeVisitor& visitor, size_t splitDepth,
+    size_t threadCount) const {
+
+    // Don't split below where we want to visit.
+    splitDepth = std::min(splitDepth, depth);
+
+    // Find all the subtrees in order, along with any dead ends above them.
+    std::vector<Subtree> subtrees;
+    std::vector<char> splitPattern(splitDepth);
+    std::vector<FMDExtensions> splitExtensions(splitDepth);
+    std::vector<size_t> splitNextBase(splitDepth);
+    explore(index.getCoveringPosition(), 0, splitDepth, splitPattern.data(),
+        splitExtensions.data(), splitNextBase.data(),
+        [&](size_t length, const FMDPosition& position, bool deadEnd) {
+
+        Subtree subtree;
+        subtree.pattern.assign(splitPattern.begin(),
+            splitPattern.begin() + length);
+        subtree.position = position;
+        subtree.deadEnd = deadEnd;
+        subtrees.push_back(subtree);
+    });
+
+    Log::info() << "Traversing " << subtrees.size() <<
+        " suffix tree subtrees to depth " << depth << std::endl;
+
+    visitor.start(subtrees.size());
+
+    if(threadCount == 0) {
+        // Use one thread per core.
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    // Don't make more threads than there are subtrees.
+    threadCount = std::max((size_t)1, std::min(threadCount, subtrees.size()));
+
+    // Threads take the next subtree nobody has started.
+    std::atomic<size_t> nextSubtree(0);
+
+    // If any thread fails, we need to pass the error along, and the others
+    // should stop.
+    std::vector<std::exception_ptr> errors(threadCount);
+    std::atomic<bool> failed(false);
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < threadCount; i++) {
+        threads.push_back(std::thread([&, i]() {
+            try {
+                // Make all our scratch space up front.
+                std::vector<char> pattern(depth);
+                std::vector<FMDExtensions> extensions(depth);
+                std::vector<size_t> nextBase(depth);
+
+                size_t number;
+                while(!failed && (number = nextSubtree++) < subtrees.size()) {
+                    const Subtree& subtree = subtrees[number];
+                    std::copy(subtree.pattern.begin(), subtree.pattern.end(),
+                        pattern.begin());
+
+                    if(subtree.deadEnd) {
+                        // There's nothing under it to explore.
+                        visitor.visit(number, pattern.data(),
+                            subtree.pattern.size(), subtree.position);
+                        continue;
+                    }
+
+                    explore(subtree.position, subtree.pattern.size(), depth,
+                        pattern.data(), extensions.data(), nextBase.data(),
+                        [&](size_t length, const FMDPosition& position,
+                        bool) {
+
+                        visitor.visit(number, pattern.data(), length,
+                            position);
+                    });
+                }
+            } catch(...) {
+                errors[i] = std::current_exception();
+                failed = true;
+            }
+        }));
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    for(auto& error : errors) {
+        if(error) {
+            // Throw the first thing that went wrong.
+            std::rethrow_exception(error);
+        }
+    }
+}
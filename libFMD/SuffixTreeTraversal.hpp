@@ -0,0 +1,105 @@
+#ifndef SUFFIXTREETRAVERSAL_HPP
+#define SUFFIXTREETRAVERSAL_HPP
+
+#include <vector>
+
+#include "FMDPosition.hpp"
+#include "FMDExtensions.hpp"
+
+// Forward declaration for circular dependency
+class FMDIndex;
+
+/**
+ * Something that wants to see the suffix tree nodes found by a
+ * SuffixTreeTraversal.
+ */
+class SuffixTreeVisitor
+{
+public:
+    virtual ~SuffixTreeVisitor() {}
+
+    /**
+     * Called once, before any nodes are visited, with the number of subtrees
+     * the traversal has been split into.
+     */
+    virtual void start(size_t) {}
+
+    /**
+     * Called for every suffix tree node found, with the number of the subtree
+     * it is in, its pattern (which is only valid until this returns), and its
+     * FMDPosition. Different subtrees are visited at the same time from
+     * different threads, but each subtree is visited by only one thread, in the
+     * order an FMDIndexIterator would yield its nodes. Subtrees are numbered in
+     * that order too, so putting them together gives the iterator's order.
+     */
+    virtual void visit(size_t subtree, const char* pattern, size_t length,
+        const FMDPosition& range) = 0;
+};
+
+/**
+ * Visits all the suffix tree nodes of an FMDIndex at a given depth, as an
+ * FMDIndexIterator would yield them, using many threads.
+ *
+ * The tree is cut at a split depth into independent subtrees, which a pool of
+ * threads takes turns exploring depth-first. Each thread keeps its search
+ * state in arrays with one entry per level, allocated once, so nothing is
+ * allocated or copied per node.
+ */
+class SuffixTreeTraversal
+{
+public:
+    /**
+     * Make a new SuffixTreeTraversal of the given index's suffix tree, visiting
+     * nodes at the given depth (which may not be 0), and also end of text dead
+     * ends above it if reportDeadEnds is set. For those dead ends, the reverse
+     * ranges will not be valid!
+     */
+    SuffixTreeTraversal(const FMDIndex& index, size_t depth,
+        bool reportDeadEnds = false);
+
+    /**
+     * Run the traversal, splitting the tree into a subtree for each node at
+     * splitDepth (or depth, if that's shallower), plus one for each dead end
+     * above that, and exploring them on the given number of threads (or one
+     * per core if 0). Any exception thrown by the visitor is passed along
+     * once all the threads have stopped.
+     */
+    void run(SuffixTreeVisitor& visitor, size_t splitDepth = 4,
+        size_t threadCount = 0) const;
+
+protected:
+    /**
+     * A node to start exploring from.
+     */
+    struct Subtree
+    {
+        // Pattern to get there, which is no longer than the split depth
+        std::vector<char> pattern;
+        // Where the pattern is
+        FMDPosition position;
+        // Is this just a dead end to visit, rather than a subtree to explore?
+        bool deadEnd;
+    };
+
+    /**
+     * Explore the subtree under the given position, which is reached by the
+     * pattern already in the first level characters of pattern, down to
+     * stopDepth, calling found(length, position, isDeadEnd) for each node at
+     * stopDepth and each dead end along the way, in iterator order. extensions
+     * and nextBase are scratch space with room for stopDepth levels, and
+     * pattern has room for stopDepth characters.
+     */
+    template<typename Found>
+    void explore(const FMDPosition& root, size_t level, size_t stopDepth,
+        char* pattern, FMDExtensions* extensions, size_t* nextBase,
+        Found found) const;
+
+    // The index we traverse
+    const FMDIndex& index;
+    // What depth to visit at
+    size_t depth;
+    // Should we visit dead ends?
+    bool reportDeadEnds;
+};
+
+#endif
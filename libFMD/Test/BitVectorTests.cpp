@@ -0,0 +1,459 @@
+// Test BitVectors and DenseBitVectors.
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <random>
+#include <cstdio>
+#include <thread>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "../BitVector.hpp"
+#include "../util.hpp"
+
+#include "BitVectorTests.hpp"
+
+using CSA::DenseBitVector;
+using CSA::pair_type;
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( BitVectorTests );
+
+void BitVectorTests::setUp() {
+    tempDir = make_tempdir();
+}
+
+void BitVectorTests::tearDown() {
+    boost::filesystem::remove_all(tempDir);
+}
+
+/**
+ * Make random bits with about the given fraction set, in runs of about the
+ * given length. The last bit is always set, so there is at least one.
+ */
+static std::vector<bool> makeBits(size_t size, double density,
+    size_t runLength, unsigned int seed) {
+    
+    std::mt19937 generator(seed);
+    std::bernoulli_distribution startRun(density / runLength);
+    
+    std::vector<bool> bits(size, false);
+    for(size_t i = 0; i < size; i++) {
+        if(startRun(generator)) {
+            for(size_t j = i; j < std::min(size, i + runLength); j++) {
+                bits[j] = true;
+            }
+        }
+    }
+    bits[size - 1] = true;
+    return bits;
+}
+
+/**
+ * Encode the given bits as a nibble-coded BitVector.
+ */
+static BitVector* encode(const std::vector<bool>& bits) {
+    BitVectorEncoder encoder(32);
+    for(size_t i = 0; i < bits.size(); i++) {
+        if(bits[i]) {
+            encoder.addBit(i);
+        }
+    }
+    encoder.flush();
+    return new BitVector(encoder, bits.size());
+}
+
+/**
+ * Check every query on the given DenseBitVector against the bits it should
+ * have.
+ */
+static void checkDense(const DenseBitVector& dense,
+    const std::vector<bool>& bits) {
+    
+    // Where is each 1?
+    std::vector<size_t> ones;
+    for(size_t i = 0; i < bits.size(); i++) {
+        if(bits[i]) {
+            ones.push_back(i);
+        }
+    }
+    
+    CPPUNIT_ASSERT_EQUAL(bits.size(), dense.getSize());
+    CPPUNIT_ASSERT_EQUAL(ones.size(), dense.getNumberOfItems());
+    
+    // How many 1s are at or before the current position?
+    size_t rank = 0;
+    for(size_t i = 0; i < bits.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL((bool)bits[i], dense.isSet(i));
+        
+        // Rank at least counts the ones before, plus 1.
+        CPPUNIT_ASSERT_EQUAL(rank + 1, dense.rank(i, true));
+        if(bits[i]) {
+            rank++;
+        }
+        CPPUNIT_ASSERT_EQUAL(rank, dense.rank(i));
+        
+        pair_type before = dense.valueBefore(i);
+        if(rank == 0) {
+            CPPUNIT_ASSERT(before == pair_type(bits.size(), ones.size()));
+        } else {
+            CPPUNIT_ASSERT(before == pair_type(ones[rank - 1], rank - 1));
+        }
+        
+        // The first 1 at or after here is the one with this rank.
+        size_t after = bits[i] ? rank - 1 : rank;
+        if(after == ones.size()) {
+            CPPUNIT_ASSERT(dense.valueAfter(i) ==
+                pair_type(bits.size(), ones.size()));
+        } else {
+            CPPUNIT_ASSERT(dense.valueAfter(i) == pair_type(ones[after],
+                after));
+        }
+    }
+    
+    for(size_t i = 0; i < ones.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(ones[i], dense.select(i));
+    }
+    
+    // Past the end we get the same answers as the nibble vectors.
+    CPPUNIT_ASSERT_EQUAL(ones.size(), dense.rank(bits.size()));
+    CPPUNIT_ASSERT_EQUAL(bits.size(), dense.select(ones.size()));
+    CPPUNIT_ASSERT(!dense.isSet(bits.size()));
+}
+
+/**
+ * Make sure DenseBitVectors answer every query right over a range of
+ * densities, and agree with the nibble-coded vectors they come from.
+ */
+void BitVectorTests::testDenseQueries() {
+    // Try sparse, dense, runny, full, and sizes that don't fill a block.
+    const size_t sizes[] = {20000, 20000, 20000, 20000, 20000, 777, 1};
+    const double densities[] = {0.001, 0.1, 0.5, 0.6, 1.0, 0.3, 1.0};
+    const size_t runs[] = {1, 1, 1, 50, 20000, 3, 1};
+    
+    for(size_t test = 0; test < 7; test++) {
+        std::vector<bool> bits = makeBits(sizes[test], densities[test],
+            runs[test], test);
+        
+        BitVector* vector = encode(bits);
+        DenseBitVector dense(*vector);
+        checkDense(dense, bits);
+        
+        // The nibble-coded iterator should agree, whichever layout it uses.
+        BitVectorIterator iterator(*vector);
+        for(size_t i = 0; i < bits.size(); i++) {
+            CPPUNIT_ASSERT_EQUAL(dense.rank(i), iterator.rank(i));
+            CPPUNIT_ASSERT_EQUAL(dense.rank(i, true), iterator.rank(i, true));
+            CPPUNIT_ASSERT_EQUAL(dense.isSet(i), iterator.isSet(i));
+            CPPUNIT_ASSERT(dense.valueAfter(i) == iterator.valueAfter(i));
+            CPPUNIT_ASSERT(dense.valueBefore(i) == iterator.valueBefore(i));
+        }
+        
+        delete vector;
+    }
+}
+
+/**
+ * Make sure only dense vectors get a DenseBitVector.
+ */
+void BitVectorTests::testLayoutChoice() {
+    // Random bits at half density don't compress.
+    BitVector* dense = encode(makeBits(100000, 0.5, 1, 1));
+    CPPUNIT_ASSERT(dense->getDense() != NULL);
+    
+    // But sparse bits and long runs do.
+    BitVector* sparse = encode(makeBits(100000, 0.001, 1, 2));
+    CPPUNIT_ASSERT(sparse->getDense() == NULL);
+    BitVector* runs = encode(makeBits(100000, 0.5, 1000, 3));
+    CPPUNIT_ASSERT(runs->getDense() == NULL);
+    
+    // The dense vector keeps only the one copy of its bits.
+    CPPUNIT_ASSERT_EQUAL(sizeof(BitVector) + dense->getDense()->reportSize(),
+        dense->reportSize());
+    
+    delete dense;
+    delete sparse;
+    delete runs;
+}
+
+/**
+ * Make sure DenseBitVectors can be saved and loaded in all the ways
+ * BitVectors can.
+ */
+void BitVectorTests::testDenseSave() {
+    std::vector<bool> bits = makeBits(5000, 0.4, 2, 4);
+    BitVector* vector = encode(bits);
+    DenseBitVector dense(*vector);
+    delete vector;
+    
+    std::string filename = tempDir + "/dense.bits";
+    {
+        std::ofstream out(filename.c_str(), std::ios::binary);
+        dense.writeTo(out);
+    }
+    
+    // Read it back as a stream.
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    DenseBitVector streamed(in);
+    checkDense(streamed, bits);
+    
+    // And as a FILE.
+    FILE* file = fopen(filename.c_str(), "rb");
+    DenseBitVector read(file);
+    fclose(file);
+    checkDense(read, bits);
+    
+    // And in place from memory.
+    std::ifstream again(filename.c_str(), std::ios::binary);
+    std::vector<size_t> buffer((boost::filesystem::file_size(filename) +
+        sizeof(size_t) - 1) / sizeof(size_t));
+    again.read((char*)buffer.data(), boost::filesystem::file_size(filename));
+    DenseBitVector mapped(buffer.data(), buffer.size());
+    checkDense(mapped, bits);
+    
+    // But not if it's been cut short.
+    CPPUNIT_ASSERT_THROW(DenseBitVector(buffer.data(), buffer.size() - 1),
+        std::runtime_error);
+    
+    // Only the copies that own their bits count them.
+    CPPUNIT_ASSERT(mapped.reportSize() < read.reportSize());
+}
+
+/**
+ * Make sure the const queries on BitVectors agree with the iterator queries,
+ * with and without the dense layout, even with several threads asking at once.
+ */
+void BitVectorTests::testConstQueries() {
+    // One of these gets a DenseBitVector and one doesn't.
+    std::vector<bool> denseBits = makeBits(20000, 0.5, 1, 5);
+    std::vector<bool> sparseBits = makeBits(20000, 0.01, 3, 6);
+    BitVector* dense = encode(denseBits);
+    BitVector* sparse = encode(sparseBits);
+    CPPUNIT_ASSERT(dense->getDense() != NULL);
+    CPPUNIT_ASSERT(sparse->getDense() == NULL);
+    
+    for(const BitVector* vector : {dense, sparse}) {
+        // Every thread checks every query, and notes if any disagree.
+        const size_t THREADS = 4;
+        std::vector<bool> agreed(THREADS, false);
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < THREADS; t++) {
+            threads.push_back(std::thread([&, t]() {
+                BitVectorIterator iterator(*vector);
+                bool agree = true;
+                for(size_t i = 0; i <= vector->getSize(); i++) {
+                    agree = agree &&
+                        vector->rank(i) == iterator.rank(i) &&
+                        vector->rank(i, true) == iterator.rank(i, true) &&
+                        vector->isSet(i) == iterator.isSet(i) &&
+                        vector->valueAfter(i) == iterator.valueAfter(i) &&
+                        vector->valueBefore(i) == iterator.valueBefore(i);
+                }
+                for(size_t i = 0; i < vector->getNumberOfItems(); i++) {
+                    agree = agree && vector->select(i) == iterator.select(i);
+                }
+                agreed[t] = agree;
+            }));
+        }
+        
+        for(size_t t = 0; t < THREADS; t++) {
+            threads[t].join();
+            CPPUNIT_ASSERT(agreed[t]);
+        }
+    }
+    
+    // And the answers should be right, not just the same.
+    for(size_t i = 0; i < sparseBits.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL((bool)sparseBits[i], sparse->isSet(i));
+        CPPUNIT_ASSERT_EQUAL((bool)denseBits[i], dense->isSet(i));
+    }
+    CPPUNIT_ASSERT_EQUAL(sparse->getNumberOfItems(),
+        sparse->rank(sparseBits.size() - 1));
+    CPPUNIT_ASSERT_EQUAL(sparseBits.size() - 1,
+        sparse->select(sparse->getNumberOfItems() - 1));
+    
+    delete dense;
+    delete sparse;
+}
+
+/**
+ * Read the whole of the given file into memory, to use in place.
+ */
+static std::vector<size_t> readWords(const std::string& filename) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    std::vector<size_t> buffer((boost::filesystem::file_size(filename) +
+        sizeof(size_t) - 1) / sizeof(size_t));
+    in.read((char*)buffer.data(), boost::filesystem::file_size(filename));
+    return buffer;
+}
+
+/**
+ * Make sure BitVectors keep their layout when saved and loaded in all the ways
+ * they can be, that older nibble-coded files still load, and that data used in
+ * place is never copied into the other layout.
+ */
+void BitVectorTests::testSavedLayouts() {
+    std::vector<bool> denseBits = makeBits(20000, 0.5, 1, 7);
+    std::vector<bool> sparseBits = makeBits(20000, 0.01, 3, 8);
+    
+    for(const std::vector<bool>* bits : {&denseBits, &sparseBits}) {
+        BitVector* vector = encode(*bits);
+        bool isDense = (vector->getDense() != NULL);
+        
+        std::string filename = tempDir + "/vector.bits";
+        {
+            std::ofstream out(filename.c_str(), std::ios::binary);
+            // Save through the base class, which must still save the layout
+            // we really have.
+            const CSA::BitVectorBase& base = *vector;
+            base.writeTo(out);
+            // Put something after it, to make sure we read the right amount.
+            size_t marker = 12345;
+            out.write((char*)&marker, sizeof(marker));
+        }
+        
+        // Read it back as a stream.
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        BitVector streamed(in);
+        size_t marker = 0;
+        in.read((char*)&marker, sizeof(marker));
+        CPPUNIT_ASSERT_EQUAL((size_t)12345, marker);
+        
+        // And as a FILE.
+        FILE* file = fopen(filename.c_str(), "rb");
+        BitVector read(file);
+        marker = 0;
+        CPPUNIT_ASSERT(fread(&marker, sizeof(marker), 1, file) == 1);
+        CPPUNIT_ASSERT_EQUAL((size_t)12345, marker);
+        fclose(file);
+        
+        // And in place from memory.
+        std::vector<size_t> buffer = readWords(filename);
+        BitVector mapped(buffer.data(), buffer.size());
+        
+        // Data used in place must all be there.
+        for(size_t words : {(size_t)0, (size_t)1, (size_t)3,
+            buffer.size() - 2}) {
+            CPPUNIT_ASSERT_THROW(BitVector(buffer.data(), words),
+                std::runtime_error);
+        }
+        
+        for(const BitVector* loaded : {&streamed, &read, &mapped}) {
+            CPPUNIT_ASSERT_EQUAL(isDense, loaded->getDense() != NULL);
+            CPPUNIT_ASSERT_EQUAL(vector->getBlockSize(),
+                loaded->getBlockSize());
+            CPPUNIT_ASSERT_EQUAL(vector->getNumberOfItems(),
+                loaded->getNumberOfItems());
+            for(size_t i = 0; i < bits->size(); i++) {
+                CPPUNIT_ASSERT_EQUAL((bool)(*bits)[i], loaded->isSet(i));
+            }
+        }
+        
+        if(isDense) {
+            // Used in place, the dense vector borrows all its bits.
+            CPPUNIT_ASSERT(mapped.reportSize() < read.reportSize());
+            
+            // A dense vector saved the old way becomes dense when read...
+            {
+                std::ofstream out(filename.c_str(), std::ios::binary);
+                BitVector::Encoder encoder(32);
+                for(size_t i = 0; i < bits->size(); i++) {
+                    if((*bits)[i]) {
+                        encoder.addBit(i);
+                    }
+                }
+                encoder.flush();
+                CSA::BitVectorBase nibbles(encoder, bits->size());
+                nibbles.writeTo(out);
+            }
+            std::ifstream old(filename.c_str(), std::ios::binary);
+            BitVector converted(old);
+            CPPUNIT_ASSERT(converted.getDense() != NULL);
+            
+            // But stays as it is when used in place.
+            std::vector<size_t> oldBuffer = readWords(filename);
+            BitVector borrowed(oldBuffer.data(), oldBuffer.size());
+            CPPUNIT_ASSERT(borrowed.getDense() == NULL);
+            for(size_t i = 0; i < bits->size(); i++) {
+                CPPUNIT_ASSERT_EQUAL((bool)(*bits)[i], converted.isSet(i));
+                CPPUNIT_ASSERT_EQUAL((bool)(*bits)[i], borrowed.isSet(i));
+            }
+        }
+        
+        delete vector;
+    }
+}
+
+/**
+ * Make sure walking through a BitVector with an iterator finds all the 1-bits
+ * in order, in either layout.
+ */
+void BitVectorTests::testIteration() {
+    std::vector<bool> bits = makeBits(20000, 0.5, 1, 9);
+    
+    // Count up the right answers.
+    std::vector<size_t> ones;
+    size_t runs = 0;
+    for(size_t i = 0; i < bits.size(); i++) {
+        if(bits[i]) {
+            ones.push_back(i);
+            if(i == 0 || !bits[i - 1]) {
+                runs++;
+            }
+        }
+    }
+    
+    // Get the dense layout, and the nibble-coded one by using it in place.
+    BitVector* dense = encode(bits);
+    CPPUNIT_ASSERT(dense->getDense() != NULL);
+    std::string filename = tempDir + "/nibbles.bits";
+    {
+        std::ofstream out(filename.c_str(), std::ios::binary);
+        BitVector::Encoder encoder(32);
+        for(size_t i : ones) {
+            encoder.addBit(i);
+        }
+        encoder.flush();
+        CSA::BitVectorBase nibbles(encoder, bits.size());
+        nibbles.writeTo(out);
+    }
+    std::vector<size_t> buffer = readWords(filename);
+    BitVector nibbles(buffer.data(), buffer.size());
+    CPPUNIT_ASSERT(nibbles.getDense() == NULL);
+    
+    for(const BitVector* vector : {dense, &nibbles}) {
+        // One at a time
+        BitVectorIterator iterator(*vector);
+        CPPUNIT_ASSERT_EQUAL(ones[0], iterator.select(0));
+        for(size_t i = 1; i < ones.size(); i++) {
+            CPPUNIT_ASSERT(iterator.hasNext());
+            CPPUNIT_ASSERT_EQUAL(ones[i], iterator.selectNext());
+        }
+        CPPUNIT_ASSERT(!iterator.hasNext());
+        
+        CPPUNIT_ASSERT(iterator.valueAfter(0) == pair_type(ones[0], 0));
+        for(size_t i = 1; i < ones.size(); i++) {
+            CPPUNIT_ASSERT(iterator.nextValue() == pair_type(ones[i], i));
+        }
+        
+        // A run at a time
+        size_t next = 0;
+        pair_type run = iterator.selectRun(0, ones.size());
+        while(run.first < bits.size()) {
+            for(size_t i = 0; i <= run.second; i++) {
+                CPPUNIT_ASSERT_EQUAL(ones[next], run.first + i);
+                next++;
+            }
+            run = iterator.selectNextRun(ones.size());
+        }
+        CPPUNIT_ASSERT_EQUAL(ones.size(), next);
+        
+        // And the runs counted
+        BitVectorIterator counter(*vector);
+        CPPUNIT_ASSERT_EQUAL(runs, counter.countRuns());
+    }
+    
+    delete dense;
+}
@@ -0,0 +1,36 @@
+#ifndef BITVECTORTESTS_HPP
+#define BITVECTORTESTS_HPP
+
+#include <string>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for BitVectors and their constant-time DenseBitVector layout.
+ */
+class BitVectorTests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(BitVectorTests);
+    CPPUNIT_TEST(testDenseQueries);
+    CPPUNIT_TEST(testLayoutChoice);
+    CPPUNIT_TEST(testDenseSave);
+    CPPUNIT_TEST(testConstQueries);
+    CPPUNIT_TEST(testSavedLayouts);
+    CPPUNIT_TEST(testIteration);
+    CPPUNIT_TEST_SUITE_END();
+    
+    // We need a temp directory to save vectors in.
+    std::string tempDir;
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testDenseQueries();
+    void testLayoutChoice();
+    void testDenseSave();
+    void testConstQueries();
+    void testSavedLayouts();
+    void testIteration();
+};
+
+#endif
@@ -3,12 +3,14 @@
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <iostream>
+#include <map>
 
 #include <ReadTable.h>
 #include <SuffixArray.h>
 
 #include "../FMDIndex.hpp"
 #include "../FMDIndexBuilder.hpp"
+#include "../InterleavedMapper.hpp"
 #include "../util.hpp"
 
 #include "FMDIndexTests.hpp"
@@ -182,6 +184,52 @@ void FMDIndexTests::testSearch() {
     
 }
 
+/**
+ * Test extending by all bases at once.
+ */
+void FMDIndexTests::testExtendAll() {
+    
+    // Try some things that appear different numbers of times, including a
+    // whole strand.
+    std::vector<std::string> patterns;
+    patterns.push_back("C");
+    patterns.push_back("TTCG");
+    patterns.push_back("TCTTTT");
+    patterns.push_back("CGGGCGCATCGCTATTATTTCTTTCTCTTTTCACA");
+    
+    for(size_t i = 0; i < patterns.size(); i++) {
+        FMDPosition range = index->count(patterns[i]);
+        
+        for(int backward = 0; backward < 2; backward++) {
+            FMDExtensions extensions = index->extendAll(range, backward);
+            
+            int64_t total = extensions.endOfTextLength;
+            for(size_t base = 0; base < NUM_BASES; base++) {
+                // Each child should be what we get extending with just that
+                // base.
+                FMDPosition child = range;
+                index->extendFast(child, BASES[base], backward);
+                CPPUNIT_ASSERT(extensions.children[base] == child);
+                CPPUNIT_ASSERT(extensions.get(BASES[base]) == child);
+                
+                total += child.getLength();
+            }
+            
+            // Everything should be accounted for.
+            CPPUNIT_ASSERT(total == range.getLength());
+        }
+    }
+    
+    // The whole strand runs into the end of the text on both sides.
+    FMDPosition strand = index->count(patterns[3]);
+    CPPUNIT_ASSERT(index->extendAll(strand, true).endOfTextLength == 1);
+    CPPUNIT_ASSERT(index->extendAll(strand, false).endOfTextLength == 1);
+    
+    // Only real bases have extensions.
+    CPPUNIT_ASSERT_THROW(index->extendAll(strand, true).get('N'),
+        std::runtime_error);
+}
+
 /**
  * Test locating the positions of things you search up.
  */
@@ -214,6 +262,39 @@ void FMDIndexTests::testLocate() {
     CPPUNIT_ASSERT(base.getOffset() == 0);
 }
 
+/**
+ * Test locating lots of things at once.
+ */
+void FMDIndexTests::testLocateBatch() {
+
+    // Locate everything, backwards, with some things more than once.
+    std::vector<int64_t> indices;
+    for(int64_t i = index->getBWTLength() - 1; i >= 0; i--) {
+        indices.push_back(i);
+        if(i % 7 == 0) {
+            indices.push_back(i);
+        }
+    }
+    
+    std::vector<TextPosition> positions = index->locateBatch(indices);
+    CPPUNIT_ASSERT(positions.size() == indices.size());
+    
+    for(size_t i = 0; i < indices.size(); i++) {
+        // Make sure each matches locating on its own.
+        CPPUNIT_ASSERT(positions[i] == index->locate(indices[i]));
+    }
+    
+    // Locate something that appears twice.
+    FMDPosition range = index->count("TTCG");
+    positions = index->locateRange(range);
+    CPPUNIT_ASSERT(positions.size() == 2);
+    CPPUNIT_ASSERT(positions[0] == index->locate(range.getForwardStart()));
+    CPPUNIT_ASSERT(positions[1] == index->locate(range.getForwardStart() + 1));
+    
+    // Nothing to locate in an empty range.
+    CPPUNIT_ASSERT(index->locateRange(index->count("GATTACA")).size() == 0);
+}
+
 /**
  * Test iterating over the suffix tree.
  */
@@ -240,6 +321,63 @@ void FMDIndexTests::testIterate() {
 
 }
 
+/**
+ * A SuffixTreeVisitor that remembers everything it sees, by subtree.
+ */
+class CollectingVisitor: public SuffixTreeVisitor {
+public:
+    void start(size_t subtrees) {
+        seen.resize(subtrees);
+    }
+    
+    void visit(size_t subtree, const char* pattern, size_t length,
+        const FMDPosition& range) {
+        // Each subtree only gets visited by one thread.
+        seen[subtree].push_back(std::make_pair(std::string(pattern, length),
+            range));
+    }
+    
+    std::vector<std::vector<std::pair<std::string, FMDPosition> > > seen;
+};
+
+/**
+ * Make sure the parallel traversal sees the same things as the iterator.
+ */
+void FMDIndexTests::testTraverse() {
+
+    for(int contextLength = 1; contextLength <= 25; contextLength += 3) {
+        for(int deadEnds = 0; deadEnds < 2; deadEnds++) {
+            // Get everything the iterator gets, in order.
+            std::vector<std::pair<std::string, FMDPosition> > expected;
+            for(FMDIndex::iterator i = index->begin(contextLength, deadEnds); 
+                i != index->end(contextLength, deadEnds); ++i) {
+                
+                expected.push_back(*i);
+            }
+            
+            for(size_t splitDepth = 0; splitDepth < 6; splitDepth += 2) {
+                // Traverse split up various ways.
+                CollectingVisitor visitor;
+                index->traverse(visitor, contextLength, deadEnds, splitDepth,
+                    4);
+                
+                // Put the subtrees back together.
+                std::vector<std::pair<std::string, FMDPosition> > found;
+                for(size_t j = 0; j < visitor.seen.size(); j++) {
+                    found.insert(found.end(), visitor.seen[j].begin(), 
+                        visitor.seen[j].end());
+                }
+                
+                CPPUNIT_ASSERT(found == expected);
+            }
+        }
+    }
+    
+    // Depth 0 isn't allowed.
+    CollectingVisitor visitor;
+    CPPUNIT_ASSERT_THROW(index->traverse(visitor, 0), std::runtime_error);
+}
+
 /**
  * Make sure disambiguating of Mappings works.
  */
@@ -302,6 +440,308 @@ void FMDIndexTests::testMap() {
     }
 }
 
+/**
+ * Make sure mapping many queries at once gets the same results as mapping them
+ * one at a time.
+ */
+void FMDIndexTests::testMapBatch() {
+    
+    // Grab both strands of the first contig, plus some things that don't map
+    // all the way through.
+    std::vector<std::string> queries;
+    queries.push_back("CATGCTTCGGCGATTCGACGCTCATCTGCGACTCT");
+    queries.push_back("AGAGTCGCAGATGAGCGTCGAATCGCCGAAGCATG");
+    queries.push_back("CATGCTTCGGAAAAAAAAAACTCATCTGCGACTCT");
+    queries.push_back("GATTACA");
+    queries.push_back("");
+    
+    for(size_t copy = 0; copy < 5; copy++) {
+        // Have more queries than go through at once.
+        for(size_t i = 0; i < 5; i++) {
+            queries.push_back(queries[i]);
+        }
+    }
+    
+    // Left-map them all at once.
+    std::vector<std::vector<Mapping>> batch = index->mapBatch(queries);
+    CPPUNIT_ASSERT(batch.size() == queries.size());
+    
+    for(size_t i = 0; i < queries.size(); i++) {
+        // Make sure each matches mapping on its own.
+        CPPUNIT_ASSERT(batch[i] == index->map(queries[i]));
+    }
+    
+    // Make a range vector with a range for every 3 positions.
+    BitVectorEncoder encoder(32);
+    for(int64_t i = 3; i < index->getBWTLength(); i += 3) {
+        encoder.addBit(i);
+    }
+    encoder.addBit(index->getBWTLength());
+    encoder.flush();
+    BitVector ranges(encoder, index->getBWTLength() + 1);
+    
+    // Right-map them all at once to the ranges, in a genome.
+    std::vector<std::vector<std::pair<int64_t,size_t>>> rangeBatch =
+        index->mapBatch(ranges, queries, &index->getGenomeMask(0), 2);
+    CPPUNIT_ASSERT(rangeBatch.size() == queries.size());
+    
+    for(size_t i = 0; i < queries.size(); i++) {
+        // Make sure each matches mapping on its own.
+        CPPUNIT_ASSERT(rangeBatch[i] == index->map(ranges, queries[i],
+            (int64_t)0, 2));
+    }
+}
+
+/**
+ * Test mapping to several levels of ranges at once.
+ */
+void FMDIndexTests::testMapLevels() {
+    
+    // Make range vectors with ranges of a few different sizes, including one
+    // where every position is its own range.
+    std::vector<BitVector*> ownedLevels;
+    std::vector<const BitVector*> levels;
+    size_t spacings[] = {1, 3, 7, 1000};
+    for(size_t spacing : spacings) {
+        BitVectorEncoder encoder(32);
+        for(int64_t i = spacing; i < index->getBWTLength(); i += spacing) {
+            encoder.addBit(i);
+        }
+        encoder.addBit(index->getBWTLength());
+        encoder.flush();
+        ownedLevels.push_back(new BitVector(encoder,
+            index->getBWTLength() + 1));
+        levels.push_back(ownedLevels.back());
+    }
+    
+    std::vector<std::string> queries;
+    queries.push_back("CATGCTTCGGCGATTCGACGCTCATCTGCGACTCT");
+    queries.push_back("AGAGTCGCAGATGAGCGTCGAATCGCCGAAGCATG");
+    queries.push_back("CATGCTTCGGAAAAAAAAAACTCATCTGCGACTCT");
+    queries.push_back("GATTACA");
+    queries.push_back("");
+    
+    for(const std::string& query : queries) {
+        for(int64_t genome = -1; genome < 1; genome++) {
+            // Map everywhere and in a genome.
+            std::vector<std::vector<std::pair<int64_t,size_t>>> mappings =
+                index->mapLevels(levels, query, genome, 2);
+            CPPUNIT_ASSERT(mappings.size() == levels.size());
+            
+            for(size_t level = 0; level < levels.size(); level++) {
+                // Make sure each level matches mapping to it on its own.
+                CPPUNIT_ASSERT(mappings[level] == index->map(*levels[level],
+                    query, genome, 2));
+            }
+        }
+        
+        if(query.size() > 10) {
+            // Map just part of it.
+            std::vector<std::vector<std::pair<int64_t,size_t>>> mappings =
+                index->mapLevels(levels, query, (int64_t)-1, 0, 5, 10);
+            for(size_t level = 0; level < levels.size(); level++) {
+                CPPUNIT_ASSERT(mappings[level] == index->map(*levels[level],
+                    query, (int64_t)-1, 0, 5, 10));
+            }
+        }
+    }
+    
+    // With no levels, we get no results.
+    CPPUNIT_ASSERT(index->mapLevels(std::vector<const BitVector*>(),
+        queries[0]).size() == 0);
+    
+    for(BitVector* level : ownedLevels) {
+        delete level;
+    }
+}
+
+/**
+ * Test mapping under several masks at once.
+ */
+void FMDIndexTests::testMapMasks() {
+    
+    // Make masks with each contig, and with everything.
+    std::vector<BitVector*> ownedMasks;
+    std::vector<const BitVector*> masks;
+    for(int64_t contig = -1; contig < 2; contig++) {
+        BitVectorEncoder encoder(32);
+        for(int64_t i = 0; i < index->getBWTLength(); i++) {
+            if(contig == -1 || index->locate(i).getText() / 2 == contig) {
+                encoder.addBit(i);
+            }
+        }
+        encoder.flush();
+        ownedMasks.push_back(new BitVector(encoder, index->getBWTLength()));
+        masks.push_back(ownedMasks.back());
+    }
+    
+    std::vector<std::string> strings;
+    strings.push_back("CATGCTTCGGCGATTCGACGCTCATCTGCGACTCT");
+    strings.push_back("AGAGTCGCAGATGAGCGTCGAATCGCCGAAGCATG");
+    strings.push_back("CATGCTTCGGAAAAAAAAAACTCATCTGCGACTCT");
+    strings.push_back("CGGGCGCATCGCTATTCGACGCTCTTTTCACACTTCGG");
+    strings.push_back("");
+    
+    std::vector<MapQuery> queries(strings.size());
+    for(size_t i = 0; i < strings.size(); i++) {
+        queries[i].text = &strings[i];
+        queries[i].start = 0;
+        queries[i].length = strings[i].size();
+    }
+    
+    std::vector<std::vector<std::vector<Mapping>>> mappings =
+        InterleavedMapper(*index).mapMasks(masks, queries, 2);
+    CPPUNIT_ASSERT(mappings.size() == queries.size());
+    
+    for(size_t i = 0; i < strings.size(); i++) {
+        CPPUNIT_ASSERT(mappings[i].size() == masks.size());
+        for(size_t k = 0; k < masks.size(); k++) {
+            // Make sure each mask matches mapping under it on its own.
+            CPPUNIT_ASSERT(mappings[i][k] == index->map(strings[i], masks[k],
+                2));
+        }
+        
+        // Mapping both ways to the same genome twice should get the same
+        // thing twice, and match mapping to it alone.
+        std::vector<size_t> genomes(2, 0);
+        std::vector<std::vector<Mapping>> both = index->mapBoth(strings[i],
+            genomes, 2);
+        CPPUNIT_ASSERT(both.size() == 2);
+        CPPUNIT_ASSERT(both[0] == index->mapBoth(strings[i], (int64_t)0, 2));
+        CPPUNIT_ASSERT(both[1] == both[0]);
+    }
+    
+    // We can't map to genomes that aren't there.
+    CPPUNIT_ASSERT_THROW(index->mapBoth(strings[0], std::vector<size_t>(1, 1)),
+        std::runtime_error);
+    
+    for(BitVector* mask : ownedMasks) {
+        delete mask;
+    }
+}
+
+/**
+ * Find the SMEMs of a query the slow way, by trying every substring.
+ */
+static std::vector<SMEM> findSMEMsSlowly(const FMDIndex& index,
+    const std::string& query, const BitVector* mask) {
+    
+    // Work out which substrings [start, end) occur at all.
+    size_t n = query.size();
+    std::vector<std::vector<bool>> occurs(n + 1,
+        std::vector<bool>(n + 1, false));
+    for(size_t start = 0; start < n; start++) {
+        for(size_t end = start + 1; end <= n && isBase(query[end - 1]);
+            end++) {
+            
+            occurs[start][end] = !index.count(query.substr(start,
+                end - start)).isEmpty(mask);
+        }
+    }
+    
+    // Find the maximal ones.
+    std::vector<std::pair<size_t, size_t>> mems;
+    for(size_t start = 0; start < n; start++) {
+        for(size_t end = start + 1; end <= n; end++) {
+            if(occurs[start][end] && (start == 0 ||
+                !occurs[start - 1][end]) && (end == n ||
+                !occurs[start][end + 1])) {
+                
+                mems.push_back(std::make_pair(start, end));
+            }
+        }
+    }
+    
+    // Keep the ones not inside any other.
+    std::vector<SMEM> smems;
+    for(size_t i = 0; i < mems.size(); i++) {
+        bool contained = false;
+        for(size_t j = 0; j < mems.size(); j++) {
+            if(j != i && mems[j].first <= mems[i].first &&
+                mems[j].second >= mems[i].second) {
+                contained = true;
+            }
+        }
+        if(!contained) {
+            SMEM smem;
+            smem.start = mems[i].first;
+            smem.length = mems[i].second - mems[i].first;
+            smem.position = index.count(query.substr(smem.start,
+                smem.length));
+            smems.push_back(smem);
+        }
+    }
+    return smems;
+}
+
+/**
+ * Test finding super-maximal exact matches.
+ */
+void FMDIndexTests::testFindSMEMs() {
+    
+    // Make some queries that match in pieces.
+    std::vector<std::string> queries;
+    queries.push_back("CATGCTTCGGCGATTCGACGCTCATCTGCGACTCT");
+    queries.push_back("CATGCTTCGGAAAAAAAAAACTCATCTGCGACTCT");
+    queries.push_back("CGGGCGCATCGCTANTATTTCTTTCTCTTTTCACACTTCGG");
+    queries.push_back("ATCTGCGACTCTCGGGCGCATCGCTATTCGACGCTCTTTTC");
+    queries.push_back("NNGATTACANN");
+    queries.push_back("");
+    
+    // Make a mask with just the first contig, like a genome mask would have.
+    BitVectorEncoder encoder(32);
+    for(int64_t i = 0; i < index->getBWTLength(); i++) {
+        if(index->locate(i).getText() / 2 == 0) {
+            encoder.addBit(i);
+        }
+    }
+    encoder.flush();
+    BitVector mask(encoder, index->getBWTLength());
+    
+    for(size_t i = 0; i < queries.size(); i++) {
+        std::vector<SMEM> expected = findSMEMsSlowly(*index, queries[i], NULL);
+        std::vector<SMEM> smems = index->findSMEMs(queries[i]);
+        
+        CPPUNIT_ASSERT(smems.size() == expected.size());
+        for(size_t j = 0; j < smems.size(); j++) {
+            // They should all be the same, in the same order.
+            CPPUNIT_ASSERT(smems[j].start == expected[j].start);
+            CPPUNIT_ASSERT(smems[j].length == expected[j].length);
+            CPPUNIT_ASSERT(smems[j].position == expected[j].position);
+        }
+        
+        // Long ones should be the only ones left with a minimum length.
+        std::vector<SMEM> longSMEMs = index->findSMEMs(queries[i], 10);
+        size_t longCount = 0;
+        for(size_t j = 0; j < expected.size(); j++) {
+            if(expected[j].length >= 10) {
+                CPPUNIT_ASSERT(longCount < longSMEMs.size());
+                CPPUNIT_ASSERT(longSMEMs[longCount].start == expected[j].start);
+                longCount++;
+            }
+        }
+        CPPUNIT_ASSERT(longSMEMs.size() == longCount);
+        
+        // Only masked occurrences should count when we have a mask.
+        expected = findSMEMsSlowly(*index, queries[i], &mask);
+        smems = index->findSMEMs(queries[i], 1, &mask);
+        
+        CPPUNIT_ASSERT(smems.size() == expected.size());
+        for(size_t j = 0; j < smems.size(); j++) {
+            CPPUNIT_ASSERT(smems[j].start == expected[j].start);
+            CPPUNIT_ASSERT(smems[j].length == expected[j].length);
+            CPPUNIT_ASSERT(smems[j].position.getLength(&mask) ==
+                expected[j].position.getLength(&mask));
+        }
+    }
+    
+    // The whole of a contig should be one SMEM.
+    std::vector<SMEM> smems = index->findSMEMs(queries[0]);
+    CPPUNIT_ASSERT(smems.size() == 1);
+    CPPUNIT_ASSERT(smems[0].start == 0);
+    CPPUNIT_ASSERT(smems[0].length == queries[0].size());
+}
+
 /**
  * Make sure minimum context length is respected.
  */
@@ -338,13 +778,135 @@ void FMDIndexTests::testContextLimit() {
     }
 }
 
+/**
+ * Make sure mapping with edits matches exact mapping when no edits are
+ * allowed, and maps through small indels when they are.
+ */
+void FMDIndexTests::testEditMap() {
+    
+    // Make a range vector where every position is its own range.
+    BitVectorEncoder encoder(32);
+    for(int64_t i = 0; i < index->getBWTLength(); i++) {
+        encoder.addBit(i);
+    }
+    encoder.addBit(index->getBWTLength());
+    encoder.flush();
+    BitVector ranges(encoder, index->getBWTLength() + 1);
+    
+    // Grab all of the first contig, and copies with a base deleted and a base
+    // inserted after the first 16.
+    std::string query = "CATGCTTCGGCGATTCGACGCTCATCTGCGACTCT";
+    std::string deleted = "CATGCTTCGGCGATTCACGCTCATCTGCGACTCT";
+    std::string inserted = "CATGCTTCGGCGATTCGTACGCTCATCTGCGACTCT";
+    
+    std::vector<std::string> queries;
+    queries.push_back(query);
+    queries.push_back(deleted);
+    queries.push_back(inserted);
+    queries.push_back("ATCTGCGACTCTCGGGCGCATCGCTATTCGACGCTCTTTTC");
+    queries.push_back("");
+    
+    for(size_t i = 0; i < queries.size(); i++) {
+        for(int minContext = 0; minContext <= 10; minContext += 10) {
+            // With no edits, it should be the same as exact mapping.
+            CPPUNIT_ASSERT(index->editMap(ranges, queries[i], (int64_t)-1,
+                minContext, 0) == index->map(ranges, queries[i], (int64_t)-1,
+                minContext));
+        }
+    }
+    
+    std::vector<std::pair<int64_t,size_t>> exact = index->map(ranges, query,
+        (int64_t)-1, 10);
+    std::vector<std::pair<int64_t,size_t>> exactDeleted = index->map(ranges,
+        deleted, (int64_t)-1, 10);
+    std::vector<std::pair<int64_t,size_t>> editDeleted = index->editMap(ranges,
+        deleted, (int64_t)-1, 10, 1);
+    std::vector<std::pair<int64_t,size_t>> editInserted = index->editMap(
+        ranges, inserted, (int64_t)-1, 10, 1);
+    
+    // Exact mapping can't get enough context for some bases before the indel.
+    CPPUNIT_ASSERT(exactDeleted[10].first == -1);
+    
+    for(size_t i = 0; i < 16; i++) {
+        // But with an edit, everything before it maps where it should.
+        CPPUNIT_ASSERT(exact[i].first != -1);
+        CPPUNIT_ASSERT(editDeleted[i].first == exact[i].first);
+        CPPUNIT_ASSERT(editInserted[i].first == exact[i].first);
+    }
+    
+    // The same should happen in a genome.
+    CPPUNIT_ASSERT(index->editMap(ranges, deleted, (int64_t)0, 10, 1) ==
+        editDeleted);
+}
 
-
-
-
-
-
-
-
-
-
+/**
+ * Test breaking down the memory used by an index, and dropping the full suffix
+ * array it was built with.
+ */
+void FMDIndexTests::testReportMemory() {
+    MemoryReport report = index->reportMemory();
+    
+    // Collect the parts by name, and make sure they add up.
+    std::map<std::string, size_t> parts;
+    size_t total = 0;
+    for(auto& part : report.getParts()) {
+        parts[part.first] = part.second;
+        total += part.second;
+    }
+    CPPUNIT_ASSERT(total == report.getTotal());
+    CPPUNIT_ASSERT(parts["bwt.runs"] > 0);
+    CPPUNIT_ASSERT(parts["sampledSuffixArray"] > 0);
+    CPPUNIT_ASSERT(parts["genomeMasks"] > 0);
+    CPPUNIT_ASSERT(parts["contigs"] > 0);
+    // The loaded index has no full suffix array.
+    CPPUNIT_ASSERT(parts.count("fullSuffixArray") == 0);
+    
+    // Reports nest under a prefix.
+    MemoryReport outer;
+    outer.add("index", report);
+    CPPUNIT_ASSERT(outer.getTotal() == report.getTotal());
+    CPPUNIT_ASSERT(outer.getParts().front().first == "index.bwt.runs");
+    
+    // An index fresh from the builder still has its full suffix array, and
+    // saves one too.
+    FMDIndexBuilder builder(tempDir + "/built", 64, false, 0, false, false,
+        true);
+    builder.add(filename);
+    FMDIndex* built = builder.build();
+    
+    report = built->reportMemory();
+    bool hasFull = false;
+    for(auto& part : report.getParts()) {
+        if(part.first == "fullSuffixArray") {
+            hasFull = true;
+            CPPUNIT_ASSERT(part.second >= built->getBWTLength() *
+                sizeof(SAElem));
+        }
+    }
+    CPPUNIT_ASSERT(hasFull);
+    
+    // Remember where everything is.
+    std::vector<TextPosition> before;
+    for(int64_t i = 0; i < built->getBWTLength(); i++) {
+        before.push_back(built->locate(i));
+    }
+    
+    // Drop it, and we should fall back to the saved one.
+    CPPUNIT_ASSERT(built->dropFullSuffixArray() > 0);
+    CPPUNIT_ASSERT(built->dropFullSuffixArray() == 0);
+    
+    report = built->reportMemory();
+    bool hasPacked = false;
+    for(auto& part : report.getParts()) {
+        CPPUNIT_ASSERT(part.first != "fullSuffixArray");
+        hasPacked = hasPacked || part.first == "packedSuffixArray";
+    }
+    CPPUNIT_ASSERT(hasPacked);
+    
+    for(int64_t i = 0; i < built->getBWTLength(); i++) {
+        // Everything is still in the same place.
+        CPPUNIT_ASSERT(built->locate(i) == before[i]);
+    }
+    
+    delete built;
+}
@@ -14,11 +14,20 @@ class FMDIndexTests : public CppUnit::TestFixture {
     CPPUNIT_TEST(testMetadata);
     CPPUNIT_TEST(testLF);
     CPPUNIT_TEST(testSearch);
+    CPPUNIT_TEST(testExtendAll);
     CPPUNIT_TEST(testLocate);
+    CPPUNIT_TEST(testLocateBatch);
     CPPUNIT_TEST(testIterate);
+    CPPUNIT_TEST(testTraverse);
     CPPUNIT_TEST(testDisambiguate);
     CPPUNIT_TEST(testMap);
+    CPPUNIT_TEST(testMapBatch);
+    CPPUNIT_TEST(testMapLevels);
+    CPPUNIT_TEST(testMapMasks);
+    CPPUNIT_TEST(testFindSMEMs);
     CPPUNIT_TEST(testContextLimit);
+    CPPUNIT_TEST(testEditMap);
+    CPPUNIT_TEST(testReportMemory);
     CPPUNIT_TEST_SUITE_END();
     
     // Keep a string saying where to get the haplotypes to test with.
@@ -43,11 +52,20 @@ public:
     void testDump();
     void testDisplay();
     void testSearch();
+    void testExtendAll();
     void testLocate();
+    void testLocateBatch();
     void testIterate();
+    void testTraverse();
     void testDisambiguate();
     void testMap();
+    void testMapBatch();
+    void testMapLevels();
+    void testMapMasks();
+    void testFindSMEMs();
     void testContextLimit();
+    void testEditMap();
+    void testReportMemory();
 };
 
 #endif
@@ -0,0 +1,351 @@
+// Test LCPArray objects.
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#include "../LCPArray.hpp"
+#include "../FMDIndex.hpp"
+#include "../FMDIndexBuilder.hpp"
+#include "../util.hpp"
+
+#include "LCPArrayTests.hpp"
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( LCPArrayTests );
+
+void LCPArrayTests::setUp() {
+    tempDir = make_tempdir();
+}
+
+
+void LCPArrayTests::tearDown() {
+    boost::filesystem::remove_all(tempDir);
+}
+
+/**
+ * Make a FASTA file with some related sequences, so there are long repeats and
+ * places where they differ, and return its name.
+ */
+static std::string makeRepeats(const std::string& tempDir) {
+    // Always make the same sequences.
+    srand(41);
+    
+    std::string bases = "ACGT";
+    std::string ancestor;
+    for(size_t i = 0; i < 2000; i++) {
+        ancestor.push_back(bases[rand() % 4]);
+    }
+    
+    std::string filename = tempDir + "/repeats.fa";
+    std::ofstream fasta(filename.c_str());
+    for(size_t copy = 0; copy < 3; copy++) {
+        // Each copy has its own changes.
+        std::string sequence = ancestor;
+        for(size_t i = 0; i < sequence.size(); i += 1 + rand() % 100) {
+            sequence[i] = bases[rand() % 4];
+        }
+        fasta << ">copy" << copy << std::endl << sequence << std::endl;
+    }
+    fasta.close();
+    
+    return filename;
+}
+
+/**
+ * Test finding small values around an index, across blocks.
+ */
+void LCPArrayTests::testFind() {
+    LCPArray::Writer writer(tempDir + "/test.lcp");
+    for(size_t i = 0; i < 1000; i++) {
+        // Make a few small values in a sea of big ones, and some too big to
+        // store.
+        if(i == 0 || i == 10 || i == 600) {
+            writer.addValue(1);
+        } else if(i == 300) {
+            writer.addValue(1000);
+        } else {
+            writer.addValue(50);
+        }
+    }
+    writer.close();
+    
+    LCPArray lcp(tempDir + "/test.lcp");
+    
+    // We get the trailing 0 too.
+    CPPUNIT_ASSERT(lcp.getLength() == 1001);
+    CPPUNIT_ASSERT(lcp.get(1000) == 0);
+    CPPUNIT_ASSERT(lcp.get(300) == LCPArray::MAX_VALUE);
+    CPPUNIT_ASSERT(lcp.get(20) == 50);
+    
+    // Look from inside and outside the blocks with small values.
+    CPPUNIT_ASSERT(lcp.findBefore(10, 2) == 10);
+    CPPUNIT_ASSERT(lcp.findBefore(9, 2) == 0);
+    CPPUNIT_ASSERT(lcp.findBefore(599, 2) == 10);
+    CPPUNIT_ASSERT(lcp.findBefore(999, 2) == 600);
+    CPPUNIT_ASSERT(lcp.findBefore(999, 51) == 999);
+    CPPUNIT_ASSERT(lcp.findAfter(11, 2) == 600);
+    CPPUNIT_ASSERT(lcp.findAfter(601, 2) == 1000);
+    CPPUNIT_ASSERT(lcp.findAfter(1, 51) == 1);
+    CPPUNIT_ASSERT(lcp.findAfter(300, 51) == 301);
+    
+    // Things that aren't LCP arrays shouldn't load.
+    std::ofstream junk((tempDir + "/junk.lcp").c_str());
+    junk << "This is not an LCP array at all." << std::endl;
+    junk.close();
+    CPPUNIT_ASSERT_THROW(LCPArray(tempDir + "/junk.lcp"), std::runtime_error);
+}
+
+/**
+ * Test that a built LCP array matches the suffixes it describes.
+ */
+void LCPArrayTests::testValues() {
+    FMDIndexBuilder builder(tempDir + "/index", 64, false, 0, true);
+    builder.add(makeRepeats(tempDir));
+    FMDIndex* index = builder.build();
+    
+    CPPUNIT_ASSERT(index->hasLCP());
+    LCPArray lcp(tempDir + "/index.lcp");
+    CPPUNIT_ASSERT(lcp.getLength() == (size_t)index->getBWTLength() + 1);
+    
+    // Get every contig, so we can read suffixes off of them.
+    std::vector<std::string> contigs;
+    for(size_t i = 0; i < index->getNumberOfContigs(); i++) {
+        std::string contig = index->displayContig(i);
+        contigs.push_back(contig);
+        contigs.push_back(reverseComplement(contig));
+    }
+    
+    std::string last;
+    for(int64_t i = 0; i < index->getBWTLength(); i++) {
+        TextPosition position = index->locate(i);
+        std::string suffix = contigs[position.getText()].substr(
+            position.getOffset());
+        
+        // Count the shared prefix with the suffix before.
+        size_t shared = 0;
+        while(shared < suffix.size() && shared < last.size() &&
+            suffix[shared] == last[shared]) {
+            shared++;
+        }
+        if(i == 0) {
+            shared = 0;
+        }
+        
+        CPPUNIT_ASSERT(lcp.get(i) == std::min(shared,
+            (size_t)LCPArray::MAX_VALUE));
+        last = suffix;
+    }
+    
+    delete index;
+}
+
+/**
+ * Test contracting searches back to shorter patterns.
+ */
+void LCPArrayTests::testContract() {
+    std::string filename = makeRepeats(tempDir);
+    
+    FMDIndexBuilder plainBuilder(tempDir + "/plain");
+    plainBuilder.add(filename);
+    FMDIndex* plain = plainBuilder.build();
+    
+    FMDIndexBuilder builder(tempDir + "/index", 64, false, 0, true);
+    builder.add(filename);
+    FMDIndex* index = builder.build();
+    
+    // Without the array, we can't contract.
+    CPPUNIT_ASSERT(!plain->hasLCP());
+    size_t length = 1;
+    CPPUNIT_ASSERT(plain->contract(plain->getCharPosition('A'), length,
+        false).isEmpty());
+    
+    std::string contig = index->displayContig(0);
+    for(size_t start = 0; start + 40 < contig.size(); start += 37) {
+        std::string pattern = contig.substr(start, 40);
+        
+        // Contract from the right, and make sure we get exactly the shorter
+        // pattern with more occurrences.
+        size_t forwardLength = pattern.size();
+        FMDPosition forward = index->contract(index->count(pattern),
+            forwardLength, false);
+        CPPUNIT_ASSERT(!forward.isEmpty());
+        CPPUNIT_ASSERT(forwardLength < pattern.size());
+        FMDPosition shorter = index->count(pattern.substr(0, forwardLength));
+        CPPUNIT_ASSERT(forward.getForwardStart() ==
+            shorter.getForwardStart());
+        CPPUNIT_ASSERT(forward.getEndOffset() == shorter.getEndOffset());
+        CPPUNIT_ASSERT(index->count(pattern.substr(0, forwardLength + 1)
+            ).getEndOffset() == index->count(pattern).getEndOffset());
+        
+        // Contract from the left the same way.
+        size_t backwardLength = pattern.size();
+        FMDPosition backward = index->contract(index->count(pattern),
+            backwardLength, true);
+        CPPUNIT_ASSERT(!backward.isEmpty());
+        shorter = index->count(pattern.substr(pattern.size() -
+            backwardLength));
+        CPPUNIT_ASSERT(backward.getReverseStart() ==
+            shorter.getReverseStart());
+        CPPUNIT_ASSERT(backward.getEndOffset() == shorter.getEndOffset());
+        CPPUNIT_ASSERT(index->count(pattern.substr(pattern.size() -
+            backwardLength - 1)).getEndOffset() ==
+            index->count(pattern).getEndOffset());
+    }
+    
+    delete plain;
+    delete index;
+}
+
+/**
+ * Test that mapping gives the same results when it contracts searches as when
+ * it restarts them.
+ */
+void LCPArrayTests::testMapping() {
+    std::string filename = makeRepeats(tempDir);
+    
+    FMDIndexBuilder plainBuilder(tempDir + "/plain");
+    plainBuilder.add(filename);
+    FMDIndex* plain = plainBuilder.build();
+    
+    FMDIndexBuilder builder(tempDir + "/index", 64, false, 0, true);
+    builder.add(filename);
+    FMDIndex* index = builder.build();
+    
+    // Make ranges of a few positions each.
+    BitVectorEncoder encoder(32);
+    for(int64_t i = 5; i < index->getBWTLength(); i += 5) {
+        encoder.addBit(i);
+    }
+    encoder.addBit(index->getBWTLength());
+    encoder.flush();
+    BitVector ranges(encoder, index->getBWTLength() + 1);
+    
+    // Make queries that wander between the copies, so searches keep failing
+    // and having to be redone.
+    std::string bases = "ACGT";
+    std::vector<std::string> queries;
+    for(size_t i = 0; i < 10; i++) {
+        std::string query;
+        while(query.size() < 500) {
+            std::string contig = index->displayContig(rand() %
+                index->getNumberOfContigs());
+            query += contig.substr(rand() % (contig.size() - 50), 50);
+            query[query.size() - 1] = bases[rand() % 4];
+        }
+        queries.push_back(query);
+    }
+    
+    for(const std::string& query : queries) {
+        for(int minContext = 0; minContext < 30; minContext += 20) {
+            CPPUNIT_ASSERT(index->map(query, (int64_t)-1, minContext) ==
+                plain->map(query, (int64_t)-1, minContext));
+            CPPUNIT_ASSERT(index->mapBoth(query, (int64_t)-1, minContext) ==
+                plain->mapBoth(query, (int64_t)-1, minContext));
+            CPPUNIT_ASSERT(index->map(ranges, query, (int64_t)-1,
+                minContext) == plain->map(ranges, query, (int64_t)-1,
+                minContext));
+        }
+    }
+    
+    CPPUNIT_ASSERT(index->mapBatch(queries) == plain->mapBatch(queries));
+    
+    delete plain;
+    delete index;
+}
+
+/**
+ * Test that mapping under masks gives the same results when it contracts
+ * searches as when it restarts them.
+ */
+void LCPArrayTests::testMaskedMapping() {
+    std::string filename = makeRepeats(tempDir);
+    
+    // Make a second genome with more changes to the same copies, so contexts
+    // can be in one genome and not the other.
+    std::string otherFilename = tempDir + "/other.fa";
+    std::ifstream fasta(filename.c_str());
+    std::ofstream other(otherFilename.c_str());
+    std::string bases = "ACGT";
+    std::string line;
+    while(std::getline(fasta, line)) {
+        if(line.size() > 0 && line[0] != '>') {
+            for(size_t i = 0; i < line.size(); i += 1 + rand() % 50) {
+                line[i] = bases[rand() % 4];
+            }
+        }
+        other << line << std::endl;
+    }
+    fasta.close();
+    other.close();
+    
+    FMDIndexBuilder plainBuilder(tempDir + "/plain");
+    plainBuilder.add(filename);
+    plainBuilder.add(otherFilename);
+    FMDIndex* plain = plainBuilder.build();
+    
+    FMDIndexBuilder builder(tempDir + "/index", 64, false, 0, true);
+    builder.add(filename);
+    builder.add(otherFilename);
+    FMDIndex* index = builder.build();
+    
+    // Make ranges of a few positions each.
+    BitVectorEncoder encoder(32);
+    for(int64_t i = 5; i < index->getBWTLength(); i += 5) {
+        encoder.addBit(i);
+    }
+    encoder.addBit(index->getBWTLength());
+    encoder.flush();
+    BitVector ranges(encoder, index->getBWTLength() + 1);
+    
+    // Make a mask that isn't a genome mask, and doesn't treat the strands
+    // alike.
+    BitVectorEncoder maskEncoder(32);
+    for(int64_t i = 0; i < index->getBWTLength(); i += 1 + i % 3) {
+        maskEncoder.addBit(i);
+    }
+    maskEncoder.flush();
+    BitVector mask(maskEncoder, index->getBWTLength());
+    
+    // Make queries that wander between the copies in both genomes.
+    std::vector<std::string> queries;
+    for(size_t i = 0; i < 10; i++) {
+        std::string query;
+        while(query.size() < 500) {
+            std::string contig = index->displayContig(rand() %
+                index->getNumberOfContigs());
+            query += contig.substr(rand() % (contig.size() - 50), 50);
+            query[query.size() - 1] = bases[rand() % 4];
+        }
+        queries.push_back(query);
+    }
+    
+    std::vector<size_t> genomes {0, 1};
+    for(const std::string& query : queries) {
+        for(int minContext = 0; minContext < 30; minContext += 20) {
+            for(int64_t genome = 0; genome < 2; genome++) {
+                CPPUNIT_ASSERT(index->map(query, genome, minContext) ==
+                    plain->map(query, genome, minContext));
+                CPPUNIT_ASSERT(index->mapBoth(query, genome, minContext) ==
+                    plain->mapBoth(query, genome, minContext));
+                CPPUNIT_ASSERT(index->map(ranges, query, genome,
+                    minContext) == plain->map(ranges, query, genome,
+                    minContext));
+            }
+            CPPUNIT_ASSERT(index->mapBoth(query, genomes, minContext) ==
+                plain->mapBoth(query, genomes, minContext));
+            CPPUNIT_ASSERT(index->map(query, &mask, minContext) ==
+                plain->map(query, &mask, minContext));
+            CPPUNIT_ASSERT(index->map(ranges, query, &mask, minContext) ==
+                plain->map(ranges, query, &mask, minContext));
+        }
+    }
+    
+    delete plain;
+    delete index;
+}
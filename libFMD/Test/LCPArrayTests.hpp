@@ -0,0 +1,32 @@
+#ifndef LCPARRAYTESTS_HPP
+#define LCPARRAYTESTS_HPP
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for the LCPArray, and contracting searches with it.
+ */
+class LCPArrayTests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(LCPArrayTests);
+    CPPUNIT_TEST(testFind);
+    CPPUNIT_TEST(testValues);
+    CPPUNIT_TEST(testContract);
+    CPPUNIT_TEST(testMapping);
+    CPPUNIT_TEST(testMaskedMapping);
+    CPPUNIT_TEST_SUITE_END();
+    
+    // We need a temp directory to save arrays and indexes in.
+    std::string tempDir;
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testFind();
+    void testValues();
+    void testContract();
+    void testMapping();
+    void testMaskedMapping();
+};
+
+#endif
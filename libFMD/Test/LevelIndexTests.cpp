@@ -0,0 +1,118 @@
+// Test LevelIndex objects.
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include "../LevelIndex.hpp"
+#include "../util.hpp"
+
+#include "LevelIndexTests.hpp"
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( LevelIndexTests );
+
+/**
+ * Make a BitVector of the given number of ranges, each 3 positions long.
+ */
+static BitVector* makeRanges(size_t ranges) {
+    BitVectorEncoder encoder(32);
+    for(size_t i = 1; i <= ranges; i++) {
+        // Put a 1 at the start of every range but the first, and after the
+        // last.
+        encoder.addBit(i * 3);
+    }
+    encoder.flush();
+    return new BitVector(encoder, ranges * 3 + 1);
+}
+
+void LevelIndexTests::setUp() {
+    tempDir = make_tempdir();
+}
+
+
+void LevelIndexTests::tearDown() {
+    boost::filesystem::remove_all(tempDir);
+}
+
+/**
+ * Test setting and getting Sides in a LevelIndex being built.
+ */
+void LevelIndexTests::testSetGet() {
+    // Make an index with 1000 ranges on 700 IDs starting from a big number.
+    size_t base = 1234567890;
+    LevelIndex levelIndex(makeRanges(1000), 1000, base, 700);
+    
+    CPPUNIT_ASSERT(levelIndex.getNumberOfRanges() == 1000);
+    CPPUNIT_ASSERT(levelIndex.getRanges().getNumberOfItems() == 1000);
+    
+    for(size_t i = 0; i < 1000; i++) {
+        levelIndex.setSide(i, base + (i * 7) % 700, i % 3 == 0);
+    }
+    
+    for(size_t i = 0; i < 1000; i++) {
+        // Make sure we get back what we put in.
+        SmallSide side = levelIndex.getSide(i);
+        CPPUNIT_ASSERT(side.getCoordinate() == base + (i * 7) % 700);
+        CPPUNIT_ASSERT(side.getFace() == (i % 3 == 0));
+    }
+    
+    // Make sure we can't set Sides past the end.
+    CPPUNIT_ASSERT_THROW(levelIndex.setSide(1000, base, false),
+        std::runtime_error);
+}
+
+/**
+ * Test saving a LevelIndex and mapping it back in.
+ */
+void LevelIndexTests::testSaveLoad() {
+    std::string filename = tempDir + "/level.idx";
+    
+    {
+        // Make and save an index where only one ID is used.
+        LevelIndex levelIndex(makeRanges(100), 100, 5, 1);
+        for(size_t i = 0; i < 100; i++) {
+            levelIndex.setSide(i, 5, i % 2);
+        }
+        levelIndex.save(filename);
+    }
+    
+    // Load it back.
+    LevelIndex loaded(filename);
+    CPPUNIT_ASSERT(loaded.getNumberOfRanges() == 100);
+    
+    for(size_t i = 0; i < 100; i++) {
+        CPPUNIT_ASSERT(loaded.getCoordinate(i) == 5);
+        CPPUNIT_ASSERT(loaded.getFace(i) == i % 2);
+    }
+    
+    // Make sure the ranges came through.
+    BitVectorIterator iterator(loaded.getRanges());
+    CPPUNIT_ASSERT(loaded.getRanges().getSize() == 301);
+    for(size_t i = 0; i < 301; i++) {
+        CPPUNIT_ASSERT(iterator.isSet(i) == (i > 0 && i % 3 == 0));
+        CPPUNIT_ASSERT(iterator.rank(i) == i / 3);
+    }
+    
+    // Make sure we can't change it.
+    CPPUNIT_ASSERT_THROW(loaded.setSide(0, 5, false), std::runtime_error);
+    
+    // Make sure other files aren't accepted.
+    std::ofstream bogus((tempDir + "/bogus").c_str(), std::ios::binary);
+    for(size_t i = 0; i < 20; i++) {
+        bogus.write((const char*)&i, sizeof(i));
+    }
+    bogus.close();
+    CPPUNIT_ASSERT_THROW(LevelIndex(tempDir + "/bogus"), std::runtime_error);
+    
+    // Or ones where the range vector runs into the Sides.
+    boost::filesystem::copy_file(filename, tempDir + "/short.idx");
+    std::fstream shortened((tempDir + "/short.idx").c_str(),
+        std::ios::binary | std::ios::in | std::ios::out);
+    size_t sideOffset = 6;
+    shortened.seekp(4 * sizeof(size_t));
+    shortened.write((const char*)&sideOffset, sizeof(sideOffset));
+    shortened.close();
+    CPPUNIT_ASSERT_THROW(LevelIndex(tempDir + "/short.idx"),
+        std::runtime_error);
+}
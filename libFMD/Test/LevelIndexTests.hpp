@@ -0,0 +1,26 @@
+#ifndef LEVELINDEXTESTS_HPP
+#define LEVELINDEXTESTS_HPP
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for the LevelIndex.
+ */
+class LevelIndexTests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(LevelIndexTests);
+    CPPUNIT_TEST(testSetGet);
+    CPPUNIT_TEST(testSaveLoad);
+    CPPUNIT_TEST_SUITE_END();
+    
+    // We need a temp directory to save indexes in.
+    std::string tempDir;
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testSetGet();
+    void testSaveLoad();
+};
+
+#endif
@@ -0,0 +1,179 @@
+// Test the Log.
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+
+#include "../Log.hpp"
+
+#include "LogTests.hpp"
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( LogTests );
+
+void LogTests::setUp() {
+    
+}
+
+void LogTests::tearDown() {
+    // Go back to the default level.
+    Log::setLevel(Log::INFO);
+}
+
+/**
+ * Make sure levels can be parsed and turned on and off.
+ */
+void LogTests::testLevels() {
+    CPPUNIT_ASSERT(Log::parseLevel("critical") == Log::CRITICAL);
+    CPPUNIT_ASSERT(Log::parseLevel("info") == Log::INFO);
+    CPPUNIT_ASSERT(Log::parseLevel("trace") == Log::TRACE);
+    CPPUNIT_ASSERT_THROW(Log::parseLevel("loud"), std::runtime_error);
+    
+    // Send log output somewhere we can see it.
+    Log::flush();
+    std::stringstream captured;
+    std::streambuf* oldBuffer = std::cout.rdbuf(captured.rdbuf());
+    
+    Log::setLevel(Log::DEBUG);
+    CPPUNIT_ASSERT(Log::getLevel() == Log::DEBUG);
+    Log::debug() << "shown " << 1 << std::endl;
+    Log::trace() << "hidden " << 2 << std::endl;
+    
+    Log::setLevel(Log::ERROR);
+    Log::info() << "hidden " << 3 << std::endl;
+    Log::error() << "shown " << 4 << std::endl;
+    
+    Log::flush();
+    std::cout.rdbuf(oldBuffer);
+    
+    std::string line;
+    std::vector<std::string> lines;
+    while(std::getline(captured, line)) {
+        lines.push_back(line);
+    }
+    
+    // Only lines at enabled levels should be there, with their labels.
+    CPPUNIT_ASSERT(lines.size() == 2);
+    CPPUNIT_ASSERT(lines[0].find("DEBUG: shown 1") != std::string::npos);
+    CPPUNIT_ASSERT(lines[1].find("ERROR: shown 4") != std::string::npos);
+}
+
+/**
+ * Make sure lines from many threads come out whole and in order per thread.
+ */
+void LogTests::testThreads() {
+    Log::flush();
+    std::stringstream captured;
+    std::streambuf* oldBuffer = std::cout.rdbuf(captured.rdbuf());
+    
+    const size_t THREADS = 8;
+    const size_t LINES = 2000;
+    
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < THREADS; i++) {
+        threads.push_back(std::thread([i, LINES]() {
+            for(size_t j = 0; j < LINES; j++) {
+                // Make lines in several pieces, some long enough to wrap.
+                Log::info() << "thread " << i << " line " << j << " " <<
+                    std::string(j % 100, 'x') << std::endl;
+            }
+        }));
+    }
+    for(size_t i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+    
+    // Also try a line too long to buffer.
+    Log::info() << "long " << std::string(100000, 'y') << std::endl;
+    
+    Log::flush();
+    std::cout.rdbuf(oldBuffer);
+    
+    // What line should we see next from each thread?
+    std::vector<size_t> nextLine(THREADS, 0);
+    size_t longLines = 0;
+    
+    std::string line;
+    while(std::getline(captured, line)) {
+        size_t labelEnd = line.find("INFO: ");
+        CPPUNIT_ASSERT(labelEnd != std::string::npos);
+        std::istringstream message(line.substr(labelEnd + 6));
+        
+        std::string word;
+        message >> word;
+        if(word == "long") {
+            std::string text;
+            message >> text;
+            CPPUNIT_ASSERT(text == std::string(100000, 'y'));
+            longLines++;
+            continue;
+        }
+        
+        size_t thread, lineNumber;
+        std::string lineWord, text;
+        CPPUNIT_ASSERT(word == "thread");
+        message >> thread >> lineWord >> lineNumber;
+        CPPUNIT_ASSERT(thread < THREADS);
+        CPPUNIT_ASSERT(lineNumber == nextLine[thread]);
+        nextLine[thread]++;
+        
+        // The whole line has to be there.
+        message >> text;
+        CPPUNIT_ASSERT(text == std::string(lineNumber % 100, 'x') ||
+            (lineNumber % 100 == 0 && text.empty()));
+    }
+    
+    for(size_t i = 0; i < THREADS; i++) {
+        CPPUNIT_ASSERT(nextLine[i] == LINES);
+    }
+    CPPUNIT_ASSERT(longLines == 1);
+}
+
+/**
+ * Make sure ERROR lines and flushes don't wait forever while other threads
+ * keep logging.
+ */
+void LogTests::testBusyFlush() {
+    Log::flush();
+    std::stringstream captured;
+    std::streambuf* oldBuffer = std::cout.rdbuf(captured.rdbuf());
+    
+    // Keep some threads logging until we are done.
+    std::atomic<bool> done(false);
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < 4; i++) {
+        threads.push_back(std::thread([&done]() {
+            while(!done.load()) {
+                Log::info() << "busy" << std::endl;
+            }
+        }));
+    }
+    
+    for(size_t i = 0; i < 100; i++) {
+        Log::error() << "error " << i << std::endl;
+        Log::flush();
+    }
+    
+    done.store(true);
+    for(size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    Log::flush();
+    std::cout.rdbuf(oldBuffer);
+    
+    // All the errors should be there, in order.
+    size_t nextError = 0;
+    std::string line;
+    while(std::getline(captured, line)) {
+        size_t labelEnd = line.find("ERROR: error ");
+        if(labelEnd != std::string::npos) {
+            CPPUNIT_ASSERT_EQUAL(nextError,
+                (size_t)std::stoull(line.substr(labelEnd + 13)));
+            nextError++;
+        }
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t)100, nextError);
+}
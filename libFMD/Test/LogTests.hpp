@@ -0,0 +1,25 @@
+#ifndef LOGTESTS_HPP
+#define LOGTESTS_HPP
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for the Log.
+ */
+class LogTests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(LogTests);
+    CPPUNIT_TEST(testLevels);
+    CPPUNIT_TEST(testThreads);
+    CPPUNIT_TEST(testBusyFlush);
+    CPPUNIT_TEST_SUITE_END();
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testLevels();
+    void testThreads();
+    void testBusyFlush();
+};
+
+#endif
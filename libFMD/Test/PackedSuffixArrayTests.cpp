@@ -0,0 +1,110 @@
+// Test PackedSuffixArray objects.
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "../PackedSuffixArray.hpp"
+#include "../FMDIndex.hpp"
+#include "../FMDIndexBuilder.hpp"
+#include "../util.hpp"
+
+#include "PackedSuffixArrayTests.hpp"
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( PackedSuffixArrayTests );
+
+void PackedSuffixArrayTests::setUp() {
+    tempDir = make_tempdir();
+}
+
+
+void PackedSuffixArrayTests::tearDown() {
+    boost::filesystem::remove_all(tempDir);
+}
+
+/**
+ * Test storing positions and getting them back after saving and loading.
+ */
+void PackedSuffixArrayTests::testSetGet() {
+    std::vector<size_t> lengths;
+    lengths.push_back(7);
+    lengths.push_back(0);
+    lengths.push_back(20);
+    
+    // Make up positions for every index, ends included.
+    std::vector<TextPosition> positions;
+    for(size_t text = 0; text < lengths.size(); text++) {
+        for(size_t offset = 0; offset <= lengths[text]; offset++) {
+            positions.push_back(TextPosition(text, offset));
+        }
+    }
+    
+    PackedSuffixArray array(lengths, positions.size());
+    for(size_t i = 0; i < positions.size(); i++) {
+        // Store them backwards, so they aren't in order.
+        array.set(i, positions[positions.size() - i - 1]);
+    }
+    
+    // We can't set things that aren't there.
+    CPPUNIT_ASSERT_THROW(array.set(0, TextPosition(0, 8)), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(array.set(0, TextPosition(3, 0)), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(array.set(positions.size(), TextPosition(0, 0)),
+        std::runtime_error);
+    
+    array.save(tempDir + "/test.sa");
+    PackedSuffixArray loaded(tempDir + "/test.sa");
+    
+    CPPUNIT_ASSERT(loaded.getNumberOfTexts() == 3);
+    CPPUNIT_ASSERT(loaded.getLength() == positions.size());
+    
+    for(size_t i = 0; i < positions.size(); i++) {
+        // Both the built and loaded arrays should have them all.
+        CPPUNIT_ASSERT(array.get(i) == positions[positions.size() - i - 1]);
+        CPPUNIT_ASSERT(loaded.get(i) == positions[positions.size() - i - 1]);
+    }
+    
+    // We can't change a loaded one.
+    CPPUNIT_ASSERT_THROW(loaded.set(0, TextPosition(0, 0)),
+        std::runtime_error);
+    
+    // Things that aren't suffix arrays shouldn't load.
+    std::ofstream junk((tempDir + "/junk.sa").c_str());
+    junk << "This is not a suffix array, packed or otherwise." << std::endl;
+    junk.close();
+    CPPUNIT_ASSERT_THROW(PackedSuffixArray(tempDir + "/junk.sa"),
+        std::runtime_error);
+}
+
+/**
+ * Test locating in a reloaded index with a saved full suffix array.
+ */
+void PackedSuffixArrayTests::testLocate() {
+    // Build the same thing with and without the full suffix array.
+    FMDIndexBuilder plainBuilder(tempDir + "/plain");
+    plainBuilder.add("Test/haplotypes.fa");
+    delete plainBuilder.build();
+    
+    FMDIndexBuilder savedBuilder(tempDir + "/saved", 64, false, 0, false,
+        false, true);
+    savedBuilder.add("Test/haplotypes.fa");
+    delete savedBuilder.build();
+    
+    CPPUNIT_ASSERT(boost::filesystem::exists(tempDir + "/saved.sa"));
+    CPPUNIT_ASSERT(!boost::filesystem::exists(tempDir + "/plain.sa"));
+    
+    // Load them back, so neither has the suffix array it was built with.
+    FMDIndex plain(tempDir + "/plain");
+    FMDIndex saved(tempDir + "/saved");
+    
+    std::vector<int64_t> indices;
+    for(int64_t i = 0; i < plain.getBWTLength(); i++) {
+        // Everything should be in the same place.
+        CPPUNIT_ASSERT(saved.locate(i) == plain.locate(i));
+        indices.push_back(i);
+    }
+    CPPUNIT_ASSERT(saved.locateBatch(indices) == plain.locateBatch(indices));
+}
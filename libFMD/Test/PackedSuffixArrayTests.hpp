@@ -0,0 +1,26 @@
+#ifndef PACKEDSUFFIXARRAYTESTS_HPP
+#define PACKEDSUFFIXARRAYTESTS_HPP
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for the PackedSuffixArray.
+ */
+class PackedSuffixArrayTests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(PackedSuffixArrayTests);
+    CPPUNIT_TEST(testSetGet);
+    CPPUNIT_TEST(testLocate);
+    CPPUNIT_TEST_SUITE_END();
+    
+    // We need a temp directory to save arrays and indexes in.
+    std::string tempDir;
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testSetGet();
+    void testLocate();
+};
+
+#endif
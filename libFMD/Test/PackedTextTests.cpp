@@ -0,0 +1,102 @@
+// Test PackedText objects.
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "../PackedText.hpp"
+#include "../FMDIndex.hpp"
+#include "../FMDIndexBuilder.hpp"
+#include "../util.hpp"
+
+#include "PackedTextTests.hpp"
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( PackedTextTests );
+
+void PackedTextTests::setUp() {
+    tempDir = make_tempdir();
+}
+
+
+void PackedTextTests::tearDown() {
+    boost::filesystem::remove_all(tempDir);
+}
+
+/**
+ * Test packing contigs and getting pieces of them back.
+ */
+void PackedTextTests::testExtract() {
+    // Make some contigs of awkward lengths, so they don't line up with bytes.
+    std::vector<std::string> contigs;
+    for(size_t i = 0; i < 6; i++) {
+        std::string contig;
+        for(size_t j = 0; j < i * 7 + 1; j++) {
+            contig.push_back("ACGT"[(i * 5 + j * j) % 4]);
+        }
+        contigs.push_back(contig);
+    }
+    
+    PackedText::Writer writer(tempDir + "/text.pak");
+    for(size_t i = 0; i < contigs.size(); i++) {
+        writer.addContig(contigs[i]);
+    }
+    writer.close();
+    
+    PackedText text(tempDir + "/text.pak");
+    CPPUNIT_ASSERT(text.getNumberOfContigs() == contigs.size());
+    
+    for(size_t i = 0; i < contigs.size(); i++) {
+        CPPUNIT_ASSERT(text.getContigLength(i) == contigs[i].size());
+        
+        for(size_t start = 0; start <= contigs[i].size(); start++) {
+            for(size_t length = 0; start + length <= contigs[i].size();
+                length++) {
+                
+                // Every piece should come back right.
+                CPPUNIT_ASSERT(text.extract(i, start, length) == 
+                    contigs[i].substr(start, length));
+            }
+        }
+    }
+    
+    // We can't go off the end of a contig.
+    CPPUNIT_ASSERT_THROW(text.extract(0, 0, 2), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(text.getContigLength(6), std::runtime_error);
+    
+    // And we can only pack bases.
+    PackedText::Writer badWriter(tempDir + "/bad.pak");
+    CPPUNIT_ASSERT_THROW(badWriter.addContig("GATTNCA"), std::runtime_error);
+}
+
+/**
+ * Test that an index with a packed text gives the same contigs as one without.
+ */
+void PackedTextTests::testIndex() {
+    // Build the same thing with and without packing.
+    FMDIndexBuilder plainBuilder(tempDir + "/plain");
+    plainBuilder.add("Test/haplotypes.fa");
+    FMDIndex* plain = plainBuilder.build();
+    
+    FMDIndexBuilder packedBuilder(tempDir + "/packed", 64, true);
+    packedBuilder.add("Test/haplotypes.fa");
+    FMDIndex* packed = packedBuilder.build();
+    
+    CPPUNIT_ASSERT(boost::filesystem::exists(tempDir + "/packed.pak"));
+    CPPUNIT_ASSERT(!boost::filesystem::exists(tempDir + "/plain.pak"));
+    
+    for(size_t i = 0; i < plain->getNumberOfContigs(); i++) {
+        // Whole contigs should match.
+        std::string contig = plain->displayContig(i);
+        CPPUNIT_ASSERT(packed->displayContig(i) == contig);
+        
+        // And so should pieces.
+        CPPUNIT_ASSERT(packed->extract(i, 3, 10) == contig.substr(3, 10));
+        CPPUNIT_ASSERT(plain->extract(i, 3, 10) == contig.substr(3, 10));
+    }
+    
+    delete plain;
+    delete packed;
+}
@@ -0,0 +1,26 @@
+#ifndef PACKEDTEXTTESTS_HPP
+#define PACKEDTEXTTESTS_HPP
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for the PackedText.
+ */
+class PackedTextTests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(PackedTextTests);
+    CPPUNIT_TEST(testExtract);
+    CPPUNIT_TEST(testIndex);
+    CPPUNIT_TEST_SUITE_END();
+    
+    // We need a temp directory to save texts and indexes in.
+    std::string tempDir;
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testExtract();
+    void testIndex();
+};
+
+#endif
@@ -0,0 +1,124 @@
+// Test SampledISA objects.
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#include "../SampledISA.hpp"
+#include "../FMDIndex.hpp"
+#include "../FMDIndexBuilder.hpp"
+#include "../util.hpp"
+
+#include "SampledISATests.hpp"
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( SampledISATests );
+
+void SampledISATests::setUp() {
+    tempDir = make_tempdir();
+}
+
+
+void SampledISATests::tearDown() {
+    boost::filesystem::remove_all(tempDir);
+}
+
+/**
+ * Test storing samples and getting them back after saving and loading.
+ */
+void SampledISATests::testSamples() {
+    // Make some texts that are and aren't multiples of the sample rate.
+    std::vector<size_t> lengths;
+    lengths.push_back(7);
+    lengths.push_back(8);
+    lengths.push_back(1);
+    
+    SampledISA isa(4, lengths, 1000);
+    
+    for(size_t text = 0; text < lengths.size(); text++) {
+        for(size_t offset = 0; offset <= lengths[text]; offset++) {
+            // Offer every position, with an index we can recognize.
+            isa.offer(TextPosition(text, offset), text * 100 + offset);
+        }
+    }
+    
+    // We can't offer things that aren't there.
+    CPPUNIT_ASSERT_THROW(isa.offer(TextPosition(0, 8), 0), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(isa.offer(TextPosition(3, 0), 0), std::runtime_error);
+    
+    isa.save(tempDir + "/test.isa");
+    SampledISA loaded(tempDir + "/test.isa");
+    
+    CPPUNIT_ASSERT(loaded.getSampleRate() == 4);
+    CPPUNIT_ASSERT(loaded.getNumberOfTexts() == 3);
+    
+    for(size_t text = 0; text < lengths.size(); text++) {
+        for(size_t offset = 0; offset <= lengths[text]; offset++) {
+            // The next sample is rounded up, but not past the end.
+            TextPosition next = loaded.getNextSampled(TextPosition(text,
+                offset));
+            CPPUNIT_ASSERT(next.getText() == text);
+            CPPUNIT_ASSERT(next.getOffset() >= offset);
+            CPPUNIT_ASSERT(next.getOffset() < offset + 4);
+            CPPUNIT_ASSERT(next.getOffset() % 4 == 0 || 
+                next.getOffset() == lengths[text]);
+            
+            // Both the built and loaded samples should have kept it.
+            CPPUNIT_ASSERT(isa.getSample(next) == text * 100 +
+                next.getOffset());
+            CPPUNIT_ASSERT(loaded.getSample(next) == text * 100 +
+                next.getOffset());
+        }
+    }
+    
+    // We can't look past the end of a text.
+    CPPUNIT_ASSERT_THROW(loaded.getNextSampled(TextPosition(2, 2)),
+        std::runtime_error);
+    
+    // And we can't change a loaded one.
+    CPPUNIT_ASSERT_THROW(loaded.offer(TextPosition(0, 0), 0),
+        std::runtime_error);
+}
+
+/**
+ * Test unlocating and extracting in an index with a sampled ISA.
+ */
+void SampledISATests::testUnlocate() {
+    // Build the same thing with and without the sampled ISA.
+    FMDIndexBuilder plainBuilder(tempDir + "/plain");
+    plainBuilder.add("Test/haplotypes.fa");
+    FMDIndex* plain = plainBuilder.build();
+    
+    FMDIndexBuilder sampledBuilder(tempDir + "/sampled", 64, false, 5);
+    sampledBuilder.add("Test/haplotypes.fa");
+    FMDIndex* sampled = sampledBuilder.build();
+    
+    CPPUNIT_ASSERT(boost::filesystem::exists(tempDir + "/sampled.isa"));
+    CPPUNIT_ASSERT(!boost::filesystem::exists(tempDir + "/plain.isa"));
+    
+    // Only the index with samples can unlocate.
+    CPPUNIT_ASSERT_THROW(plain->unlocate(TextPosition(0, 0)),
+        std::runtime_error);
+    
+    for(int64_t i = 0; i < sampled->getBWTLength(); i++) {
+        // Every BWT index should come back from where it is.
+        CPPUNIT_ASSERT(sampled->unlocate(sampled->locate(i)) == i);
+    }
+    
+    for(size_t i = 0; i < plain->getNumberOfContigs(); i++) {
+        std::string contig = plain->displayContig(i);
+        
+        for(size_t start = 0; start < contig.size(); start += 7) {
+            // Pieces from anywhere should come out right.
+            size_t length = std::min((size_t)13, contig.size() - start);
+            CPPUNIT_ASSERT(sampled->extract(i, start, length) ==
+                contig.substr(start, length));
+        }
+    }
+    
+    delete plain;
+    delete sampled;
+}
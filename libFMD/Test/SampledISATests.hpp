@@ -0,0 +1,26 @@
+#ifndef SAMPLEDISATESTS_HPP
+#define SAMPLEDISATESTS_HPP
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for the SampledISA.
+ */
+class SampledISATests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(SampledISATests);
+    CPPUNIT_TEST(testSamples);
+    CPPUNIT_TEST(testUnlocate);
+    CPPUNIT_TEST_SUITE_END();
+    
+    // We need a temp directory to save samples and indexes in.
+    std::string tempDir;
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testSamples();
+    void testUnlocate();
+};
+
+#endif
@@ -0,0 +1,115 @@
+// Test the Trace timeline.
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+
+#include "../Trace.hpp"
+
+#include "TraceTests.hpp"
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( TraceTests );
+
+void TraceTests::setUp() {
+    // Start with nothing recorded.
+    Trace::clear();
+}
+
+void TraceTests::tearDown() {
+    // Go back to not recording.
+    Trace::stop();
+    Trace::clear();
+}
+
+/**
+ * Count the times the given text appears in the given string.
+ */
+static size_t countOccurrences(const std::string& text,
+    const std::string& pattern) {
+    
+    size_t count = 0;
+    for(size_t found = text.find(pattern); found != std::string::npos;
+        found = text.find(pattern, found + 1)) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Make sure spans, counters and thread names from several threads all come out.
+ */
+void TraceTests::testSpans() {
+    Trace::start();
+    CPPUNIT_ASSERT(Trace::isEnabled());
+    
+    {
+        TraceSpan outer("outer");
+        
+        const size_t THREADS = 4;
+        std::vector<std::thread> threads;
+        for(size_t i = 0; i < THREADS; i++) {
+            threads.push_back(std::thread([i]() {
+                Trace::nameThread("worker " + std::to_string(i));
+                TraceSpan span("work");
+                Trace::count("progress", i);
+            }));
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        
+        // A span can be finished early, but only counts once.
+        TraceSpan early(std::string("quoted \"name\""));
+        early.finish();
+    }
+    
+    std::stringstream out;
+    Trace::write(out);
+    std::string json = out.str();
+    
+    CPPUNIT_ASSERT(json.find("{\"traceEvents\":[") == 0);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, countOccurrences(json, "\"outer\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)4, countOccurrences(json, "\"work\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, countOccurrences(json,
+        "\"quoted \\\"name\\\"\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)6, countOccurrences(json, "\"ph\":\"X\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)4, countOccurrences(json, "\"ph\":\"C\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)4, countOccurrences(json,
+        "\"thread_name\""));
+    CPPUNIT_ASSERT(json.find("\"worker 3\"") != std::string::npos);
+    CPPUNIT_ASSERT(json.find("\"progress\":2") != std::string::npos);
+    
+    // Clearing throws it all out.
+    Trace::clear();
+    std::stringstream cleared;
+    Trace::write(cleared);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, countOccurrences(cleared.str(),
+        "\"ph\":\"X\""));
+}
+
+/**
+ * Make sure nothing is recorded while tracing is off.
+ */
+void TraceTests::testDisabled() {
+    Trace::stop();
+    CPPUNIT_ASSERT(!Trace::isEnabled());
+    
+    {
+        TraceSpan span("hidden");
+        Trace::count("hidden", 1);
+        
+        // Spans started while off stay off.
+        Trace::start();
+    }
+    TraceSpan late("late");
+    Trace::stop();
+    late.finish();
+    
+    std::stringstream out;
+    Trace::write(out);
+    CPPUNIT_ASSERT(out.str().find("hidden") == std::string::npos);
+    // Spans started while on are still finished.
+    CPPUNIT_ASSERT(out.str().find("\"late\"") != std::string::npos);
+}
@@ -0,0 +1,23 @@
+#ifndef TRACETESTS_HPP
+#define TRACETESTS_HPP
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for the Trace timeline.
+ */
+class TraceTests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(TraceTests);
+    CPPUNIT_TEST(testSpans);
+    CPPUNIT_TEST(testDisabled);
+    CPPUNIT_TEST_SUITE_END();
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testSpans();
+    void testDisabled();
+};
+
+#endif
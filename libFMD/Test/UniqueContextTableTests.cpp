@@ -0,0 +1,232 @@
+// Test UniqueContextTable objects.
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#include "../UniqueContextTable.hpp"
+#include "../FMDIndex.hpp"
+#include "../FMDIndexBuilder.hpp"
+#include "../util.hpp"
+
+#include "UniqueContextTableTests.hpp"
+
+// Register the fixture to be run.
+CPPUNIT_TEST_SUITE_REGISTRATION( UniqueContextTableTests );
+
+void UniqueContextTableTests::setUp() {
+    tempDir = make_tempdir();
+}
+
+
+void UniqueContextTableTests::tearDown() {
+    boost::filesystem::remove_all(tempDir);
+}
+
+/**
+ * Test storing lengths and getting them back after saving and loading.
+ */
+void UniqueContextTableTests::testSetGet() {
+    std::vector<size_t> lengths;
+    lengths.push_back(7);
+    lengths.push_back(0);
+    lengths.push_back(300);
+    
+    UniqueContextTable table(lengths);
+    
+    for(size_t text = 0; text < lengths.size(); text++) {
+        for(size_t offset = 0; offset < lengths[text]; offset++) {
+            // Set every position to something we can recognize.
+            table.set(TextPosition(text, offset), text + offset);
+        }
+    }
+    
+    // We can't set things that aren't there.
+    CPPUNIT_ASSERT_THROW(table.set(TextPosition(0, 7), 1), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(table.set(TextPosition(1, 0), 1), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(table.set(TextPosition(3, 0), 1), std::runtime_error);
+    
+    table.save(tempDir + "/test.uct");
+    UniqueContextTable loaded(tempDir + "/test.uct");
+    
+    CPPUNIT_ASSERT(loaded.getNumberOfTexts() == 3);
+    
+    for(size_t text = 0; text < lengths.size(); text++) {
+        for(size_t offset = 0; offset < lengths[text]; offset++) {
+            // Long lengths are clipped.
+            size_t expected = std::min(text + offset,
+                (size_t)UniqueContextTable::MAX_VALUE);
+            CPPUNIT_ASSERT(table.get(TextPosition(text, offset)) == expected);
+            CPPUNIT_ASSERT(loaded.get(TextPosition(text, offset)) == expected);
+        }
+    }
+    
+    // We can't look past the end of a text, or change a loaded table.
+    CPPUNIT_ASSERT_THROW(loaded.get(TextPosition(2, 300)), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(loaded.set(TextPosition(0, 0), 1),
+        std::runtime_error);
+    
+    // Things that aren't tables shouldn't load.
+    std::ofstream junk((tempDir + "/junk.uct").c_str());
+    junk << "This is not a unique context table." << std::endl;
+    junk.close();
+    CPPUNIT_ASSERT_THROW(UniqueContextTable(tempDir + "/junk.uct"),
+        std::runtime_error);
+}
+
+/**
+ * Test that a built table has the shortest unique context in each genome.
+ */
+void UniqueContextTableTests::testContexts() {
+    // Always make the same sequences.
+    srand(42);
+    
+    // Make two genomes that share some sequence, and repeat some of it, so
+    // contexts are unique in one genome but not the other.
+    std::string bases = "ACGT";
+    std::string shared;
+    for(size_t i = 0; i < 60; i++) {
+        shared.push_back(bases[rand() % 4]);
+    }
+    
+    std::vector<std::string> filenames;
+    for(size_t genome = 0; genome < 2; genome++) {
+        std::string sequence;
+        for(size_t i = 0; i < 100; i++) {
+            sequence.push_back(bases[rand() % 4]);
+        }
+        sequence += shared;
+        if(genome == 1) {
+            // Repeat it in this one.
+            sequence += shared.substr(10, 40);
+        }
+        
+        filenames.push_back(tempDir + "/genome" + std::to_string(genome) +
+            ".fa");
+        std::ofstream fasta(filenames.back().c_str());
+        fasta << ">genome" << genome << std::endl << sequence << std::endl;
+        fasta.close();
+    }
+    
+    FMDIndexBuilder plainBuilder(tempDir + "/plain");
+    FMDIndexBuilder builder(tempDir + "/index", 64, false, 0, false, true);
+    for(const std::string& filename : filenames) {
+        plainBuilder.add(filename);
+        builder.add(filename);
+    }
+    FMDIndex* plain = plainBuilder.build();
+    FMDIndex* index = builder.build();
+    
+    // Only the index with the table can look up contexts.
+    CPPUNIT_ASSERT(!plain->hasUniqueContexts());
+    CPPUNIT_ASSERT(index->hasUniqueContexts());
+    CPPUNIT_ASSERT_THROW(plain->getUniqueContextLength(TextPosition(0, 0)),
+        std::runtime_error);
+    
+    for(size_t text = 0; text < index->getNumberOfContigs() * 2; text++) {
+        // Get the text, on whatever strand it is.
+        std::string contig = index->displayContig(text / 2);
+        if(text % 2 == 1) {
+            contig = reverseComplement(contig);
+        }
+        
+        // Count occurrences in the text's genome only.
+        const BitVector& mask = index->getGenomeMask(
+            index->getContigGenome(text / 2));
+        
+        for(size_t offset = 0; offset < contig.size(); offset++) {
+            // Search for the shortest unique context the slow way.
+            size_t expected = 0;
+            for(size_t length = 1; offset + length <= contig.size();
+                length++) {
+                
+                if(index->count(contig.substr(offset, length)).getLength(
+                    &mask) == 1) {
+                    
+                    expected = length;
+                    break;
+                }
+            }
+            
+            CPPUNIT_ASSERT(index->getUniqueContextLength(TextPosition(text,
+                offset)) == expected);
+            
+            // Going left from the same base on the other strand should match.
+            CPPUNIT_ASSERT(index->getUniqueContextLength(TextPosition(
+                text ^ 1, contig.size() - offset - 1), true) == expected);
+        }
+        
+        // We can't look past the end.
+        CPPUNIT_ASSERT_THROW(index->getUniqueContextLength(TextPosition(text,
+            contig.size()), true), std::runtime_error);
+    }
+    
+    delete plain;
+    delete index;
+}
+
+/**
+ * Test that mapping contigs with the table gives the same results as searching.
+ */
+void UniqueContextTableTests::testMapContig() {
+    srand(7);
+    
+    // Make genomes with repeats both within and between them, so some bases
+    // need long contexts and some never map.
+    std::string bases = "ACGT";
+    std::string repeat;
+    for(size_t i = 0; i < 30; i++) {
+        repeat.push_back(bases[rand() % 4]);
+    }
+    
+    FMDIndexBuilder builder(tempDir + "/index", 64, false, 0, false, true);
+    for(size_t genome = 0; genome < 2; genome++) {
+        std::string filename = tempDir + "/genome" + std::to_string(genome) +
+            ".fa";
+        std::ofstream fasta(filename.c_str());
+        for(size_t contig = 0; contig < 2; contig++) {
+            std::string sequence;
+            for(size_t i = 0; i < 80; i++) {
+                sequence.push_back(bases[rand() % 4]);
+                if(i % 40 == 20) {
+                    sequence += repeat;
+                }
+            }
+            fasta << ">contig" << contig << std::endl << sequence << std::endl;
+        }
+        fasta.close();
+        builder.add(filename);
+    }
+    FMDIndex* index = builder.build();
+    
+    // How many bases map to their own genomes?
+    size_t mapped = 0;
+    for(size_t contig = 0; contig < index->getNumberOfContigs(); contig++) {
+        std::string sequence = index->displayContig(contig);
+        for(int64_t genome = -1; genome < 2; genome++) {
+            for(int minContext : {0, 3, 20}) {
+                // Whether or not the table gets used, the results must be what
+                // a search gives.
+                std::vector<Mapping> mappings = index->mapContig(contig,
+                    genome, minContext);
+                CPPUNIT_ASSERT(mappings == index->map(sequence, genome,
+                    minContext));
+                
+                if(genome == (int64_t)index->getContigGenome(contig)) {
+                    for(const Mapping& mapping : mappings) {
+                        mapped += mapping.is_mapped;
+                    }
+                }
+            }
+        }
+    }
+    // Make sure there was something to get right.
+    CPPUNIT_ASSERT(mapped > 0);
+    
+    delete index;
+}
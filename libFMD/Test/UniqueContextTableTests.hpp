@@ -0,0 +1,28 @@
+#ifndef UNIQUECONTEXTTABLETESTS_HPP
+#define UNIQUECONTEXTTABLETESTS_HPP
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Tests for the UniqueContextTable.
+ */
+class UniqueContextTableTests : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(UniqueContextTableTests);
+    CPPUNIT_TEST(testSetGet);
+    CPPUNIT_TEST(testContexts);
+    CPPUNIT_TEST(testMapContig);
+    CPPUNIT_TEST_SUITE_END();
+    
+    // We need a temp directory to save tables and indexes in.
+    std::string tempDir;
+    
+public:
+    void setUp();
+    void tearDown();
+
+    void testSetGet();
+    void testContexts();
+    void testMapContig();
+};
+
+#endif
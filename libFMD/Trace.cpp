@@ -0,0 +1,276 @@
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+
+#include "Trace.hpp"
+
+// Don't record unless asked.
+std::atomic<bool> Trace::enabled(false);
+
+/**
+ * One thing that happened on a thread: either a span or a counter sample.
+ */
+struct TraceEvent {
+    // What is it called?
+    std::string name;
+    // Is it a span ('X') or a counter sample ('C')?
+    char phase;
+    // When did it start, in microseconds?
+    double time;
+    // How long did it last (for spans), in microseconds, or what was the
+    // counter's value?
+    double value;
+};
+
+/**
+ * Everything recorded by one thread. Only that thread adds to it, so its lock
+ * is only ever contended when we are writing out.
+ */
+struct TraceBuffer {
+    // Lock for everything below
+    std::mutex mutex;
+    // What number is the thread?
+    size_t thread;
+    // What is it called, if anything?
+    std::string name;
+    // What did it record?
+    std::vector<TraceEvent> events;
+};
+
+/**
+ * Owns the buffers of every thread that has ever recorded anything, since they
+ * need to outlive their threads. Never destroyed, so threads can still record
+ * while the program exits.
+ */
+struct TraceRegistry {
+    // Lock for everything below
+    std::mutex mutex;
+    // All the buffers, in the order their threads started recording
+    std::vector<TraceBuffer*> buffers;
+    // Where to save at exit, if anywhere
+    std::string filename;
+    // Have we arranged to save at exit?
+    bool saving;
+
+    TraceRegistry(): mutex(), buffers(), filename(), saving(false) {}
+
+    /**
+     * Get the one TraceRegistry.
+     */
+    static TraceRegistry& get() {
+        static TraceRegistry* registry = new TraceRegistry();
+        return *registry;
+    }
+
+    /**
+     * Save where we were asked to when the program exits.
+     */
+    static void saveAtExit() {
+        TraceRegistry& registry = get();
+        std::string filename;
+        {
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            filename = registry.filename;
+        }
+        if(filename != "") {
+            Trace::stop();
+            try {
+                Trace::save(filename);
+            } catch(std::runtime_error& error) {
+                // We can't throw out of an exit handler.
+                fprintf(stderr, "%s\n", error.what());
+            }
+        }
+    }
+};
+
+/**
+ * Get the calling thread's buffer, making it if needed.
+ */
+static TraceBuffer& getThreadBuffer() {
+    static thread_local TraceBuffer* buffer = NULL;
+    if(buffer == NULL) {
+        TraceRegistry& registry = TraceRegistry::get();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        buffer = new TraceBuffer();
+        // Number threads from 1 in the order we see them.
+        buffer->thread = registry.buffers.size() + 1;
+        registry.buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+/**
+ * Get the time that we count from.
+ */
+static std::chrono::steady_clock::time_point getEpoch() {
+    static std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+    return epoch;
+}
+
+/**
+ * Write the given string as a quoted JSON string.
+ */
+static void writeString(std::ostream& out, const std::string& text) {
+    out << '"';
+    for(char c : text) {
+        if(c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if((unsigned char)c < 0x20) {
+            // Escape control characters by number.
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void Trace::start(const std::string& filename) {
+    // Start the clock if it isn't going already.
+    getEpoch();
+
+    if(filename != "") {
+        TraceRegistry& registry = TraceRegistry::get();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.filename = filename;
+        if(!registry.saving) {
+            std::atexit(&TraceRegistry::saveAtExit);
+            registry.saving = true;
+        }
+    }
+
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void Trace::stop() {
+    enabled.store(false, std::memory_order_relaxed);
+}
+
+double Trace::now() {
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - getEpoch()).count();
+}
+
+void Trace::span(const std::string& name, double start, double end) {
+    TraceBuffer& buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back(TraceEvent{name, 'X', start, end - start});
+}
+
+void Trace::count(const std::string& name, int64_t value) {
+    if(!isEnabled()) {
+        return;
+    }
+    double time = now();
+    TraceBuffer& buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back(TraceEvent{name, 'C', time, (double)value});
+}
+
+void Trace::nameThread(const std::string& name) {
+    if(!isEnabled()) {
+        return;
+    }
+    TraceBuffer& buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.name = name;
+}
+
+void Trace::clear() {
+    TraceRegistry& registry = TraceRegistry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for(TraceBuffer* buffer : registry.buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->events.clear();
+    }
+}
+
+void Trace::write(std::ostream& out) {
+    TraceRegistry& registry = TraceRegistry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    out << "{\"traceEvents\":[";
+    // Do we need a comma before the next event?
+    bool first = true;
+
+    for(TraceBuffer* buffer : registry.buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+
+        if(buffer->name != "") {
+            // Label the thread's row.
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\","
+                "\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread <<
+                ",\"args\":{\"name\":";
+            writeString(out, buffer->name);
+            out << "}}";
+            first = false;
+        }
+
+        for(const TraceEvent& event : buffer->events) {
+            out << (first ? "" : ",") << "\n{\"name\":";
+            writeString(out, event.name);
+            out << ",\"ph\":\"" << event.phase << "\",\"pid\":1,\"tid\":" <<
+                buffer->thread << ",\"ts\":" << (int64_t)event.time;
+            if(event.phase == 'X') {
+                out << ",\"dur\":" << (int64_t)event.value << "}";
+            } else {
+                // Counters keep their value in an argument named after them.
+                out << ",\"args\":{";
+                writeString(out, event.name);
+                out << ":" << (int64_t)event.value << "}}";
+            }
+            first = false;
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void Trace::save(const std::string& filename) {
+    std::ofstream file(filename.c_str());
+    if(!file.good()) {
+        throw std::runtime_error("Could not open trace file " + filename);
+    }
+    write(file);
+    file.close();
+    if(file.fail()) {
+        throw std::runtime_error("Could not write trace file " + filename);
+    }
+}
+
+TraceSpan::TraceSpan(const char* name): recording(Trace::isEnabled()),
+    name(), start(0) {
+
+    if(recording) {
+        this->name = name;
+        start = Trace::now();
+    }
+}
+
+TraceSpan::TraceSpan(const std::string& name): recording(Trace::isEnabled()),
+    name(), start(0) {
+
+    if(recording) {
+        this->name = name;
+        start = Trace::now();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    finish();
+}
+
+void TraceSpan::finish() {
+    if(recording) {
+        Trace::span(name, start, Trace::now());
+        recording = false;
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <ostream>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Static timeline tracing system. While tracing is on, TraceSpans and counter
+ * samples are recorded into a buffer for each thread, and can be written out in
+ * the Chrome trace event JSON format, which chrome://tracing and Perfetto can
+ * show as a timeline with a row per thread.
+ *
+ * While tracing is off, which is the default, a TraceSpan costs one check.
+ */
+class Trace {
+public:
+    /**
+     * Start recording. If a filename is given, everything recorded is saved
+     * there when the program exits.
+     */
+    static void start(const std::string& filename = "");
+
+    /**
+     * Stop recording. What was recorded is kept.
+     */
+    static void stop();
+
+    /**
+     * Are we recording?
+     */
+    static inline bool isEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the number of microseconds since tracing was first used.
+     */
+    static double now();
+
+    /**
+     * Record a span with the given name on the calling thread, from the given
+     * start to the given end time, in microseconds.
+     */
+    static void span(const std::string& name, double start, double end);
+
+    /**
+     * Record the value of the counter with the given name at the current time.
+     * Each counter gets its own graph.
+     */
+    static void count(const std::string& name, int64_t value);
+
+    /**
+     * Give the calling thread a name to show on its row.
+     */
+    static void nameThread(const std::string& name);
+
+    /**
+     * Throw out everything recorded so far.
+     */
+    static void clear();
+
+    /**
+     * Write everything recorded so far to the given stream as Chrome trace
+     * event JSON. Should not be called while other threads are recording.
+     */
+    static void write(std::ostream& out);
+
+    /**
+     * Write everything recorded so far to the given file. Throws
+     * std::runtime_error if the file can't be written.
+     */
+    static void save(const std::string& filename);
+
+protected:
+    // Are we recording?
+    static std::atomic<bool> enabled;
+};
+
+/**
+ * Records the time from its construction to its destruction as a span on the
+ * calling thread's row, if tracing is on when it is constructed.
+ */
+class TraceSpan {
+public:
+    /**
+     * Start a span with the given name.
+     */
+    TraceSpan(const char* name);
+
+    /**
+     * Start a span with the given name.
+     */
+    TraceSpan(const std::string& name);
+
+    /**
+     * Finish the span, if it wasn't finished already.
+     */
+    ~TraceSpan();
+
+    /**
+     * Finish the span now, for phases that don't end with a scope.
+     */
+    void finish();
+
+protected:
+    // Are we recording this span?
+    bool recording;
+    // What is it called?
+    std::string name;
+    // When did it start?
+    double start;
+
+private:
+    /**
+     * Spans can't be copied.
+     */
+    TraceSpan(const TraceSpan& other) = delete;
+
+    /**
+     * Or assigned.
+     */
+    TraceSpan& operator=(const TraceSpan& other) = delete;
+};
+
+#endif
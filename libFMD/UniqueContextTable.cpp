@@ -0,0 +1,155 @@
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "UniqueContextTable.hpp"
+#include "Log.hpp"
+
+UniqueContextTable::UniqueContextTable(const std::vector<size_t>& lengths):
+    numberOfTexts(lengths.size()), textStarts(NULL), textStartData(),
+    lengthData(), lengths(NULL), mapped(NULL), mappedBytes(0) {
+
+    size_t total = 0;
+    for(size_t i = 0; i < numberOfTexts; i++) {
+        // Each text gets a length for every offset in it.
+        textStartData.push_back(total);
+        total += lengths[i];
+    }
+    textStartData.push_back(total);
+    textStarts = textStartData.data();
+
+    // Everything starts out with no unique context.
+    lengthData.resize(total, 0);
+    this->lengths = lengthData.data();
+}
+
+UniqueContextTable::UniqueContextTable(const std::string& filename):
+    numberOfTexts(0), textStarts(NULL), textStartData(), lengthData(),
+    lengths(NULL), mapped(NULL), mappedBytes(0) {
+
+    // Open the file and see how big it is.
+    int file = open(filename.c_str(), O_RDONLY);
+    if(file == -1) {
+        throw std::runtime_error("Could not open unique context table " +
+            filename);
+    }
+    struct stat fileStats;
+    if(fstat(file, &fileStats) == -1) {
+        close(file);
+        throw std::runtime_error("Could not stat unique context table " +
+            filename);
+    }
+    mappedBytes = fileStats.st_size;
+
+    if(mappedBytes < (HEADER_WORDS + 1) * sizeof(uint64_t)) {
+        close(file);
+        throw std::runtime_error("Unique context table " + filename +
+            " is truncated");
+    }
+
+    // Map the whole thing. The mapping keeps the file open for us.
+    mapped = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if(mapped == MAP_FAILED) {
+        mapped = NULL;
+        throw std::runtime_error("Could not map unique context table " +
+            filename);
+    }
+
+    // Look at it as words.
+    const uint64_t* words = (const uint64_t*)mapped;
+
+    if(words[0] != MAGIC) {
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error(filename + " is not a unique context table");
+    }
+
+    // Read the rest of the header.
+    numberOfTexts = words[1];
+
+    // The lengths come after the text starts.
+    size_t lengthOffset = HEADER_WORDS + numberOfTexts + 1;
+
+    if(lengthOffset * sizeof(uint64_t) > mappedBytes ||
+        lengthOffset * sizeof(uint64_t) + words[lengthOffset - 1] >
+        mappedBytes) {
+
+        munmap(mapped, mappedBytes);
+        throw std::runtime_error("Unique context table " + filename +
+            " is truncated");
+    }
+
+    // Use everything right where it is.
+    textStarts = words + HEADER_WORDS;
+    lengths = (const unsigned char*)(words + lengthOffset);
+
+    Log::info() << "Mapped unique context table of " <<
+        textStarts[numberOfTexts] << " positions" << std::endl;
+}
+
+UniqueContextTable::~UniqueContextTable() {
+    if(mapped != NULL) {
+        // Unmap the file now that nothing is looking at it.
+        munmap(mapped, mappedBytes);
+    }
+}
+
+void UniqueContextTable::set(const TextPosition& position, size_t length) {
+    if(mapped != NULL) {
+        throw std::runtime_error(
+            "Can't set lengths in a loaded unique context table");
+    }
+
+    lengthData[getIndex(position)] = std::min(length, (size_t)MAX_VALUE);
+}
+
+void UniqueContextTable::save(const std::string& filename) const {
+    std::ofstream stream(filename.c_str(), std::ios::binary);
+
+    // Write the header and the text starts.
+    uint64_t header[HEADER_WORDS] = {MAGIC, numberOfTexts};
+    stream.write((const char*)header, sizeof(header));
+    stream.write((const char*)textStarts,
+        (numberOfTexts + 1) * sizeof(uint64_t));
+
+    // Then all the lengths.
+    stream.write((const char*)lengths, textStarts[numberOfTexts]);
+
+    stream.close();
+    if(!stream.good()) {
+        throw std::runtime_error("Could not save unique context table to " +
+            filename);
+    }
+}
+
+size_t UniqueContextTable::getNumberOfTexts() const {
+    return numberOfTexts;
+}
+
+size_t UniqueContextTable::get(const TextPosition& position) const {
+    return lengths[getIndex(position)];
+}
+
+size_t UniqueContextTable::reportSize() const {
+    if(mapped != NULL) {
+        return sizeof(*this) + mappedBytes;
+    }
+    return sizeof(*this) + textStartData.size() * sizeof(uint64_t) +
+        lengthData.size();
+}
+
+size_t UniqueContextTable::getIndex(const TextPosition& position) const {
+    if(position.getText() >= numberOfTexts || position.getOffset() >=
+        textStarts[position.getText() + 1] - textStarts[position.getText()]) {
+
+        throw std::runtime_error(
+            "Position out of bounds for unique context table");
+    }
+
+    return textStarts[position.getText()] + position.getOffset();
+}
@@ -0,0 +1,116 @@
+#ifndef UNIQUECONTEXTTABLE_HPP
+#define UNIQUECONTEXTTABLE_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "TextPosition.hpp"
+
+/**
+ * For every position in every text of an FMDIndex, the length of the shortest
+ * substring starting there that occurs exactly once in the genome the text
+ * belongs to. This is the shortest right context that can map a base to that
+ * position under its genome's mask, so how much context a position needs can
+ * be looked up instead of searched for.
+ *
+ * Lengths are stored one per byte, clipped to MAX_VALUE, which means "at least
+ * MAX_VALUE". A length of 0 means no substring starting there is unique before
+ * the text ends.
+ *
+ * On disk, the file can be mapped into memory and used in place:
+ *
+ * magic: "SGUCTXT1"
+ * number of texts
+ * the start of each text's lengths, plus the total at the end
+ * the lengths, text by text, in offset order, one per byte
+ */
+class UniqueContextTable {
+
+public:
+    /**
+     * Magic number at the start of every unique context table file.
+     */
+    static const uint64_t MAGIC = 0x3154585443554753ULL; // "SGUCTXT1"
+
+    /**
+     * Lengths are clipped to this.
+     */
+    static const size_t MAX_VALUE = 255;
+
+    /**
+     * Make a new UniqueContextTable to be filled in with set, for texts of the
+     * given lengths. Every length starts out as 0.
+     */
+    UniqueContextTable(const std::vector<size_t>& lengths);
+
+    /**
+     * Load a UniqueContextTable saved with save() from the given file, by
+     * mapping it into memory.
+     */
+    UniqueContextTable(const std::string& filename);
+
+    ~UniqueContextTable();
+
+    /**
+     * Set the shortest unique context length for the given position, clipping
+     * it to MAX_VALUE. Not safe to call from multiple threads.
+     */
+    void set(const TextPosition& position, size_t length);
+
+    /**
+     * Save the UniqueContextTable to the given file.
+     */
+    void save(const std::string& filename) const;
+
+    /**
+     * Get the number of texts.
+     */
+    size_t getNumberOfTexts() const;
+
+    /**
+     * Get the (clipped) shortest unique context length for the given position,
+     * or 0 if it has none.
+     */
+    size_t get(const TextPosition& position) const;
+
+    /**
+     * Get the number of bytes used by the UniqueContextTable, in memory or
+     * mapped.
+     */
+    size_t reportSize() const;
+
+protected:
+    // How many words of header come before the text starts?
+    static const size_t HEADER_WORDS = 2;
+
+    /**
+     * Get where the length for the given position is stored, making sure it is
+     * in a text.
+     */
+    size_t getIndex(const TextPosition& position) const;
+
+    // How many texts are there?
+    size_t numberOfTexts;
+
+    // The start of each text's lengths, with the total at the end
+    const uint64_t* textStarts;
+    // The text starts, if we own them because we're building
+    std::vector<uint64_t> textStartData;
+
+    // The lengths, if we own them because we're building
+    std::vector<unsigned char> lengthData;
+    // The lengths, wherever they live
+    const unsigned char* lengths;
+
+    // The file we have mapped, if any, and how long it is in bytes.
+    void* mapped;
+    size_t mappedBytes;
+
+private:
+    // Can't copy, since we own things.
+    UniqueContextTable(const UniqueContextTable& other);
+    UniqueContextTable& operator=(const UniqueContextTable& other);
+};
+
+#endif
@@ -38,6 +38,7 @@
 %newobject FMDIndexBuilder::build;
 
 %include "CSA/BitVectorBase.hpp"
+%include "CSA/DenseBitVector.hpp"
 %include "CSA/BitVector.hpp"
 
 // We need to use the inner vector iterator classes to look at vectors. Give a
@@ -73,6 +74,7 @@ using CSA::BitVectorEncoder;
 
 %include "Mapping.hpp"
 %include "TextPosition.hpp"
+%include "MemoryReport.hpp"
 %{
   #include "FMDIndex.hpp"
 %}
@@ -82,6 +84,11 @@ using CSA::BitVectorEncoder;
   #include "FMDIndexBuilder.hpp"
 %}
 %include "FMDIndexBuilder.hpp"
+%{
+  #include "LevelIndex.hpp"
+%}
+%include "SmallSide.hpp"
+%include "LevelIndex.hpp"
 
 %{
   using namespace CSA;
@@ -62,6 +62,33 @@ class RLBWT
             return unit.getChar();
         }
         
+        // Return the symbol at idx, and set occ to the number of times it
+        // appears in bwt[0, idx), which is what an LF step needs, with one scan
+        inline char getCharAndOcc(size_t idx, BaseCount& occ) const
+        {
+            // Start from the same marker as getChar
+            const LargeMarker& upper = getUpperMarker(idx);
+            size_t current_position = upper.getActualPosition();
+            assert(current_position >= idx);
+
+            AlphaCount64 running_count = upper.counts;
+            size_t symbol_index = upper.unitIndex;
+
+            // Search backwards (towards 0) until idx is found, taking off the
+            // counts for everything at or after it
+            while(current_position > idx)
+            {
+                assert(symbol_index != 0);
+                symbol_index -= 1;
+                current_position -= m_rlString[symbol_index].subtractAlphaCount(running_count, current_position - idx);
+            }
+
+            // symbol_index is now the index of the run containing the idx symbol
+            char b = m_rlString[symbol_index].getChar();
+            occ = running_count.get(b);
+            return b;
+        }
+
         // Get the index of the marker nearest to position in the bwt
         inline size_t getNearestMarkerIdx(size_t position, size_t sampleRate, size_t shiftValue) const
         {
@@ -160,6 +187,35 @@ class RLBWT
             return running_count;
         }
 
+        // Start loading the markers that getOcc(b, idx) and getFullOcc(idx)
+        // will read, without waiting for them
+        inline void prefetchMarkers(size_t idx) const
+        {
+            // Find the markers the same way getNearestMarker does
+            ++idx;
+            size_t small_idx = getNearestMarkerIdx(idx, m_smallSampleRate, m_smallShiftValue);
+            size_t large_idx = (small_idx << m_smallShiftValue) >> m_largeShiftValue;
+            __builtin_prefetch(m_smallMarkers.data() + small_idx);
+            __builtin_prefetch(m_largeMarkers.data() + large_idx);
+        }
+
+        // Start loading the run-length units that getOcc(b, idx) and
+        // getFullOcc(idx) will scan. This has to read the markers, so it works
+        // best some time after prefetchMarkers(idx).
+        inline void prefetchRuns(size_t idx) const
+        {
+            ++idx;
+            const LargeMarker& marker = getNearestMarker(idx);
+            const RLUnit* unit = m_rlString.data() + marker.unitIndex;
+            __builtin_prefetch(unit);
+
+            // The scan can cross into the next cache line in either direction
+            if(marker.getActualPosition() < idx)
+                __builtin_prefetch(unit + 64);
+            else if(marker.unitIndex >= 64)
+                __builtin_prefetch(unit - 64);
+        }
+
         // Adds to the count of symbol b in the range [targetPosition, currentPosition)
         // Precondition: currentPosition <= targetPosition
         inline void accumulateBackwards(AlphaCount64& running_count, size_t currentUnitIndex, size_t currentPosition, const size_t targetPosition) const
@@ -239,6 +295,14 @@ class RLBWT
         inline size_t getBWLen() const { return m_numSymbols; }
         inline size_t getNumRuns() const { return m_rlString.size(); }
 
+        // Return the number of bytes used by the run-length string and by the markers
+        inline size_t getRunBytes() const { return m_rlString.capacity() * sizeof(RLUnit); }
+        inline size_t getMarkerBytes() const
+        {
+            return m_smallMarkers.capacity() * sizeof(SmallMarker) +
+                   m_largeMarkers.capacity() * sizeof(LargeMarker);
+        }
+
         // Return the first letter of the suffix starting at idx
         inline char getF(size_t idx) const
         {
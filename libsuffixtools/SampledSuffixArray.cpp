@@ -12,6 +12,7 @@
 #include "SampledSuffixArray.h"
 #include "SAReader.h"
 #include "SAWriter.h"
+#include <algorithm>
 
 #if HAVE_OPENMP
 #include <omp.h>
@@ -79,6 +80,101 @@ SAElem SampledSuffixArray::calcSA(int64_t idx, const BWT* pBWT) const
     return elem;
 }
 
+//
+void SampledSuffixArray::calcSABatch(const std::vector<int64_t>& indices, const BWT* pBWT, std::vector<SAElem>& out) const
+{
+    // How far ahead in a step to start loading the BWT
+    static const size_t MARKER_DISTANCE = 16;
+    static const size_t RUN_DISTANCE = 8;
+
+    out.resize(indices.size());
+
+    // Each walk is the index it is currently at, and the slot in indices it
+    // started from. Sorting by index puts duplicate indices together, and only
+    // the first of each needs to be walked. LF is a permutation, so walks
+    // from different indices never meet after that.
+    std::vector<std::pair<int64_t, size_t> > walks(indices.size());
+    for(size_t i = 0; i < indices.size(); ++i)
+        walks[i] = std::make_pair(indices[i], i);
+    std::sort(walks.begin(), walks.end());
+
+    std::vector<std::pair<int64_t, size_t> > duplicates;
+    std::vector<std::pair<int64_t, size_t> >::iterator last = walks.begin();
+    for(std::vector<std::pair<int64_t, size_t> >::iterator iter = walks.begin(); iter != walks.end(); ++iter)
+    {
+        if(iter != walks.begin() && iter->first == (last - 1)->first)
+        {
+            // Remember to copy the answer from the walk for the same index.
+            duplicates.push_back(std::make_pair(iter->second, (last - 1)->second));
+        }
+        else
+        {
+            *last = *iter;
+            ++last;
+        }
+    }
+    walks.erase(last, walks.end());
+
+    // Every walk still going has taken the same number of steps. LF keeps
+    // indices with the same BWT character in order, and sends each character
+    // to its own contiguous block, so bucketing the walks by character after
+    // each step keeps them sorted without sorting again.
+    std::vector<std::pair<int64_t, size_t> > buckets[BWT_ALPHABET::size];
+    size_t offset = 0;
+    while(!walks.empty())
+    {
+        for(size_t i = 0; i < walks.size(); ++i)
+        {
+            // Start loading what the walks a little ahead will need.
+            if(i + MARKER_DISTANCE < walks.size())
+                pBWT->prefetchMarkers(walks[i + MARKER_DISTANCE].first);
+            if(i + RUN_DISTANCE < walks.size())
+                pBWT->prefetchRuns(walks[i + RUN_DISTANCE].first);
+
+            int64_t idx = walks[i].first;
+            SAElem& elem = out[walks[i].second];
+
+            // Check if this position is sampled, exactly like calcSA.
+            if(m_sampleRate > 0 && idx % m_sampleRate == 0 && !m_saSamples[idx / m_sampleRate].isEmpty())
+            {
+                elem = m_saSamples[idx / m_sampleRate];
+                elem.setPos(elem.getPos() + offset);
+                continue;
+            }
+
+            // Otherwise backtrack, finding the character and its rank together
+            BaseCount occ;
+            char b = pBWT->getCharAndOcc(idx, occ);
+            idx = pBWT->getPC(b) + occ;
+
+            if(b == '$')
+            {
+                // This walk hit the start of a read.
+                assert(idx < (int64_t)m_saLexoIndex.size());
+                elem.setID(m_saLexoIndex[idx]);
+                elem.setPos(offset);
+                continue;
+            }
+
+            // Keep going with this walk
+            buckets[BWT_ALPHABET::getRank(b)].push_back(std::make_pair(idx, walks[i].second));
+        }
+        ++offset;
+
+        // Put the walks back together in order.
+        walks.clear();
+        for(size_t i = 0; i < BWT_ALPHABET::size; ++i)
+        {
+            walks.insert(walks.end(), buckets[i].begin(), buckets[i].end());
+            buckets[i].clear();
+        }
+    }
+
+    // Fill in the duplicates.
+    for(size_t i = 0; i < duplicates.size(); ++i)
+        out[duplicates[i].first] = out[duplicates[i].second];
+}
+
 // Returns the ID of the read with lexicographic rank r
 size_t SampledSuffixArray::lookupLexoRank(size_t r) const
 {
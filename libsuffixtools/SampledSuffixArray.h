@@ -34,6 +34,11 @@ class SampledSuffixArray
         // Calculate the suffix array element for the given index
         SAElem calcSA(int64_t idx, const BWT* pBWT) const;
 
+        // Calculate the suffix array elements for many indices at once, putting
+        // them in out in the same order. All the indices are walked back through
+        // the BWT together, in sorted order, so nearby steps share cache lines.
+        void calcSABatch(const std::vector<int64_t>& indices, const BWT* pBWT, std::vector<SAElem>& out) const;
+
         // Returns the ID of the read with lexicographic rank r
         size_t lookupLexoRank(size_t r) const;
 
@@ -47,6 +52,13 @@ class SampledSuffixArray
         void validate(std::string readsFile, const BWT* pBWT);
         void printInfo() const;
 
+        // Return the number of bytes used by the samples and the lexicographic index
+        size_t getSampleBytes() const
+        {
+            return m_saSamples.capacity() * sizeof(SAElem) +
+                   m_saLexoIndex.capacity() * sizeof(SSA_INT_TYPE);
+        }
+
         // I/O
         void writeLexicoIndex(const std::string& filename);
         void writeSSA(std::string filename);
@@ -36,6 +36,7 @@ class SuffixArray
         inline const SAElem& get(size_t idx) const { assert(idx < m_data.size()); return m_data[idx]; }
         inline void set(size_t idx, SAElem e) { m_data[idx] = e; }
         size_t getSize() const { return m_data.size(); }
+        size_t getByteSize() const { return m_data.capacity() * sizeof(SAElem); }
         size_t getNumStrings() const { return m_numStrings; } 
         std::string getSuffix(size_t idx, const ReadTable* pRT) const;
         size_t getSuffixLength(const ReadTable* pRT, const SAElem elem) const;
@@ -1,12 +1,9 @@
 package edu.ucsc.genome
 import scala.collection.immutable.HashMap
 import scala.collection.mutable.{ArrayBuilder, ArrayBuffer}
-import org.ga4gh.{FMDUtil, BitVector, BitVectorIterator, FMDIndex, Mapping}
+import org.ga4gh.{BitVector, BitVectorIterator, FMDIndex, Mapping, LevelIndex}
 import scala.collection.JavaConversions._
 import java.io.File
-import java.nio.file._
-import java.nio.{ByteBuffer, ByteOrder}
-import java.nio.channels.FileChannel
 
 /**
  * Represents a Reference Structure: a phased or unphased sequence graph, with a
@@ -158,96 +155,6 @@ class StringReferenceStructure(index: FMDIndex) extends ReferenceStructure {
     
 }
 
-/**
- * Represents an array of Side objects that live in an on-disk file, as written
- * by createIndex (on an x86_64 system). The file format is a series of little-
- * endian 8 byte records, where the low bit represents the face (LEFT or RIGHT),
- * and the high 63 bits represent the ID. Unfortunately, this means in practice
- * we only get 63 bits of ID storage instead of 64.
- *
- */
-class SideArray(filename: String) {
-    // Open the file for random access.
-    val file = FileChannel.open(Paths.get(filename), StandardOpenOption.READ)
-    
-    /**
-     * Get the number of items in the array. This is just how many 8-byte
-     * records fit in the file.
-     */
-    def length = file.size / 8
-    
-    /**
-     * Dump the entire file in hex to the console, for debugging.
-     */
-    def dump = {
-        // Make a 1-byte buffer to read into
-        val buffer = ByteBuffer.allocate(1)
-        
-        (0L until length * 8).foreach { i =>
-            // Grab each byte in turn
-            file.read(buffer, i)
-            
-            // Rewind to start of buffer
-            buffer.flip
-            
-            // Grab the byte as the first byte in the buffer
-            val byteVal = buffer.get(0)
-            
-            // Dump the byte as hex
-            println("%d: %02x".format(i, byteVal))
-        }
-    }
-    
-    /**
-     * Load the record at the given index and return it as a Side.
-     */
-    def apply(index: Long): Side = {
-        if(index > length) {
-            // Don't let them look past the end.
-            throw new Exception("Index %d beyond file length %d".format(index,
-                length))
-        }
-        
-        if(index < 0) {
-            // Or before the beginning.
-            throw new Exception("Index %d is negative".format(index))
-        }
-        
-        // Make a buffer to read into
-        val buffer = ByteBuffer.allocate(8)
-        
-        // Pop it into little endian mode
-        buffer.order(ByteOrder.LITTLE_ENDIAN)
-        
-        // Read the bytes diurectly from the correct position in the file
-        val bytesRead = file.read(buffer, index * 8)
-        
-        if(bytesRead != 8) {
-            // Complain if we can't get all the bytes
-            throw new Exception("Only managed to read " + bytesRead +
-                " of 8 bytes")
-        }
-        
-        // Rewind to start of buffer
-        buffer.flip
-        
-        // Grab the record as the first long in the buffer.
-        val record = buffer.getLong
-        
-        // Unpack the high 63 bits as the ID of the Side
-        val coordinate = record >> 1
-        // And the low bit as the face        
-        val face = record & 1 match {
-            case 0 => Face.LEFT
-            case 1 => Face.RIGHT
-        }
-        
-        // Make and return the Side
-        new Side(coordinate, face)
-        
-    }
-}
-
 /**
  * A ReferenceStructure that has been built by the createIndex program and
  * loaded form disk. Internally keeps track of its bit vector of ranges and
@@ -256,30 +163,21 @@ class SideArray(filename: String) {
 class MergedReferenceStructure(index: FMDIndex, directory: String)
     extends ReferenceStructure {
     
-    // Load the range vector
-    val rangeVector = {
-        // We're about to use an API that doesn't really have error checking. So
-        // first we make sure we can actually see this file.
-        // TODO: check access rights and so forth.
-        if(!(new File(directory + "/vector.bin").exists)) {
-            throw new Exception("vector.bin file not found in %s"
+    // Load the level index, which holds both the range vector and the Sides
+    // the ranges map to.
+    val levelIndex = {
+        // The native code will throw if it can't map the file, but a missing
+        // file is the most likely problem, so check for that first.
+        if(!(new File(directory + "/level.idx").exists)) {
+            throw new Exception("level.idx file not found in %s"
                 .format(directory))
         }
-    
-        // First open a C FILE* with the minimal API that FMDUtil in RLCSA comes
-        // with.
-        val file = FMDUtil.fopen(directory + "/vector.bin", "r")
-        // Load the BitVector from it
-        val toReturn = new BitVector(file)
-        // Close the file. OS should free it.
-        FMDUtil.fclose(file)
-     
-        // Send out the BitVector   
-        toReturn
+        
+        new LevelIndex(directory + "/level.idx")
     }
     
-    // Open (and wrap) the array of Sides that correspond to the ranges
-    val sideArray = new SideArray(directory + "/mappings.bin")
+    // Grab the range vector out of it
+    val rangeVector = levelIndex.getRanges
         
     /**
      * Map the given string on the given side to all levels of the reference
@@ -322,10 +220,16 @@ class MergedReferenceStructure(index: FMDIndex, directory: String)
                     // left-side ones. Also remember that range indices are
                     // 1-based coming out of the FMD-index.
                     case range => 
-                        if(range < sideArray.length + 1) {
+                        if(range < levelIndex.getNumberOfRanges) {
                             // We got a range that a Side is defined for.
                             // Retrieve and flip the Side.
-                            Some(!(sideArray(range.toInt)))
+                            val face = if(levelIndex.getFace(range)) {
+                                Face.RIGHT
+                            } else {
+                                Face.LEFT
+                            }
+                            Some(!(new Side(levelIndex.getCoordinate(range),
+                                face)))
                         } else {
                             // Complain we're supposed to be mapping to a range
                             // that doesn't exist.
@@ -67,7 +67,7 @@ do
 
     echo "Indexing ${GENOME_FASTA}"
 
-    time ../createIndex/createIndex ${GENOME_FASTA}-index ${GENOME_FASTA} --quiet --context 20
+    time ../createIndex/createIndex ${GENOME_FASTA}-index ${GENOME_FASTA} --quiet --context 20 --trace ${GENOME_FASTA}.trace.json
         
     # Check the sizes of the index.
     BWT_BYTES=$(stat -c%s ${GENOME_FASTA}-index/index.basename.bwt)
@@ -75,12 +75,6 @@ do
     
     # Dump a grepable TSV line
     printf "RESULTS\t${NUM_GENOMES}\t${BWT_BYTES}\t${SSA_BYTES}\n"
-    
-    if [ -e gmon.out ]
-    then
-        # Make the profiling report
-        gprof ../createIndex/createIndex gmon.out > ${GENOME_FASTA}.gprof.txt
-    fi
 
 done
 